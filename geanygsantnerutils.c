@@ -16,12 +16,24 @@
 //
 // msgwin_status_add ("[%s] AFTER C", label);
 //
+// Engines without Geany/Scintilla (formatters, pipe, transforms, diff, ..) live in ggucore.c.
+// make test / make bench run them headless.
+//
 //######################################################################################################
 // vim: sw=4 ts=4 ft=c noexpandtab:
 
 // Includes
+#define _GNU_SOURCE // memmem
 #include <geanyplugin.h>
+#include "ggucore.h"
 #include <stdio.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #ifdef HAVE_LOCALE_H
 	#include <locale.h>
 #endif
@@ -30,6 +42,16 @@
 // Plugin setup
 const gboolean DEBUG_DOCOPEN_MSGWIN = FALSE;
 const char *PLUGIN_NAME = "geanygsantnerutils";
+#define GGU_PIPE_HISTORY_MAX 50
+#define GGU_PIPE_PREVIEW_DEBOUNCE_MS 300
+#define GGU_PIPE_PREVIEW_SHOW_MAX (256 * 1024)
+#define GGU_SEARCH_SHOW_MAX 10000
+#define GGU_QUICK_OPEN_MONITORS_MAX 8192
+#define GGU_FAVOURITES_CHECK_INTERVAL_S 30
+#define GGU_TELEMETRY_PAINT_TIMEOUT_S 5
+#define GGU_COPROCESS_TIMEOUT_MS 10000
+#define GGU_FORMAT_TIMEOUT_MS 30000 // Format on save with a formatter command
+#define GGU_FOLD_MARGIN 2 // Margin Geany shows fold markers in
 GeanyPlugin *geany_plugin; // Init by macros
 GeanyData *geany_data;     // Init by macros
 PLUGIN_VERSION_CHECK(147)
@@ -41,6 +63,31 @@ enum SignalKeys {
 	GEANY_KEYS_GGU_PIPE,
 	GEANY_KEYS_GGU_FAVOURITES,
 	GEANY_KEYS_GGU_SEARCH,
+	GEANY_KEYS_GGU_JSON_PRETTY_BLOCK,
+	GEANY_KEYS_GGU_XML_PRETTY_BLOCK,
+	GEANY_KEYS_GGU_NDJSON_PRETTY,
+	GEANY_KEYS_GGU_NDJSON_MINIFY,
+	GEANY_KEYS_GGU_JSON_PRETTY_FRAGMENTS,
+	GEANY_KEYS_GGU_JSON_VALIDATE,
+	GEANY_KEYS_GGU_FORMAT,
+	GEANY_KEYS_GGU_SEARCH_DOCUMENTS,
+	GEANY_KEYS_GGU_QUICK_OPEN,
+	GEANY_KEYS_GGU_TELEMETRY_EXPORT,
+	GEANY_KEYS_GGU_LARGE_FILE_TOGGLE,
+	GEANY_KEYS_GGU_JSON_GOTO_PATH,
+	GEANY_KEYS_GGU_JSON_MATCH_BRACKET,
+	GEANY_KEYS_GGU_XML_QUERY,
+	GEANY_KEYS_GGU_DIFF,
+	GEANY_KEYS_GGU_DIFF_NEXT,
+	GEANY_KEYS_GGU_TRANSFORM_BASE64_ENCODE,  // Same order as GsTransformType
+	GEANY_KEYS_GGU_TRANSFORM_BASE64_DECODE,
+	GEANY_KEYS_GGU_TRANSFORM_HEX_ENCODE,
+	GEANY_KEYS_GGU_TRANSFORM_HEX_DECODE,
+	GEANY_KEYS_GGU_TRANSFORM_URL_ENCODE,
+	GEANY_KEYS_GGU_TRANSFORM_URL_DECODE,
+	GEANY_KEYS_GGU_TRANSFORM_INFLATE,
+	GEANY_KEYS_GGU_TRANSFORM_BASE64_INFLATE,
+	GEANY_KEYS_GGU_TRANSFORM_JWT_DECODE,
 	GEANY_KEYS_GGU_COUNT,
 };
 static struct plugin_private {
@@ -48,251 +95,2657 @@ static struct plugin_private {
 	GtkWidget           *menuitem_json_pretty;   // tools menu option
 	GtkWidget           *menuitem_xml_pretty;    // tools menu option
 	GtkWidget           *menuitem_pipe;            // tools menu option
+	GtkWidget           *menuitem_ndjson_pretty;   // tools menu option
+	GtkWidget           *menuitem_ndjson_minify;   // tools menu option
+	GtkWidget           *menuitem_json_fragments;  // tools menu option
+	GtkWidget           *menuitem_json_validate;   // tools menu option
+	GtkWidget           *menuitem_format;          // tools menu option
+	GtkWidget           *menuitem_search_documents; // tools menu option
+	GtkWidget           *menuitem_quick_open;      // tools menu option
+	GtkWidget           *menuitem_telemetry_export; // tools menu option
+	GtkWidget           *menuitem_large_file_toggle; // tools menu option
+	GtkWidget           *menuitem_json_goto_path;  // tools menu option
+	GtkWidget           *menuitem_xml_query;       // tools menu option
+	GtkWidget           *menuitem_diff;            // tools menu option
+	GtkWidget           *menuitem_transform;       // tools menu option
+	GtkWidget           *menu_transform;           // (sub)menu with one GtkMenuItem per transform
 
 	// Favourites
 	GtkWidget           *menuitem_favourites;      // file menu option
 	GtkMenuToolButton   *toolbar_item_favourites;  // toolbar option
 	GtkWidget           *menu_favorites;           // (sub)menu containing multiple GtkMenuItem's
+	gchar               *favourites;               // favourites key the menu is built from
+	GHashTable          *favourites_checked;       // Filepath -> GsFavouriteCheck
+	GCancellable        *favourites_cancellable;   // Pending existence checks
+	GFileMonitor        *favourites_conf_monitor;  // geany.conf
+	guint                favourites_conf_timer;    // Debounces changes of geany.conf
+
+	// Lists
+	GList                menuitem_list;            // dynamic allocated items that must be free'd
+	GeanyKeyGroup       *keybinding_group;         // Key bindings
+
+	gboolean             current_doc_is_new;
+
+	// Pipe
+	struct GsPipeJob    *pipe_job;                 // Currently running pipe, NULL if none
+	guint                pipe_doc_id;              // Document the pipe output goes to
+	gsize                pipe_range_start;         // Offset of the piped range (selection or whole document)
+	GtkWidget           *pipe_dialog;              // Progress dialog with cancel option
+	GtkWidget           *pipe_progressbar;
+	guint                pipe_progress_timer;
+	guint64              pipe_input_hash;          // Hash of the running pipe's input, key for the cache
+	struct GsPipeCache  *pipe_cache;               // Outputs of recent commands
+	GList               *pipe_history;             // Recent commands (gchar*), newest first
+	struct GsPipePreview *pipe_preview;            // Live preview of the open pipe dialog, NULL if closed
+	gsize                pipe_preview_size;        // Preview input limit in bytes, 0 disables the preview
+
+	// Formatters
+	GHashTable          *formatters;               // Filetype (lowercase, "<ft>_server" for co-processes) -> command
+	GHashTable          *coprocesses;              // Command -> running GsCoprocess
+	gchar              **format_on_save;           // Filetypes (lowercase) formatted in background after saving
+	struct GsFormatQueue *format_queue;            // Background formats, NULL until first use
+	guint                format_timer;             // Takes finished background formats
+	guint                format_saving_doc_id;     // Document saved with its format result, not formatted again
+	GHashTable          *doc_versions;             // Document id -> number of text modifications
+
+	// Search in open documents
+	struct GsSearch     *search;                   // Running search, NULL if none
+	GArray              *search_doc_ids;           // Document id of every searched text
+	guint                search_shown;             // Matches listed in the message window
+	guint                search_timer;
+	GtkWidget           *search_dialog;            // Progress dialog with cancel option
+	GtkWidget           *search_progressbar;
+	gchar               *search_pattern;           // Last pattern and options, preset in the dialog
+	gboolean             search_regex, search_match_case;
+
+	// Startup
+	GKeyFile            *startup_config;           // geany.conf while deferred init runs
+	guint                startup_phase;            // Next deferred init phase
+	guint                startup_idle;             // Deferred init callback, 0 if not running
+	GString             *startup_timing;           // Time of every phase so far
+	gint64               startup_init_us, startup_deferred_us;
+
+	// Quick open
+	struct GsPathIndex  *quick_open_index;         // Favourites, recent files and files below the roots
+	struct GsPathScan   *quick_open_scan;          // Running scan of the roots, NULL if none
+	gchar              **quick_open_roots;         // Directories to index
+	guint                quick_open_max_files;
+	guint                quick_open_timer;         // Takes scan results, sets up monitors
+	guint                quick_open_rescan;        // Pending rescan after directories changed
+	GPtrArray           *quick_open_monitors;      // GFileMonitor of every indexed directory
+	GPtrArray           *quick_open_dirs;          // Directories still waiting for a monitor
+
+	// Telemetry
+	struct GsTelemetry  *telemetry;                // Latency samples, NULL if disabled
+	GArray              *telemetry_pending;        // GsTelemetryPending, recorded when the next frame is painted
+	GdkFrameClock       *telemetry_clock;          // Clock telemetry_paint_handler is connected to
+	gulong               telemetry_paint_handler;
+	guint                telemetry_save_doc_id;    // Document being saved
+	gint64               telemetry_save_start;
+
+	// Large files
+	GHashTable          *large_files;              // Document id -> GsLargeFile of documents in large file mode
+	gsize                large_file_size;          // Threshold in bytes, 0 disables
+	GtkWidget           *large_file_indicator;     // Status bar button
+
+	// JSON index
+	GHashTable          *json_indexes;             // Document id -> GsJsonDocIndex of indexed documents
+	guint                json_index_timer;         // Takes finished builds, starts due rebuilds
+	GtkWidget           *json_path_label;          // Status bar: Path of the value at the caret, created on first use
+
+	// XML query
+	struct GsXpath      *xml_query;                // Compiled query of the running run
+	struct GsXpathRun   *xml_query_run;            // Running query, NULL if none
+	guint                xml_query_doc_id;         // Document queried, read-only meanwhile
+	guint                xml_query_version;        // Its version at the start, the query stops if it changes
+	guint                xml_query_idle;
+	guint                xml_query_count, xml_query_shown;
+	gboolean             xml_query_cancelled;
+	gint64               xml_query_start;
+	GString             *xml_query_extract;        // Extracted matches, NULL to list them in the message window
+	GtkWidget           *xml_query_dialog;         // Progress dialog with cancel option
+	GtkWidget           *xml_query_progressbar;
+	gchar               *xml_query_text;           // Last query, preset in the dialog
+	gboolean             xml_query_extract_last;   // Last choice of the dialog
+
+	// Diff
+	struct GsDiffJob    *diff_job;                 // Running diff, NULL if none
+	guint                diff_timer;               // Polls the running diff
+	guint                diff_doc_id;              // Document compared (new side)
+	guint                diff_other_id;            // Document compared with (old side), 0 for the saved file
+	guint                diff_version, diff_other_version; // Their versions at the start, marks are skipped if changed
+	gint64               diff_start;
+} plugin_private;
+
+//######################################################################################################
+
+static void debug_doc_info_to_msgwin(GeanyDocument *doc, const char *eventname) {
+	if (!DEBUG_DOCOPEN_MSGWIN || doc == NULL) {
+		return;
+	}
+	const char *ft_ext = (doc->file_type != NULL && doc->file_type->extension != NULL) ? doc->file_type->extension : "NULL";
+	msgwin_status_add ("[DEBUG/debug_doc_info_to_msgwin]: %s ft_ext >%s<, new?%d, filename >%s<)", eventname, ft_ext, plugin_private.current_doc_is_new ? 1 : 0 ,(doc->file_name != NULL ? doc->file_name : "NULL"));
+}
+
+// Frees input string
+static gchar* gs_glib_strreplace(gchar *text, const gchar *search, const gchar *replace, gboolean free_input) {
+	char **split = g_strsplit(text, search, -1);
+	if (free_input) {
+		g_free(text);
+	}
+	text = g_strjoinv(replace, split);
+	g_strfreev(split);
+	return text;
+}
+
+static gchar *geany_conf_filepath() {
+	return g_build_filename(geany_data->app->configdir, "geany.conf", NULL);
+}
+
+// Get settings object for standard geany.conf file
+static GKeyFile* geany_conf_load() {
+#pragma GCC diagnostic ignored "-Wunused-result"
+	gchar *configfile = geany_conf_filepath();
+	GKeyFile *config = g_key_file_new();
+
+	if (! g_file_test(configfile, G_FILE_TEST_IS_REGULAR)) {
+		SETPTR(configfile, g_build_filename(geany_data->app->datadir, "geany.conf", NULL));
+	}
+	g_key_file_load_from_file(config, configfile, G_KEY_FILE_NONE, NULL);
+	g_free(configfile);
+	return config;
+}
+
+// Favourites key: TITLE;FILEPATH pairs, a --- TITLE is a separator without FILEPATH. Returns title and
+// filepath ($HOME replaced) of every entry one after another, the filepath of separators is NULL
+static GPtrArray* favourites_parse(const gchar *favourites) {
+	GPtrArray *entries = g_ptr_array_new_with_free_func(g_free);
+	gchar **strarr = g_strsplit(favourites, ";", -1);
+	for (gint i = 0; strarr[i] != NULL && strarr[i+1] != NULL; i += 2) {
+		gboolean separator = g_str_equal(strarr[i], "---");
+		g_ptr_array_add(entries, g_strdup(strarr[i]));
+		g_ptr_array_add(entries, separator ? NULL : gs_glib_strreplace(strarr[i+1], "$HOME", g_get_home_dir(), 0));
+		i -= separator ? 1 : 0;
+	}
+	g_strfreev(strarr);
+	return entries;
+}
+
+//######################################################################################################
+
+
+//######################################################################################################
+// Scintilla buffer access
+//
+// Read the document in place instead of copying it with sci_get_contents(). SCI_GETRANGEPOINTER
+// moves the gap of Scintilla's gap buffer out of the range and returns a pointer into the buffer.
+// The pointer is only valid until the document is modified, so read everything before editing.
+
+static inline const gchar* gs_sci_text_range(ScintillaObject *sci, gsize start, gsize len) {
+	return (const gchar*) scintilla_send_message(sci, SCI_GETRANGEPOINTER, start, len);
+}
+
+// Replace old_text, which is the document content at [offset, offset+old_len), with new_text by applying
+// only the changed hunks inside one undo action. Returns the number of replacements done.
+// old_text may point into the document itself (gs_sci_text_range), it is only read before the first edit
+static guint gs_sci_apply_text(ScintillaObject *sci, gsize offset, const gchar *old_text, gsize old_len, const gchar *new_text, gsize new_len) {
+	GArray *hunks = g_array_new(FALSE, FALSE, sizeof(GsDiffHunk));
+	gs_diff_text(old_text, old_len, new_text, new_len, hunks);
+
+	// Back to front, so earlier offsets stay valid
+	sci_start_undo_action(sci);
+	for (gint i = (gint) hunks->len - 1; i >= 0; i--) {
+		GsDiffHunk *hunk = &g_array_index(hunks, GsDiffHunk, i);
+		scintilla_send_message(sci, SCI_SETTARGETSTART, offset + hunk->old_start, 0);
+		scintilla_send_message(sci, SCI_SETTARGETEND,   offset + hunk->old_end, 0);
+		scintilla_send_message(sci, SCI_REPLACETARGET,  hunk->new_end - hunk->new_start, (sptr_t) (new_text + hunk->new_start));
+	}
+	sci_end_undo_action(sci);
+
+	guint count = hunks->len;
+	g_array_free(hunks, TRUE);
+	return count;
+}
+
+//######################################################################################################
+// Tool ranges
+//
+// Tools work on the selection, the block around the caret or the whole document. Only the range is
+// read in place and only changed lines inside of it are written back, so cost scales with the range.
+
+// Range a tool works on: The selection if any, else the block around the caret (if requested), else
+// the whole document. Returns FALSE if a block was requested but the caret is not inside one
+static gboolean ui_sci_tool_range(ScintillaObject *sci, GsBlockKind kind, gboolean html, gsize *start, gsize *end) {
+	if (sci_has_selection(sci)) {
+		*start = sci_get_selection_start(sci);
+		*end = sci_get_selection_end(sci);
+		return TRUE;
+	}
+	gsize len = sci_get_length(sci);
+	if (kind == GS_BLOCK_NONE) {
+		*start = 0;
+		*end = len;
+		return TRUE;
+	}
+	return gs_find_block(gs_sci_text_range(sci, 0, len), len, sci_get_current_position(sci), kind, html, start, end);
+}
+
+// Leading whitespace of the line containing pos. Uses SCI_GETCHARAT, so range pointers stay valid
+static gchar* ui_sci_line_indentation(ScintillaObject *sci, gsize pos) {
+	gint line_start = sci_get_position_from_line(sci, sci_get_line_from_position(sci, pos));
+	GString *indentation = g_string_new(NULL);
+	for (gchar c; line_start < (gint) pos && ((c = sci_get_char_at(sci, line_start)) == ' ' || c == '\t'); line_start++) {
+		g_string_append_c(indentation, c);
+	}
+	return g_string_free(indentation, FALSE);
+}
+
+//######################################################################################################
+
+// Show a parse error at document position pos in the message window (clickable) and move the caret there
+static void ui_report_parse_error(GeanyDocument *doc, const gchar *tool, gsize pos, const gchar *message) {
+	ScintillaObject *sci = doc->editor->sci;
+	gint line = sci_get_line_from_position(sci, pos);
+	gchar *filename = document_get_basename_for_display(doc, -1);
+	msgwin_switch_tab(MSG_MESSAGE, 1);
+	msgwin_msg_add(COLOR_RED, line + 1, doc, _("[%s] %s error at line %d, column %d (byte %zu): %s"),
+		filename, tool, line + 1, sci_get_col_from_position(sci, pos) + 1, pos, message);
+	editor_goto_pos(doc->editor, pos, TRUE);
+	free(filename);
+}
+
+// Telemetry: Record the time since time_start (monotonic clock) as sample of event for doc, NULL if
+// there is none. size is the document size when it started, -1 to take the current one
+static void telemetry_add(const gchar *event, GeanyDocument *doc, gssize size, gint64 time_start) {
+	if (plugin_private.telemetry == NULL) {
+		return;
+	}
+	gint64 duration = g_get_monotonic_time() - time_start;
+	GsTelemetrySample sample = { g_get_real_time() - duration, duration, MAX(size, 0), "", "" };
+	if (DOC_VALID(doc)) {
+		sample.size = size >= 0 ? (gsize) size : (gsize) sci_get_length(doc->editor->sci);
+		sample.filetype = g_intern_string(doc->file_type != NULL ? doc->file_type->name : "");
+		sample.file = g_intern_string(DOC_FILENAME(doc));
+	}
+	gs_telemetry_add(plugin_private.telemetry, event, &sample);
+}
+
+typedef struct {
+	const gchar *event;
+	guint        doc_id;
+	gint64       time_start;
+} GsTelemetryPending;
+
+// A frame was painted, pending events are on screen now. Samples of a window which didn't paint for
+// a long time (e.g. minimized) are dropped
+static void on_telemetry_after_paint(GdkFrameClock *clock, gpointer user_data) {
+	g_signal_handler_disconnect(clock, plugin_private.telemetry_paint_handler);
+	plugin_private.telemetry_paint_handler = 0;
+	plugin_private.telemetry_clock = NULL;
+
+	GArray *pending = plugin_private.telemetry_pending;
+	for (guint i = 0; i < pending->len; i++) {
+		const GsTelemetryPending *entry = &g_array_index(pending, GsTelemetryPending, i);
+		GeanyDocument *doc = document_find_by_id(entry->doc_id);
+		if (DOC_VALID(doc) && g_get_monotonic_time() - entry->time_start < GGU_TELEMETRY_PAINT_TIMEOUT_S * G_USEC_PER_SEC) {
+			telemetry_add(entry->event, doc, -1, entry->time_start);
+		}
+	}
+	g_array_set_size(pending, 0);
+}
+
+// Record event for doc once the next frame is painted, that is when the user sees the result.
+// Nothing is recorded before Geany's window is realized (documents of the last session)
+static void telemetry_add_when_painted(const gchar *event, GeanyDocument *doc) {
+	GdkFrameClock *clock = gtk_widget_get_frame_clock(geany_data->main_widgets->window);
+	if (plugin_private.telemetry == NULL || clock == NULL) {
+		return;
+	}
+	GsTelemetryPending entry = { event, doc->id, g_get_monotonic_time() };
+	g_array_append_val(plugin_private.telemetry_pending, entry);
+	if (plugin_private.telemetry_paint_handler == 0) {
+		plugin_private.telemetry_clock = clock;
+		plugin_private.telemetry_paint_handler = g_signal_connect(clock, "after-paint", G_CALLBACK(on_telemetry_after_paint), NULL);
+	}
+}
+
+// Telemetry setting of geany.conf, samples recorded until now are dropped if it is off
+static void telemetry_settings_load(GKeyFile *config) {
+	if (!utils_get_setting_boolean(config, PLUGIN_NAME, "telemetry", TRUE) && plugin_private.telemetry != NULL) {
+		gs_telemetry_free(plugin_private.telemetry);
+		plugin_private.telemetry = NULL;
+	}
+}
+
+// Telemetry export: Write every sample to telemetry.csv and telemetry.json in the plugin config dir, open
+// the percentiles per event, filetype and size class and the slowest samples in a new document
+static void exec_telemetry_export() {
+	if (plugin_private.telemetry == NULL) {
+		msgwin_status_add(_("Telemetry: Disabled, set telemetry=true in group %s of geany.conf"), PLUGIN_NAME);
+		return;
+	}
+	GArray *summary = gs_telemetry_summary(plugin_private.telemetry);
+	GString *csv = g_string_new(NULL), *json = g_string_new(NULL), *report = g_string_new(NULL);
+	gs_telemetry_write_csv(plugin_private.telemetry, csv);
+	gs_telemetry_write_json(plugin_private.telemetry, summary, json);
+	gs_telemetry_write_report(plugin_private.telemetry, summary, report);
+
+	// Write files
+	GError *error = NULL;
+	gchar *dirpath = g_build_filename(geany_data->app->configdir, "plugins", PLUGIN_NAME, NULL);
+	gchar *csv_filepath = g_build_filename(dirpath, "telemetry.csv", NULL), *json_filepath = g_build_filename(dirpath, "telemetry.json", NULL);
+	g_mkdir_with_parents(dirpath, 0755);
+	if (g_file_set_contents(csv_filepath, csv->str, csv->len, &error) && g_file_set_contents(json_filepath, json->str, json->len, &error)) {
+		msgwin_status_add(_("Telemetry: Exported to %s and %s"), csv_filepath, json_filepath);
+	} else {
+		msgwin_status_add(_("Telemetry: Export failed: %s"), error->message);
+		g_error_free(error);
+	}
+	document_new_file(NULL, NULL, report->str);
+
+	// Free resources
+	g_free(json_filepath);
+	g_free(csv_filepath);
+	g_free(dirpath);
+	g_string_free(report, TRUE);
+	g_string_free(json, TRUE);
+	g_string_free(csv, TRUE);
+	g_array_free(summary, TRUE);
+}
+
+// Validate JSON of current document or selection natively, without reformatting or copying it
+static void exec_json_validate() {
+	GeanyDocument	*doc;
+	ScintillaObject	*sci;
+	if((doc = document_get_current()) == NULL || (sci = doc->editor->sci) == NULL) {
+		return;
+	}
+
+	// Range to work on, read in place
+	gsize range_start, range_end;
+	ui_sci_tool_range(sci, GS_BLOCK_NONE, FALSE, &range_start, &range_end);
+	gsize text_len = range_end - range_start;
+	const gchar *text = gs_sci_text_range(sci, range_start, text_len);
+
+	// Validate only (no output)
+	GsParseError err = { 0, NULL };
+	gint64 time_start = g_get_monotonic_time();
+	gboolean ok = gs_json_format(text, text_len, 0, NULL, &err);
+	gdouble seconds = MAX(1, g_get_monotonic_time() - time_start) / (gdouble) G_USEC_PER_SEC;
+	msgwin_status_add("JSON Validate: %.2f MB in %.3f s (%.1f MB/s)", text_len / 1e6, seconds, text_len / 1e6 / seconds);
+
+	// Evaluate result
+	if (ok) {
+		gchar *filename = document_get_basename_for_display(doc, -1);
+		msgwin_status_add(_("[%s] Valid JSON"), filename);
+		ui_set_statusbar(FALSE, _("[%s] Valid JSON"), filename);
+		free(filename);
+	} else {
+		ui_report_parse_error(doc, "JSON", range_start + err.offset, err.message);
+	}
+}
+
+// Reformat JSON Lines (NDJSON) of current document or selection on all cores, one JSON value per line.
+// indent > 0 pretty-prints each record, indent == 0 minifies each record to a single line
+static void exec_ndjson_format(gint indent) {
+	GeanyDocument	*doc;
+	ScintillaObject	*sci;
+	if((doc = document_get_current()) == NULL || (sci = doc->editor->sci) == NULL) {
+		return;
+	}
+
+	// Range to work on, read in place
+	gsize range_start, range_end;
+	ui_sci_tool_range(sci, GS_BLOCK_NONE, FALSE, &range_start, &range_end);
+	gsize text_len = range_end - range_start;
+	const gchar *text = gs_sci_text_range(sci, range_start, text_len);
+	gint first_line = sci_get_line_from_position(sci, range_start);
+	gchar *filename = document_get_basename_for_display(doc, -1);
+
+	// Reformat
+	GString *out = g_string_sized_new(text_len + (indent > 0 ? text_len : 0) + 1);
+	GArray *errors = g_array_new(FALSE, FALSE, sizeof(GsNdjsonError));
+	gint64 time_start = g_get_monotonic_time();
+	guint lines = gs_ndjson_format(text, text_len, indent, out, errors);
+	gdouble seconds = MAX(1, g_get_monotonic_time() - time_start) / (gdouble) G_USEC_PER_SEC;
+	msgwin_status_add("NDJSON: %u lines, %.2f MB in %.3f s (%.1f MB/s, %u threads)", lines, text_len / 1e6, seconds, text_len / 1e6 / seconds, g_get_num_processors());
+
+	// Set reformatted text to UI, only changed parts are replaced. Invalid lines stay unchanged
+	guint changes = gs_sci_apply_text(sci, range_start, text, text_len, out->str, out->len);
+	scintilla_send_message(sci, SCI_SCROLLCARET, 0, 0);
+	msgwin_status_add(_("[%s] %u changes applied, %u of %u lines invalid"), filename, changes, errors->len, lines);
+
+	// Report invalid lines, clickable at their position after reformatting
+	if (errors->len > 0) {
+		msgwin_switch_tab(MSG_MESSAGE, 1);
+	}
+	for (guint i = 0; i < errors->len && i < 100; i++) {
+		GsNdjsonError *error = &g_array_index(errors, GsNdjsonError, i);
+		msgwin_msg_add(COLOR_RED, first_line + error->out_line + 1, doc, _("[%s] NDJSON line %u, column %zu: %s"),
+			filename, first_line + error->line + 1, error->column + 1, error->message);
+	}
+	if (errors->len > 100) {
+		msgwin_msg_add(COLOR_RED, -1, doc, _("[%s] NDJSON: %u more invalid lines not shown"), filename, errors->len - 100);
+	}
+
+	// Free resources
+	g_array_free(errors, TRUE);
+	g_string_free(out, TRUE);
+	free(filename);
+}
+
+static void ui_json_index_check(GeanyDocument *doc);
+
+// Reformat JSON of current document (or selection / block at caret) with the builtin JSON engine
+static void exec_json_pretty(GsBlockKind block) {
+	GeanyDocument	*doc;
+	ScintillaObject	*sci;
+	if((doc = document_get_current()) == NULL || (sci = doc->editor->sci) == NULL) {
+		return;
+	}
+
+	// Range to work on, read in place
+	gsize range_start, range_end;
+	if (!ui_sci_tool_range(sci, block, FALSE, &range_start, &range_end)) {
+		msgwin_status_add(_("JSON Pretty: Cursor is not inside a JSON block"));
+		return;
+	}
+	gboolean whole_doc = range_start == 0 && range_end == (gsize) sci_get_length(sci);
+	gsize text_len = range_end - range_start;
+	const gchar *text = gs_sci_text_range(sci, range_start, text_len);
+	gchar *filename = document_get_basename_for_display(doc, -1);
+
+	// Determine first [/{ and last ]/}, trim leading/trailing text (like logging prefixes)
+	gsize offset_begin = gs_mem_first_of(text, text_len, '[', '{');
+	gsize offset_end   = gs_mem_end_of_last(text, text_len, ']', '}');
+	msgwin_status_add("JSON Pretty: range_start=%zd, offset_begin=%zd, offset_end=%zd, strlen=%zd", range_start, offset_begin, offset_end, text_len);
+
+	// Reformat
+	gsize length = offset_end > offset_begin ? offset_end - offset_begin : 0;
+	GString *out = g_string_sized_new(length + length / 2 + 1);
+	GsParseError err = { 0, NULL };
+	gint64 time_start = g_get_monotonic_time();
+	gboolean ok = gs_json_format(text + offset_begin, length, 2, out, &err);
+	gdouble seconds = MAX(1, g_get_monotonic_time() - time_start) / (gdouble) G_USEC_PER_SEC;
+	msgwin_status_add("JSON Pretty: %.2f MB in %.3f s (%.1f MB/s)", length / 1e6, seconds, length / 1e6 / seconds);
+
+	// Another value follows on a later line: The content is JSON Lines (NDJSON)
+	gboolean ndjson = FALSE;
+	if (!ok && err.message == gs_json_err_extra_data) {
+		for (const gchar *p = text + offset_begin + err.offset; p > text + offset_begin && g_ascii_isspace(p[-1]) && !ndjson; p--) {
+			ndjson = p[-1] == '\n';
+		}
+	}
+
+	// Evaluate result
+	if (ok && whole_doc) {
+		// Set reformatted text to UI, only changed parts are replaced
+		g_string_append_c(out, '\n');
+		guint changes = gs_sci_apply_text(sci, 0, text, text_len, out->str, out->len);
+		scintilla_send_message(sci, SCI_SCROLLCARET, 0, 0);
+		msgwin_status_add(_("[%s] %u changes applied"), filename, changes);
+	} else if (ok) {
+		// Range: Keep surrounding text, indent like the line the block starts in and select the result
+		gchar *indentation = ui_sci_line_indentation(sci, range_start + offset_begin);
+		gs_string_indent_lines(out, indentation);
+		guint changes = gs_sci_apply_text(sci, range_start + offset_begin, text + offset_begin, length, out->str, out->len);
+		sci_set_selection_start(sci, range_start + offset_begin);
+		sci_set_selection_end(sci, range_start + offset_begin + out->len);
+		scintilla_send_message(sci, SCI_SCROLLCARET, 0, 0);
+		msgwin_status_add(_("[%s] %u changes applied in range"), filename, changes);
+		g_free(indentation);
+	} else if (ndjson) {
+		msgwin_status_add(_("[%s] Multiple JSON values on separate lines, formatting as JSON Lines"), filename);
+	} else {
+		ui_report_parse_error(doc, "JSON pretty", range_start + offset_begin + err.offset, err.message);
+	}
+
+	GeanyFiletype *ft;
+	if (whole_doc && (ft = filetypes_detect_from_file("f.json")) != NULL) {
+		document_set_filetype(doc, ft);
+		ui_json_index_check(doc);
+	}
+
+	// Free resources
+	g_string_free(out, TRUE);
+	free(filename);
+	if (ndjson) {
+		exec_ndjson_format(2);
+	}
+}
+
+
+// Reformat every JSON fragment embedded in the current document or selection, keep the text around it
+static void exec_json_pretty_fragments() {
+	GeanyDocument	*doc;
+	ScintillaObject	*sci;
+	if((doc = document_get_current()) == NULL || (sci = doc->editor->sci) == NULL) {
+		return;
+	}
+
+	// Range to work on, read in place
+	gsize range_start, range_end;
+	ui_sci_tool_range(sci, GS_BLOCK_NONE, FALSE, &range_start, &range_end);
+	gsize text_len = range_end - range_start;
+	const gchar *text = gs_sci_text_range(sci, range_start, text_len);
+	gchar *filename = document_get_basename_for_display(doc, -1);
+
+	// Reformat
+	GString *out = g_string_sized_new(text_len + text_len / 2 + 1);
+	gint64 time_start = g_get_monotonic_time();
+	guint fragments = gs_json_format_fragments(text, text_len, 2, out);
+	gdouble seconds = MAX(1, g_get_monotonic_time() - time_start) / (gdouble) G_USEC_PER_SEC;
+	msgwin_status_add("JSON Fragments: %u found, %.2f MB in %.3f s (%.1f MB/s)", fragments, text_len / 1e6, seconds, text_len / 1e6 / seconds);
+
+	// Set reformatted text to UI, only changed parts are replaced
+	guint changes = gs_sci_apply_text(sci, range_start, text, text_len, out->str, out->len);
+	scintilla_send_message(sci, SCI_SCROLLCARET, 0, 0);
+	msgwin_status_add(_("[%s] %u JSON fragments reformatted, %u changes applied"), filename, fragments, changes);
+
+	// Free resources
+	g_string_free(out, TRUE);
+	free(filename);
+}
+
+
+// Reformat XML / HTML of current document (or selection / element at caret) with the builtin XML engine
+static void exec_xml_pretty(GsBlockKind block) {
+	GeanyDocument	*doc;
+	ScintillaObject	*sci;
+	if((doc = document_get_current()) == NULL || (sci = doc->editor->sci) == NULL) {
+		return;
+	}
+
+	// Range to work on, read in place
+	gboolean html = doc->file_type != NULL && doc->file_type->extension != NULL && g_str_has_prefix(doc->file_type->extension, "htm");
+	gsize range_start, range_end;
+	if (!ui_sci_tool_range(sci, block, html, &range_start, &range_end)) {
+		msgwin_status_add(_("XML Pretty: Cursor is not inside an XML element"));
+		return;
+	}
+	gboolean whole_doc = range_start == 0 && range_end == (gsize) sci_get_length(sci);
+	gsize text_len = range_end - range_start;
+	const gchar *text = gs_sci_text_range(sci, range_start, text_len);
+	gchar *filename = document_get_basename_for_display(doc, -1);
+
+	// Determine first < and last >
+	gsize offset_begin = gs_mem_first_of(text, text_len, '<', '<');
+	gsize offset_end   = gs_mem_end_of_last(text, text_len, '>', '>');
+	msgwin_status_add("XML Pretty: range_start=%zd, offset_begin=%zd, offset_end=%zd, strlen=%zd", range_start, offset_begin, offset_end, text_len);
+
+	// Reformat (width 105, indent 2, indented attributes)
+	gsize length = offset_end > offset_begin ? offset_end - offset_begin : 0;
+	html = html || gs_xml_looks_like_html(text + offset_begin, length);
+	GString *out = g_string_sized_new(length + length / 2 + 1);
+	GsParseError err = { 0, NULL };
+	gint64 time_start = g_get_monotonic_time();
+	gboolean ok = gs_xml_format(text + offset_begin, length, html, 2, 105, out, &err);
+	gdouble seconds = MAX(1, g_get_monotonic_time() - time_start) / (gdouble) G_USEC_PER_SEC;
+	msgwin_status_add("XML Pretty: %.2f MB in %.3f s (%.1f MB/s)", length / 1e6, seconds, length / 1e6 / seconds);
+
+	// Evaluate result
+	if (ok && whole_doc) {
+		// Set reformatted text to UI, only changed parts are replaced
+		g_string_append_c(out, '\n');
+		guint changes = gs_sci_apply_text(sci, 0, text, text_len, out->str, out->len);
+		scintilla_send_message(sci, SCI_SCROLLCARET, 0, 0);
+		msgwin_status_add(_("[%s] %u changes applied"), filename, changes);
+	} else if (ok) {
+		// Range: Keep surrounding text, indent like the line the element starts in and select the result
+		gchar *indentation = ui_sci_line_indentation(sci, range_start + offset_begin);
+		gs_string_indent_lines(out, indentation);
+		guint changes = gs_sci_apply_text(sci, range_start + offset_begin, text + offset_begin, length, out->str, out->len);
+		sci_set_selection_start(sci, range_start + offset_begin);
+		sci_set_selection_end(sci, range_start + offset_begin + out->len);
+		scintilla_send_message(sci, SCI_SCROLLCARET, 0, 0);
+		msgwin_status_add(_("[%s] %u changes applied in range"), filename, changes);
+		g_free(indentation);
+	} else {
+		ui_report_parse_error(doc, "XML pretty", range_start + offset_begin + err.offset, err.message);
+	}
+
+	// Free resources
+	g_string_free(out, TRUE);
+	free(filename);
+}
+
+static void ui_pipe_progress_stop() {
+	if (plugin_private.pipe_progress_timer != 0) {
+		g_source_remove(plugin_private.pipe_progress_timer);
+		plugin_private.pipe_progress_timer = 0;
+	}
+	if (plugin_private.pipe_dialog != NULL) {
+		gtk_widget_destroy(plugin_private.pipe_dialog);
+		plugin_private.pipe_dialog = NULL;
+		plugin_private.pipe_progressbar = NULL;
+	}
+}
+
+static void on_pipe_dialog_response(GtkDialog *dialog, gint response, gpointer user_data) {
+	gs_pipe_job_cancel(plugin_private.pipe_job);
+}
+
+// Show a progress dialog with cancel option for pipes which take longer than a moment
+static gboolean on_pipe_progress_timer(gpointer user_data) {
+	GsPipeJob *job = plugin_private.pipe_job;
+	if (job == NULL) {
+		plugin_private.pipe_progress_timer = 0;
+		return FALSE;
+	}
+
+	if (plugin_private.pipe_dialog == NULL) {
+		plugin_private.pipe_dialog = gtk_dialog_new_with_buttons("Pipe", GTK_WINDOW(geany->main_widgets->window), GTK_DIALOG_DESTROY_WITH_PARENT, _("_Cancel"), GTK_RESPONSE_CANCEL, NULL);
+		GtkWidget *vbox = gtk_dialog_get_content_area(GTK_DIALOG(plugin_private.pipe_dialog));
+		GtkWidget *label = gtk_label_new(job->command);
+		plugin_private.pipe_progressbar = gtk_progress_bar_new();
+		gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(plugin_private.pipe_progressbar), TRUE);
+		gtk_box_pack_start(GTK_BOX(vbox), label, FALSE, FALSE, 6);
+		gtk_box_pack_start(GTK_BOX(vbox), plugin_private.pipe_progressbar, FALSE, FALSE, 6);
+		gtk_window_set_default_size(GTK_WINDOW(plugin_private.pipe_dialog), 400, -1);
+		g_signal_connect(plugin_private.pipe_dialog, "response", G_CALLBACK(on_pipe_dialog_response), NULL);
+		g_signal_connect(plugin_private.pipe_dialog, "delete-event", G_CALLBACK(gtk_true), NULL); // Closed when the pipe is done
+		gtk_widget_show_all(plugin_private.pipe_dialog);
+	}
+
+	gchar *progress = g_strdup_printf(_("%.1f / %.1f MB in, %.1f MB out, %.1f s"), job->input_pos / 1e6, job->input_len / 1e6,
+		job->output->len / 1e6, (g_get_monotonic_time() - job->time_start) / (gdouble) G_USEC_PER_SEC);
+	if (job->ch_in != NULL && job->input_len > 0) {
+		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(plugin_private.pipe_progressbar), job->input_pos / (gdouble) job->input_len);
+	} else {
+		gtk_progress_bar_pulse(GTK_PROGRESS_BAR(plugin_private.pipe_progressbar));
+	}
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(plugin_private.pipe_progressbar), job->cancelled ? _("Cancelling…") : progress);
+	g_free(progress);
+	return TRUE;
+}
+
+// Pipe stdin: Stream straight from the document, which is read-only while the pipe runs
+static const gchar* on_pipe_read_input(gsize pos, gsize len, gpointer user_data) {
+	GeanyDocument *doc = user_data;
+	if (!DOC_VALID(doc) || doc->id != plugin_private.pipe_doc_id) {
+		return NULL;
+	}
+	return gs_sci_text_range(doc->editor->sci, plugin_private.pipe_range_start + pos, len);
+}
+
+// Pipe finished: Replace document text with output
+static void on_pipe_done(GsPipeJob *job, gpointer user_data) {
+	GeanyDocument *doc = user_data;
+	gint exitc = gs_pipe_exit_code(job->wait_status);
+	plugin_private.pipe_job = NULL;
+	ui_pipe_progress_stop();
+
+	// Document may have been closed meanwhile
+	if (!DOC_VALID(doc) || doc->id != plugin_private.pipe_doc_id) {
+		return;
+	}
+	ScintillaObject *sci = doc->editor->sci;
+	scintilla_send_message(sci, SCI_SETREADONLY, doc->readonly, 0);
+	gchar *filename = document_get_basename_for_display(doc, -1);
+
+	// Evaluate result
+	if (job->cancelled) {
+		msgwin_status_add(_("[%s] Pipe cancelled: %s"), filename, job->command);
+	} else if (exitc == 0) {
+		// Set output to UI, only changed parts are replaced
+		gsize start = plugin_private.pipe_range_start;
+		guint changes = gs_sci_apply_text(sci, start, gs_sci_text_range(sci, start, job->input_len), job->input_len, job->output->str, job->output->len);
+		scintilla_send_message(sci, SCI_SCROLLCARET, 0, 0);
+		msgwin_status_add(_("[%s] Pipe finished in %.2f s, %u changes applied: %s"), filename, (g_get_monotonic_time() - job->time_start) / (gdouble) G_USEC_PER_SEC, changes, job->command);
+		telemetry_add("pipe", doc, job->input_len, job->time_start);
+
+		// Output is owned by the cache now
+		gs_pipe_cache_insert(plugin_private.pipe_cache, plugin_private.pipe_input_hash, job->input_len, job->command, job->output);
+		job->output = g_string_new(NULL);
+	} else {
+		msgwin_switch_tab(MSG_MESSAGE, 1);
+		msgwin_msg_add(COLOR_RED, -1, doc, _("[%s] Error code %d. -> %s"), filename, exitc, job->errors->len > 0 ? job->errors->str : job->output->str);
+	}
+	free(filename);
+}
+
+// Run command in background with the selection or document as input, its output replaces the input.
+// Input is streamed in chunks straight from the document, which is read-only meanwhile. With use_cache
+// the output of an earlier run on the same input is taken instead, otherwise the command runs again
+static void ui_pipe_start(GeanyDocument *doc, const gchar *command, gboolean use_cache) {
+	ScintillaObject *sci = doc->editor->sci;
+	if (plugin_private.pipe_job != NULL) {
+		msgwin_status_add(_("Pipe: Another command is still running: %s"), plugin_private.pipe_job->command);
+		return;
+	}
+
+	// Same command on unchanged text: Take the cached output
+	gsize range_start, range_end;
+	ui_sci_tool_range(sci, GS_BLOCK_NONE, FALSE, &range_start, &range_end);
+	gsize input_len = range_end - range_start;
+	const gchar *input = gs_sci_text_range(sci, range_start, input_len);
+	guint64 input_hash = gs_hash_xxh64(input, input_len, 0);
+	GString *cached = use_cache ? gs_pipe_cache_lookup(plugin_private.pipe_cache, input_hash, input_len, command) : NULL;
+	if (cached != NULL) {
+		gchar *filename = document_get_basename_for_display(doc, -1);
+		guint changes = gs_sci_apply_text(sci, range_start, input, input_len, cached->str, cached->len);
+		scintilla_send_message(sci, SCI_SCROLLCARET, 0, 0);
+		msgwin_status_add(_("[%s] Pipe result from cache of an earlier run, command not run again (Shift+Enter in the Pipe dialog does), %u changes applied: %s"), filename, changes, command);
+		ui_set_statusbar(FALSE, _("Pipe: Result from cache, command not run again: %s"), command);
+		free(filename);
+		return;
+	}
+
+	// Only built-in text operators: Run them right here, no process needed
+	GPtrArray *ops = gs_textops_parse(command);
+	if (ops != NULL) {
+		gint64 time_start = g_get_monotonic_time();
+		gchar *error = NULL;
+		GString *output = gs_textops_run(ops, input, input_len, &error);
+		gchar *filename = document_get_basename_for_display(doc, -1);
+		g_ptr_array_free(ops, TRUE);
+		if (output == NULL) {
+			msgwin_switch_tab(MSG_MESSAGE, 1);
+			msgwin_msg_add(COLOR_RED, -1, doc, _("[%s] Pipe failed: %s"), filename, error);
+			g_free(error);
+			free(filename);
+			return;
+		}
+		guint changes = gs_sci_apply_text(sci, range_start, input, input_len, output->str, output->len);
+		scintilla_send_message(sci, SCI_SCROLLCARET, 0, 0);
+		msgwin_status_add(_("[%s] Pipe with built-in operators finished in %.3f s, %u changes applied: %s"), filename,
+			(g_get_monotonic_time() - time_start) / (gdouble) G_USEC_PER_SEC, changes, command);
+		free(filename);
+		gs_pipe_cache_insert(plugin_private.pipe_cache, input_hash, input_len, command, output);
+		return;
+	}
+
+	// Run in background, keep document unchanged until output arrives
+	GError *error = NULL;
+	plugin_private.pipe_doc_id = doc->id;
+	plugin_private.pipe_range_start = range_start;
+	plugin_private.pipe_input_hash = input_hash;
+	plugin_private.pipe_job = gs_pipe_job_start(command, input_len, on_pipe_read_input, on_pipe_done, doc, &error);
+	if (plugin_private.pipe_job == NULL) {
+		msgwin_switch_tab(MSG_MESSAGE, 1);
+		msgwin_msg_add(COLOR_RED, -1, doc, _("Pipe: Failed to run command: %s"), error->message);
+		g_error_free(error);
+	} else {
+		scintilla_send_message(sci, SCI_SETREADONLY, TRUE, 0);
+		plugin_private.pipe_progress_timer = g_timeout_add(300, on_pipe_progress_timer, NULL);
+	}
+}
+
+static gchar* pipe_history_filepath() {
+	return g_build_filename(geany_data->app->configdir, "plugins", PLUGIN_NAME, "pipe_history", NULL);
+}
+
+// Load command history, one command per line, newest first
+static void pipe_history_load() {
+	gchar *filepath = pipe_history_filepath(), *contents = NULL;
+	if (g_file_get_contents(filepath, &contents, NULL, NULL)) {
+		gchar **lines = g_strsplit(contents, "\n", -1);
+		for (gchar **line = lines; *line != NULL; line++) {
+			if (**line != '\0' && g_list_length(plugin_private.pipe_history) < GGU_PIPE_HISTORY_MAX) {
+				plugin_private.pipe_history = g_list_append(plugin_private.pipe_history, g_strdup(*line));
+			}
+		}
+		g_strfreev(lines);
+	}
+	g_free(contents);
+	g_free(filepath);
+}
+
+// Move command to the top of the history and save it
+static void pipe_history_add(const gchar *command) {
+	if (strchr(command, '\n') != NULL) {
+		return;
+	}
+	for (GList *item = plugin_private.pipe_history; item != NULL; item = item->next) {
+		if (g_str_equal(item->data, command)) {
+			g_free(item->data);
+			plugin_private.pipe_history = g_list_delete_link(plugin_private.pipe_history, item);
+			break;
+		}
+	}
+	plugin_private.pipe_history = g_list_prepend(plugin_private.pipe_history, g_strdup(command));
+	if (g_list_length(plugin_private.pipe_history) > GGU_PIPE_HISTORY_MAX) { // Drop oldest
+		GList *last = g_list_last(plugin_private.pipe_history);
+		g_free(last->data);
+		plugin_private.pipe_history = g_list_delete_link(plugin_private.pipe_history, last);
+	}
+
+	GString *contents = g_string_new(NULL);
+	for (GList *item = plugin_private.pipe_history; item != NULL; item = item->next) {
+		g_string_append_printf(contents, "%s\n", (gchar*) item->data);
+	}
+
+	gchar *filepath = pipe_history_filepath(), *dirpath = g_path_get_dirname(filepath);
+	g_mkdir_with_parents(dirpath, 0755);
+	g_file_set_contents(filepath, contents->str, contents->len, NULL);
+	g_free(dirpath);
+	g_free(filepath);
+	g_string_free(contents, TRUE);
+}
+
+// Pipe settings of geany.conf and the command history
+static void pipe_settings_load(GKeyFile *config) {
+	plugin_private.pipe_cache->max_size = (gsize) MAX(0, utils_get_setting_integer(config, PLUGIN_NAME, "pipe_cache_mb", 64)) * 1024 * 1024;
+	plugin_private.pipe_preview_size = (gsize) MAX(0, utils_get_setting_integer(config, PLUGIN_NAME, "pipe_preview_mb", 1)) * 1024 * 1024;
+	pipe_history_load();
+}
+
+// Live preview of the pipe dialog: Runs the command on a part of the document while typing
+typedef struct GsPipePreview {
+	GeanyDocument *doc;
+	gsize          input_start, input_len;  // Preview input: first pipe_preview_mb from the first visible line
+	GsPipeJob     *job;                     // Running preview command, NULL if none
+	gsize          shown_len;               // Output bytes shown so far
+	guint          debounce_timer, refresh_timer;
+	gsize          range_len;               // Input of the pipe itself, to find its cached output
+	guint64        range_hash;
+	GtkWidget     *entry, *check, *cache_check, *status, *textview;
+} GsPipePreview;
+
+static const gchar* on_pipe_preview_read_input(gsize pos, gsize len, gpointer user_data) {
+	GsPipePreview *preview = plugin_private.pipe_preview;
+	return preview != NULL ? gs_sci_text_range(preview->doc->editor->sci, preview->input_start + pos, len) : NULL;
+}
+
+// Show output in the preview pane, limited to the first GGU_PIPE_PREVIEW_SHOW_MAX bytes of valid UTF-8
+static void ui_pipe_preview_show(GsPipePreview *preview, const GString *text) {
+	const gchar *valid_end = NULL;
+	gsize len = MIN(text->len, GGU_PIPE_PREVIEW_SHOW_MAX);
+	g_utf8_validate(text->str, len, &valid_end);
+	gtk_text_buffer_set_text(gtk_text_view_get_buffer(GTK_TEXT_VIEW(preview->textview)), text->str, valid_end - text->str);
+	preview->shown_len = text->len;
+}
+
+// Stream output of the running preview into the pane
+static gboolean on_pipe_preview_refresh(gpointer user_data) {
+	GsPipePreview *preview = user_data;
+	if (preview->job == NULL) {
+		preview->refresh_timer = 0;
+		return FALSE;
+	}
+	if (preview->job->output->len != preview->shown_len && preview->shown_len < GGU_PIPE_PREVIEW_SHOW_MAX) {
+		ui_pipe_preview_show(preview, preview->job->output);
+	}
+	gchar *status = g_strdup_printf(_("Running… %.1f / %.1f MB in, %.1f MB out"), preview->job->input_pos / 1e6, preview->job->input_len / 1e6, preview->job->output->len / 1e6);
+	gtk_label_set_text(GTK_LABEL(preview->status), status);
+	g_free(status);
+	return TRUE;
+}
+
+static void on_pipe_preview_done(GsPipeJob *job, gpointer user_data) {
+	GsPipePreview *preview = plugin_private.pipe_preview;
+	if (preview == NULL || preview->job != job) { // Replaced or dialog closed meanwhile
+		return;
+	}
+	preview->job = NULL;
+	gint exitc = gs_pipe_exit_code(job->wait_status);
+	ui_pipe_preview_show(preview, exitc == 0 || job->errors->len == 0 ? job->output : job->errors);
+	gchar *status = g_strdup_printf(_("Exit code %d after %.2f s. Preview of %.1f MB from line %d, %.1f MB out"), exitc,
+		(g_get_monotonic_time() - job->time_start) / (gdouble) G_USEC_PER_SEC, job->input_len / 1e6,
+		sci_get_line_from_position(preview->doc->editor->sci, preview->input_start) + 1, job->output->len / 1e6);
+	gtk_label_set_text(GTK_LABEL(preview->status), status);
+	g_free(status);
+}
+
+// Stop the running preview command, its output is ignored from now on
+static void ui_pipe_preview_stop(GsPipePreview *preview) {
+	if (preview->job != NULL) {
+		gs_pipe_job_cancel(preview->job);
+		preview->job = NULL;
+	}
+}
+
+// Tell whether OK takes the cached output of an earlier run instead of running the command
+static void ui_pipe_preview_cache_state(GsPipePreview *preview, const gchar *command) {
+	gboolean cached = *command != '\0' && gs_pipe_cache_lookup(plugin_private.pipe_cache, preview->range_hash, preview->range_len, command) != NULL;
+	gtk_button_set_label(GTK_BUTTON(preview->cache_check), cached
+		? _("Use cached output: This command ran on the same text before, OK applies that output without running it again")
+		: _("Use cached output: None for this command and text, OK runs it"));
+}
+
+// Typing paused: Run the current command on the preview input
+static gboolean on_pipe_preview_debounce(gpointer user_data) {
+	GsPipePreview *preview = user_data;
+	const gchar *command = gtk_entry_get_text(GTK_ENTRY(preview->entry));
+	GError *error = NULL;
+	preview->debounce_timer = 0;
+	ui_pipe_preview_stop(preview);
+	ui_pipe_preview_cache_state(preview, command);
+	if (!gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(preview->check)) || *command == '\0') {
+		return FALSE;
+	}
+
+	GPtrArray *ops = gs_textops_parse(command);
+	if (ops != NULL) {
+		gint64 time_start = g_get_monotonic_time();
+		gchar *error = NULL;
+		GString *output = gs_textops_run(ops, on_pipe_preview_read_input(0, preview->input_len, NULL), preview->input_len, &error);
+		g_ptr_array_free(ops, TRUE);
+		if (output == NULL) {
+			gtk_label_set_text(GTK_LABEL(preview->status), error);
+			g_free(error);
+			return FALSE;
+		}
+		ui_pipe_preview_show(preview, output);
+		gchar *status = g_strdup_printf(_("Built-in operators, %.3f s. Preview of %.1f MB from line %d, %.1f MB out"),
+			(g_get_monotonic_time() - time_start) / (gdouble) G_USEC_PER_SEC, preview->input_len / 1e6,
+			sci_get_line_from_position(preview->doc->editor->sci, preview->input_start) + 1, output->len / 1e6);
+		gtk_label_set_text(GTK_LABEL(preview->status), status);
+		g_free(status);
+		g_string_free(output, TRUE);
+		return FALSE;
+	}
+
+	preview->job = gs_pipe_job_start(command, preview->input_len, on_pipe_preview_read_input, on_pipe_preview_done, NULL, &error);
+	if (preview->job == NULL) {
+		gtk_label_set_text(GTK_LABEL(preview->status), error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+	preview->shown_len = 0;
+	if (preview->refresh_timer == 0) {
+		preview->refresh_timer = g_timeout_add(100, on_pipe_preview_refresh, preview);
+	}
+	return FALSE;
+}
+
+static void on_pipe_preview_changed(GtkWidget *widget, gpointer user_data) {
+	GsPipePreview *preview = user_data;
+	if (preview->debounce_timer != 0) {
+		g_source_remove(preview->debounce_timer);
+	}
+	preview->debounce_timer = g_timeout_add(GGU_PIPE_PREVIEW_DEBOUNCE_MS, on_pipe_preview_debounce, preview);
+}
+
+// Shift+Enter: Run the command again instead of taking its cached output
+static gboolean on_pipe_entry_key_press(GtkWidget *entry, GdkEventKey *event, gpointer user_data) {
+	GsPipePreview *preview = plugin_private.pipe_preview;
+	if ((event->keyval != GDK_KEY_Return && event->keyval != GDK_KEY_KP_Enter) || !(event->state & GDK_SHIFT_MASK) || preview == NULL) {
+		return FALSE;
+	}
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(preview->cache_check), FALSE);
+	gtk_dialog_response(GTK_DIALOG(user_data), GTK_RESPONSE_ACCEPT);
+	return TRUE;
+}
+
+// Ask for a pipe command, the history is offered in a combo box. While typing, the command runs on
+// the first pipe_preview_mb from the first visible line and its output is shown below.
+// use_cache is set unless the cached output of an earlier run is refused. Returns NULL if cancelled
+static gchar* ui_pipe_command_dialog(GeanyDocument *doc, gboolean *use_cache) {
+	GtkWidget *dialog = gtk_dialog_new_with_buttons("Pipe", GTK_WINDOW(geany->main_widgets->window), GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, _("_Cancel"), GTK_RESPONSE_CANCEL, _("_OK"), GTK_RESPONSE_ACCEPT, NULL);
+	GtkWidget *vbox = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+	GtkWidget *label = gtk_label_new("echo current-editor-text | >>INPUT<<  > editor-text-afterwards");
+	GtkWidget *combo = gtk_combo_box_text_new_with_entry();
+	GtkWidget *entry = gtk_bin_get_child(GTK_BIN(combo));
+	for (GList *item = plugin_private.pipe_history; item != NULL; item = item->next) {
+		gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), item->data);
+	}
+	gtk_entry_set_text(GTK_ENTRY(entry), plugin_private.pipe_history != NULL ? plugin_private.pipe_history->data : "grep -i ");
+	gtk_entry_set_activates_default(GTK_ENTRY(entry), TRUE);
+	gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT);
+
+	// Preview input: From the first visible line (inside the tool range), cut at a line end
+	ScintillaObject *sci = doc->editor->sci;
+	GsPipePreview *preview = g_new0(GsPipePreview, 1);
+	gsize range_start, range_end;
+	ui_sci_tool_range(sci, GS_BLOCK_NONE, FALSE, &range_start, &range_end);
+	gint first_line = scintilla_send_message(sci, SCI_DOCLINEFROMVISIBLE, scintilla_send_message(sci, SCI_GETFIRSTVISIBLELINE, 0, 0), 0);
+	preview->doc = doc;
+	preview->range_len = range_end - range_start;
+	preview->range_hash = gs_hash_xxh64(gs_sci_text_range(sci, range_start, preview->range_len), preview->range_len, 0);
+	preview->input_start = CLAMP((gsize) sci_get_position_from_line(sci, first_line), range_start, range_end);
+	preview->input_len = MIN(range_end - preview->input_start, plugin_private.pipe_preview_size);
+	if (preview->input_start + preview->input_len < range_end) {
+		const gchar *input = gs_sci_text_range(sci, preview->input_start, preview->input_len);
+		const gchar *nl = memrchr(input, '\n', preview->input_len);
+		preview->input_len = nl != NULL ? (gsize)(nl - input) + 1 : preview->input_len;
+	}
+	plugin_private.pipe_preview = preview;
+
+	// Preview pane
+	preview->entry = entry;
+	preview->check = gtk_check_button_new_with_label(_("Live preview"));
+	preview->cache_check = gtk_check_button_new_with_label(NULL);
+	preview->status = gtk_label_new(NULL);
+	preview->textview = gtk_text_view_new();
+	GtkWidget *scroll = gtk_scrolled_window_new(NULL, NULL);
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(preview->check), plugin_private.pipe_preview_size > 0);
+	gtk_widget_set_sensitive(preview->check, plugin_private.pipe_preview_size > 0);
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(preview->cache_check), plugin_private.pipe_cache->max_size > 0);
+	gtk_widget_set_sensitive(preview->cache_check, plugin_private.pipe_cache->max_size > 0);
+	gtk_widget_set_tooltip_text(preview->cache_check, _("Off for commands with changing output like date, curl or shuf. Shift+Enter runs the command without the cache once"));
+	gtk_label_set_ellipsize(GTK_LABEL(preview->status), PANGO_ELLIPSIZE_END);
+	gtk_text_view_set_editable(GTK_TEXT_VIEW(preview->textview), FALSE);
+	gtk_text_view_set_monospace(GTK_TEXT_VIEW(preview->textview), TRUE);
+	gtk_container_add(GTK_CONTAINER(scroll), preview->textview);
+	g_signal_connect(entry, "changed", G_CALLBACK(on_pipe_preview_changed), preview);
+	g_signal_connect(preview->check, "toggled", G_CALLBACK(on_pipe_preview_changed), preview);
+	g_signal_connect(entry, "key-press-event", G_CALLBACK(on_pipe_entry_key_press), dialog);
+
+	gtk_box_pack_start(GTK_BOX(vbox), label, FALSE, FALSE, 6);
+	gtk_box_pack_start(GTK_BOX(vbox), combo, FALSE, FALSE, 6);
+	gtk_box_pack_start(GTK_BOX(vbox), preview->check, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(vbox), preview->cache_check, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(vbox), preview->status, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(vbox), scroll, TRUE, TRUE, 6);
+	gtk_window_set_default_size(GTK_WINDOW(dialog), 800, 500);
+	gtk_widget_show_all(dialog);
+	ui_pipe_preview_cache_state(preview, gtk_entry_get_text(GTK_ENTRY(entry)));
+	on_pipe_preview_changed(NULL, preview);
+
+	gchar *command = gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT ? g_strdup(gtk_entry_get_text(GTK_ENTRY(entry))) : NULL;
+	*use_cache = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(preview->cache_check));
+
+	// Stop preview, a cancelled command finishes in background and is ignored
+	plugin_private.pipe_preview = NULL;
+	if (preview->debounce_timer != 0) {
+		g_source_remove(preview->debounce_timer);
+	}
+	if (preview->refresh_timer != 0) {
+		g_source_remove(preview->refresh_timer);
+	}
+	ui_pipe_preview_stop(preview);
+	g_free(preview);
+	gtk_widget_destroy(dialog);
+	return command;
+}
+
+// Pipe: Run shell command with current text (or selection) as input, replace it with the output
+static void exec_pipe() {
+	GeanyDocument	*doc;
+	ScintillaObject	*sci;
+	if((doc = document_get_current()) == NULL || (sci = doc->editor->sci) == NULL) {
+		return;
+	}
+	if (plugin_private.pipe_job != NULL) {
+		msgwin_status_add(_("Pipe: Another command is still running: %s"), plugin_private.pipe_job->command);
+		return;
+	}
+
+	// Get pipe input
+	gboolean use_cache;
+	gchar *user_input = ui_pipe_command_dialog(doc, &use_cache);
+	if (user_input == NULL) { // canceled
+		return;
+	}
+	pipe_history_add(user_input);
+	ui_pipe_start(doc, user_input, use_cache);
+
+	// Free resources
+	g_free(user_input);
+}
+
+static guint doc_version(GeanyDocument *doc);
+
+// Co-process format request, the result is applied when it arrives if the document is unchanged
+typedef struct {
+	guint   doc_id;
+	guint   version;
+	gsize   range_start, range_len;
+	gint64  time_start;
+} GsCoprocessFormat;
+
+static void on_coprocess_formatted(GsCoprocess *co, gboolean ok, GString *out, GString *errors, gpointer user_data) {
+	GsCoprocessFormat *format = user_data;
+	GeanyDocument *doc = document_find_by_id(format->doc_id);
+	if (co->closing || !DOC_VALID(doc)) {
+		g_free(format);
+		return;
+	}
+	ScintillaObject *sci = doc->editor->sci;
+	gchar *filename = document_get_basename_for_display(doc, -1);
+	gdouble millis = (g_get_monotonic_time() - format->time_start) / 1000.0;
+
+	// An empty answer to non-empty input is the formatter's way to report an error
+	if (doc_version(doc) != format->version) {
+		msgwin_status_add(_("[%s] Format: Document changed meanwhile, result dropped: %s"), filename, co->command);
+	} else if (ok && (out->len > 0 || format->range_len == 0)) {
+		// Unchanged since the request, so the range still holds the input
+		const gchar *text = gs_sci_text_range(sci, format->range_start, format->range_len);
+		guint changes = gs_sci_apply_text(sci, format->range_start, text, format->range_len, out->str, out->len);
+		scintilla_send_message(sci, SCI_SCROLLCARET, 0, 0);
+		msgwin_status_add(_("[%s] Formatted in %.1f ms, %u changes applied: %s"), filename, millis, changes, co->command);
+		telemetry_add("format_server", doc, format->range_len, format->time_start);
+	} else {
+		msgwin_switch_tab(MSG_MESSAGE, 1);
+		msgwin_msg_add(COLOR_RED, -1, doc, _("[%s] Formatter failed: %s -> %s"), filename, co->command, errors->len > 0 ? errors->str : _("no output"));
+	}
+
+	// Free resources
+	free(filename);
+	g_free(format);
+}
+
+// Format the selection or document with a persistent co-process, which is started on first use and
+// after it failed. The request runs in background, the formatter gets a copy of the text
+static void ui_format_with_coprocess(GeanyDocument *doc, const gchar *command) {
+	ScintillaObject *sci = doc->editor->sci;
+	GError *error = NULL;
+	GsCoprocess *co = gs_coprocess_get(plugin_private.coprocesses, command, &error);
+	if (co == NULL) {
+		msgwin_switch_tab(MSG_MESSAGE, 1);
+		msgwin_msg_add(COLOR_RED, -1, doc, _("Format: Failed to start formatter: %s"), error->message);
+		g_error_free(error);
+		return;
+	} else if (co->busy) {
+		msgwin_status_add(_("Format: Formatter is still busy: %s"), command);
+		return;
+	}
+
+	// Range to work on
+	gsize range_start, range_end;
+	ui_sci_tool_range(sci, GS_BLOCK_NONE, FALSE, &range_start, &range_end);
+	GsCoprocessFormat *format = g_new0(GsCoprocessFormat, 1);
+	format->doc_id      = doc->id;
+	format->version     = doc_version(doc);
+	format->range_start = range_start;
+	format->range_len   = range_end - range_start;
+	format->time_start  = g_get_monotonic_time();
+	GBytes *input = g_bytes_new(gs_sci_text_range(sci, range_start, format->range_len), format->range_len);
+	gs_coprocess_request(co, input, GGU_COPROCESS_TIMEOUT_MS, on_coprocess_formatted, format);
+	g_bytes_unref(input);
+}
+
+// Command of formatter_<ft_name>, builtin:json / builtin:xml by default for JSON, XML and HTML. NULL if none
+static const gchar* formatter_command(const gchar *ft_name) {
+	const gchar *command = g_hash_table_lookup(plugin_private.formatters, ft_name);
+	if (command == NULL && g_str_equal(ft_name, "json")) {
+		command = "builtin:json";
+	} else if (command == NULL && (g_str_equal(ft_name, "xml") || g_str_equal(ft_name, "html"))) {
+		command = "builtin:xml";
+	}
+	return command;
+}
+
+// Format current document (or selection) with the formatter configured for its filetype
+static void exec_format() {
+	GeanyDocument	*doc;
+	ScintillaObject	*sci;
+	if((doc = document_get_current()) == NULL || (sci = doc->editor->sci) == NULL) {
+		return;
+	}
+
+	// Lookup formatter_<filetype>_server, then formatter_<filetype>
+	gchar *ft_name = g_ascii_strdown(doc->file_type != NULL ? doc->file_type->name : "none", -1);
+	gchar *server_key = g_strconcat(ft_name, "_server", NULL);
+	const gchar *server = g_hash_table_lookup(plugin_private.formatters, server_key);
+	const gchar *command = formatter_command(ft_name);
+
+	if (server != NULL) {
+		ui_format_with_coprocess(doc, server);
+	} else if (command == NULL) {
+		msgwin_status_add(_("Format: No formatter for filetype %s. Add formatter_%s=<command> to group %s in geany.conf"), ft_name, ft_name, PLUGIN_NAME);
+		ui_set_statusbar(FALSE, _("Format: No formatter for filetype %s"), ft_name);
+	} else if (g_str_equal(command, "builtin:json")) {
+		exec_json_pretty(GS_BLOCK_NONE);
+	} else if (g_str_equal(command, "builtin:xml")) {
+		exec_xml_pretty(GS_BLOCK_NONE);
+	} else {
+		ui_pipe_start(doc, command, TRUE);
+	}
+
+	// Free resources
+	g_free(server_key);
+	g_free(ft_name);
+}
+
+// Formatter registry: formatter_* keys of the plugin group in geany.conf, without prefix, and format_on_save
+static void formatters_load(GKeyFile *config) {
+	gchar **keys = g_key_file_get_keys(config, PLUGIN_NAME, NULL, NULL);
+	for (gchar **key = keys; key != NULL && *key != NULL; key++) {
+		if (g_str_has_prefix(*key, "formatter_")) {
+			gchar *command = utils_get_setting_string(config, PLUGIN_NAME, *key, "");
+			g_hash_table_insert(plugin_private.formatters, g_ascii_strdown(*key + strlen("formatter_"), -1), command);
+		}
+	}
+	g_strfreev(keys);
+
+	// Filetypes formatted in background after saving, opt-in
+	gchar *format_on_save = utils_get_setting_string(config, PLUGIN_NAME, "format_on_save", "");
+	gchar *format_on_save_lower = g_ascii_strdown(format_on_save, -1);
+	g_strfreev(plugin_private.format_on_save);
+	plugin_private.format_on_save = g_strsplit(format_on_save_lower, ";", -1);
+	g_free(format_on_save_lower);
+	g_free(format_on_save);
+}
+
+static void ui_search_documents_stop() {
+	if (plugin_private.search_timer != 0) {
+		g_source_remove(plugin_private.search_timer);
+		plugin_private.search_timer = 0;
+	}
+	if (plugin_private.search_dialog != NULL) {
+		gtk_widget_destroy(plugin_private.search_dialog);
+		plugin_private.search_dialog = NULL;
+		plugin_private.search_progressbar = NULL;
+	}
+	if (plugin_private.search != NULL) {
+		gs_search_free(plugin_private.search);
+		plugin_private.search = NULL;
+		g_array_free(plugin_private.search_doc_ids, TRUE);
+		plugin_private.search_doc_ids = NULL;
+	}
+}
+
+static void on_search_documents_dialog_response(GtkDialog *dialog, gint response, gpointer user_data) {
+	gs_search_cancel(plugin_private.search);
+}
+
+// Stream matches into the message window, a limited number per tick so the UI stays responsive.
+// A progress dialog with live count and cancel option shows up for searches which take longer than a moment
+static gboolean on_search_documents_timer(gpointer user_data) {
+	GsSearch *search = plugin_private.search;
+	GsSearchMatch *match = NULL;
+	for (guint i = 0; i < 1000 && (match = gs_search_next(search)) != NULL; i++) {
+		GeanyDocument *doc = document_find_by_id(g_array_index(plugin_private.search_doc_ids, guint, match->text));
+		if (DOC_VALID(doc) && plugin_private.search_shown < GGU_SEARCH_SHOW_MAX) {
+			gint line = sci_get_line_from_position(doc->editor->sci, match->pos) + 1;
+			gchar *filename = document_get_basename_for_display(doc, -1);
+			msgwin_msg_add(COLOR_BLACK, line, doc, "%s:%d: %s", filename, line, match->line);
+			free(filename);
+			plugin_private.search_shown++;
+		}
+		gs_search_match_free(match);
+	}
+
+	gint count = g_atomic_int_get(&search->count);
+	gdouble seconds = (g_get_monotonic_time() - search->time_start) / (gdouble) G_USEC_PER_SEC;
+	if (match == NULL && gs_search_done(search)) {
+		msgwin_msg_add(COLOR_BLUE, -1, NULL, _("Search: %d matches for \"%s\" in %u documents, %.2f s%s"), count, plugin_private.search_pattern,
+			search->texts->len, seconds, g_atomic_int_get(&search->cancelled) ? _(" (cancelled)") : "");
+		if (plugin_private.search_shown < (guint) count) {
+			msgwin_msg_add(COLOR_BLUE, -1, NULL, _("Search: Only the first %u matches are listed"), plugin_private.search_shown);
+		}
+		ui_set_statusbar(FALSE, _("Search: %d matches"), count);
+		gsize size = 0;
+		for (guint i = 0; i < search->texts->len; i++) {
+			size += g_bytes_get_size(g_ptr_array_index(search->texts, i));
+		}
+		telemetry_add("search_documents", NULL, size, search->time_start);
+		plugin_private.search_timer = 0;
+		ui_search_documents_stop();
+		return FALSE;
+	}
+
+	if (plugin_private.search_dialog == NULL && seconds > 0.3) {
+		plugin_private.search_dialog = gtk_dialog_new_with_buttons(_("Search in open documents"), GTK_WINDOW(geany->main_widgets->window), GTK_DIALOG_DESTROY_WITH_PARENT, _("_Cancel"), GTK_RESPONSE_CANCEL, NULL);
+		GtkWidget *vbox = gtk_dialog_get_content_area(GTK_DIALOG(plugin_private.search_dialog));
+		GtkWidget *label = gtk_label_new(plugin_private.search_pattern);
+		plugin_private.search_progressbar = gtk_progress_bar_new();
+		gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(plugin_private.search_progressbar), TRUE);
+		gtk_box_pack_start(GTK_BOX(vbox), label, FALSE, FALSE, 6);
+		gtk_box_pack_start(GTK_BOX(vbox), plugin_private.search_progressbar, FALSE, FALSE, 6);
+		gtk_window_set_default_size(GTK_WINDOW(plugin_private.search_dialog), 400, -1);
+		g_signal_connect(plugin_private.search_dialog, "response", G_CALLBACK(on_search_documents_dialog_response), NULL);
+		g_signal_connect(plugin_private.search_dialog, "delete-event", G_CALLBACK(gtk_true), NULL); // Closed when the search is done
+		gtk_widget_show_all(plugin_private.search_dialog);
+	}
+	if (plugin_private.search_dialog != NULL) {
+		gchar *progress = g_strdup_printf(_("%d matches, %.1f s"), count, seconds);
+		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(plugin_private.search_progressbar), search->chunks_done / (gdouble) MAX(search->chunks->len, 1));
+		gtk_progress_bar_set_text(GTK_PROGRESS_BAR(plugin_private.search_progressbar), g_atomic_int_get(&search->cancelled) ? _("Cancelling…") : progress);
+		g_free(progress);
+	}
+	ui_set_statusbar(FALSE, _("Search: %d matches so far"), count);
+	return TRUE;
+}
+
+// Ask for the pattern and options, the selection or the last pattern is preset. Returns NULL if cancelled
+static gchar* ui_search_documents_dialog(GeanyDocument *doc) {
+	GtkWidget *dialog = gtk_dialog_new_with_buttons(_("Search in open documents"), GTK_WINDOW(geany->main_widgets->window), GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, _("_Cancel"), GTK_RESPONSE_CANCEL, _("_Search"), GTK_RESPONSE_ACCEPT, NULL);
+	GtkWidget *vbox = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+	GtkWidget *entry = gtk_entry_new();
+	GtkWidget *check_regex = gtk_check_button_new_with_label(_("Regular expression"));
+	GtkWidget *check_case = gtk_check_button_new_with_label(_("Match case"));
+	gchar *selection = doc != NULL && sci_has_selection(doc->editor->sci) ? sci_get_selection_contents(doc->editor->sci) : NULL;
+	if (selection != NULL && strchr(selection, '\n') == NULL) {
+		gtk_entry_set_text(GTK_ENTRY(entry), selection);
+	} else if (plugin_private.search_pattern != NULL) {
+		gtk_entry_set_text(GTK_ENTRY(entry), plugin_private.search_pattern);
+	}
+	gtk_entry_set_activates_default(GTK_ENTRY(entry), TRUE);
+	gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT);
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_regex), plugin_private.search_regex);
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_case), plugin_private.search_match_case);
+
+	gtk_box_pack_start(GTK_BOX(vbox), entry, FALSE, FALSE, 6);
+	gtk_box_pack_start(GTK_BOX(vbox), check_regex, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(vbox), check_case, FALSE, FALSE, 0);
+	gtk_window_set_default_size(GTK_WINDOW(dialog), 400, -1);
+	gtk_widget_show_all(dialog);
+
+	gchar *pattern = NULL;
+	if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT && *gtk_entry_get_text(GTK_ENTRY(entry)) != '\0') {
+		pattern = g_strdup(gtk_entry_get_text(GTK_ENTRY(entry)));
+		plugin_private.search_regex = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(check_regex));
+		plugin_private.search_match_case = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(check_case));
+	}
+	gtk_widget_destroy(dialog);
+	g_free(selection);
+	return pattern;
+}
+
+// Search all open documents in background, matches are listed in the message window as they are found
+static void exec_search_documents() {
+	gchar *pattern = ui_search_documents_dialog(document_get_current());
+	if (pattern == NULL) { // canceled
+		return;
+	}
+	ui_search_documents_stop(); // Replaces a running search
+
+	GError *error = NULL;
+	GsSearch *search = gs_search_new(pattern, plugin_private.search_regex, !plugin_private.search_match_case, &error);
+	SETPTR(plugin_private.search_pattern, pattern);
+	if (search == NULL) {
+		msgwin_status_add(_("Search: Invalid regular expression: %s"), error->message);
+		ui_set_statusbar(FALSE, _("Search: Invalid regular expression: %s"), error->message);
+		g_error_free(error);
+		return;
+	}
+
+	// Snapshot every document, the search doesn't see edits made meanwhile
+	guint i;
+	plugin_private.search_doc_ids = g_array_new(FALSE, FALSE, sizeof(guint));
+	foreach_document(i) {
+		ScintillaObject *sci = documents[i]->editor->sci;
+		gsize len = sci_get_length(sci);
+		gs_search_add_text(search, g_bytes_new(gs_sci_text_range(sci, 0, len), len));
+		g_array_append_val(plugin_private.search_doc_ids, documents[i]->id);
+	}
+
+	msgwin_clear_tab(MSG_MESSAGE);
+	msgwin_switch_tab(MSG_MESSAGE, TRUE);
+	msgwin_msg_add(COLOR_BLUE, -1, NULL, _("Searching for \"%s\" in %u documents…"), pattern, search->texts->len);
+	plugin_private.search = search;
+	plugin_private.search_shown = 0;
+	gs_search_start(search);
+	plugin_private.search_timer = g_timeout_add(100, on_search_documents_timer, NULL);
+}
+
+static gchar* quick_open_index_filepath() {
+	return g_build_filename(geany_data->app->configdir, "plugins", PLUGIN_NAME, "quick_open_index", NULL);
+}
+
+static void ui_quick_open_monitors_free() {
+	if (plugin_private.quick_open_monitors != NULL) {
+		g_ptr_array_free(plugin_private.quick_open_monitors, TRUE);
+		plugin_private.quick_open_monitors = NULL;
+	}
+	if (plugin_private.quick_open_dirs != NULL) {
+		g_ptr_array_free(plugin_private.quick_open_dirs, TRUE);
+		plugin_private.quick_open_dirs = NULL;
+	}
+}
+
+static void ui_quick_open_scan_stop() {
+	if (plugin_private.quick_open_timer != 0) {
+		g_source_remove(plugin_private.quick_open_timer);
+		plugin_private.quick_open_timer = 0;
+	}
+	if (plugin_private.quick_open_scan != NULL) {
+		gs_path_scan_free(plugin_private.quick_open_scan);
+		plugin_private.quick_open_scan = NULL;
+	}
+}
+
+static gboolean on_quick_open_timer(gpointer user_data);
+
+// Rescan the roots in background, the current index stays in use until the new one is ready
+static void ui_quick_open_scan_start(gboolean load_cache) {
+	ui_quick_open_scan_stop();
+	if (plugin_private.quick_open_roots == NULL || *plugin_private.quick_open_roots == NULL) {
+		return;
+	}
+	gchar *filepath = quick_open_index_filepath();
+	plugin_private.quick_open_scan = gs_path_scan_start(plugin_private.quick_open_roots, plugin_private.quick_open_max_files, filepath, load_cache);
+	plugin_private.quick_open_timer = g_timeout_add(100, on_quick_open_timer, NULL);
+	g_free(filepath);
+}
+
+static gboolean on_quick_open_rescan(gpointer user_data) {
+	plugin_private.quick_open_rescan = 0;
+	ui_quick_open_scan_start(FALSE);
+	return FALSE;
+}
+
+// Files are added and removed as they change, new or removed directories need a rescan (debounced)
+static void on_quick_open_dir_changed(GFileMonitor *monitor, GFile *file, GFile *other_file, GFileMonitorEvent event, gpointer user_data) {
+	gchar *path = g_file_get_path(file);
+	const gchar *name = path != NULL ? strrchr(path, G_DIR_SEPARATOR) : NULL;
+	if (name == NULL || name[1] == '.') { // Hidden files aren't indexed
+		g_free(path);
+		return;
+	}
+	if (event == G_FILE_MONITOR_EVENT_CREATED && g_file_test(path, G_FILE_TEST_IS_REGULAR) && !g_file_test(path, G_FILE_TEST_IS_SYMLINK)) {
+		gs_path_index_add(plugin_private.quick_open_index, path, 0);
+	} else if (event == G_FILE_MONITOR_EVENT_CREATED && g_file_test(path, G_FILE_TEST_IS_DIR) && !g_file_test(path, G_FILE_TEST_IS_SYMLINK)) {
+		if (plugin_private.quick_open_rescan == 0) {
+			plugin_private.quick_open_rescan = g_timeout_add_seconds(5, on_quick_open_rescan, NULL);
+		}
+	} else if (event == G_FILE_MONITOR_EVENT_DELETED) {
+		if (g_hash_table_contains(plugin_private.quick_open_index->lookup, path)) {
+			gs_path_index_remove(plugin_private.quick_open_index, path);
+		} else if (plugin_private.quick_open_rescan == 0) { // Likely a directory
+			plugin_private.quick_open_rescan = g_timeout_add_seconds(5, on_quick_open_rescan, NULL);
+		}
+	}
+	g_free(path);
+}
+
+// Take a new index from the scan: favourites, recent and opened files of the current one are kept.
+// Directories of a finished scan get monitors, a limited number per tick so the UI stays responsive
+static gboolean on_quick_open_timer(gpointer user_data) {
+	GsPathScanResult *result = gs_path_scan_next(plugin_private.quick_open_scan);
+	if (result != NULL) {
+		GsPathIndex *index = plugin_private.quick_open_index;
+		for (guint i = 0; i < index->entries->len; i++) {
+			const GsPathEntry *entry = &g_array_index(index->entries, GsPathEntry, i);
+			if (entry->path != NULL && entry->flags != 0) {
+				gs_path_index_add(result->index, entry->path, entry->flags);
+			}
+		}
+		gs_path_index_free(index);
+		plugin_private.quick_open_index = result->index;
+		if (result->dirs != NULL) {
+			ui_quick_open_monitors_free();
+			plugin_private.quick_open_dirs = result->dirs;
+			plugin_private.quick_open_monitors = g_ptr_array_new_with_free_func(g_object_unref);
+			gs_path_scan_free(plugin_private.quick_open_scan);
+			plugin_private.quick_open_scan = NULL;
+		}
+		g_free(result);
+	}
+
+	GPtrArray *dirs = plugin_private.quick_open_dirs;
+	for (guint i = 0; dirs != NULL && i < 256 && dirs->len > 0; i++) {
+		gchar *dirpath = g_ptr_array_steal_index_fast(dirs, dirs->len - 1);
+		GFile *dir = g_file_new_for_path(dirpath);
+		GFileMonitor *monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_NONE, NULL, NULL);
+		if (monitor != NULL) {
+			g_signal_connect(monitor, "changed", G_CALLBACK(on_quick_open_dir_changed), NULL);
+			g_ptr_array_add(plugin_private.quick_open_monitors, monitor);
+		}
+		g_object_unref(dir);
+		g_free(dirpath);
+		if (plugin_private.quick_open_monitors->len >= GGU_QUICK_OPEN_MONITORS_MAX) {
+			g_ptr_array_set_size(dirs, 0);
+		}
+	}
+	if (plugin_private.quick_open_scan == NULL && (dirs == NULL || dirs->len == 0)) {
+		plugin_private.quick_open_timer = 0;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// Show the best matches for the entry text in the list, the first one selected. Nothing typed yet lists favourites and recent files
+static void on_quick_open_changed(GtkWidget *entry, gpointer user_data) {
+	GtkWidget *tree = user_data;
+	GtkListStore *store = GTK_LIST_STORE(gtk_tree_view_get_model(GTK_TREE_VIEW(tree)));
+	const GsPathEntry *results[GS_PATH_RESULTS_MAX];
+	gint64 time_start = g_get_monotonic_time();
+	guint count = gs_path_index_query(plugin_private.quick_open_index, gtk_entry_get_text(GTK_ENTRY(entry)), results);
+	gint64 time_query = g_get_monotonic_time() - time_start;
+
+	gtk_list_store_clear(store);
+	for (guint i = 0; i < count; i++) {
+		gchar *dirpath = g_strndup(results[i]->path, results[i]->base);
+		gtk_list_store_insert_with_values(store, NULL, -1, 0, results[i]->path + results[i]->base, 1, dirpath, 2, results[i]->path, -1);
+		g_free(dirpath);
+	}
+	GtkTreePath *first = gtk_tree_path_new_first();
+	gtk_tree_view_set_cursor(GTK_TREE_VIEW(tree), first, NULL, FALSE);
+	gtk_tree_path_free(first);
+	ui_set_statusbar(FALSE, _("Quick open: %u of %u files, %.1f ms"), count, g_hash_table_size(plugin_private.quick_open_index->lookup), time_query / 1000.0);
+}
+
+// Up/Down in the entry move the selection of the list
+static gboolean on_quick_open_key_press(GtkWidget *entry, GdkEventKey *event, gpointer user_data) {
+	if (event->keyval != GDK_KEY_Up && event->keyval != GDK_KEY_Down) {
+		return FALSE;
+	}
+	GtkTreePath *path = NULL;
+	gtk_tree_view_get_cursor(GTK_TREE_VIEW(user_data), &path, NULL);
+	if (path != NULL) {
+		if (event->keyval == GDK_KEY_Up) {
+			gtk_tree_path_prev(path);
+		} else {
+			gtk_tree_path_next(path);
+		}
+		gtk_tree_view_set_cursor(GTK_TREE_VIEW(user_data), path, NULL, FALSE); // Ignored behind the last row
+		gtk_tree_path_free(path);
+	}
+	return TRUE;
+}
+
+static void on_quick_open_row_activated(GtkTreeView *tree, GtkTreePath *path, GtkTreeViewColumn *column, gpointer dialog) {
+	gtk_dialog_response(GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT);
+}
+
+// Quick open: Fuzzy search the paths of favourites, recent files and the configured roots, open the chosen file
+static void exec_quick_open() {
+	GtkWidget *dialog = gtk_dialog_new_with_buttons(_("Quick open"), GTK_WINDOW(geany->main_widgets->window), GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, _("_Cancel"), GTK_RESPONSE_CANCEL, _("_Open"), GTK_RESPONSE_ACCEPT, NULL);
+	GtkWidget *vbox = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+	GtkWidget *entry = gtk_entry_new();
+	GtkListStore *store = gtk_list_store_new(3, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING); // Name, directory, path
+	GtkWidget *tree = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
+	GtkWidget *scroll = gtk_scrolled_window_new(NULL, NULL);
+	g_object_unref(store);
+	gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(tree), -1, _("Name"), gtk_cell_renderer_text_new(), "text", 0, NULL);
+	gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(tree), -1, _("Directory"), gtk_cell_renderer_text_new(), "text", 1, NULL);
+	gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(tree), FALSE);
+	gtk_container_add(GTK_CONTAINER(scroll), tree);
+	gtk_entry_set_activates_default(GTK_ENTRY(entry), TRUE);
+	gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT);
+	g_signal_connect(entry, "changed", G_CALLBACK(on_quick_open_changed), tree);
+	g_signal_connect(entry, "key-press-event", G_CALLBACK(on_quick_open_key_press), tree);
+	g_signal_connect(tree, "row-activated", G_CALLBACK(on_quick_open_row_activated), dialog);
+
+	gtk_box_pack_start(GTK_BOX(vbox), entry, FALSE, FALSE, 6);
+	gtk_box_pack_start(GTK_BOX(vbox), scroll, TRUE, TRUE, 0);
+	gtk_window_set_default_size(GTK_WINDOW(dialog), 700, 450);
+	gtk_widget_show_all(dialog);
+	on_quick_open_changed(entry, tree); // Favourites and recent files for the empty query
+
+	GtkTreeModel *model = NULL;
+	GtkTreeIter iter;
+	if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT && gtk_tree_selection_get_selected(gtk_tree_view_get_selection(GTK_TREE_VIEW(tree)), &model, &iter)) {
+		gchar *filepath = NULL;
+		gtk_tree_model_get(model, &iter, 2, &filepath, -1);
+		document_open_file(filepath, FALSE, NULL, NULL);
+		g_free(filepath);
+	}
+	gtk_widget_destroy(dialog);
+}
+
+// Quick open index: Favourites and recent files of geany.conf, then the files below quick_open_roots
+// from the saved index while the roots are rescanned in background
+static void quick_open_init(GKeyFile *config) {
+	GsPathIndex *index = plugin_private.quick_open_index;
+	gchar *str = utils_get_setting_string(config, PLUGIN_NAME, "favourites", "");
+	GPtrArray *favourites = favourites_parse(str);
+	for (guint i = 1; i < favourites->len; i += 2) {
+		if (g_ptr_array_index(favourites, i) != NULL) {
+			gs_path_index_add(index, g_ptr_array_index(favourites, i), GS_PATH_FAVOURITE);
+		}
+	}
+	gchar **recent = g_key_file_get_string_list(config, "files", "recent_files", NULL, NULL);
+	for (gchar **filepath = recent; filepath != NULL && *filepath != NULL; filepath++) {
+		gs_path_index_add(index, *filepath, GS_PATH_RECENT);
+	}
+	g_strfreev(recent);
+	g_ptr_array_free(favourites, TRUE);
+	g_free(str);
+
+	gchar *roots = utils_get_setting_string(config, PLUGIN_NAME, "quick_open_roots", "");
+	SETPTR(roots, gs_glib_strreplace(roots, "$HOME", g_get_home_dir(), 0));
+	plugin_private.quick_open_roots = g_strsplit(roots, ";", -1);
+	plugin_private.quick_open_max_files = MAX(0, utils_get_setting_integer(config, PLUGIN_NAME, "quick_open_max_files", 500000));
+	ui_quick_open_scan_start(TRUE);
+	g_free(roots);
+}
+
+//######################################################################################################
+// Large files
+//
+// Documents of at least large_file_mb are switched to plain text without folding, wrapping and symbols,
+// so huge logs open and scroll quickly. The plugin skips its own per-document work for them too. A
+// button in the status bar shows the mode for the current document, clicking it restores everything
+
+static void ui_debloat_based_on_current_filetype(GeanyDocument *doc);
+
+// Settings of a document before large file mode
+typedef struct {
+	GeanyFiletype *filetype;
+	gboolean       line_wrapping;
+	gint           wrap_mode;
+	gint           fold_margin_width;
+} GsLargeFile;
+
+static gboolean large_file_is(GeanyDocument *doc) {
+	return g_hash_table_contains(plugin_private.large_files, GUINT_TO_POINTER(doc->id));
+}
+
+// Show the status bar button while the current document is in large file mode
+static void ui_large_file_indicator_update() {
+	GeanyDocument *doc = document_get_current();
+	if (plugin_private.large_file_indicator != NULL) {
+		gtk_widget_set_visible(plugin_private.large_file_indicator, DOC_VALID(doc) && large_file_is(doc));
+	}
+}
+
+// Switch doc to plain text, turn off folding and wrapping. Plain text has no symbols to parse
+static void ui_large_file_enable(GeanyDocument *doc) {
+	ScintillaObject *sci = doc->editor->sci;
+	if (large_file_is(doc)) {
+		return;
+	}
+	GsLargeFile *large = g_new0(GsLargeFile, 1);
+	large->filetype = doc->file_type;
+	large->line_wrapping = doc->editor->line_wrapping;
+	large->wrap_mode = scintilla_send_message(sci, SCI_GETWRAPMODE, 0, 0);
+	large->fold_margin_width = scintilla_send_message(sci, SCI_GETMARGINWIDTHN, GGU_FOLD_MARGIN, 0);
+	g_hash_table_insert(plugin_private.large_files, GUINT_TO_POINTER(doc->id), large);
+
+	document_set_filetype(doc, filetypes_index(GEANY_FILETYPES_NONE));
+	doc->editor->line_wrapping = FALSE;
+	scintilla_send_message(sci, SCI_SETWRAPMODE, SC_WRAP_NONE, 0);
+	scintilla_send_message(sci, SCI_SETMARGINWIDTHN, GGU_FOLD_MARGIN, 0);
+
+	gchar *filename = document_get_basename_for_display(doc, -1);
+	msgwin_status_add(_("[%s] Large file (%.1f MB): Plain text, no folding, wrapping and symbols. Click \"Large file\" in the status bar to restore"),
+		filename, sci_get_length(sci) / 1e6);
+	free(filename);
+	ui_large_file_indicator_update();
+}
+
+// Restore filetype, folding and wrapping of doc
+static void ui_large_file_restore(GeanyDocument *doc) {
+	ScintillaObject *sci = doc->editor->sci;
+	GsLargeFile *large = g_hash_table_lookup(plugin_private.large_files, GUINT_TO_POINTER(doc->id));
+	if (large == NULL) {
+		return;
+	}
+	document_set_filetype(doc, large->filetype);
+	doc->editor->line_wrapping = large->line_wrapping;
+	scintilla_send_message(sci, SCI_SETWRAPMODE, large->wrap_mode, 0);
+	scintilla_send_message(sci, SCI_SETMARGINWIDTHN, GGU_FOLD_MARGIN, large->fold_margin_width);
+	g_hash_table_remove(plugin_private.large_files, GUINT_TO_POINTER(doc->id));
+
+	gchar *filename = document_get_basename_for_display(doc, -1);
+	msgwin_status_add(_("[%s] Large file: Full features restored"), filename);
+	free(filename);
+	ui_large_file_indicator_update();
+	ui_debloat_based_on_current_filetype(doc);
+}
+
+// Large file mode if doc reaches the threshold. Returns whether it is in large file mode
+static gboolean ui_large_file_check(GeanyDocument *doc) {
+	if (plugin_private.large_file_size > 0 && !large_file_is(doc) && (gsize) sci_get_length(doc->editor->sci) >= plugin_private.large_file_size) {
+		ui_large_file_enable(doc);
+	}
+	return large_file_is(doc);
+}
+
+static void on_large_file_indicator_clicked(GtkButton *button, gpointer user_data) {
+	GeanyDocument *doc = document_get_current();
+	if (DOC_VALID(doc)) {
+		ui_large_file_restore(doc);
+	}
+}
+
+// Large file mode: Toggle for the current document, regardless of its size
+static void exec_large_file_toggle() {
+	GeanyDocument *doc = document_get_current();
+	if (!DOC_VALID(doc)) {
+		return;
+	}
+	if (large_file_is(doc)) {
+		ui_large_file_restore(doc);
+	} else {
+		ui_large_file_enable(doc);
+	}
+}
+
+// Threshold of geany.conf and the status bar button. Documents opened before are checked now
+static void large_file_settings_load(GKeyFile *config) {
+	plugin_private.large_file_size = (gsize) MAX(0, utils_get_setting_integer(config, PLUGIN_NAME, "large_file_mb", 100)) * 1000 * 1000;
+
+	GtkWidget *statusbar = ui_lookup_widget(geany_data->main_widgets->window, "statusbar");
+	plugin_private.large_file_indicator = gtk_button_new_with_label(_("Large file"));
+	gtk_button_set_relief(GTK_BUTTON(plugin_private.large_file_indicator), GTK_RELIEF_NONE);
+	gtk_widget_set_tooltip_text(plugin_private.large_file_indicator, _("Plain text without folding, wrapping and symbols. Click to restore"));
+	g_signal_connect(plugin_private.large_file_indicator, "clicked", G_CALLBACK(on_large_file_indicator_clicked), NULL);
+	gtk_box_pack_end(GTK_BOX(statusbar), plugin_private.large_file_indicator, FALSE, FALSE, 0);
+
+	guint i;
+	foreach_document(i) {
+		ui_large_file_check(documents[i]);
+	}
+	ui_large_file_indicator_update();
+}
+
+//######################################################################################################
+// Format on save
+//
+// Filetypes listed in format_on_save are formatted after saving, on a worker thread with a snapshot of
+// the document, so the save itself doesn't wait. Every text modification counts up the version of a
+// document. A result is applied as minimal edit and saved only if the version is still the one of the
+// snapshot, otherwise it is dropped and the file stays as saved
+
+static guint doc_version(GeanyDocument *doc) {
+	return GPOINTER_TO_UINT(g_hash_table_lookup(plugin_private.doc_versions, GUINT_TO_POINTER(doc->id)));
+}
+
+static void ui_format_on_save_apply(GsFormatJob *job) {
+	GeanyDocument *doc = document_find_by_id(job->doc_id);
+	if (!DOC_VALID(doc)) {
+		return;
+	}
+	ScintillaObject *sci = doc->editor->sci;
+	gchar *filename = document_get_basename_for_display(doc, -1);
+	gsize len = g_bytes_get_size(job->snapshot);
+	gdouble millis = (g_get_monotonic_time() - job->time_start) / 1000.0;
+
+	if (!gs_format_job_is_current(job, doc->id, doc_version(doc))) {
+		msgwin_status_add(_("[%s] Format on save: Document changed meanwhile, result dropped"), filename);
+	} else if (!job->ok && job->err.message != NULL) {
+		gint line = sci_get_line_from_position(sci, job->err.offset);
+		msgwin_switch_tab(MSG_MESSAGE, 1);
+		msgwin_msg_add(COLOR_RED, line + 1, doc, _("[%s] Format on save: Error at line %d, column %d: %s"),
+			filename, line + 1, sci_get_col_from_position(sci, job->err.offset) + 1, job->err.message);
+	} else if (!job->ok) {
+		msgwin_switch_tab(MSG_MESSAGE, 1);
+		msgwin_msg_add(COLOR_RED, -1, doc, _("[%s] Format on save: Formatter failed: %s -> %s"), filename, job->command, job->errors != NULL ? job->errors : _("no output"));
+	} else {
+		// Unchanged since the snapshot, so the document still holds it
+		guint changes = gs_sci_apply_text(sci, 0, gs_sci_text_range(sci, 0, len), len, job->out->str, job->out->len);
+		if (changes > 0) {
+			plugin_private.format_saving_doc_id = doc->id;
+			document_save_file(doc, FALSE);
+			plugin_private.format_saving_doc_id = 0;
+		}
+		msgwin_status_add(_("[%s] Format on save: Formatted in %.1f ms, %u changes applied: %s"), filename, millis, changes, job->command);
+		telemetry_add("format_on_save", doc, len, job->time_start);
+	}
+	free(filename);
+}
+
+// Apply finished formats, runs while any is pending
+static gboolean on_format_on_save_timer(gpointer user_data) {
+	GsFormatJob *job;
+	while ((job = gs_format_queue_next(plugin_private.format_queue)) != NULL) {
+		ui_format_on_save_apply(job);
+		gs_format_job_free(job);
+	}
+	if (plugin_private.format_queue->pending > 0) {
+		return TRUE;
+	}
+	plugin_private.format_timer = 0;
+	return FALSE;
+}
+
+// Document saved: Format a snapshot in background if its filetype is listed in format_on_save. Documents
+// in large file mode count with their original filetype. Coprocess formatters are not used here
+static void ui_format_on_save_start(GeanyDocument *doc) {
+	if (plugin_private.format_on_save == NULL || doc->id == plugin_private.format_saving_doc_id) {
+		return;
+	}
+	GsLargeFile *large = g_hash_table_lookup(plugin_private.large_files, GUINT_TO_POINTER(doc->id));
+	GeanyFiletype *ft = large != NULL ? large->filetype : doc->file_type;
+	gchar *ft_name = g_ascii_strdown(ft != NULL ? ft->name : "none", -1);
+	const gchar *command = formatter_command(ft_name);
+
+	if (command != NULL && g_strv_contains((const gchar* const*) plugin_private.format_on_save, ft_name)) {
+		ScintillaObject *sci = doc->editor->sci;
+		gsize len = sci_get_length(sci);
+		GBytes *snapshot = g_bytes_new(gs_sci_text_range(sci, 0, len), len);
+		if (plugin_private.format_queue == NULL) {
+			plugin_private.format_queue = gs_format_queue_new(GGU_FORMAT_TIMEOUT_MS);
+		}
+		gs_format_queue_push(plugin_private.format_queue, doc->id, doc_version(doc), command, g_str_equal(ft_name, "html"), snapshot);
+		g_bytes_unref(snapshot);
+		if (plugin_private.format_timer == 0) {
+			plugin_private.format_timer = g_timeout_add(50, on_format_on_save_timer, NULL);
+		}
+	}
+	g_free(ft_name);
+}
+
+//######################################################################################################
+// JSON index
+//
+// JSON documents are indexed in background when shown first. The status bar shows the path of the value
+// at the caret, go to path and the matching bracket look up the index instead of scanning the text.
+// Plain edits only shift the offsets of the index, edits touching the structure rescan the container
+// holding them. Only if that fails the index is dropped and rebuilt from a snapshot of the whole
+// document once typing pauses for GGU_JSON_INDEX_DEBOUNCE_MS, a build of an older snapshot is cancelled
+
+#define GGU_JSON_INDEX_DEBOUNCE_MS 500
+#define GGU_JSON_PATH_READ_AHEAD   256 // Bytes behind the caret read for the path, the rest of a key at the caret
+
+typedef struct {
+	GsJsonIndex      *index;        // NULL until built and after structural edits
+	GsJsonIndexBuild *build;        // Running build, NULL if none
+	GArray           *build_edits;  // GsJsonEdit since the build's snapshot, replayed onto its index
+	gint64            rebuild_at;   // Monotonic time to start a new build, 0 if none is due
+	guint             builds;       // Builds finished, only the first one is reported
+	gchar            *pending_path; // Go to path once the index is ready
+} GsJsonDocIndex;
+
+static void json_doc_index_free(GsJsonDocIndex *state) {
+	if (state->build != NULL) {
+		gs_json_index_build_finish(state->build, TRUE);
+	}
+	if (state->index != NULL) {
+		gs_json_index_free(state->index);
+	}
+	g_array_free(state->build_edits, TRUE);
+	g_free(state->pending_path);
+	g_free(state);
+}
+
+// Whether doc is indexed without being asked for. Documents in large file mode count with their original filetype
+static gboolean json_index_wanted(GeanyDocument *doc) {
+	GsLargeFile *large = g_hash_table_lookup(plugin_private.large_files, GUINT_TO_POINTER(doc->id));
+	GeanyFiletype *ft = large != NULL ? large->filetype : doc->file_type;
+	return ft != NULL && ft->id == GEANY_FILETYPES_JSON;
+}
+
+static GsJsonDocIndex* json_doc_index_get(GeanyDocument *doc) {
+	GsJsonDocIndex *state = g_hash_table_lookup(plugin_private.json_indexes, GUINT_TO_POINTER(doc->id));
+	if (state == NULL) {
+		state = g_new0(GsJsonDocIndex, 1);
+		state->build_edits = g_array_new(FALSE, FALSE, sizeof(GsJsonEdit));
+		g_hash_table_insert(plugin_private.json_indexes, GUINT_TO_POINTER(doc->id), state);
+	}
+	return state;
+}
+
+static gboolean on_json_index_timer(gpointer user_data);
+
+static void ui_json_index_timer_start() {
+	if (plugin_private.json_index_timer == 0) {
+		plugin_private.json_index_timer = g_timeout_add(100, on_json_index_timer, NULL);
+	}
+}
+
+// Index a snapshot of doc in background, a running build is cancelled
+static void ui_json_index_build(GeanyDocument *doc, GsJsonDocIndex *state) {
+	ScintillaObject *sci = doc->editor->sci;
+	gsize len = sci_get_length(sci);
+	if (state->build != NULL) {
+		gs_json_index_build_finish(state->build, TRUE);
+	}
+	g_array_set_size(state->build_edits, 0);
+	state->rebuild_at = 0;
+	state->build = gs_json_index_build_start(g_bytes_new(gs_sci_text_range(sci, 0, len), len));
+	ui_json_index_timer_start();
+}
+
+// Drop the index and build a new one once typing pauses
+static void ui_json_index_invalidate(GsJsonDocIndex *state) {
+	if (state->index != NULL) {
+		gs_json_index_free(state->index);
+		state->index = NULL;
+	}
+	if (state->build != NULL) {
+		gs_json_index_build_finish(state->build, TRUE);
+		state->build = NULL;
+	}
+	state->rebuild_at = g_get_monotonic_time() + GGU_JSON_INDEX_DEBOUNCE_MS * 1000;
+	ui_json_index_timer_start();
+}
+
+// Show the path of the value at the caret of the current document in the status bar
+static void ui_json_path_update() {
+	GeanyDocument *doc = document_get_current();
+	GsJsonDocIndex *state = DOC_VALID(doc) ? g_hash_table_lookup(plugin_private.json_indexes, GUINT_TO_POINTER(doc->id)) : NULL;
+	gchar *path = NULL;
+	if (state != NULL && state->index != NULL) {
+		// The text up to the caret is read in place, the gap of the buffer is at the caret while typing and
+		// SCI_GETRANGEPOINTER leaves it there. The rest of a key at the caret is copied (SCI_GETTEXTRANGE)
+		ScintillaObject *sci = doc->editor->sci;
+		gsize pos = sci_get_current_position(sci);
+		gsize ahead_len = MIN(GGU_JSON_PATH_READ_AHEAD, (gsize) sci_get_length(sci) - pos);
+		gchar *ahead = sci_get_contents_range(sci, pos, pos + ahead_len);
+		path = gs_json_index_path(state->index, gs_sci_text_range(sci, 0, pos), pos, ahead, ahead_len, pos);
+		g_free(ahead);
+	}
+	if (path != NULL && plugin_private.json_path_label == NULL) {
+		GtkWidget *statusbar = ui_lookup_widget(geany_data->main_widgets->window, "statusbar");
+		plugin_private.json_path_label = gtk_label_new(NULL);
+		gtk_label_set_ellipsize(GTK_LABEL(plugin_private.json_path_label), PANGO_ELLIPSIZE_START);
+		gtk_label_set_max_width_chars(GTK_LABEL(plugin_private.json_path_label), 60);
+		gtk_label_set_selectable(GTK_LABEL(plugin_private.json_path_label), TRUE);
+		gtk_box_pack_end(GTK_BOX(statusbar), plugin_private.json_path_label, FALSE, FALSE, 6);
+	}
+	if (plugin_private.json_path_label != NULL) {
+		gtk_label_set_text(GTK_LABEL(plugin_private.json_path_label), path != NULL ? path : "");
+		gtk_widget_set_visible(plugin_private.json_path_label, path != NULL);
+	}
+	g_free(path);
+}
+
+static void ui_json_goto_path(GeanyDocument *doc, GsJsonIndex *index, const gchar *path) {
+	ScintillaObject *sci = doc->editor->sci;
+	gsize len = sci_get_length(sci), pos;
+	const gchar *error = NULL;
+	if (gs_json_index_find(index, gs_sci_text_range(sci, 0, len), len, path, &pos, &error)) {
+		editor_goto_pos(doc->editor, pos, TRUE);
+	} else {
+		msgwin_status_add(_("JSON go to path: %s: %s"), path, error);
+		ui_set_statusbar(FALSE, _("JSON go to path: %s"), error);
+	}
+}
+
+// A build finished: Shift it by the edits made meanwhile, a pending go to path jumps now
+static void ui_json_index_take(GeanyDocument *doc, GsJsonDocIndex *state) {
+	GsJsonIndex *index = gs_json_index_build_finish(state->build, FALSE);
+	state->build = NULL;
+	for (guint i = 0; i < state->build_edits->len; i++) {
+		GsJsonEdit *edit = &g_array_index(state->build_edits, GsJsonEdit, i);
+		gs_json_index_add_edit(index, edit->pos, edit->delta);
+	}
+	g_array_set_size(state->build_edits, 0);
+	state->index = index;
+
+	if (state->builds++ == 0) {
+		gchar *filename = document_get_basename_for_display(doc, -1);
+		msgwin_status_add(_("[%s] JSON index: %u containers, %u keys in %.3f s"), filename, index->nodes->len, index->keys->len, index->seconds);
+		free(filename);
+	}
+	if (state->pending_path != NULL) {
+		if (doc == document_get_current()) {
+			ui_json_goto_path(doc, index, state->pending_path);
+		}
+		g_free(state->pending_path);
+		state->pending_path = NULL;
+	}
+	if (doc == document_get_current()) {
+		ui_json_path_update();
+	}
+}
+
+// Take finished builds and start due rebuilds, runs while any is running or due
+static gboolean on_json_index_timer(gpointer user_data) {
+	gboolean again = FALSE;
+	gint64 now = g_get_monotonic_time();
+	GHashTableIter iter;
+	gpointer key, value;
+	g_hash_table_iter_init(&iter, plugin_private.json_indexes);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		GsJsonDocIndex *state = value;
+		GeanyDocument *doc = document_find_by_id(GPOINTER_TO_UINT(key));
+		if (!DOC_VALID(doc)) {
+			continue;
+		}
+		if (state->build != NULL && gs_json_index_build_done(state->build)) {
+			ui_json_index_take(doc, state);
+		}
+		if (state->build == NULL && state->rebuild_at != 0 && now >= state->rebuild_at) {
+			ui_json_index_build(doc, state);
+		}
+		again |= state->build != NULL || state->rebuild_at != 0;
+	}
+	if (again) {
+		return TRUE;
+	}
+	plugin_private.json_index_timer = 0;
+	return FALSE;
+}
+
+static const gchar* on_json_index_read(gsize pos, gsize len, gpointer user_data) {
+	return gs_sci_text_range(user_data, pos, len);
+}
+
+// Text of an indexed document was modified
+static void ui_json_index_edit(GeanyDocument *doc, GsJsonDocIndex *state, SCNotification *nt) {
+	GsJsonEdit edit = { nt->position, (nt->modificationType & SC_MOD_INSERTTEXT) ? nt->length : -nt->length };
+	if (nt->text != NULL && !gs_json_index_edit_is_structural(nt->text, nt->length)) {
+		if (state->index != NULL) {
+			gs_json_index_add_edit(state->index, edit.pos, edit.delta);
+		} else if (state->build != NULL) {
+			g_array_append_val(state->build_edits, edit);
+		}
+	} else if (state->index == NULL || !gs_json_index_update(state->index, edit.pos, edit.delta, on_json_index_read, doc->editor->sci)) {
+		ui_json_index_invalidate(state);
+	}
+}
+
+// Document shown or reformatted: Index it if it is JSON, unless that is done already
+static void ui_json_index_check(GeanyDocument *doc) {
+	if (json_index_wanted(doc) && !g_hash_table_contains(plugin_private.json_indexes, GUINT_TO_POINTER(doc->id))) {
+		ui_json_index_build(doc, json_doc_index_get(doc));
+	}
+	ui_json_path_update();
+}
+
+// JSON go to path: Ask for a path like $.items[12].id, the path at the caret is preset. Without an index
+// yet, one is built and the jump follows once it is ready
+static void exec_json_goto_path() {
+	GeanyDocument *doc = document_get_current();
+	if (!DOC_VALID(doc)) {
+		return;
+	}
+	GsJsonDocIndex *state = json_doc_index_get(doc);
+	if (state->index == NULL && state->build == NULL) {
+		ui_json_index_build(doc, state); // Runs while the dialog is open
+	}
+
+	GtkWidget *dialog = gtk_dialog_new_with_buttons(_("JSON go to path"), GTK_WINDOW(geany->main_widgets->window), GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, _("_Cancel"), GTK_RESPONSE_CANCEL, _("_Go to"), GTK_RESPONSE_ACCEPT, NULL);
+	GtkWidget *vbox = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+	GtkWidget *entry = gtk_entry_new();
+	if (plugin_private.json_path_label != NULL && gtk_widget_get_visible(plugin_private.json_path_label)) {
+		gtk_entry_set_text(GTK_ENTRY(entry), gtk_label_get_text(GTK_LABEL(plugin_private.json_path_label)));
+	} else {
+		gtk_entry_set_text(GTK_ENTRY(entry), "$");
+	}
+	gtk_entry_set_placeholder_text(GTK_ENTRY(entry), "$.items[12].id");
+	gtk_entry_set_activates_default(GTK_ENTRY(entry), TRUE);
+	gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT);
+	gtk_box_pack_start(GTK_BOX(vbox), entry, FALSE, FALSE, 6);
+	gtk_window_set_default_size(GTK_WINDOW(dialog), 400, -1);
+	gtk_widget_show_all(dialog);
+
+	gchar *path = NULL;
+	if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT && *gtk_entry_get_text(GTK_ENTRY(entry)) != '\0') {
+		path = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(entry))));
+	}
+	gtk_widget_destroy(dialog);
+	if (path == NULL || !DOC_VALID(doc) || (state = g_hash_table_lookup(plugin_private.json_indexes, GUINT_TO_POINTER(doc->id))) == NULL) {
+		g_free(path);
+	} else if (state->index != NULL) {
+		ui_json_goto_path(doc, state->index, path);
+		g_free(path);
+	} else {
+		g_free(state->pending_path);
+		state->pending_path = path;
+		msgwin_status_add(_("JSON go to path: Indexing, jumping to %s once done"), path);
+	}
+}
+
+// JSON matching bracket: Jump to the bracket matching the one at (or before) the caret
+static void exec_json_match_bracket() {
+	GeanyDocument *doc = document_get_current();
+	if (!DOC_VALID(doc)) {
+		return;
+	}
+	GsJsonDocIndex *state = json_doc_index_get(doc);
+	if (state->index == NULL) {
+		if (state->build == NULL) {
+			ui_json_index_build(doc, state);
+		}
+		ui_set_statusbar(FALSE, _("JSON matching bracket: Indexing, try again in a moment"));
+		return;
+	}
+	gsize pos = sci_get_current_position(doc->editor->sci), match;
+	if (gs_json_index_match(state->index, pos, &match) || (pos > 0 && gs_json_index_match(state->index, pos - 1, &match))) {
+		editor_goto_pos(doc->editor, match, FALSE);
+	} else {
+		ui_set_statusbar(FALSE, _("JSON matching bracket: No bracket at the caret"));
+	}
+}
+
+//######################################################################################################
+// XML query
+//
+// Runs an XPath subset query over the current XML/HTML document in the main loop, GGU_XML_QUERY_SLICE
+// bytes per idle call, reading the document in place: no copy and no tree, so memory stays bounded for
+// documents of several GB. The document is read-only meanwhile. Matches are listed in the message
+// window as they are found (click to jump) or collected into a new document
+
+#define GGU_XML_QUERY_SLICE       (4 * 1024 * 1024)
+#define GGU_XML_QUERY_SNIPPET_MAX 200
+
+static void ui_xml_query_stop() {
+	if (plugin_private.xml_query_idle != 0) {
+		g_source_remove(plugin_private.xml_query_idle);
+		plugin_private.xml_query_idle = 0;
+	}
+	if (plugin_private.xml_query_dialog != NULL) {
+		gtk_widget_destroy(plugin_private.xml_query_dialog);
+		plugin_private.xml_query_dialog = NULL;
+		plugin_private.xml_query_progressbar = NULL;
+	}
+	if (plugin_private.xml_query_run != NULL) {
+		GeanyDocument *doc = document_find_by_id(plugin_private.xml_query_doc_id);
+		if (DOC_VALID(doc)) {
+			scintilla_send_message(doc->editor->sci, SCI_SETREADONLY, doc->readonly, 0);
+		}
+		gs_xpath_run_free(plugin_private.xml_query_run);
+		gs_xpath_free(plugin_private.xml_query);
+		plugin_private.xml_query_run = NULL;
+		plugin_private.xml_query = NULL;
+	}
+	if (plugin_private.xml_query_extract != NULL) {
+		g_string_free(plugin_private.xml_query_extract, TRUE);
+		plugin_private.xml_query_extract = NULL;
+	}
+}
+
+static void on_xml_query_dialog_response(GtkDialog *dialog, gint response, gpointer user_data) {
+	plugin_private.xml_query_cancelled = TRUE;
+}
+
+// First line of a match for the message window, at most GGU_XML_QUERY_SNIPPET_MAX bytes of valid UTF-8
+static gchar* xml_query_snippet(const gchar *text, gsize len) {
+	const gchar *line_end = memchr(text, '\n', MIN(len, GGU_XML_QUERY_SNIPPET_MAX)), *valid_end;
+	g_utf8_validate(text, line_end != NULL ? (gsize)(line_end - text) : MIN(len, GGU_XML_QUERY_SNIPPET_MAX), &valid_end);
+	return g_strdup_printf("%.*s%s", (gint)(valid_end - text), text, valid_end < text + len ? "…" : "");
+}
+
+// Query finished or cancelled: Summary, extracted matches go to a new document
+static void ui_xml_query_done(GeanyDocument *doc, gsize len, const gchar *reason) {
+	GsXpathRun *run = plugin_private.xml_query_run;
+	gdouble seconds = MAX(1, g_get_monotonic_time() - plugin_private.xml_query_start) / (gdouble) G_USEC_PER_SEC;
+	msgwin_msg_add(COLOR_BLUE, -1, NULL, _("XML query: %u matches for %s, %.1f MB in %.2f s (%.0f MB/s)%s"), plugin_private.xml_query_count,
+		plugin_private.xml_query_text, run->pos / 1e6, seconds, run->pos / 1e6 / seconds, reason);
+	if (run->errors > 0) {
+		gint line = sci_get_line_from_position(doc->editor->sci, run->error_pos) + 1;
+		msgwin_msg_add(COLOR_DARK_RED, line, doc, _("XML query: %u malformed tags read as text, the first one at line %d"), run->errors, line);
+	}
+	if (plugin_private.xml_query_extract == NULL && plugin_private.xml_query_shown < plugin_private.xml_query_count) {
+		msgwin_msg_add(COLOR_BLUE, -1, NULL, _("XML query: Only the first %u matches are listed"), plugin_private.xml_query_shown);
+	}
+	ui_set_statusbar(FALSE, _("XML query: %u matches"), plugin_private.xml_query_count);
+	telemetry_add("xml_query", doc, len, plugin_private.xml_query_start);
+
+	// Elements are extracted as a document of the same kind, text and attribute values one per line
+	GString *extract = plugin_private.xml_query_extract;
+	GeanyFiletype *ft = run->xpath->select == GS_XPATH_ELEMENT ? filetypes_detect_from_file(run->html ? "f.html" : "f.xml") : NULL;
+	plugin_private.xml_query_extract = NULL;
+	ui_xml_query_stop();
+	if (extract != NULL) {
+		document_new_file(NULL, ft, extract->str);
+		g_string_free(extract, TRUE);
+	}
+}
 
-	// Lists
-	GList                menuitem_list;            // dynamic allocated items that must be free'd
-	GeanyKeyGroup       *keybinding_group;         // Key bindings
+// Evaluate the next slice of the document. A progress dialog with live count and cancel option shows up for
+// queries which take longer than a moment
+static gboolean on_xml_query_idle(gpointer user_data) {
+	GsXpathRun *run = plugin_private.xml_query_run;
+	GeanyDocument *doc = document_find_by_id(plugin_private.xml_query_doc_id);
+	if (!DOC_VALID(doc)) {
+		plugin_private.xml_query_idle = 0;
+		ui_xml_query_stop();
+		return FALSE;
+	}
+	ScintillaObject *sci = doc->editor->sci;
+	gsize len = sci_get_length(sci);
+	if (doc_version(doc) != plugin_private.xml_query_version || plugin_private.xml_query_cancelled) {
+		plugin_private.xml_query_idle = 0;
+		ui_xml_query_done(doc, len, plugin_private.xml_query_cancelled ? _(" (cancelled)") : _(" (document changed, stopped)"));
+		return FALSE;
+	}
 
-	gboolean             current_doc_is_new;
-} plugin_private;
+	// Offsets of the run stay valid, the pointer is taken again as the buffer may have moved since the last slice
+	const gchar *text = gs_sci_text_range(sci, 0, len);
+	GArray *matches = g_array_new(FALSE, FALSE, sizeof(GsXpathMatch));
+	gboolean more = gs_xpath_run_step(run, text, len, GGU_XML_QUERY_SLICE, matches);
+	gchar *filename = document_get_basename_for_display(doc, -1);
+	for (guint i = 0; i < matches->len; i++) {
+		GsXpathMatch *match = &g_array_index(matches, GsXpathMatch, i);
+		if (plugin_private.xml_query_extract != NULL) {
+			g_string_append_len(plugin_private.xml_query_extract, text + match->start, match->end - match->start);
+			g_string_append_c(plugin_private.xml_query_extract, '\n');
+		} else if (plugin_private.xml_query_shown < GGU_SEARCH_SHOW_MAX) {
+			gint line = sci_get_line_from_position(sci, match->start) + 1;
+			gchar *snippet = xml_query_snippet(text + match->start, match->end - match->start);
+			msgwin_msg_add(COLOR_BLACK, line, doc, "%s:%d: %s", filename, line, snippet);
+			g_free(snippet);
+			plugin_private.xml_query_shown++;
+		}
+	}
+	plugin_private.xml_query_count += matches->len;
+	g_array_free(matches, TRUE);
+	free(filename);
+	if (!more) {
+		plugin_private.xml_query_idle = 0;
+		ui_xml_query_done(doc, len, "");
+		return FALSE;
+	}
 
-//######################################################################################################
+	gdouble seconds = (g_get_monotonic_time() - plugin_private.xml_query_start) / (gdouble) G_USEC_PER_SEC;
+	if (plugin_private.xml_query_dialog == NULL && seconds > 0.3) {
+		plugin_private.xml_query_dialog = gtk_dialog_new_with_buttons(_("XML query"), GTK_WINDOW(geany->main_widgets->window), GTK_DIALOG_DESTROY_WITH_PARENT, _("_Cancel"), GTK_RESPONSE_CANCEL, NULL);
+		GtkWidget *vbox = gtk_dialog_get_content_area(GTK_DIALOG(plugin_private.xml_query_dialog));
+		GtkWidget *label = gtk_label_new(plugin_private.xml_query_text);
+		plugin_private.xml_query_progressbar = gtk_progress_bar_new();
+		gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(plugin_private.xml_query_progressbar), TRUE);
+		gtk_box_pack_start(GTK_BOX(vbox), label, FALSE, FALSE, 6);
+		gtk_box_pack_start(GTK_BOX(vbox), plugin_private.xml_query_progressbar, FALSE, FALSE, 6);
+		gtk_window_set_default_size(GTK_WINDOW(plugin_private.xml_query_dialog), 400, -1);
+		g_signal_connect(plugin_private.xml_query_dialog, "response", G_CALLBACK(on_xml_query_dialog_response), NULL);
+		g_signal_connect(plugin_private.xml_query_dialog, "delete-event", G_CALLBACK(gtk_true), NULL); // Closed when the query is done
+		gtk_widget_show_all(plugin_private.xml_query_dialog);
+	}
+	if (plugin_private.xml_query_dialog != NULL) {
+		gchar *progress = g_strdup_printf(_("%u matches, %.1f s"), plugin_private.xml_query_count, seconds);
+		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(plugin_private.xml_query_progressbar), run->pos / (gdouble) MAX(len, 1));
+		gtk_progress_bar_set_text(GTK_PROGRESS_BAR(plugin_private.xml_query_progressbar), progress);
+		g_free(progress);
+	}
+	return TRUE;
+}
 
-static void debug_doc_info_to_msgwin(GeanyDocument *doc, const char *eventname) {
-	if (!DEBUG_DOCOPEN_MSGWIN || doc == NULL) {
+// Ask for the query and whether to extract the matches, the last query is preset. Returns NULL if cancelled
+static gchar* ui_xml_query_dialog() {
+	GtkWidget *dialog = gtk_dialog_new_with_buttons(_("XML/HTML query (XPath)"), GTK_WINDOW(geany->main_widgets->window), GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, _("_Cancel"), GTK_RESPONSE_CANCEL, _("_Run"), GTK_RESPONSE_ACCEPT, NULL);
+	GtkWidget *vbox = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+	GtkWidget *entry = gtk_entry_new();
+	GtkWidget *hint = gtk_label_new(_("/a/b, //b, *, [@attr], [@attr='value'], [@attr!='value'], ending in /text(), //text() or /@attr"));
+	GtkWidget *check_extract = gtk_check_button_new_with_label(_("Extract matches into a new document"));
+	gtk_entry_set_text(GTK_ENTRY(entry), plugin_private.xml_query_text != NULL ? plugin_private.xml_query_text : "//");
+	gtk_entry_set_placeholder_text(GTK_ENTRY(entry), "//item[@type='book']/title/text()");
+	gtk_entry_set_activates_default(GTK_ENTRY(entry), TRUE);
+	gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT);
+	gtk_label_set_line_wrap(GTK_LABEL(hint), TRUE);
+	gtk_widget_set_sensitive(hint, FALSE);
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_extract), plugin_private.xml_query_extract_last);
+
+	gtk_box_pack_start(GTK_BOX(vbox), entry, FALSE, FALSE, 6);
+	gtk_box_pack_start(GTK_BOX(vbox), hint, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(vbox), check_extract, FALSE, FALSE, 6);
+	gtk_window_set_default_size(GTK_WINDOW(dialog), 400, -1);
+	gtk_widget_show_all(dialog);
+
+	gchar *query = NULL;
+	if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT && *gtk_entry_get_text(GTK_ENTRY(entry)) != '\0') {
+		query = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(entry))));
+		plugin_private.xml_query_extract_last = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(check_extract));
+	}
+	gtk_widget_destroy(dialog);
+	return query;
+}
+
+// XML query: Evaluate an XPath subset on the current document, matches stream into the message window or a new document
+static void exec_xml_query() {
+	GeanyDocument *doc = document_get_current();
+	if (!DOC_VALID(doc)) {
 		return;
 	}
-	const char *ft_ext = (doc->file_type != NULL && doc->file_type->extension != NULL) ? doc->file_type->extension : "NULL";
-	msgwin_status_add ("[DEBUG/debug_doc_info_to_msgwin]: %s ft_ext >%s<, new?%d, filename >%s<)", eventname, ft_ext, plugin_private.current_doc_is_new ? 1 : 0 ,(doc->file_name != NULL ? doc->file_name : "NULL"));
+	if (plugin_private.pipe_job != NULL && plugin_private.pipe_doc_id == doc->id) {
+		msgwin_status_add(_("XML query: A pipe command is still running on this document"));
+		return;
+	}
+	gchar *query = ui_xml_query_dialog();
+	if (query == NULL) { // canceled
+		return;
+	}
+	ui_xml_query_stop(); // Replaces a running query
+	SETPTR(plugin_private.xml_query_text, query);
+
+	const gchar *error;
+	GsXpath *xpath = gs_xpath_compile(query, &error);
+	if (xpath == NULL) {
+		msgwin_status_add(_("XML query: %s: %s"), query, error);
+		ui_set_statusbar(FALSE, _("XML query: %s"), error);
+		return;
+	}
+	ScintillaObject *sci = doc->editor->sci;
+	gsize len = sci_get_length(sci);
+	GsLargeFile *large = g_hash_table_lookup(plugin_private.large_files, GUINT_TO_POINTER(doc->id));
+	GeanyFiletype *ft = large != NULL ? large->filetype : doc->file_type;
+	gboolean html = (ft != NULL && ft->id == GEANY_FILETYPES_HTML) || gs_xml_looks_like_html(gs_sci_text_range(sci, 0, MIN(len, 1024)), MIN(len, 1024));
+
+	plugin_private.xml_query = xpath;
+	plugin_private.xml_query_run = gs_xpath_run_new(xpath, html);
+	plugin_private.xml_query_doc_id = doc->id;
+	plugin_private.xml_query_version = doc_version(doc);
+	plugin_private.xml_query_extract = plugin_private.xml_query_extract_last ? g_string_new(NULL) : NULL;
+	plugin_private.xml_query_count = plugin_private.xml_query_shown = 0;
+	plugin_private.xml_query_cancelled = FALSE;
+	plugin_private.xml_query_start = g_get_monotonic_time();
+	scintilla_send_message(sci, SCI_SETREADONLY, TRUE, 0);
+
+	msgwin_clear_tab(MSG_MESSAGE);
+	msgwin_switch_tab(MSG_MESSAGE, TRUE);
+	msgwin_msg_add(COLOR_BLUE, -1, NULL, _("XML query: %s (%s)…"), query, html ? "HTML" : "XML");
+	plugin_private.xml_query_idle = g_idle_add(on_xml_query_idle, NULL);
 }
 
-// Frees input string
-static gchar* gs_glib_strreplace(gchar *text, const gchar *search, const gchar *replace, gboolean free_input) {
-	char **split = g_strsplit(text, search, -1);
-	if (free_input) {
-		g_free(text);
+//######################################################################################################
+// Diff
+//
+// Compares the current document with its saved file or another open document in background. Changed
+// lines get indicators (added green, changed orange, removed lines of the other document red, a red
+// underline where lines were deleted) and the hunks are listed in the message window (click to jump)
+
+#define GGU_DIFF_INDICATOR_ADDED   16
+#define GGU_DIFF_INDICATOR_CHANGED 17
+#define GGU_DIFF_INDICATOR_REMOVED 18
+#define GGU_DIFF_INDICATOR_DELETED 19
+#define GGU_DIFF_SNIPPET_MAX       120
+
+static const struct {
+	gint indicator, style, color; // color is BGR
+} GGU_DIFF_INDICATORS[] = {
+	{ GGU_DIFF_INDICATOR_ADDED,   INDIC_STRAIGHTBOX,       0x00B000 },
+	{ GGU_DIFF_INDICATOR_CHANGED, INDIC_STRAIGHTBOX,       0x0090FF },
+	{ GGU_DIFF_INDICATOR_REMOVED, INDIC_STRAIGHTBOX,       0x0000E0 },
+	{ GGU_DIFF_INDICATOR_DELETED, INDIC_COMPOSITIONTHICK,  0x0000E0 },
+};
+
+static void ui_diff_clear(ScintillaObject *sci) {
+	gint len = sci_get_length(sci);
+	for (guint i = 0; i < G_N_ELEMENTS(GGU_DIFF_INDICATORS); i++) {
+		scintilla_send_message(sci, SCI_SETINDICATORCURRENT, GGU_DIFF_INDICATORS[i].indicator, 0);
+		scintilla_send_message(sci, SCI_INDICATORCLEARRANGE, 0, len);
 	}
-	text = g_strjoinv(replace, split);
-	g_strfreev(split);
-	return text;
 }
 
-// Get filepath to random file/directory in temporary directory
-static char* gs_glib_tmp_filepath(const char* prefix, const char* postfix) {
-	gchar *uuid = g_uuid_string_random();
-	GString *filename = g_string_new(prefix);
-	g_string_append(filename, uuid);
-	g_string_append(filename, postfix);
-	gchar *fn = g_string_free(filename, FALSE);
-	gchar *out = g_build_filename(g_get_tmp_dir(), fn, NULL);
-	free(uuid);
-	free(fn);
+static void ui_diff_setup(ScintillaObject *sci) {
+	for (guint i = 0; i < G_N_ELEMENTS(GGU_DIFF_INDICATORS); i++) {
+		gint indicator = GGU_DIFF_INDICATORS[i].indicator;
+		scintilla_send_message(sci, SCI_INDICSETSTYLE, indicator, GGU_DIFF_INDICATORS[i].style);
+		scintilla_send_message(sci, SCI_INDICSETFORE, indicator, GGU_DIFF_INDICATORS[i].color);
+		scintilla_send_message(sci, SCI_INDICSETALPHA, indicator, 50);
+		scintilla_send_message(sci, SCI_INDICSETUNDER, indicator, TRUE);
+	}
+	ui_diff_clear(sci);
+}
 
-	return out;
+// Mark lines [line_start, line_end) with indicator
+static void ui_diff_mark(ScintillaObject *sci, gint indicator, guint line_start, guint line_end) {
+	gint lines = sci_get_line_count(sci);
+	gint start = sci_get_position_from_line(sci, MIN((gint) line_start, lines - 1));
+	gint end = (gint) line_end < lines ? sci_get_position_from_line(sci, line_end) : sci_get_length(sci);
+	if (end > start) {
+		scintilla_send_message(sci, SCI_SETINDICATORCURRENT, indicator, 0);
+		scintilla_send_message(sci, SCI_INDICATORFILLRANGE, start, end - start);
+	}
 }
 
-static gchar *geany_conf_filepath() {
-	return g_build_filename(geany_data->app->configdir, "geany.conf", NULL);
+// Start of the next range of indicator behind pos, -1 if none. pos -1 includes a range starting at 0
+static gint ui_diff_next_mark(ScintillaObject *sci, gint indicator, gint pos) {
+	gint len = sci_get_length(sci);
+	if (pos < 0) {
+		if (len > 0 && scintilla_send_message(sci, SCI_INDICATORVALUEAT, indicator, 0) != 0) {
+			return 0;
+		}
+		pos = 0;
+	} else if (scintilla_send_message(sci, SCI_INDICATORVALUEAT, indicator, pos) != 0) {
+		pos = scintilla_send_message(sci, SCI_INDICATOREND, indicator, pos);
+	}
+	gint start = pos < len ? scintilla_send_message(sci, SCI_INDICATOREND, indicator, pos) : len;
+	return start > pos && start < len ? start : -1;
 }
 
-// Get settings object for standard geany.conf file
-static GKeyFile* geany_conf_load() {
-#pragma GCC diagnostic ignored "-Wunused-result"
-	gchar *configfile = geany_conf_filepath();
-	GKeyFile *config = g_key_file_new();
+// Line of text as message window snippet
+static gchar* ui_diff_snippet(const gchar *line, gsize len) {
+	gsize end = 0;
+	while (end < len && end < GGU_DIFF_SNIPPET_MAX && line[end] != '\n' && line[end] != '\r') {
+		end++;
+	}
+	while (end > 0 && end < len && ((guchar) line[end] & 0xC0) == 0x80) { // Don't cut UTF-8 sequences
+		end--;
+	}
+	return g_strndup(line, end);
+}
 
-	if (! g_file_test(configfile, G_FILE_TEST_IS_REGULAR)) {
-		SETPTR(configfile, g_build_filename(geany_data->app->datadir, "geany.conf", NULL));
+static void ui_diff_stop() {
+	if (plugin_private.diff_timer != 0) {
+		g_source_remove(plugin_private.diff_timer);
+		plugin_private.diff_timer = 0;
+	}
+	if (plugin_private.diff_job != NULL) {
+		gs_diff_job_finish(plugin_private.diff_job, TRUE, NULL, NULL);
+		plugin_private.diff_job = NULL;
 	}
-	g_key_file_load_from_file(config, configfile, G_KEY_FILE_NONE, NULL);
-	g_free(configfile);
-	return config;
 }
 
-//######################################################################################################
+// Mark and list the hunks. old_text is the old side, its lines are read for deleted lines in the list
+static void ui_diff_show(GeanyDocument *doc, GeanyDocument *other, GArray *hunks, GBytes *old_text) {
+	ScintillaObject *sci = doc->editor->sci;
+	gsize old_len;
+	const gchar *old = g_bytes_get_data(old_text, &old_len), *old_line = old, *old_end = old + old_len;
+	guint old_line_number = 0, added = 0, removed = 0;
+	ui_diff_setup(sci);
+	if (other != NULL) {
+		ui_diff_setup(other->editor->sci);
+	}
 
+	for (guint i = 0; i < hunks->len; i++) {
+		GsDiffLines *hunk = &g_array_index(hunks, GsDiffLines, i);
+		guint old_count = hunk->old_end - hunk->old_start, new_count = hunk->new_end - hunk->new_start;
+		added += new_count;
+		removed += old_count;
+		if (old_count == 0) {
+			ui_diff_mark(sci, GGU_DIFF_INDICATOR_ADDED, hunk->new_start, hunk->new_end);
+		} else if (new_count == 0) {
+			// Underline the line above the deleted ones, the first line for deletions at the start
+			gint line = MAX((gint) hunk->new_start - 1, 0);
+			ui_diff_mark(sci, GGU_DIFF_INDICATOR_DELETED, line, line + 1);
+		} else {
+			ui_diff_mark(sci, GGU_DIFF_INDICATOR_CHANGED, hunk->new_start, hunk->new_end);
+		}
+		if (other != NULL && old_count > 0) {
+			ui_diff_mark(other->editor->sci, GGU_DIFF_INDICATOR_REMOVED, hunk->old_start, hunk->old_end);
+		}
 
-// Use json_reformat executable to reformat JSON
-// Write text of current open file to temporary file, json_reformat and capture output
-static void exec_json_pretty() {
-	GeanyDocument	*doc;
-	ScintillaObject	*sci;
-	if((doc = document_get_current()) == NULL || (sci = doc->editor->sci) == NULL) {
-		return;
+		if (i < GGU_SEARCH_SHOW_MAX) {
+			gchar *snippet;
+			if (new_count > 0) {
+				gint start = sci_get_position_from_line(sci, hunk->new_start);
+				gint len = MIN(sci_get_line_end_position(sci, hunk->new_start) - start, GGU_DIFF_SNIPPET_MAX * 4);
+				snippet = ui_diff_snippet(gs_sci_text_range(sci, start, len), len);
+			} else {
+				for (; old_line_number < hunk->old_start && old_line < old_end; old_line_number++) {
+					const gchar *nl = memchr(old_line, '\n', old_end - old_line);
+					old_line = nl != NULL ? nl + 1 : old_end;
+				}
+				snippet = ui_diff_snippet(old_line, old_end - old_line);
+			}
+			msgwin_msg_add(COLOR_BLACK, hunk->new_start + 1, doc, "@@ -%u,%u +%u,%u @@ %s%s", hunk->old_start + 1, old_count,
+				hunk->new_start + 1, new_count, new_count > 0 ? "" : "-", snippet);
+			g_free(snippet);
+		}
+	}
+	if (hunks->len > GGU_SEARCH_SHOW_MAX) {
+		msgwin_msg_add(COLOR_BLUE, -1, NULL, _("Diff: Only the first %u changes are listed"), GGU_SEARCH_SHOW_MAX);
 	}
 
-	// Current content
-	gchar *text = sci_get_contents(sci, -1);
+	gdouble seconds = (g_get_monotonic_time() - plugin_private.diff_start) / (gdouble) G_USEC_PER_SEC;
 	gchar *filename = document_get_basename_for_display(doc, -1);
+	gchar *other_name = other != NULL ? document_get_basename_for_display(other, -1) : g_strdup(_("saved file"));
+	msgwin_msg_add(COLOR_BLUE, -1, NULL, _("Diff: %s → %s: %u changes, +%u -%u lines in %.2f s"), other_name, filename, hunks->len, added, removed, seconds);
+	ui_set_statusbar(FALSE, hunks->len > 0 ? _("Diff: %u changes, +%u -%u lines") : _("Diff: No differences"), hunks->len, added, removed);
+	g_free(other_name);
+	g_free(filename);
+}
 
-	// Determine first [/{ and last ]/}, trim leading/trailing text (like logging prefixes)
-	gchar *text_reverse = g_utf8_strreverse(text, -1);
-	size_t offset_begin = MAX(0, MIN(strcspn(text, "["), strcspn(text, "{")));
-	size_t offset_end   = strlen(text) - MAX(0, MIN(strcspn(text_reverse, "]"), strcspn(text_reverse, "}")));
-	free(text_reverse); text_reverse = NULL;
-	msgwin_status_add("JSON Pretty: offset_begin=%zd, offset_end=%zd, strlen=%zd", offset_begin, offset_end, strlen(text));
-
-	// Prepare & Run cmd
-	gchar *tmp_infile  = gs_glib_tmp_filepath(".", ".json");
-	gchar *tmp_outfile = gs_glib_tmp_filepath(".", ".json");
-	GString *syscmd_gstring = g_string_new("/bin/cat '");
-	g_string_append(syscmd_gstring, tmp_infile);
-	g_string_append(syscmd_gstring, "' | python3 -m json.tool --indent=2 > '");
-	g_string_append(syscmd_gstring, tmp_outfile);
-	g_string_append(syscmd_gstring, "'");
-	char *syscmd = g_string_free(syscmd_gstring, FALSE);
-	g_file_set_contents(tmp_infile, text+offset_begin, offset_end-offset_begin, NULL);
-	int exitc = system(syscmd);
-	gsize length;
-	g_free(text);
-	g_file_get_contents(tmp_outfile, &text, &length, NULL);
-	unlink(tmp_infile);  free(tmp_infile);  tmp_infile = NULL;
-	unlink(tmp_outfile); free(tmp_outfile); tmp_outfile = NULL;
-	g_free(syscmd); syscmd=NULL;
-
-	// Evaluate result
-	if (exitc == 0) {
-		// Set reformatted text to UI
-		sci_start_undo_action(sci);
-		sci_set_text(sci, text);
-		sci_end_undo_action(sci);
-		sci_set_current_position(sci, 0, TRUE);
-	} else if (exitc > 256) {
-		msgwin_switch_tab(MSG_MESSAGE, 1);
-		msgwin_msg_add(COLOR_RED, -1, doc, _("[%s] JSON pretty error - python3 is not installed."), filename);
+static gboolean on_diff_timer(gpointer user_data) {
+	if (!gs_diff_job_done(plugin_private.diff_job)) {
+		return TRUE;
+	}
+	plugin_private.diff_timer = 0;
+	GBytes *old_text;
+	gchar *error;
+	GArray *hunks = gs_diff_job_finish(plugin_private.diff_job, FALSE, &old_text, &error);
+	plugin_private.diff_job = NULL;
+
+	GeanyDocument *doc = document_find_by_id(plugin_private.diff_doc_id);
+	GeanyDocument *other = plugin_private.diff_other_id != 0 ? document_find_by_id(plugin_private.diff_other_id) : NULL;
+	if (hunks == NULL) {
+		msgwin_status_add(_("Diff: Can't read the saved file: %s"), error);
+		ui_set_statusbar(FALSE, _("Diff: Can't read the saved file"));
+	} else if (!DOC_VALID(doc) || (plugin_private.diff_other_id != 0 && !DOC_VALID(other))) {
+		ui_set_statusbar(FALSE, _("Diff: Document closed"));
+	} else if (doc_version(doc) != plugin_private.diff_version || (other != NULL && doc_version(other) != plugin_private.diff_other_version)) {
+		ui_set_statusbar(FALSE, _("Diff: Document changed meanwhile, run it again"));
 	} else {
-		msgwin_switch_tab(MSG_MESSAGE, 1);
-		msgwin_msg_add(COLOR_RED, -1, doc, _("[%s] JSON pretty error - exit code %d. The content seems not to be valid JSON."), filename, exitc);
+		ui_diff_show(doc, other, hunks, old_text);
+		telemetry_add("diff", doc, sci_get_length(doc->editor->sci), plugin_private.diff_start);
 	}
+	if (hunks != NULL) {
+		g_array_free(hunks, TRUE);
+		g_bytes_unref(old_text);
+	}
+	g_free(error);
+	return FALSE;
+}
 
-	GeanyFiletype *ft;
-	if ((ft = filetypes_detect_from_file("f.json")) != NULL) {
-		document_set_filetype(doc, ft);
+// Ask what to compare the document with. Returns FALSE if cancelled, else *other_id is the document id,
+// 0 for the saved file, G_MAXUINT to clear the marks
+static gboolean ui_diff_dialog(GeanyDocument *doc, guint *other_id) {
+	GtkWidget *dialog = gtk_dialog_new_with_buttons(_("Diff"), GTK_WINDOW(geany->main_widgets->window), GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, _("_Cancel"), GTK_RESPONSE_CANCEL, _("_Compare"), GTK_RESPONSE_ACCEPT, NULL);
+	GtkWidget *vbox = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+	GtkWidget *combo = gtk_combo_box_text_new();
+	GArray *ids = g_array_new(FALSE, FALSE, sizeof(guint));
+	guint id, i;
+
+	if (doc->real_path != NULL) {
+		id = 0;
+		g_array_append_val(ids, id);
+		gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), _("Saved file on disk"));
+	}
+	foreach_document(i) {
+		GeanyDocument *other = documents[i];
+		if (other != doc) {
+			gchar *filename = document_get_basename_for_display(other, -1);
+			g_array_append_val(ids, other->id);
+			gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), filename);
+			g_free(filename);
+		}
+	}
+	id = G_MAXUINT;
+	g_array_append_val(ids, id);
+	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), _("Clear diff marks"));
+	for (i = 0; i < ids->len; i++) { // Preselect the last choice
+		if (g_array_index(ids, guint, i) == plugin_private.diff_other_id) {
+			gtk_combo_box_set_active(GTK_COMBO_BOX(combo), i);
+		}
+	}
+	if (gtk_combo_box_get_active(GTK_COMBO_BOX(combo)) < 0) {
+		gtk_combo_box_set_active(GTK_COMBO_BOX(combo), 0);
 	}
 
-	// Free resources
-	free(filename);
-	free(text);
-}
+	gtk_box_pack_start(GTK_BOX(vbox), gtk_label_new(_("Compare the current document with:")), FALSE, FALSE, 6);
+	gtk_box_pack_start(GTK_BOX(vbox), combo, FALSE, FALSE, 6);
+	gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT);
+	gtk_window_set_default_size(GTK_WINDOW(dialog), 400, -1);
+	gtk_widget_show_all(dialog);
 
+	gboolean accepted = gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT;
+	if (accepted) {
+		*other_id = g_array_index(ids, guint, gtk_combo_box_get_active(GTK_COMBO_BOX(combo)));
+	}
+	g_array_free(ids, TRUE);
+	gtk_widget_destroy(dialog);
+	return accepted;
+}
 
-// Use tidy executable to reformat XML / HTML
-// Write text of current open file to temporary file, tidy and capture output
-static void exec_xml_pretty() {
-	GeanyDocument	*doc;
-	ScintillaObject	*sci;
-	if((doc = document_get_current()) == NULL || (sci = doc->editor->sci) == NULL) {
+// Diff: Compare the current document with its saved file or another open document
+static void exec_diff() {
+	GeanyDocument *doc = document_get_current();
+	guint other_id;
+	if (!DOC_VALID(doc) || !ui_diff_dialog(doc, &other_id)) {
 		return;
 	}
+	ui_diff_stop(); // Replaces a running diff
 
-	// Current content
-	gchar *text = sci_get_contents(sci, -1);
-	gchar *filename = document_get_basename_for_display(doc, -1);
-
-	// Determine first < and last >
-	gchar *text_reverse = g_utf8_strreverse(text, -1);
-	size_t offset_begin = MAX(0, strcspn(text, "<"));
-	size_t offset_end   = strlen(text) - MAX(0, strcspn(text_reverse, ">"));
-	free(text_reverse); text_reverse = NULL;
-	msgwin_status_add("XML Pretty: offset_begin=%zd, offset_end=%zd, strlen=%zd", offset_begin, offset_end, strlen(text));
-
-	// Prepare & Run cmd
-	gchar *tmp_infile  = gs_glib_tmp_filepath(".", ".xml");
-	gchar *tmp_outfile = gs_glib_tmp_filepath(".", ".xml");
-	GString *syscmd_gstring = g_string_new("/bin/cat '");
-	g_string_append(syscmd_gstring, tmp_infile);
-	g_string_append(syscmd_gstring, "' | tidy -q -xml -w 105 --indent auto --indent-spaces 2 --indent-attributes y --quiet yes > '");
-	g_string_append(syscmd_gstring, tmp_outfile);
-	g_string_append(syscmd_gstring, "'");
-	char *syscmd = g_string_free(syscmd_gstring, FALSE);
-	g_file_set_contents(tmp_infile, text+offset_begin, offset_end-offset_begin, NULL);
-	int exitc = system(syscmd);
-	gsize length;
-	g_free(text);
-	g_file_get_contents(tmp_outfile, &text, &length, NULL);
-	unlink(tmp_infile);  free(tmp_infile);  tmp_infile = NULL;
-	unlink(tmp_outfile); free(tmp_outfile); tmp_outfile = NULL;
-	g_free(syscmd); syscmd=NULL;
+	GeanyDocument *other = other_id != 0 && other_id != G_MAXUINT ? document_find_by_id(other_id) : NULL;
+	if (other_id == G_MAXUINT) {
+		guint i;
+		foreach_document(i) {
+			ui_diff_clear(documents[i]->editor->sci);
+		}
+		ui_set_statusbar(FALSE, _("Diff: Marks cleared"));
+		return;
+	} else if (other_id != 0 && !DOC_VALID(other)) {
+		return;
+	}
 
-	// Evaluate result
-	if (exitc == 0) {
-		// Set reformatted text to UI
-		sci_start_undo_action(sci);
-		sci_set_text(sci, text);
-		sci_end_undo_action(sci);
-		sci_set_current_position(sci, 0, TRUE);
-	} else if (exitc > 256) {
-		msgwin_switch_tab(MSG_MESSAGE, 1);
-		msgwin_msg_add(COLOR_RED, -1, doc, _("[%s] tidy not installed. Contained in package tidy"), filename);
-	} else {
-		msgwin_switch_tab(MSG_MESSAGE, 1);
-		msgwin_msg_add(COLOR_RED, -1, doc, _("[%s] tidy error, code %d. The content seems not to be valid XML/HTML."), filename, exitc);
+	ScintillaObject *sci = doc->editor->sci;
+	gsize len = sci_get_length(sci);
+	GBytes *new_text = g_bytes_new(gs_sci_text_range(sci, 0, len), len);
+	GBytes *old_text = NULL;
+	if (other != NULL) {
+		gsize other_len = sci_get_length(other->editor->sci);
+		old_text = g_bytes_new(gs_sci_text_range(other->editor->sci, 0, other_len), other_len);
+		plugin_private.diff_other_version = doc_version(other);
 	}
+	plugin_private.diff_doc_id = doc->id;
+	plugin_private.diff_other_id = other_id;
+	plugin_private.diff_version = doc_version(doc);
+	plugin_private.diff_start = g_get_monotonic_time();
+	plugin_private.diff_job = gs_diff_job_start(old_text, doc->real_path, doc->encoding, new_text);
+	plugin_private.diff_timer = g_timeout_add(50, on_diff_timer, NULL);
+
+	msgwin_clear_tab(MSG_MESSAGE);
+	msgwin_switch_tab(MSG_MESSAGE, TRUE);
+	ui_set_statusbar(FALSE, _("Diff: Comparing…"));
+}
 
-	// Free resources
-	free(text);
-	free(filename);
+// Diff: Jump to the next marked change after the caret line, wrapping around at the end
+static void exec_diff_next() {
+	GeanyDocument *doc = document_get_current();
+	if (!DOC_VALID(doc)) {
+		return;
+	}
+	ScintillaObject *sci = doc->editor->sci;
+	gint from = sci_get_line_end_position(sci, sci_get_current_line(sci));
+	for (gint round = 0; round < 2; round++) {
+		gint next = -1;
+		for (guint i = 0; i < G_N_ELEMENTS(GGU_DIFF_INDICATORS); i++) {
+			gint pos = ui_diff_next_mark(sci, GGU_DIFF_INDICATORS[i].indicator, from);
+			next = pos >= 0 && (next < 0 || pos < next) ? pos : next;
+		}
+		if (next >= 0) {
+			editor_goto_pos(doc->editor, next, TRUE);
+			return;
+		}
+		from = -1;
+	}
+	ui_set_statusbar(FALSE, _("Diff: No marked changes"));
 }
 
-// Pipe
-static void exec_pipe() {
+//######################################################################################################
+// Transform: Native codecs on the selection or the whole document, without starting base64 / gunzip
+
+static const struct {
+	const gchar *name;   // Keybinding and telemetry name
+	const gchar *label;  // Menu label
+} GGU_TRANSFORMS[] = {
+	[GS_TRANSFORM_BASE64_ENCODE]  = { "base64_encode",  "Base64 encode" },
+	[GS_TRANSFORM_BASE64_DECODE]  = { "base64_decode",  "Base64 decode" },
+	[GS_TRANSFORM_HEX_ENCODE]     = { "hex_encode",     "Hex encode" },
+	[GS_TRANSFORM_HEX_DECODE]     = { "hex_decode",     "Hex decode" },
+	[GS_TRANSFORM_URL_ENCODE]     = { "url_encode",     "URL encode (percent)" },
+	[GS_TRANSFORM_URL_DECODE]     = { "url_decode",     "URL decode (percent)" },
+	[GS_TRANSFORM_INFLATE]        = { "inflate",        "Inflate (gzip / zlib)" },
+	[GS_TRANSFORM_BASE64_INFLATE] = { "base64_inflate", "Base64 decode + inflate" },
+	[GS_TRANSFORM_JWT_DECODE]     = { "jwt_decode",     "JWT decode to new document" },
+};
+
+// Transform: Replace selection or document by its encoded / decoded form. A JWT opens decoded in a new JSON document
+static void exec_transform(GsTransformType type) {
 	GeanyDocument	*doc;
 	ScintillaObject	*sci;
 	if((doc = document_get_current()) == NULL || (sci = doc->editor->sci) == NULL) {
 		return;
 	}
-
-	// Get pipe input
-	gchar *user_input = dialogs_show_input("Pipe", GTK_WINDOW(geany->main_widgets->window), "echo current-editor-text | >>INPUT<<  > editor-text-afterwards", "grep -i ");
-	if (user_input == NULL) { // canceled
+	const gchar *label = _(GGU_TRANSFORMS[type].label);
+	if (plugin_private.pipe_job != NULL && plugin_private.pipe_doc_id == doc->id) {
+		msgwin_status_add(_("%s: A pipe command is still running on this document"), label);
 		return;
 	}
 
-	// Current content
-	gchar *text = sci_get_contents(sci, -1);
+	// Range to work on, read in place
+	gsize range_start, range_end;
+	ui_sci_tool_range(sci, GS_BLOCK_NONE, FALSE, &range_start, &range_end);
+	gsize text_len = range_end - range_start;
+	const gchar *text = gs_sci_text_range(sci, range_start, text_len);
 	gchar *filename = document_get_basename_for_display(doc, -1);
 
-
-	// Prepare & Run cmd
-	gchar *tmp_infile  = gs_glib_tmp_filepath(".", ".txt");
-	gchar *tmp_outfile = gs_glib_tmp_filepath(".", ".txt");
-	GString *syscmd_gstring = g_string_new("/bin/cat '");
-	g_string_append(syscmd_gstring, tmp_infile);
-	g_string_append(syscmd_gstring, "' | ");
-	g_string_append(syscmd_gstring, user_input);
-	g_string_append(syscmd_gstring, " > '");
-	g_string_append(syscmd_gstring, tmp_outfile);
-	g_string_append(syscmd_gstring, "'");
-	char *syscmd = g_string_free(syscmd_gstring, FALSE);
-	g_file_set_contents(tmp_infile, text, -1, NULL);
-	int exitc = system(syscmd);
-	gsize length;
-	g_free(text);
-	g_file_get_contents(tmp_outfile, &text, &length, NULL);
-	unlink(tmp_infile);  free(tmp_infile);  tmp_infile = NULL;
-	unlink(tmp_outfile); free(tmp_outfile); tmp_outfile = NULL;
-	g_free(syscmd); syscmd=NULL;
-	g_free(user_input); user_input = NULL;
-
-	// Evaluate result
-	if (exitc == 0) {
-		// Set reformatted text to UI
-		sci_start_undo_action(sci);
-		sci_set_text(sci, text);
-		sci_end_undo_action(sci);
-		sci_set_current_position(sci, 0, TRUE);
+	// Transform
+	GString *out = g_string_sized_new(text_len + text_len / 2 + 16);
+	gchar *error = NULL;
+	gint64 time_start = g_get_monotonic_time();
+	gboolean ok = gs_transform(type, text, text_len, 0, out, &error);
+	gdouble seconds = MAX(1, g_get_monotonic_time() - time_start) / (gdouble) G_USEC_PER_SEC;
+	msgwin_status_add("%s: %.2f MB -> %.2f MB in %.3f s (%.1f MB/s)", GGU_TRANSFORMS[type].name, text_len / 1e6, out->len / 1e6, seconds, text_len / 1e6 / seconds);
+
+	// Set result to UI
+	if (!ok) {
+		msgwin_status_add(_("[%s] %s: %s"), filename, label, error);
+		ui_set_statusbar(FALSE, _("[%s] %s: %s"), filename, label, error);
+	} else if (type == GS_TRANSFORM_JWT_DECODE) {
+		document_new_file(NULL, filetypes_detect_from_file("f.json"), out->str);
 	} else {
-		msgwin_switch_tab(MSG_MESSAGE, 1);
-		msgwin_msg_add(COLOR_RED, -1, doc, _("[%s] Error code %d. -> %s"), filename, exitc, text);
+		guint changes = gs_sci_apply_text(sci, range_start, text, text_len, out->str, out->len);
+		scintilla_send_message(sci, SCI_SCROLLCARET, 0, 0);
+		msgwin_status_add(_("[%s] %s: %u changes applied"), filename, label, changes);
+		if (!g_utf8_validate(out->str, out->len, NULL)) {
+			ui_set_statusbar(FALSE, _("[%s] %s: Result is binary, not valid UTF-8"), filename, label);
+		}
 	}
 
 	// Free resources
-	free(text);
+	g_free(error);
+	g_string_free(out, TRUE);
 	free(filename);
 }
 
@@ -305,13 +2758,63 @@ static void on_item_activated_open_file_in_callback_arg(GtkWidget *wid, gpointer
     document_open_file(filepath, 0, NULL, NULL);
 }
 
-static gboolean on_item_activated_by_keybinding_id(guint keyid) {
+// Telemetry event of every tool which is done when it returns. Tools waiting for the user in a dialog
+// aren't timed here, pipe and search in open documents record their background run when done
+static const gchar *TELEMETRY_TOOLS[GEANY_KEYS_GGU_COUNT] = {
+	[GEANY_KEYS_GGU_XML_PRETTY]            = "xml_pretty",
+	[GEANY_KEYS_GGU_JSON_PRETTY]           = "json_pretty",
+	[GEANY_KEYS_GGU_JSON_PRETTY_BLOCK]     = "json_pretty_block",
+	[GEANY_KEYS_GGU_XML_PRETTY_BLOCK]      = "xml_pretty_block",
+	[GEANY_KEYS_GGU_NDJSON_PRETTY]         = "ndjson_pretty",
+	[GEANY_KEYS_GGU_NDJSON_MINIFY]         = "ndjson_minify",
+	[GEANY_KEYS_GGU_JSON_PRETTY_FRAGMENTS] = "json_pretty_fragments",
+	[GEANY_KEYS_GGU_JSON_VALIDATE]         = "json_validate",
+	[GEANY_KEYS_GGU_FORMAT]                = "format",
+	[GEANY_KEYS_GGU_JSON_MATCH_BRACKET]    = "json_match_bracket",
+	[GEANY_KEYS_GGU_DIFF_NEXT]             = "diff_next",
+	[GEANY_KEYS_GGU_TRANSFORM_BASE64_ENCODE]  = "transform_base64_encode",
+	[GEANY_KEYS_GGU_TRANSFORM_BASE64_DECODE]  = "transform_base64_decode",
+	[GEANY_KEYS_GGU_TRANSFORM_HEX_ENCODE]     = "transform_hex_encode",
+	[GEANY_KEYS_GGU_TRANSFORM_HEX_DECODE]     = "transform_hex_decode",
+	[GEANY_KEYS_GGU_TRANSFORM_URL_ENCODE]     = "transform_url_encode",
+	[GEANY_KEYS_GGU_TRANSFORM_URL_DECODE]     = "transform_url_decode",
+	[GEANY_KEYS_GGU_TRANSFORM_INFLATE]        = "transform_inflate",
+	[GEANY_KEYS_GGU_TRANSFORM_BASE64_INFLATE] = "transform_base64_inflate",
+	[GEANY_KEYS_GGU_TRANSFORM_JWT_DECODE]     = "transform_jwt_decode",
+};
+
+static gboolean ui_exec_by_keybinding_id(guint keyid) {
+	if (keyid >= GEANY_KEYS_GGU_TRANSFORM_BASE64_ENCODE && keyid <= GEANY_KEYS_GGU_TRANSFORM_JWT_DECODE) {
+		exec_transform(keyid - GEANY_KEYS_GGU_TRANSFORM_BASE64_ENCODE);
+		return TRUE;
+	}
 	switch(keyid) {
 	case GEANY_KEYS_GGU_JSON_PRETTY:
-		exec_json_pretty();
+		exec_json_pretty(GS_BLOCK_NONE);
+		return TRUE;
+	case GEANY_KEYS_GGU_JSON_PRETTY_BLOCK:
+		exec_json_pretty(GS_BLOCK_JSON);
 		return TRUE;
 	case GEANY_KEYS_GGU_XML_PRETTY:
-		exec_xml_pretty();
+		exec_xml_pretty(GS_BLOCK_NONE);
+		return TRUE;
+	case GEANY_KEYS_GGU_XML_PRETTY_BLOCK:
+		exec_xml_pretty(GS_BLOCK_XML);
+		return TRUE;
+	case GEANY_KEYS_GGU_NDJSON_PRETTY:
+		exec_ndjson_format(2);
+		return TRUE;
+	case GEANY_KEYS_GGU_NDJSON_MINIFY:
+		exec_ndjson_format(0);
+		return TRUE;
+	case GEANY_KEYS_GGU_JSON_PRETTY_FRAGMENTS:
+		exec_json_pretty_fragments();
+		return TRUE;
+	case GEANY_KEYS_GGU_JSON_VALIDATE:
+		exec_json_validate();
+		return TRUE;
+	case GEANY_KEYS_GGU_FORMAT:
+		exec_format();
 		return TRUE;
 	case GEANY_KEYS_GGU_PIPE:
 		exec_pipe();
@@ -319,13 +2822,55 @@ static gboolean on_item_activated_by_keybinding_id(guint keyid) {
 	case GEANY_KEYS_GGU_SEARCH:
 		keybindings_send_command(GEANY_KEY_GROUP_SEARCH, GEANY_KEYS_SEARCH_FIND);
 		return TRUE;
+	case GEANY_KEYS_GGU_SEARCH_DOCUMENTS:
+		exec_search_documents();
+		return TRUE;
+	case GEANY_KEYS_GGU_QUICK_OPEN:
+		exec_quick_open();
+		return TRUE;
+	case GEANY_KEYS_GGU_TELEMETRY_EXPORT:
+		exec_telemetry_export();
+		return TRUE;
+	case GEANY_KEYS_GGU_LARGE_FILE_TOGGLE:
+		exec_large_file_toggle();
+		return TRUE;
+	case GEANY_KEYS_GGU_JSON_GOTO_PATH:
+		exec_json_goto_path();
+		return TRUE;
+	case GEANY_KEYS_GGU_JSON_MATCH_BRACKET:
+		exec_json_match_bracket();
+		return TRUE;
+	case GEANY_KEYS_GGU_XML_QUERY:
+		exec_xml_query();
+		return TRUE;
+	case GEANY_KEYS_GGU_DIFF:
+		exec_diff();
+		return TRUE;
+	case GEANY_KEYS_GGU_DIFF_NEXT:
+		exec_diff_next();
+		return TRUE;
 	case GEANY_KEYS_GGU_FAVOURITES:
-		gtk_menu_popup_at_pointer(GTK_MENU(gtk_menu_tool_button_get_menu(plugin_private.toolbar_item_favourites)), NULL);
+		if (plugin_private.toolbar_item_favourites != NULL) { // Set up after startup
+			gtk_menu_popup_at_pointer(GTK_MENU(gtk_menu_tool_button_get_menu(plugin_private.toolbar_item_favourites)), NULL);
+		}
 		return TRUE;
 	}
 	return FALSE;
 }
 
+// Run the tool of keyid, timed for telemetry. The document size is taken before the tool changes it
+static gboolean on_item_activated_by_keybinding_id(guint keyid) {
+	GeanyDocument *doc = document_get_current();
+	if (keyid >= GEANY_KEYS_GGU_COUNT || TELEMETRY_TOOLS[keyid] == NULL || plugin_private.telemetry == NULL || doc == NULL) {
+		return ui_exec_by_keybinding_id(keyid);
+	}
+	gint64 time_start = g_get_monotonic_time();
+	gssize size = sci_get_length(doc->editor->sci);
+	gboolean handled = ui_exec_by_keybinding_id(keyid);
+	telemetry_add(TELEMETRY_TOOLS[keyid], doc, size, time_start);
+	return handled;
+}
+
 // Menu item activated by ID. Forward to keybinding handler
 static void on_item_activated_by_id(GtkWidget *wid, gpointer eventdata) {
 	on_item_activated_by_keybinding_id(GPOINTER_TO_INT(eventdata));
@@ -435,60 +2980,177 @@ void ui_treebrowser_plugin_load_folder(const gchar* filepath){
 	}
 }
 
-static void add_favourites_to_menu(const gchar *dir_home, GKeyFile* config, const GtkMenu *file_menu) {
-	gchar *str;
-	gchar **strarr;
+// Result of the last existence check of a favourite
+typedef struct {
+	gboolean exists;
+	gboolean pending;  // Check running
+	gint64   time;     // Of the last finished check, 0 if none
+} GsFavouriteCheck;
+
+// Grey out the menu items of filepath unless it exists. /tmp/ files are created when opened
+static void ui_favourites_set_exists(const gchar *filepath, gboolean exists) {
+	GList *items = gtk_container_get_children(GTK_CONTAINER(plugin_private.menu_favorites));
+	for (GList *item = items; item != NULL; item = item->next) {
+		const gchar *item_filepath = g_object_get_data(G_OBJECT(item->data), "ggu_filepath");
+		if (item_filepath != NULL && g_str_equal(item_filepath, filepath)) {
+			gtk_widget_set_sensitive(item->data, exists || g_str_has_prefix(filepath, "/tmp/"));
+			gtk_widget_set_tooltip_text(item->data, exists ? filepath : _("File not found"));
+		}
+	}
+	g_list_free(items);
+}
+
+static void on_favourite_checked(GObject *source, GAsyncResult *result, gpointer user_data) {
+	GError *error = NULL;
+	GFileInfo *info = g_file_query_info_finish(G_FILE(source), result, &error);
+	if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) { // Plugin unloaded
+		g_error_free(error);
+		return;
+	}
+	gchar *filepath = g_file_get_path(G_FILE(source));
+	GsFavouriteCheck *check = g_hash_table_lookup(plugin_private.favourites_checked, filepath);
+	check->exists = info != NULL && g_file_info_get_file_type(info) == G_FILE_TYPE_REGULAR;
+	check->pending = FALSE;
+	check->time = g_get_monotonic_time();
+	ui_favourites_set_exists(filepath, check->exists);
+	if (info != NULL) {
+		g_object_unref(info);
+	}
+	if (error != NULL) {
+		g_error_free(error);
+	}
+	g_free(filepath);
+}
+
+// Check whether the favourite exists in background, unless that is known from a recent check.
+// GIO runs the check in a worker thread, a hanging network mount doesn't block the UI
+static void ui_favourite_check(const gchar *filepath) {
+	GsFavouriteCheck *check = g_hash_table_lookup(plugin_private.favourites_checked, filepath);
+	if (check == NULL) {
+		check = g_new0(GsFavouriteCheck, 1);
+		g_hash_table_insert(plugin_private.favourites_checked, g_strdup(filepath), check);
+	} else if (check->time != 0) {
+		ui_favourites_set_exists(filepath, check->exists);
+	}
+	if (check->pending || (check->time != 0 && g_get_monotonic_time() - check->time < GGU_FAVOURITES_CHECK_INTERVAL_S * G_USEC_PER_SEC)) {
+		return;
+	}
+	check->pending = TRUE;
+	GFile *file = g_file_new_for_path(filepath);
+	g_file_query_info_async(file, G_FILE_ATTRIBUTE_STANDARD_TYPE, G_FILE_QUERY_INFO_NONE, G_PRIORITY_LOW, plugin_private.favourites_cancellable, on_favourite_checked, NULL);
+	g_object_unref(file);
+}
 
-	// Favourites
-	str = utils_get_setting_string(config, PLUGIN_NAME, "favourites", "");
-	if (g_utf8_strlen(str, -1) > 0) {
-		strarr = g_strsplit(str, ";", -1);
+// Menu opened: Recheck favourites, e.g. a USB drive may have been plugged in meanwhile
+static void on_favourites_menu_show(GtkWidget *menu, gpointer user_data) {
+	GList *items = gtk_container_get_children(GTK_CONTAINER(menu));
+	for (GList *item = items; item != NULL; item = item->next) {
+		const gchar *filepath = g_object_get_data(G_OBJECT(item->data), "ggu_filepath");
+		if (filepath != NULL) {
+			ui_favourite_check(filepath);
+		}
+	}
+	g_list_free(items);
+}
 
-		// Setup submenu
-		plugin_private.menu_favorites = gtk_menu_new();
-		for (int i=0; (strarr[i] != NULL && strarr[i+1] != NULL); i+=2) {
+// (Re)build the favourites menu right away. Whether the files exist is checked in background, missing
+// ones are greyed out. The menu is hidden if there are no favourites
+static void ui_favourites_menu_fill(const gchar *favourites) {
+	GList *items = gtk_container_get_children(GTK_CONTAINER(plugin_private.menu_favorites));
+	g_list_free_full(items, (GDestroyNotify) gtk_widget_destroy);
+	SETPTR(plugin_private.favourites, g_strdup(favourites));
+
+	GPtrArray *entries = favourites_parse(favourites);
+	for (guint i = 0; i < entries->len; i += 2) {
+		const gchar *filepath = g_ptr_array_index(entries, i + 1);
+		GtkWidget *menuitem = NULL;
+		if (filepath == NULL) { // Separator
+			menuitem = gtk_separator_menu_item_new();
+		} else {
 			// First underscore is for keybinding and doesn't show up
-			gchar *label = gs_glib_strreplace(gs_glib_strreplace(strarr[i], "_", "__", 0), ">>", "»", 1);
-
-			// Create submenu item
-			GtkWidget* menuitem = NULL;
-			if (g_str_equal(label, "---")) { // Separator
-				menuitem = gtk_separator_menu_item_new(); i--;
-			} else { // Filepath
-				gchar *filepath = gs_glib_strreplace(strarr[i+1], "$HOME", dir_home, 0);
-				if (g_file_test(filepath, G_FILE_TEST_IS_REGULAR) || g_str_has_prefix(filepath, "/tmp/")) {
-					menuitem = ui_image_menu_item_new(NULL, label);
-					g_signal_connect(G_OBJECT(menuitem), "activate", G_CALLBACK(on_item_activated_open_file_in_callback_arg), filepath);
-				}
-			}
+			gchar *label = gs_glib_strreplace(gs_glib_strreplace(g_ptr_array_index(entries, i), "_", "__", 0), ">>", "»", 1);
+			menuitem = ui_image_menu_item_new(NULL, label);
+			g_object_set_data_full(G_OBJECT(menuitem), "ggu_filepath", g_strdup(filepath), g_free);
+			g_signal_connect(G_OBJECT(menuitem), "activate", G_CALLBACK(on_item_activated_open_file_in_callback_arg), g_object_get_data(G_OBJECT(menuitem), "ggu_filepath"));
+			g_free(label);
+		}
+		gtk_menu_shell_append(GTK_MENU_SHELL(plugin_private.menu_favorites), menuitem);
+		gtk_widget_show_all(menuitem);
+		if (filepath != NULL) {
+			ui_favourite_check(filepath);
+		}
+	}
+	gtk_widget_set_visible(plugin_private.menuitem_favourites, entries->len > 0);
+	gtk_widget_set_visible(GTK_WIDGET(plugin_private.toolbar_item_favourites), entries->len > 0);
+	g_ptr_array_free(entries, TRUE);
+}
 
-			// Add item to submenu
-			if (menuitem != NULL) {
-				gtk_menu_shell_append(GTK_MENU_SHELL(plugin_private.menu_favorites), menuitem);
-				gtk_widget_show_all(menuitem);
-				#pragma GCC diagnostic ignored "-Wunused-result"
-				g_list_append(&plugin_private.menuitem_list, menuitem);
+// geany.conf settled down after changes: Rebuild the menu if the favourites key changed
+static gboolean on_favourites_conf_timer(gpointer user_data) {
+	plugin_private.favourites_conf_timer = 0;
+	GKeyFile *config = geany_conf_load();
+	gchar *favourites = utils_get_setting_string(config, PLUGIN_NAME, "favourites", "");
+	if (!g_str_equal(favourites, plugin_private.favourites)) {
+		ui_favourites_menu_fill(favourites);
+		GPtrArray *entries = favourites_parse(favourites);
+		for (guint i = 1; i < entries->len; i += 2) {
+			if (g_ptr_array_index(entries, i) != NULL) {
+				gs_path_index_add(plugin_private.quick_open_index, g_ptr_array_index(entries, i), GS_PATH_FAVOURITE);
 			}
 		}
+		g_ptr_array_free(entries, TRUE);
+		msgwin_status_add(_("Favourites: Reloaded from geany.conf"));
+	}
+	g_free(favourites);
+	g_key_file_free(config);
+	return FALSE;
+}
+
+static void on_favourites_conf_changed(GFileMonitor *monitor, GFile *file, GFile *other_file, GFileMonitorEvent event, gpointer user_data) {
+	if (plugin_private.favourites_conf_timer != 0) {
+		g_source_remove(plugin_private.favourites_conf_timer);
+	}
+	plugin_private.favourites_conf_timer = g_timeout_add(500, on_favourites_conf_timer, NULL);
+}
 
-		// Show submenu - at menu
-		plugin_private.menuitem_favourites = ui_image_menu_item_new("gtk-about", _("Fav"));
-		gtk_menu_item_set_submenu(GTK_MENU_ITEM(plugin_private.menuitem_favourites), plugin_private.menu_favorites);
-		gtk_widget_show_all(plugin_private.menu_favorites);
-		gtk_widget_show_all(plugin_private.menuitem_favourites);
-		gtk_menu_shell_insert(GTK_MENU_SHELL(file_menu), plugin_private.menuitem_favourites, 4);
+static void add_favourites_to_menu(GKeyFile* config) {
+	const GtkMenu *file_menu = GTK_MENU(ui_lookup_widget(geany_data->main_widgets->window, "file1_menu"));
+	plugin_private.favourites_checked = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	plugin_private.favourites_cancellable = g_cancellable_new();
+
+	// Setup submenu
+	plugin_private.menu_favorites = gtk_menu_new();
+	g_signal_connect(plugin_private.menu_favorites, "show", G_CALLBACK(on_favourites_menu_show), NULL);
+
+	// Show submenu - at menu
+	plugin_private.menuitem_favourites = ui_image_menu_item_new("gtk-about", _("Fav"));
+	gtk_menu_item_set_submenu(GTK_MENU_ITEM(plugin_private.menuitem_favourites), plugin_private.menu_favorites);
+	gtk_widget_show_all(plugin_private.menu_favorites);
+	gtk_widget_show_all(plugin_private.menuitem_favourites);
+	gtk_menu_shell_insert(GTK_MENU_SHELL(file_menu), plugin_private.menuitem_favourites, 4);
+
+	// Show submenu - at toolbar
+	plugin_private.toolbar_item_favourites = GTK_MENU_TOOL_BUTTON(gtk_menu_tool_button_new(NULL, _("Fav")));
+	gtk_tool_button_set_icon_name(GTK_TOOL_BUTTON(plugin_private.toolbar_item_favourites), "gtk-about");
+	gtk_menu_tool_button_set_menu(plugin_private.toolbar_item_favourites, plugin_private.menu_favorites);
+	gtk_toolbar_insert(GTK_TOOLBAR(geany_data->main_widgets->toolbar), GTK_TOOL_ITEM(plugin_private.toolbar_item_favourites), 1);
+	gtk_widget_show_all(GTK_WIDGET(plugin_private.toolbar_item_favourites));
+	g_signal_connect(G_OBJECT(plugin_private.toolbar_item_favourites), "clicked", G_CALLBACK(on_item_activated_by_id), GINT_TO_POINTER(GEANY_KEYS_GGU_FAVOURITES));
 
-		// Show submenu - at toolbar
-		plugin_private.toolbar_item_favourites = GTK_MENU_TOOL_BUTTON(gtk_menu_tool_button_new(NULL, _("Fav")));
-		gtk_tool_button_set_icon_name(GTK_TOOL_BUTTON(plugin_private.toolbar_item_favourites), "gtk-about");
-		gtk_menu_tool_button_set_menu(plugin_private.toolbar_item_favourites, plugin_private.menu_favorites);
-		gtk_toolbar_insert(GTK_TOOLBAR(geany_data->main_widgets->toolbar), GTK_TOOL_ITEM(plugin_private.toolbar_item_favourites), 1);
-		gtk_widget_show_all(GTK_WIDGET(plugin_private.toolbar_item_favourites));
-		g_signal_connect(G_OBJECT(plugin_private.toolbar_item_favourites), "clicked", G_CALLBACK(on_item_activated_by_id), GINT_TO_POINTER(GEANY_KEYS_GGU_FAVOURITES));
+	// Favourites
+	gchar *str = utils_get_setting_string(config, PLUGIN_NAME, "favourites", "");
+	ui_favourites_menu_fill(str);
+	g_free(str);
 
-		free(strarr);
+	// Rebuild when the favourites key of geany.conf changes
+	gchar *configfile = geany_conf_filepath();
+	GFile *file = g_file_new_for_path(configfile);
+	plugin_private.favourites_conf_monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, NULL);
+	if (plugin_private.favourites_conf_monitor != NULL) {
+		g_signal_connect(plugin_private.favourites_conf_monitor, "changed", G_CALLBACK(on_favourites_conf_changed), NULL);
 	}
-	free(str);
+	g_object_unref(file);
+	g_free(configfile);
 }
 
 
@@ -546,8 +3208,17 @@ static void on_document_new(GObject *obj, GeanyDocument *doc, gpointer user_data
 	}
 }
 
+static void on_document_before_save(GObject *obj, GeanyDocument *doc, gpointer user_data) {
+	plugin_private.telemetry_save_doc_id = doc->id;
+	plugin_private.telemetry_save_start = g_get_monotonic_time();
+}
+
 static void on_document_save(GObject *obj, GeanyDocument *doc, gpointer user_data) {
 	debug_doc_info_to_msgwin(doc, "on_document_save");
+	if (plugin_private.telemetry_save_start != 0 && plugin_private.telemetry_save_doc_id == doc->id) {
+		telemetry_add("save", doc, -1, plugin_private.telemetry_save_start);
+		plugin_private.telemetry_save_start = 0;
+	}
 	gboolean is_new_file = plugin_private.current_doc_is_new;
 	plugin_private.current_doc_is_new = FALSE;
 
@@ -560,46 +3231,164 @@ static void on_document_save(GObject *obj, GeanyDocument *doc, gpointer user_dat
 			document_set_filetype(doc, filetypes_detect_from_file(DOC_FILENAME(doc)));
 		}
 	}
+	ui_format_on_save_start(doc);
 }
 
 // Callback: Existing document opened in Geany (not called for new file)
 static void on_document_open(GObject *obj, GeanyDocument *doc, gpointer user_data) {
 	debug_doc_info_to_msgwin(doc, "on_document_open");
-	ft_use_html_syntax_for_markdown_filesuse_html_syntax_for_markdown_files(doc);
+	telemetry_add_when_painted("open", doc);
+	if (!ui_large_file_check(doc)) {
+		ft_use_html_syntax_for_markdown_filesuse_html_syntax_for_markdown_files(doc);
+	}
+	if (doc->real_path != NULL) {
+		gs_path_index_add(plugin_private.quick_open_index, doc->real_path, GS_PATH_RECENT);
+	}
 }
 
 static void on_document_shown(GObject *obj, GeanyDocument *doc, gpointer user_data) {
 	plugin_private.current_doc_is_new = (doc->file_name == NULL ? TRUE : FALSE);
 	debug_doc_info_to_msgwin(doc, "on_document_shown");
-	ui_debloat_based_on_current_filetype(doc);
+	telemetry_add_when_painted("tab_switch", doc);
+	ui_large_file_indicator_update();
+	if (!large_file_is(doc)) {
+		ui_debloat_based_on_current_filetype(doc);
+	}
+	ui_json_index_check(doc);
+}
+
+static void on_document_close(GObject *obj, GeanyDocument *doc, gpointer user_data) {
+	g_hash_table_remove(plugin_private.large_files, GUINT_TO_POINTER(doc->id));
+	g_hash_table_remove(plugin_private.doc_versions, GUINT_TO_POINTER(doc->id));
+	g_hash_table_remove(plugin_private.json_indexes, GUINT_TO_POINTER(doc->id));
+}
+
+// Count up the document version on every text modification and keep the JSON index up to date. Caret
+// moves update the path in the status bar
+static gboolean on_editor_notify(GObject *obj, GeanyEditor *editor, SCNotification *nt, gpointer user_data) {
+	GeanyDocument *doc = editor->document;
+	if (nt->nmhdr.code == SCN_MODIFIED && (nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) && doc != NULL) {
+		g_hash_table_insert(plugin_private.doc_versions, GUINT_TO_POINTER(doc->id), GUINT_TO_POINTER(doc_version(doc) + 1));
+		GsJsonDocIndex *state = g_hash_table_lookup(plugin_private.json_indexes, GUINT_TO_POINTER(doc->id));
+		if (state != NULL) {
+			ui_json_index_edit(doc, state, nt);
+		}
+	} else if (nt->nmhdr.code == SCN_UPDATEUI && (nt->updated & (SC_UPDATE_SELECTION | SC_UPDATE_CONTENT)) && doc != NULL && doc == document_get_current()) {
+		ui_json_path_update();
+	}
+	return FALSE;
 }
 
 //######################################################################################################
 
-static gboolean plugin_post_init_200ms()  {
+// Startup
+//
+// plugin_init only sets up what has to exist right away: signals, keybindings and menu items. The rest
+// runs once Geany's window is up (or right away when the plugin is enabled later), one phase per idle
+// callback so the window repaints in between. Every phase is timed, the report goes to the status window
+
+static void ui_treebrowser_load_default_folder(GKeyFile *config) {
 	ui_treebrowser_plugin_load_folder("/tmp/aatmp");
-	return FALSE; // Destorys timer
+}
+
+static const struct {
+	const gchar *name;
+	void       (*run)(GKeyFile *config);
+} STARTUP_PHASES[] = {
+	{ "msgwin",      ui_switch_to_message_window_tab },
+	{ "telemetry",   telemetry_settings_load },
+	{ "large files", large_file_settings_load },
+	{ "formatters",  formatters_load },
+	{ "pipe",        pipe_settings_load },
+	{ "quick open",  quick_open_init },
+	{ "restyle",     ui_debloat_and_restyle },
+	{ "favourites",  add_favourites_to_menu },
+	{ "treebrowser", ui_treebrowser_load_default_folder },
+};
+
+// Add the time since time_start to the report. Returns it in microseconds
+static gint64 startup_timing_add(const gchar *phase, gint64 time_start) {
+	gint64 duration = g_get_monotonic_time() - time_start;
+	g_string_append_printf(plugin_private.startup_timing, "%s%s %.1f ms", plugin_private.startup_timing->len > 0 ? ", " : "", phase, duration / 1000.0);
+	return duration;
+}
+
+// Run the next deferred phase, geany.conf is loaded first and kept until the last one is done
+static gboolean on_startup_idle(gpointer user_data) {
+	gint64 time_start = g_get_monotonic_time();
+	if (plugin_private.startup_config == NULL) {
+		plugin_private.startup_config = geany_conf_load();
+		plugin_private.startup_deferred_us += startup_timing_add("geany.conf", time_start);
+		return TRUE;
+	}
+
+	guint phase = plugin_private.startup_phase;
+	if (phase < G_N_ELEMENTS(STARTUP_PHASES)) {
+		plugin_private.startup_phase++;
+		STARTUP_PHASES[phase].run(plugin_private.startup_config);
+		plugin_private.startup_deferred_us += startup_timing_add(STARTUP_PHASES[phase].name, time_start);
+	}
+	if (plugin_private.startup_phase < G_N_ELEMENTS(STARTUP_PHASES)) {
+		return TRUE;
+	}
+
+	msgwin_status_add("Startup: %.1f ms in plugin_init, %.1f ms deferred to idle (%s)",
+		plugin_private.startup_init_us / 1000.0, plugin_private.startup_deferred_us / 1000.0, plugin_private.startup_timing->str);
+	g_key_file_free(plugin_private.startup_config);
+	plugin_private.startup_config = NULL;
+	plugin_private.startup_idle = 0;
+	return FALSE;
+}
+
+static void on_geany_startup_complete(GObject *obj, gpointer user_data) {
+	if (plugin_private.startup_idle == 0 && plugin_private.startup_phase == 0) {
+		plugin_private.startup_idle = g_idle_add(on_startup_idle, NULL);
+	}
 }
 
 // Init plugin
 void plugin_init(GeanyData *geany_data) {
+	gint64 time_start = g_get_monotonic_time();
+
+	// The module stays resident after being disabled, nothing of an earlier session may be left over
+	memset(&plugin_private, 0, sizeof(plugin_private));
+	plugin_private.startup_timing = g_string_new(NULL);
     main_locale_init(LOCALEDIR, GETTEXT_PACKAGE);
-	GKeyFile *config         = geany_conf_load();
-	const GtkMenu *file_menu = GTK_MENU(ui_lookup_widget(geany_data->main_widgets->window, "file1_menu"));
-	const gchar *dir_home    = g_get_home_dir();
+	plugin_module_make_resident(geany_plugin); // GIO callbacks of pending file checks may run after unloading
 
 	// Register callbacks
 	plugin_signal_connect(geany_plugin, NULL, "document-new",      TRUE, (GCallback) &on_document_new,   NULL);
 	plugin_signal_connect(geany_plugin, NULL, "document-open",     TRUE, (GCallback) &on_document_open,  NULL);
 	plugin_signal_connect(geany_plugin, NULL, "document-activate", TRUE, (GCallback) &on_document_shown, NULL);
+	plugin_signal_connect(geany_plugin, NULL, "document-before-save", FALSE, (GCallback) &on_document_before_save, NULL);
 	plugin_signal_connect(geany_plugin, NULL, "document-save",     TRUE, (GCallback) &on_document_save, NULL);
-
-	// Switch message window tab based on settings
-	ui_switch_to_message_window_tab(config);
+	plugin_signal_connect(geany_plugin, NULL, "document-close",    TRUE, (GCallback) &on_document_close, NULL);
+	plugin_signal_connect(geany_plugin, NULL, "editor-notify",     FALSE, (GCallback) &on_editor_notify, NULL);
+
+	// Formatters, pipe cache and quick open index start empty, settings are read after startup
+	plugin_private.formatters  = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	plugin_private.coprocesses = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify) gs_coprocess_free);
+	plugin_private.pipe_cache = g_new0(GsPipeCache, 1);
+	plugin_private.quick_open_index = gs_path_index_new();
+	plugin_private.telemetry = gs_telemetry_new();
+	plugin_private.telemetry_pending = g_array_new(FALSE, FALSE, sizeof(GsTelemetryPending));
+	plugin_private.large_files = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+	plugin_private.doc_versions = g_hash_table_new(g_direct_hash, g_direct_equal);
+	plugin_private.json_indexes = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) json_doc_index_free);
+	startup_timing_add("setup", time_start);
 
 	// Setup Keybindings
+	gint64 time_keybindings = g_get_monotonic_time();
 	plugin_private.keybinding_group = plugin_set_key_group(geany_plugin, PLUGIN_NAME, GEANY_KEYS_GGU_COUNT, on_item_activated_by_keybinding_id);
 
+	// Format by filetype
+	const char *GEANY_KEYS_GGU_FORMAT_LABEL = _("[GGU] Format (formatter for filetype)");
+	plugin_private.menuitem_format = ui_image_menu_item_new(NULL, GEANY_KEYS_GGU_FORMAT_LABEL);
+	g_signal_connect(G_OBJECT(plugin_private.menuitem_format), "activate", G_CALLBACK(on_item_activated_by_id), GINT_TO_POINTER(GEANY_KEYS_GGU_FORMAT));
+	gtk_widget_show_all(plugin_private.menuitem_format);
+	gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), plugin_private.menuitem_format);
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_FORMAT, NULL, 0, 0, "ggu_format", GEANY_KEYS_GGU_FORMAT_LABEL, plugin_private.menuitem_format);
+
 	// JSON Reformat
 	const char *GEANY_KEYS_GGU_JSON_PRETTY_LABEL = _("[GGU] JSON pretty");
 	plugin_private.menuitem_json_pretty = ui_image_menu_item_new(NULL, GEANY_KEYS_GGU_JSON_PRETTY_LABEL);
@@ -608,6 +3397,22 @@ void plugin_init(GeanyData *geany_data) {
 	gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), plugin_private.menuitem_json_pretty);
 	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_JSON_PRETTY, NULL, 0, 0, "ggu_json_pretty", GEANY_KEYS_GGU_JSON_PRETTY_LABEL, plugin_private.menuitem_json_pretty);
 
+	// JSON pretty fragments
+	const char *GEANY_KEYS_GGU_JSON_PRETTY_FRAGMENTS_LABEL = _("[GGU] JSON pretty (all fragments in text)");
+	plugin_private.menuitem_json_fragments = ui_image_menu_item_new(NULL, GEANY_KEYS_GGU_JSON_PRETTY_FRAGMENTS_LABEL);
+	g_signal_connect(G_OBJECT(plugin_private.menuitem_json_fragments), "activate", G_CALLBACK(on_item_activated_by_id), GINT_TO_POINTER(GEANY_KEYS_GGU_JSON_PRETTY_FRAGMENTS));
+	gtk_widget_show_all(plugin_private.menuitem_json_fragments);
+	gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), plugin_private.menuitem_json_fragments);
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_JSON_PRETTY_FRAGMENTS, NULL, 0, 0, "ggu_json_pretty_fragments", GEANY_KEYS_GGU_JSON_PRETTY_FRAGMENTS_LABEL, plugin_private.menuitem_json_fragments);
+
+	// JSON validate
+	const char *GEANY_KEYS_GGU_JSON_VALIDATE_LABEL = _("[GGU] JSON validate");
+	plugin_private.menuitem_json_validate = ui_image_menu_item_new(NULL, GEANY_KEYS_GGU_JSON_VALIDATE_LABEL);
+	g_signal_connect(G_OBJECT(plugin_private.menuitem_json_validate), "activate", G_CALLBACK(on_item_activated_by_id), GINT_TO_POINTER(GEANY_KEYS_GGU_JSON_VALIDATE));
+	gtk_widget_show_all(plugin_private.menuitem_json_validate);
+	gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), plugin_private.menuitem_json_validate);
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_JSON_VALIDATE, NULL, 0, 0, "ggu_json_validate", GEANY_KEYS_GGU_JSON_VALIDATE_LABEL, plugin_private.menuitem_json_validate);
+
 	// XML Reformat
 	const char *GEANY_KEYS_GGU_XML_PRETTY_LABEL = _("[GGU] XML/HTML pretty");
 	plugin_private.menuitem_xml_pretty = ui_image_menu_item_new(NULL, GEANY_KEYS_GGU_XML_PRETTY_LABEL);
@@ -616,6 +3421,56 @@ void plugin_init(GeanyData *geany_data) {
 	gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), plugin_private.menuitem_xml_pretty);
 	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_XML_PRETTY, NULL, 0, 0, "ggu_xml_pretty", GEANY_KEYS_GGU_XML_PRETTY_LABEL, plugin_private.menuitem_xml_pretty);
 
+	// XML query
+	const char *GEANY_KEYS_GGU_XML_QUERY_LABEL = _("[GGU] XML/HTML query (XPath)");
+	plugin_private.menuitem_xml_query = ui_image_menu_item_new(NULL, GEANY_KEYS_GGU_XML_QUERY_LABEL);
+	g_signal_connect(G_OBJECT(plugin_private.menuitem_xml_query), "activate", G_CALLBACK(on_item_activated_by_id), GINT_TO_POINTER(GEANY_KEYS_GGU_XML_QUERY));
+	gtk_widget_show_all(plugin_private.menuitem_xml_query);
+	gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), plugin_private.menuitem_xml_query);
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_XML_QUERY, NULL, 0, 0, "ggu_xml_query", GEANY_KEYS_GGU_XML_QUERY_LABEL, plugin_private.menuitem_xml_query);
+
+	// Diff
+	const char *GEANY_KEYS_GGU_DIFF_LABEL = _("[GGU] Diff (saved file / open document)");
+	plugin_private.menuitem_diff = ui_image_menu_item_new(NULL, GEANY_KEYS_GGU_DIFF_LABEL);
+	g_signal_connect(G_OBJECT(plugin_private.menuitem_diff), "activate", G_CALLBACK(on_item_activated_by_id), GINT_TO_POINTER(GEANY_KEYS_GGU_DIFF));
+	gtk_widget_show_all(plugin_private.menuitem_diff);
+	gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), plugin_private.menuitem_diff);
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_DIFF, NULL, 0, 0, "ggu_diff", GEANY_KEYS_GGU_DIFF_LABEL, plugin_private.menuitem_diff);
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_DIFF_NEXT, NULL, 0, 0, "ggu_diff_next", _("[GGU] Diff: Next change"), NULL);
+
+	// Transform submenu, one item and keybinding per transform
+	plugin_private.menu_transform = gtk_menu_new();
+	plugin_private.menuitem_transform = ui_image_menu_item_new(NULL, _("[GGU] Transform"));
+	gtk_menu_item_set_submenu(GTK_MENU_ITEM(plugin_private.menuitem_transform), plugin_private.menu_transform);
+	for (guint i = 0; i < G_N_ELEMENTS(GGU_TRANSFORMS); i++) {
+		guint keyid = GEANY_KEYS_GGU_TRANSFORM_BASE64_ENCODE + i;
+		gchar *name = g_strconcat("ggu_transform_", GGU_TRANSFORMS[i].name, NULL);
+		gchar *label = g_strconcat(_("[GGU] Transform: "), _(GGU_TRANSFORMS[i].label), NULL);
+		GtkWidget *menuitem = gtk_menu_item_new_with_label(_(GGU_TRANSFORMS[i].label));
+		g_signal_connect(G_OBJECT(menuitem), "activate", G_CALLBACK(on_item_activated_by_id), GINT_TO_POINTER(keyid));
+		gtk_container_add(GTK_CONTAINER(plugin_private.menu_transform), menuitem);
+		keybindings_set_item(plugin_private.keybinding_group, keyid, NULL, 0, 0, name, label, menuitem);
+		g_free(name);
+		g_free(label);
+	}
+	gtk_widget_show_all(plugin_private.menuitem_transform);
+	gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), plugin_private.menuitem_transform);
+
+	// NDJSON pretty & minify
+	const char *GEANY_KEYS_GGU_NDJSON_PRETTY_LABEL = _("[GGU] JSON Lines (NDJSON) pretty");
+	plugin_private.menuitem_ndjson_pretty = ui_image_menu_item_new(NULL, GEANY_KEYS_GGU_NDJSON_PRETTY_LABEL);
+	g_signal_connect(G_OBJECT(plugin_private.menuitem_ndjson_pretty), "activate", G_CALLBACK(on_item_activated_by_id), GINT_TO_POINTER(GEANY_KEYS_GGU_NDJSON_PRETTY));
+	gtk_widget_show_all(plugin_private.menuitem_ndjson_pretty);
+	gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), plugin_private.menuitem_ndjson_pretty);
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_NDJSON_PRETTY, NULL, 0, 0, "ggu_ndjson_pretty", GEANY_KEYS_GGU_NDJSON_PRETTY_LABEL, plugin_private.menuitem_ndjson_pretty);
+
+	const char *GEANY_KEYS_GGU_NDJSON_MINIFY_LABEL = _("[GGU] JSON Lines (NDJSON) minify");
+	plugin_private.menuitem_ndjson_minify = ui_image_menu_item_new(NULL, GEANY_KEYS_GGU_NDJSON_MINIFY_LABEL);
+	g_signal_connect(G_OBJECT(plugin_private.menuitem_ndjson_minify), "activate", G_CALLBACK(on_item_activated_by_id), GINT_TO_POINTER(GEANY_KEYS_GGU_NDJSON_MINIFY));
+	gtk_widget_show_all(plugin_private.menuitem_ndjson_minify);
+	gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), plugin_private.menuitem_ndjson_minify);
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_NDJSON_MINIFY, NULL, 0, 0, "ggu_ndjson_minify", GEANY_KEYS_GGU_NDJSON_MINIFY_LABEL, plugin_private.menuitem_ndjson_minify);
+
 	// Pipe
 	const char *GEANY_KEYS_GGU_PIPE_LABEL = _("[GGU] Pipe (grep/cut/..)");
 	plugin_private.menuitem_pipe = ui_image_menu_item_new(NULL, GEANY_KEYS_GGU_PIPE_LABEL);
@@ -627,17 +3482,59 @@ void plugin_init(GeanyData *geany_data) {
 	// Search (geany only allows single keybinding to one action)
 	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_SEARCH, NULL, 0, 0, "ggu_search_dialog", _("[GGU] Seach dialog (add second search keybinding)"), NULL);
 
-	// Restyle sidebar
-	ui_debloat_and_restyle(config);
-
-	// Add favourites to the file menu
-	add_favourites_to_menu(dir_home, config, file_menu);
-
-	// Post Init
-	g_timeout_add(200, plugin_post_init_200ms, NULL);
-
-	// Free resources
-	free((char*) dir_home);
+	// Search in all open documents
+	const char *GEANY_KEYS_GGU_SEARCH_DOCUMENTS_LABEL = _("[GGU] Search in open documents");
+	plugin_private.menuitem_search_documents = ui_image_menu_item_new(NULL, GEANY_KEYS_GGU_SEARCH_DOCUMENTS_LABEL);
+	g_signal_connect(G_OBJECT(plugin_private.menuitem_search_documents), "activate", G_CALLBACK(on_item_activated_by_id), GINT_TO_POINTER(GEANY_KEYS_GGU_SEARCH_DOCUMENTS));
+	gtk_widget_show_all(plugin_private.menuitem_search_documents);
+	gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), plugin_private.menuitem_search_documents);
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_SEARCH_DOCUMENTS, NULL, 0, 0, "ggu_search_documents", GEANY_KEYS_GGU_SEARCH_DOCUMENTS_LABEL, plugin_private.menuitem_search_documents);
+
+	// Quick open
+	const char *GEANY_KEYS_GGU_QUICK_OPEN_LABEL = _("[GGU] Quick open");
+	plugin_private.menuitem_quick_open = ui_image_menu_item_new(NULL, GEANY_KEYS_GGU_QUICK_OPEN_LABEL);
+	g_signal_connect(G_OBJECT(plugin_private.menuitem_quick_open), "activate", G_CALLBACK(on_item_activated_by_id), GINT_TO_POINTER(GEANY_KEYS_GGU_QUICK_OPEN));
+	gtk_widget_show_all(plugin_private.menuitem_quick_open);
+	gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), plugin_private.menuitem_quick_open);
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_QUICK_OPEN, NULL, 0, 0, "ggu_quick_open", GEANY_KEYS_GGU_QUICK_OPEN_LABEL, plugin_private.menuitem_quick_open);
+
+	// Telemetry export
+	const char *GEANY_KEYS_GGU_TELEMETRY_EXPORT_LABEL = _("[GGU] Telemetry export (latency percentiles)");
+	plugin_private.menuitem_telemetry_export = ui_image_menu_item_new(NULL, GEANY_KEYS_GGU_TELEMETRY_EXPORT_LABEL);
+	g_signal_connect(G_OBJECT(plugin_private.menuitem_telemetry_export), "activate", G_CALLBACK(on_item_activated_by_id), GINT_TO_POINTER(GEANY_KEYS_GGU_TELEMETRY_EXPORT));
+	gtk_widget_show_all(plugin_private.menuitem_telemetry_export);
+	gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), plugin_private.menuitem_telemetry_export);
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_TELEMETRY_EXPORT, NULL, 0, 0, "ggu_telemetry_export", GEANY_KEYS_GGU_TELEMETRY_EXPORT_LABEL, plugin_private.menuitem_telemetry_export);
+
+	// Large file mode
+	const char *GEANY_KEYS_GGU_LARGE_FILE_TOGGLE_LABEL = _("[GGU] Large file mode (toggle)");
+	plugin_private.menuitem_large_file_toggle = ui_image_menu_item_new(NULL, GEANY_KEYS_GGU_LARGE_FILE_TOGGLE_LABEL);
+	g_signal_connect(G_OBJECT(plugin_private.menuitem_large_file_toggle), "activate", G_CALLBACK(on_item_activated_by_id), GINT_TO_POINTER(GEANY_KEYS_GGU_LARGE_FILE_TOGGLE));
+	gtk_widget_show_all(plugin_private.menuitem_large_file_toggle);
+	gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), plugin_private.menuitem_large_file_toggle);
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_LARGE_FILE_TOGGLE, NULL, 0, 0, "ggu_large_file_toggle", GEANY_KEYS_GGU_LARGE_FILE_TOGGLE_LABEL, plugin_private.menuitem_large_file_toggle);
+
+	// JSON go to path
+	const char *GEANY_KEYS_GGU_JSON_GOTO_PATH_LABEL = _("[GGU] JSON go to path");
+	plugin_private.menuitem_json_goto_path = ui_image_menu_item_new(NULL, GEANY_KEYS_GGU_JSON_GOTO_PATH_LABEL);
+	g_signal_connect(G_OBJECT(plugin_private.menuitem_json_goto_path), "activate", G_CALLBACK(on_item_activated_by_id), GINT_TO_POINTER(GEANY_KEYS_GGU_JSON_GOTO_PATH));
+	gtk_widget_show_all(plugin_private.menuitem_json_goto_path);
+	gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), plugin_private.menuitem_json_goto_path);
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_JSON_GOTO_PATH, NULL, 0, 0, "ggu_json_goto_path", GEANY_KEYS_GGU_JSON_GOTO_PATH_LABEL, plugin_private.menuitem_json_goto_path);
+
+	// Pretty print only the block around the cursor
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_JSON_PRETTY_BLOCK, NULL, 0, 0, "ggu_json_pretty_block", _("[GGU] JSON pretty (block at cursor)"), NULL);
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_XML_PRETTY_BLOCK, NULL, 0, 0, "ggu_xml_pretty_block", _("[GGU] XML/HTML pretty (element at cursor)"), NULL);
+	keybindings_set_item(plugin_private.keybinding_group, GEANY_KEYS_GGU_JSON_MATCH_BRACKET, NULL, 0, 0, "ggu_json_match_bracket", _("[GGU] JSON matching bracket (indexed)"), NULL);
+	startup_timing_add("keybindings", time_keybindings);
+
+	// Settings, restyling, favourites and treebrowser once Geany is up
+	if (main_is_realized()) { // Enabled in the plugin manager
+		plugin_private.startup_idle = g_idle_add(on_startup_idle, NULL);
+	} else {
+		plugin_signal_connect(geany_plugin, NULL, "geany-startup-complete", FALSE, (GCallback) &on_geany_startup_complete, NULL);
+	}
+	plugin_private.startup_init_us = g_get_monotonic_time() - time_start;
 }
 
 // Plugin destructor
@@ -645,6 +3542,100 @@ void plugin_init(GeanyData *geany_data) {
 void plugin_cleanup(void) {
 	GList *iterator = NULL;
 
+	if (plugin_private.startup_idle != 0) {
+		g_source_remove(plugin_private.startup_idle);
+		plugin_private.startup_idle = 0;
+	}
+	if (plugin_private.startup_config != NULL) {
+		g_key_file_free(plugin_private.startup_config);
+		plugin_private.startup_config = NULL;
+	}
+	g_string_free(plugin_private.startup_timing, TRUE);
+	plugin_private.startup_timing = NULL;
+
+	if (plugin_private.pipe_job != NULL) {
+		GeanyDocument *doc = plugin_private.pipe_job->user_data;
+		if (DOC_VALID(doc) && doc->id == plugin_private.pipe_doc_id) {
+			scintilla_send_message(doc->editor->sci, SCI_SETREADONLY, doc->readonly, 0);
+		}
+		gs_pipe_job_abort(plugin_private.pipe_job);
+		plugin_private.pipe_job = NULL;
+	}
+	ui_pipe_progress_stop();
+	ui_search_documents_stop();
+	g_free(plugin_private.search_pattern);
+	plugin_private.search_pattern = NULL;
+	ui_xml_query_stop();
+	g_free(plugin_private.xml_query_text);
+	plugin_private.xml_query_text = NULL;
+	ui_diff_stop();
+	guint i;
+	foreach_document(i) {
+		ui_diff_clear(documents[i]->editor->sci);
+	}
+	ui_quick_open_scan_stop();
+	ui_quick_open_monitors_free();
+	if (plugin_private.quick_open_rescan != 0) {
+		g_source_remove(plugin_private.quick_open_rescan);
+		plugin_private.quick_open_rescan = 0;
+	}
+	gs_path_index_free(plugin_private.quick_open_index);
+	plugin_private.quick_open_index = NULL;
+	g_strfreev(plugin_private.quick_open_roots);
+	plugin_private.quick_open_roots = NULL;
+	if (plugin_private.format_timer != 0) {
+		g_source_remove(plugin_private.format_timer);
+		plugin_private.format_timer = 0;
+	}
+	if (plugin_private.format_queue != NULL) {
+		gs_format_queue_free(plugin_private.format_queue); // Results are dropped
+		plugin_private.format_queue = NULL;
+	}
+	g_strfreev(plugin_private.format_on_save);
+	plugin_private.format_on_save = NULL;
+	g_hash_table_destroy(plugin_private.doc_versions);
+	plugin_private.doc_versions = NULL;
+	g_hash_table_destroy(plugin_private.coprocesses);
+	g_hash_table_destroy(plugin_private.formatters);
+	gs_pipe_cache_trim(plugin_private.pipe_cache, 0);
+	g_free(plugin_private.pipe_cache);
+	g_list_free_full(plugin_private.pipe_history, g_free);
+	plugin_private.pipe_history = NULL;
+
+	if (plugin_private.telemetry_paint_handler != 0) {
+		g_signal_handler_disconnect(plugin_private.telemetry_clock, plugin_private.telemetry_paint_handler);
+		plugin_private.telemetry_paint_handler = 0;
+		plugin_private.telemetry_clock = NULL;
+	}
+	g_array_free(plugin_private.telemetry_pending, TRUE);
+	plugin_private.telemetry_pending = NULL;
+	if (plugin_private.telemetry != NULL) {
+		gs_telemetry_free(plugin_private.telemetry);
+		plugin_private.telemetry = NULL;
+	}
+	g_hash_table_destroy(plugin_private.large_files); // Documents stay as they are
+	plugin_private.large_files = NULL;
+	if (plugin_private.json_index_timer != 0) {
+		g_source_remove(plugin_private.json_index_timer);
+		plugin_private.json_index_timer = 0;
+	}
+	g_hash_table_destroy(plugin_private.json_indexes); // Running builds are cancelled
+	plugin_private.json_indexes = NULL;
+
+	if (plugin_private.favourites_conf_timer != 0) {
+		g_source_remove(plugin_private.favourites_conf_timer);
+		plugin_private.favourites_conf_timer = 0;
+	}
+	g_clear_object(&plugin_private.favourites_conf_monitor);
+	g_cancellable_cancel(plugin_private.favourites_cancellable);
+	g_clear_object(&plugin_private.favourites_cancellable);
+	if (plugin_private.favourites_checked != NULL) { // Not set up if unloaded during startup
+		g_hash_table_destroy(plugin_private.favourites_checked);
+		plugin_private.favourites_checked = NULL;
+	}
+	g_free(plugin_private.favourites);
+	plugin_private.favourites = NULL;
+
 	if (GTK_IS_WIDGET(plugin_private.toolbar_item_favourites)) {
 		gtk_menu_tool_button_set_menu(plugin_private.toolbar_item_favourites, NULL);
 		gtk_widget_destroy(GTK_WIDGET(plugin_private.toolbar_item_favourites));
@@ -654,6 +3645,21 @@ void plugin_cleanup(void) {
 	if (GTK_IS_WIDGET(plugin_private.menuitem_json_pretty))  { gtk_widget_destroy(plugin_private.menuitem_json_pretty); }
 	if (GTK_IS_WIDGET(plugin_private.menuitem_xml_pretty))   { gtk_widget_destroy(plugin_private.menuitem_xml_pretty); }
 	if (GTK_IS_WIDGET(plugin_private.menuitem_pipe))         { gtk_widget_destroy(plugin_private.menuitem_pipe); }
+	if (GTK_IS_WIDGET(plugin_private.menuitem_ndjson_pretty)) { gtk_widget_destroy(plugin_private.menuitem_ndjson_pretty); }
+	if (GTK_IS_WIDGET(plugin_private.menuitem_ndjson_minify)) { gtk_widget_destroy(plugin_private.menuitem_ndjson_minify); }
+	if (GTK_IS_WIDGET(plugin_private.menuitem_json_fragments)) { gtk_widget_destroy(plugin_private.menuitem_json_fragments); }
+	if (GTK_IS_WIDGET(plugin_private.menuitem_json_validate)) { gtk_widget_destroy(plugin_private.menuitem_json_validate); }
+	if (GTK_IS_WIDGET(plugin_private.menuitem_format))       { gtk_widget_destroy(plugin_private.menuitem_format); }
+	if (GTK_IS_WIDGET(plugin_private.menuitem_search_documents)) { gtk_widget_destroy(plugin_private.menuitem_search_documents); }
+	if (GTK_IS_WIDGET(plugin_private.menuitem_quick_open))   { gtk_widget_destroy(plugin_private.menuitem_quick_open); }
+	if (GTK_IS_WIDGET(plugin_private.menuitem_telemetry_export)) { gtk_widget_destroy(plugin_private.menuitem_telemetry_export); }
+	if (GTK_IS_WIDGET(plugin_private.menuitem_large_file_toggle)) { gtk_widget_destroy(plugin_private.menuitem_large_file_toggle); }
+	if (GTK_IS_WIDGET(plugin_private.menuitem_json_goto_path)) { gtk_widget_destroy(plugin_private.menuitem_json_goto_path); }
+	if (GTK_IS_WIDGET(plugin_private.menuitem_xml_query))    { gtk_widget_destroy(plugin_private.menuitem_xml_query); }
+	if (GTK_IS_WIDGET(plugin_private.menuitem_diff))         { gtk_widget_destroy(plugin_private.menuitem_diff); }
+	if (GTK_IS_WIDGET(plugin_private.menuitem_transform))    { gtk_widget_destroy(plugin_private.menuitem_transform); }
+	if (GTK_IS_WIDGET(plugin_private.large_file_indicator))  { gtk_widget_destroy(plugin_private.large_file_indicator); }
+	if (GTK_IS_WIDGET(plugin_private.json_path_label))       { gtk_widget_destroy(plugin_private.json_path_label); }
 
 	for (iterator = &(plugin_private.menuitem_list); iterator; iterator = iterator->next) {
 		if (GTK_IS_WIDGET(iterator->data)) { gtk_widget_destroy(iterator->data); }
@@ -0,0 +1,5297 @@
+//######################################################################################################
+//
+// > ggucore: Text processing core of geanygsantnerutils (formatters, pipe, transforms, diff, search, ..)
+//
+// Authors:
+//   2019-2023 Gregor Santner, gsantner AT mailbox DOT org
+//
+// License: Public domain / Creative Commons Zero 1.0
+//
+//######################################################################################################
+//
+// Depends on GLib/GIO only, no Geany or Scintilla. Built as static library libggucore.a which is
+// linked into the plugin and into ggubench (make test / make bench).
+//
+//######################################################################################################
+// vim: sw=4 ts=4 ft=c noexpandtab:
+
+// Includes
+#define _GNU_SOURCE // memmem, memrchr
+#include "ggucore.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+//######################################################################################################
+// JSON engine
+//
+// Single pass tokenizer which validates and pretty-prints at the same time. Output follows
+// `python3 -m json.tool --indent=N`: one member per line, `": "` after keys, `{}`/`[]` for empty
+// containers. With indent=0 the output is compact (like --compact). Strings and numbers are copied
+// verbatim, hence unicode stays as-is instead of being \u-escaped.
+// Nesting is tracked on a heap stack, so deeply nested input doesn't hit the C stack.
+
+// Lookup: characters that end a run of plain string content
+static const guint8 gs_json_string_special[256] = {
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	0,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,1,0,0,0,
+};
+
+// Find the next `"`, `\` or control character in string content, starting at p
+// Uses SSE2 to test 16 bytes per step where available, the lookup table for the rest
+const gchar* gs_json_scan_string_special(const gchar *p, const gchar *end) {
+#ifdef __SSE2__
+	const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\'), ctrl = _mm_set1_epi8(0x1F);
+	for (; end - p >= 16; p += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*) p);
+		__m128i hits  = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+		                             _mm_cmpeq_epi8(_mm_min_epu8(chunk, ctrl), chunk));
+		int mask = _mm_movemask_epi8(hits);
+		if (mask != 0) {
+			return p + __builtin_ctz(mask);
+		}
+	}
+#endif
+	while (p < end && !gs_json_string_special[(guint8) *p]) {
+		p++;
+	}
+	return p;
+}
+
+static inline const gchar* gs_json_skip_ws(const gchar *p, const gchar *end) {
+	while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+		p++;
+	}
+	return p;
+}
+
+// Validate string starting at opening quote p, return pointer behind closing quote or NULL on error
+static const gchar* gs_json_scan_string(const gchar *p, const gchar *end, const gchar **errpos, const gchar **errmsg) {
+	for (p++; ; ) {
+		p = gs_json_scan_string_special(p, end);
+		if (p >= end) {
+			*errpos = end; *errmsg = "Unterminated string";
+			return NULL;
+		} else if (*p == '"') {
+			return p + 1;
+		} else if (*p == '\\') {
+			if (p + 1 >= end) {
+				*errpos = end; *errmsg = "Unterminated string";
+				return NULL;
+			}
+			switch (p[1]) {
+			case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+				p += 2;
+				break;
+			case 'u':
+				if (end - p < 6 || !g_ascii_isxdigit(p[2]) || !g_ascii_isxdigit(p[3]) || !g_ascii_isxdigit(p[4]) || !g_ascii_isxdigit(p[5])) {
+					*errpos = p; *errmsg = "Invalid \\u escape in string";
+					return NULL;
+				}
+				p += 6;
+				break;
+			default:
+				*errpos = p; *errmsg = "Invalid escape in string";
+				return NULL;
+			}
+		} else {
+			*errpos = p; *errmsg = "Invalid control character in string";
+			return NULL;
+		}
+	}
+}
+
+// Validate number starting at p, return pointer behind it or NULL on error
+static const gchar* gs_json_scan_number(const gchar *p, const gchar *end, const gchar **errpos, const gchar **errmsg) {
+	const gchar *begin = p;
+	if (p < end && *p == '-') {
+		p++;
+	}
+	if (p < end && *p == '0') {
+		p++;
+	} else if (p < end && *p >= '1' && *p <= '9') {
+		while (++p < end && g_ascii_isdigit(*p));
+	} else {
+		*errpos = p; *errmsg = "Invalid number";
+		return NULL;
+	}
+	if (p < end && *p == '.') {
+		if (++p >= end || !g_ascii_isdigit(*p)) {
+			*errpos = p; *errmsg = "Invalid number, expected digit after '.'";
+			return NULL;
+		}
+		while (++p < end && g_ascii_isdigit(*p));
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		if (++p < end && (*p == '+' || *p == '-')) {
+			p++;
+		}
+		if (p >= end || !g_ascii_isdigit(*p)) {
+			*errpos = p; *errmsg = "Invalid number, expected digit in exponent";
+			return NULL;
+		}
+		while (++p < end && g_ascii_isdigit(*p));
+	}
+	return p > begin ? p : NULL;
+}
+
+// Append newline and indentation for given depth
+static inline void gs_json_newline(GString *out, gint indent, gsize depth) {
+	static const gchar spaces[] = "                                                                ";
+	gsize n = depth * (gsize) indent;
+	g_string_append_c(out, '\n');
+	for (; n > sizeof(spaces) - 1; n -= sizeof(spaces) - 1) {
+		g_string_append_len(out, spaces, sizeof(spaces) - 1);
+	}
+	g_string_append_len(out, spaces, n);
+}
+
+// Prefix every line of out except the first one with indentation, so a reformatted block fits its position
+void gs_string_indent_lines(GString *out, const gchar *indentation) {
+	gsize indent_len = strlen(indentation), lines = 0;
+	if (indent_len == 0) {
+		return;
+	}
+	for (const gchar *p = out->str; (p = memchr(p, '\n', out->str + out->len - p)) != NULL; p++) {
+		lines++;
+	}
+	GString *indented = g_string_sized_new(out->len + lines * indent_len + 1);
+	for (gsize pos = 0, next; pos < out->len; pos = next) {
+		const gchar *nl = memchr(out->str + pos, '\n', out->len - pos);
+		next = nl != NULL ? (gsize)(nl - out->str) + 1 : out->len;
+		if (pos > 0) {
+			g_string_append_len(indented, indentation, indent_len);
+		}
+		g_string_append_len(indented, out->str + pos, next - pos);
+	}
+	g_string_truncate(out, 0);
+	g_string_append_len(out, indented->str, indented->len);
+	g_string_free(indented, TRUE);
+}
+
+const gchar gs_json_err_extra_data[] = "Extra data after JSON value";
+
+// Validate and reformat one JSON value at the start of text[0..len). indent > 0: pretty-print, indent == 0:
+// compact. out may be NULL to only validate. consumed == NULL: only whitespace may follow the value,
+// otherwise data after the value is allowed and *consumed is set to the end of the value.
+// Returns TRUE on success, otherwise err is filled and out contains a partial result
+static gboolean gs_json_parse(const gchar *text, gsize len, gint indent, GString *out, GsParseError *err, gsize *consumed) {
+	enum { EXPECT_VALUE, EXPECT_KEY, AFTER_VALUE } expect = EXPECT_VALUE;
+	const gchar *p = text, *end = text + len, *tok, *errpos = NULL, *errmsg = NULL;
+	GByteArray *stack = g_byte_array_new(); // Open containers: '{' or '['
+	const gchar *key_separator = indent > 0 ? ": " : ":";
+
+	p = gs_json_skip_ws(p, end);
+	while (errmsg == NULL) {
+		if (expect == AFTER_VALUE) {
+			if (stack->len == 0 && consumed != NULL) {
+				*consumed = p - text;
+				break;
+			}
+			p = gs_json_skip_ws(p, end);
+			if (stack->len == 0) {
+				if (p < end) {
+					errpos = p; errmsg = gs_json_err_extra_data;
+				}
+				break;
+			}
+			guint8 top = stack->data[stack->len - 1];
+			if (p >= end) {
+				errpos = p; errmsg = top == '{' ? "Expected ',' or '}' but reached end of input" : "Expected ',' or ']' but reached end of input";
+			} else if (*p == ',') {
+				p = gs_json_skip_ws(p + 1, end);
+				if (out) {
+					g_string_append_c(out, ',');
+					if (indent > 0) {
+						gs_json_newline(out, indent, stack->len);
+					}
+				}
+				expect = top == '{' ? EXPECT_KEY : EXPECT_VALUE;
+			} else if ((*p == '}' && top == '{') || (*p == ']' && top == '[')) {
+				g_byte_array_set_size(stack, stack->len - 1);
+				if (out) {
+					if (indent > 0) {
+						gs_json_newline(out, indent, stack->len);
+					}
+					g_string_append_c(out, *p);
+				}
+				p++;
+			} else {
+				errpos = p; errmsg = top == '{' ? "Expected ',' or '}'" : "Expected ',' or ']'";
+			}
+			continue;
+		}
+
+		if (p >= end) {
+			errpos = p; errmsg = expect == EXPECT_KEY ? "Expected string key but reached end of input" : "Expected value but reached end of input";
+			continue;
+		}
+
+		if (expect == EXPECT_KEY) {
+			if (*p != '"') {
+				errpos = p; errmsg = "Expected string key in double quotes";
+				continue;
+			}
+			if ((tok = gs_json_scan_string(p, end, &errpos, &errmsg)) == NULL) {
+				continue;
+			}
+			if (out) {
+				g_string_append_len(out, p, tok - p);
+			}
+			p = gs_json_skip_ws(tok, end);
+			if (p >= end || *p != ':') {
+				errpos = p; errmsg = "Expected ':' after key";
+				continue;
+			}
+			p = gs_json_skip_ws(p + 1, end);
+			if (out) {
+				g_string_append(out, key_separator);
+			}
+			expect = EXPECT_VALUE;
+			continue;
+		}
+
+		// EXPECT_VALUE
+		tok = NULL;
+		switch (*p) {
+		case '{':
+		case '[': {
+			if (out) {
+				g_string_append_c(out, *p);
+			}
+			const gchar close = *p == '{' ? '}' : ']';
+			const gchar *next = gs_json_skip_ws(p + 1, end);
+			if (next < end && *next == close) { // Empty container
+				if (out) {
+					g_string_append_c(out, close);
+				}
+				p = next + 1;
+				expect = AFTER_VALUE;
+				continue;
+			}
+			g_byte_array_append(stack, (const guint8*) p, 1);
+			if (out && indent > 0) {
+				gs_json_newline(out, indent, stack->len);
+			}
+			expect = *p == '{' ? EXPECT_KEY : EXPECT_VALUE;
+			p = next;
+			continue;
+		}
+		case '"':
+			tok = gs_json_scan_string(p, end, &errpos, &errmsg);
+			break;
+		case 't':
+			tok = (end - p >= 4 && memcmp(p, "true", 4) == 0) ? p + 4 : NULL;
+			break;
+		case 'f':
+			tok = (end - p >= 5 && memcmp(p, "false", 5) == 0) ? p + 5 : NULL;
+			break;
+		case 'n':
+			tok = (end - p >= 4 && memcmp(p, "null", 4) == 0) ? p + 4 : NULL;
+			break;
+		default:
+			if (*p == '-' || g_ascii_isdigit(*p)) {
+				tok = gs_json_scan_number(p, end, &errpos, &errmsg);
+			}
+			break;
+		}
+		if (tok == NULL) {
+			if (errmsg == NULL) {
+				errpos = p; errmsg = "Expected value";
+			}
+			continue;
+		}
+		if (out) {
+			g_string_append_len(out, p, tok - p);
+		}
+		p = tok;
+		expect = AFTER_VALUE;
+	}
+
+	g_byte_array_free(stack, TRUE);
+	if (errmsg != NULL) {
+		if (err) {
+			err->offset  = errpos - text;
+			err->message = errmsg;
+		}
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// Validate and reformat exactly one JSON value (surrounded by optional whitespace) of text[0..len)
+gboolean gs_json_format(const gchar *text, gsize len, gint indent, GString *out, GsParseError *err) {
+	return gs_json_parse(text, len, indent, out, err, NULL);
+}
+
+// Bracket pairs of text in one pass, ordered by the opening one. Quotes count only inside of brackets,
+// the prose around fragments has its own. A closing bracket of the wrong kind or a line break in a
+// string leaves the open brackets without a pair (close G_MAXSIZE): No JSON value can start there
+typedef struct {
+	gsize open, close;
+} GsJsonBrackets;
+
+static GArray* gs_json_match_brackets(const gchar *text, gsize len) {
+	GArray *pairs = g_array_new(FALSE, FALSE, sizeof(GsJsonBrackets));
+	GArray *open = g_array_new(FALSE, FALSE, sizeof(guint)); // Indexes of unpaired pairs
+	gboolean in_string = FALSE;
+	for (gsize i = 0; i < len; i++) {
+		gchar c = text[i];
+		if (in_string) {
+			if (c == '\\') {
+				i++;
+			} else if (c == '"' || c == '\n') {
+				in_string = FALSE;
+				g_array_set_size(open, c == '\n' ? 0 : open->len);
+			}
+		} else if (c == '{' || c == '[') {
+			GsJsonBrackets pair = { i, G_MAXSIZE };
+			guint index = pairs->len;
+			g_array_append_val(pairs, pair);
+			g_array_append_val(open, index);
+		} else if ((c == '}' || c == ']') && open->len > 0) {
+			GsJsonBrackets *pair = &g_array_index(pairs, GsJsonBrackets, g_array_index(open, guint, open->len - 1));
+			if (text[pair->open] == (c == '}' ? '{' : '[')) {
+				pair->close = i;
+				g_array_set_size(open, open->len - 1);
+			} else {
+				g_array_set_size(open, 0);
+			}
+		} else if (c == '"' && open->len > 0) {
+			in_string = TRUE;
+		}
+	}
+	g_array_free(open, TRUE);
+	return pairs;
+}
+
+// Reformat every JSON object or array embedded in text[0..len), like payloads behind log prefixes, and
+// copy the text around them unchanged. Arrays count only if they contain objects or arrays, so "[1]"
+// or "[INFO]" in plain text stay as they are. Fragments are indented like the line they start in.
+// Only balanced bracket pairs are parsed, each up to its closing bracket. If one fails at an error, the
+// brackets opened before the error and closed behind it fail there as well and are skipped, so the
+// scan stays linear, also for unbalanced openers like "[[[[" or truncated records.
+// Returns the number of reformatted fragments
+guint gs_json_format_fragments(const gchar *text, gsize len, gint indent, GString *out) {
+	const gchar *end = text + len, *copied = text, *line_start = text;
+	GString *fragment = g_string_new(NULL);
+	GArray *pairs = gs_json_match_brackets(text, len);
+	gsize failed_at = 0; // Error offset of the last failed candidate
+	guint count = 0;
+
+	for (guint i = 0; i < pairs->len; i++) {
+		const GsJsonBrackets *pair = &g_array_index(pairs, GsJsonBrackets, i);
+		const gchar *p = text + pair->open;
+		if (p < copied || pair->close == G_MAXSIZE || (pair->open < failed_at && pair->close >= failed_at)) {
+			continue;
+		}
+		const gchar *first = gs_json_skip_ws(p + 1, end);
+		gsize consumed = 0;
+		GsParseError err = { 0, NULL };
+		g_string_truncate(fragment, 0);
+		if (*p == '[' && *first != '{' && *first != '[') {
+			continue;
+		} else if (!gs_json_parse(p, pair->close - pair->open + 1, indent, NULL, &err, &consumed)) {
+			failed_at = pair->open + err.offset; // Validated first: the indented output of deeply nested candidates can be huge
+			continue;
+		}
+		gs_json_parse(p, consumed, indent, fragment, NULL, NULL);
+
+		// Indentation of the line the fragment starts in
+		const gchar *nl = memrchr(copied, '\n', p - copied);
+		line_start = nl != NULL ? nl + 1 : line_start;
+		const gchar *indent_end = line_start;
+		while (indent_end < p && (*indent_end == ' ' || *indent_end == '\t')) {
+			indent_end++;
+		}
+		gchar *indentation = g_strndup(line_start, indent_end - line_start);
+		gs_string_indent_lines(fragment, indentation);
+		g_free(indentation);
+
+		g_string_append_len(out, copied, p - copied);
+		g_string_append_len(out, fragment->str, fragment->len);
+		nl = memrchr(p, '\n', consumed);
+		line_start = nl != NULL ? nl + 1 : line_start;
+		copied = p + consumed;
+		count++;
+	}
+	g_string_append_len(out, copied, end - copied);
+	g_string_free(fragment, TRUE);
+	g_array_free(pairs, TRUE);
+	return count;
+}
+
+// Offset of the first a or b in text, len if none
+gsize gs_mem_first_of(const gchar *text, gsize len, gchar a, gchar b) {
+	const gchar *pa = memchr(text, a, len);
+	const gchar *pb = memchr(text, b, pa != NULL ? (gsize)(pa - text) : len);
+	return pb != NULL ? (gsize)(pb - text) : (pa != NULL ? (gsize)(pa - text) : len);
+}
+
+// Offset behind the last a or b in text, 0 if none. Scans backwards in place
+gsize gs_mem_end_of_last(const gchar *text, gsize len, gchar a, gchar b) {
+	const gchar *pa = memrchr(text, a, len);
+	gsize from = pa != NULL ? (gsize)(pa - text) + 1 : 0;
+	const gchar *pb = memrchr(text + from, b, len - from);
+	return pb != NULL ? (gsize)(pb - text) + 1 : from;
+}
+
+//######################################################################################################
+// NDJSON / JSON Lines engine
+//
+// Every line holds one JSON value. The text is cut into batches of whole lines, which are formatted by
+// gs_json_format on a GThreadPool. Each batch has its own output and error list, they are joined in
+// order when all batches are done. Invalid lines are kept as they are.
+
+#define GS_NDJSON_BATCH_SIZE (1024 * 1024)
+
+typedef struct {
+	const gchar *text;
+	gsize        len;
+	gint         indent;
+	GString     *out;
+	GArray      *errors;    // GsNdjsonError, lines relative to the batch
+	guint        lines, out_lines;
+} GsNdjsonBatch;
+
+static void gs_ndjson_format_batch(gpointer data, gpointer user_data) {
+	GsNdjsonBatch *batch = data;
+	const gchar *p = batch->text, *end = batch->text + batch->len;
+	batch->out = g_string_sized_new(batch->len + (batch->indent > 0 ? batch->len : 0) + 1);
+	batch->errors = g_array_new(FALSE, FALSE, sizeof(GsNdjsonError));
+
+	for (; p < end; batch->lines++, batch->out_lines++) {
+		const gchar *nl = memchr(p, '\n', end - p);
+		const gchar *next = nl != NULL ? nl + 1 : end;
+		const gchar *content_end = nl != NULL ? nl : end;
+		content_end -= (content_end > p && content_end[-1] == '\r'); // Keep CRLF line endings
+
+		gsize out_start = batch->out->len;
+		GsParseError err = { 0, NULL };
+		if (gs_json_skip_ws(p, content_end) == content_end) {
+			// Empty line, keep it
+		} else if (gs_json_format(p, content_end - p, batch->indent, batch->out, &err)) {
+			for (const gchar *q = batch->out->str + out_start; batch->indent > 0 && (q = memchr(q, '\n', batch->out->str + batch->out->len - q)) != NULL; q++) {
+				batch->out_lines++;
+			}
+		} else {
+			GsNdjsonError error = { batch->lines, batch->out_lines, err.offset, err.message };
+			g_array_append_val(batch->errors, error);
+			g_string_truncate(batch->out, out_start);
+			g_string_append_len(batch->out, p, content_end - p);
+		}
+		g_string_append_len(batch->out, content_end, next - content_end);
+		p = next;
+	}
+}
+
+// Format every line of text[0..len) as one JSON value, pretty (indent > 0) or minified (indent == 0),
+// using all cores. Lines that are no valid JSON are appended to errors. Returns the number of lines
+guint gs_ndjson_format(const gchar *text, gsize len, gint indent, GString *out, GArray *errors) {
+	GPtrArray *batches = g_ptr_array_new();
+	GThreadPool *pool = g_thread_pool_new(gs_ndjson_format_batch, NULL, g_get_num_processors(), FALSE, NULL);
+
+	// Cut at line ends behind every GS_NDJSON_BATCH_SIZE bytes
+	for (gsize pos = 0, batch_end; pos < len; pos = batch_end) {
+		const gchar *nl = NULL;
+		batch_end = pos + GS_NDJSON_BATCH_SIZE;
+		if (batch_end >= len || (nl = memchr(text + batch_end - 1, '\n', len - batch_end + 1)) == NULL) {
+			batch_end = len;
+		} else {
+			batch_end = nl + 1 - text;
+		}
+		GsNdjsonBatch *batch = g_new0(GsNdjsonBatch, 1);
+		batch->text = text + pos;
+		batch->len = batch_end - pos;
+		batch->indent = indent;
+		g_ptr_array_add(batches, batch);
+		g_thread_pool_push(pool, batch, NULL);
+	}
+	g_thread_pool_free(pool, FALSE, TRUE); // Waits for all batches
+
+	// Join in order
+	guint lines = 0, out_lines = 0;
+	for (guint i = 0; i < batches->len; i++) {
+		GsNdjsonBatch *batch = g_ptr_array_index(batches, i);
+		g_string_append_len(out, batch->out->str, batch->out->len);
+		for (guint e = 0; e < batch->errors->len; e++) {
+			GsNdjsonError error = g_array_index(batch->errors, GsNdjsonError, e);
+			error.line += lines;
+			error.out_line += out_lines;
+			g_array_append_val(errors, error);
+		}
+		lines += batch->lines;
+		out_lines += batch->out_lines;
+		g_string_free(batch->out, TRUE);
+		g_array_free(batch->errors, TRUE);
+		g_free(batch);
+	}
+	g_ptr_array_free(batches, TRUE);
+	return lines;
+}
+
+//######################################################################################################
+// XML / HTML engine
+//
+// Tokenizer without any element stack: the scanner is a plain value struct, copy it to peek ahead.
+// The indenter only keeps the current depth, so memory doesn't depend on how deep the document is
+// nested. Layout follows `tidy -xml -w 105 --indent auto --indent-spaces 2 --indent-attributes y`.
+
+static const gchar *gs_html_void_elements[] = { "area", "base", "br", "col", "embed", "hr", "img", "input", "link", "meta", "param", "source", "track", "wbr", NULL };
+static const gchar *gs_html_raw_elements[]  = { "script", "style", "pre", "textarea", NULL };
+
+static gboolean gs_xml_name_in(const gchar *name, gsize len, const gchar **list) {
+	for (; *list != NULL; list++) {
+		if (strlen(*list) == len && g_ascii_strncasecmp(name, *list, len) == 0) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static inline gboolean gs_xml_is_name_char(gchar c) {
+	return g_ascii_isalnum(c) || c == '_' || c == ':' || c == '-' || c == '.' || (guchar) c >= 0x80;
+}
+
+// Find needle in p[0..end), return pointer to it or NULL
+static inline const gchar* gs_memmem(const gchar *p, const gchar *end, const gchar *needle, gsize needle_len) {
+	return p < end ? memmem(p, end - p, needle, needle_len) : NULL;
+}
+
+void gs_xml_scanner_init(GsXmlScanner *s, const gchar *text, gsize len, gboolean html) {
+	memset(s, 0, sizeof(*s));
+	s->p = text;
+	s->end = text + len;
+	s->html = html;
+}
+
+// Read next token. Returns FALSE at EOF or error (type GS_XML_TOKEN_ERROR, s->errmsg set)
+gboolean gs_xml_next(GsXmlScanner *s, GsXmlToken *t) {
+	const gchar *p = s->p, *end = s->end, *q;
+	memset(t, 0, sizeof(*t));
+	t->start = p;
+
+	if (p >= end) {
+		t->type = GS_XML_TOKEN_EOF;
+		t->end = end;
+		return FALSE;
+	}
+
+	// Raw text: everything up to the matching end tag (HTML script/style/pre/textarea)
+	if (s->raw_name != NULL) {
+		for (q = p; (q = gs_memmem(q, end, "</", 2)) != NULL; q += 2) {
+			if ((gsize)(end - q - 2) >= s->raw_name_len && g_ascii_strncasecmp(q + 2, s->raw_name, s->raw_name_len) == 0
+					&& (q + 2 + s->raw_name_len == end || !gs_xml_is_name_char(q[2 + s->raw_name_len]))) {
+				break;
+			}
+		}
+		s->raw_name = NULL;
+		if (q != p) {
+			t->type = GS_XML_TOKEN_TEXT;
+			t->end = s->p = (q != NULL ? q : end);
+			return TRUE;
+		}
+	}
+
+	// Text
+	if (*p != '<' || p + 1 >= end || !(gs_xml_is_name_char(p[1]) || p[1] == '/' || p[1] == '!' || p[1] == '?')) {
+		for (q = p + 1; (q = memchr(q, '<', end - q)) != NULL && q + 1 < end && !(gs_xml_is_name_char(q[1]) || q[1] == '/' || q[1] == '!' || q[1] == '?'); q++);
+		t->type = GS_XML_TOKEN_TEXT;
+		t->end = s->p = (q != NULL ? q : end);
+		return TRUE;
+	}
+
+	// Comment, CDATA, declarations and processing instructions
+	const gchar *close = NULL;
+	if (end - p >= 4 && memcmp(p, "<!--", 4) == 0) {
+		t->type = GS_XML_TOKEN_COMMENT;
+		close = (q = gs_memmem(p + 4, end, "-->", 3)) != NULL ? q + 3 : NULL;
+	} else if (end - p >= 9 && memcmp(p, "<![CDATA[", 9) == 0) {
+		t->type = GS_XML_TOKEN_CDATA;
+		close = (q = gs_memmem(p + 9, end, "]]>", 3)) != NULL ? q + 3 : NULL;
+	} else if (p[1] == '?') {
+		t->type = GS_XML_TOKEN_DECL;
+		close = (q = gs_memmem(p + 2, end, "?>", 2)) != NULL ? q + 2 : NULL;
+	} else if (p[1] == '!') { // DOCTYPE, may contain an internal subset in [...]
+		gint brackets = 0;
+		t->type = GS_XML_TOKEN_DECL;
+		for (q = p + 2; q < end && (*q != '>' || brackets > 0); q++) {
+			brackets += (*q == '[') - (*q == ']');
+		}
+		close = q < end ? q + 1 : NULL;
+	}
+	if (t->type != GS_XML_TOKEN_EOF) {
+		if (close == NULL) {
+			t->type = GS_XML_TOKEN_ERROR;
+			s->errmsg = "Unterminated comment, CDATA section or declaration";
+			return FALSE;
+		}
+		t->end = s->p = close;
+		return TRUE;
+	}
+
+	// Element tag
+	gboolean is_end = p[1] == '/';
+	t->name = q = p + 1 + is_end;
+	while (q < end && gs_xml_is_name_char(*q)) {
+		q++;
+	}
+	t->name_end = t->attrs = q;
+	for (gchar quote = 0; q < end && (quote != 0 || *q != '>'); q++) {
+		if (quote != 0) {
+			quote = (*q == quote) ? 0 : quote;
+		} else if (*q == '"' || *q == '\'') {
+			quote = *q;
+		} else if (*q == '<') {
+			break;
+		}
+	}
+	if (q >= end || *q != '>' || t->name == t->name_end) {
+		t->type = GS_XML_TOKEN_ERROR;
+		s->errmsg = "Unterminated or malformed tag";
+		return FALSE;
+	}
+	t->end = s->p = q + 1;
+	t->attrs_end = q;
+	if (is_end) {
+		t->type = GS_XML_TOKEN_END;
+	} else if (q[-1] == '/' && q - 1 >= t->attrs) {
+		t->type = GS_XML_TOKEN_EMPTY;
+		t->attrs_end = q - 1;
+	} else if (s->html && gs_xml_name_in(t->name, t->name_end - t->name, gs_html_void_elements)) {
+		t->type = GS_XML_TOKEN_EMPTY;
+	} else {
+		t->type = GS_XML_TOKEN_START;
+		if (s->html && gs_xml_name_in(t->name, t->name_end - t->name, gs_html_raw_elements)) {
+			s->raw_name = t->name;
+			s->raw_name_len = t->name_end - t->name;
+		}
+	}
+	return TRUE;
+}
+
+// Iterate attributes of a tag: call with *pos = t->attrs, returns FALSE when done
+static gboolean gs_xml_next_attr(const gchar **pos, const gchar *attrs_end, const gchar **attr, const gchar **attr_end) {
+	const gchar *p = *pos;
+	while (p < attrs_end && g_ascii_isspace(*p)) {
+		p++;
+	}
+	if (p >= attrs_end) {
+		return FALSE;
+	}
+	*attr = p;
+	while (p < attrs_end && !g_ascii_isspace(*p) && *p != '=') {
+		p++;
+	}
+	const gchar *name_end = p;
+	while (p < attrs_end && g_ascii_isspace(*p)) {
+		p++;
+	}
+	if (p < attrs_end && *p == '=') {
+		for (p++; p < attrs_end && g_ascii_isspace(*p); p++);
+		if (p < attrs_end && (*p == '"' || *p == '\'')) {
+			const gchar *q = memchr(p + 1, *p, attrs_end - p - 1);
+			p = q != NULL ? q + 1 : attrs_end;
+		} else {
+			while (p < attrs_end && !g_ascii_isspace(*p)) {
+				p++;
+			}
+		}
+	} else {
+		p = name_end;
+	}
+	*attr_end = p;
+	*pos = p;
+	return TRUE;
+}
+
+// Guess whether text is HTML (instead of XML) by looking at its start
+gboolean gs_xml_looks_like_html(const gchar *text, gsize len) {
+	gsize n = MIN(len, 1024);
+	for (gsize i = 0; i + 5 <= n; i++) {
+		if (text[i] == '<' && (g_ascii_strncasecmp(text + i, "<!doctype html", MIN(14, n - i)) == 0 || g_ascii_strncasecmp(text + i, "<html", 5) == 0)) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+typedef struct {
+	GString *out;
+	gint     indent;      // Spaces per level
+	gint     width;       // Wrap text at this column
+	gsize    line_start;  // Offset in out where the current line starts
+} GsXmlWriter;
+
+static inline void gs_xml_newline(GsXmlWriter *w, gsize depth) {
+	if (w->out->len > 0) {
+		g_string_append_c(w->out, '\n');
+	}
+	w->line_start = w->out->len;
+	for (gsize n = depth * w->indent; n > 0; n--) {
+		g_string_append_c(w->out, ' ');
+	}
+}
+
+// Append whitespace-collapsed text, wrapped at the configured width
+static void gs_xml_write_text(GsXmlWriter *w, const gchar *p, const gchar *end, gsize depth) {
+	gboolean first = TRUE;
+	while (p < end) {
+		while (p < end && g_ascii_isspace(*p)) {
+			p++;
+		}
+		const gchar *word = p;
+		while (p < end && !g_ascii_isspace(*p)) {
+			p++;
+		}
+		if (word == p) {
+			break;
+		}
+		gsize column = w->out->len - w->line_start;
+		if (!first && column + 1 + (p - word) > (gsize) w->width) {
+			gs_xml_newline(w, depth);
+		} else if (!first) {
+			g_string_append_c(w->out, ' ');
+		}
+		g_string_append_len(w->out, word, p - word);
+		first = FALSE;
+	}
+}
+
+// Append tag with attributes, every attribute after the first on its own line aligned below the first
+static void gs_xml_write_tag(GsXmlWriter *w, const GsXmlToken *t) {
+	const gchar *pos = t->attrs, *attr, *attr_end;
+	gsize align = 0;
+	g_string_append_c(w->out, '<');
+	g_string_append_len(w->out, t->name, t->name_end - t->name);
+	for (gboolean first = TRUE; gs_xml_next_attr(&pos, t->attrs_end, &attr, &attr_end); first = FALSE) {
+		if (first) {
+			g_string_append_c(w->out, ' ');
+			align = w->out->len - w->line_start;
+		} else {
+			g_string_append_c(w->out, '\n');
+			w->line_start = w->out->len;
+			for (gsize n = align; n > 0; n--) {
+				g_string_append_c(w->out, ' ');
+			}
+		}
+		g_string_append_len(w->out, attr, attr_end - attr);
+	}
+	g_string_append(w->out, t->type == GS_XML_TOKEN_EMPTY ? " />" : ">");
+}
+
+static gboolean gs_xml_is_blank(const gchar *p, const gchar *end) {
+	for (; p < end; p++) {
+		if (!g_ascii_isspace(*p)) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+// Reformat XML/HTML text[0..len) with given indent and wrap width
+// Returns TRUE on success, otherwise err is filled and out contains a partial result
+gboolean gs_xml_format(const gchar *text, gsize len, gboolean html, gint indent, gint width, GString *out, GsParseError *err) {
+	GsXmlScanner s, peek;
+	GsXmlToken t, t2, t3;
+	GsXmlWriter w = { out, indent, width, out->len };
+	gsize depth = 0;
+	gs_xml_scanner_init(&s, text, len, html);
+
+	while (gs_xml_next(&s, &t)) {
+		switch (t.type) {
+		case GS_XML_TOKEN_TEXT:
+			if (!gs_xml_is_blank(t.start, t.end)) {
+				gs_xml_newline(&w, depth);
+				gs_xml_write_text(&w, t.start, t.end, depth);
+			}
+			break;
+		case GS_XML_TOKEN_START:
+			gs_xml_newline(&w, depth);
+			gs_xml_write_tag(&w, &t);
+			peek = s;
+			gs_xml_next(&peek, &t2);
+			if (s.raw_name != NULL) { // Raw text element, keep content as-is
+				if (t2.type == GS_XML_TOKEN_TEXT) {
+					g_string_append_len(out, t2.start, t2.end - t2.start);
+					s = peek;
+					gs_xml_next(&peek, &t2);
+				}
+				if (t2.type == GS_XML_TOKEN_END) {
+					g_string_append_len(out, t2.start, t2.end - t2.start);
+					s = peek;
+				} else {
+					depth++;
+				}
+				break;
+			}
+			if (t2.type == GS_XML_TOKEN_END) { // <a></a>
+				g_string_append_len(out, t2.start, t2.end - t2.start);
+				s = peek;
+				break;
+			}
+			if (t2.type == GS_XML_TOKEN_TEXT && gs_xml_next(&peek, &t3) && t3.type == GS_XML_TOKEN_END) { // <a>short text</a>
+				gsize line_start = w.line_start, line_end = out->len;
+				gs_xml_write_text(&w, t2.start, t2.end, depth + 1);
+				if (w.line_start == line_start && out->len - line_start + (t3.end - t3.start) <= (gsize) width) {
+					g_string_append_len(out, t3.start, t3.end - t3.start);
+					s = peek;
+					break;
+				}
+				g_string_truncate(out, line_end);
+				w.line_start = line_start;
+			}
+			depth++;
+			break;
+		case GS_XML_TOKEN_END:
+			depth = depth > 0 ? depth - 1 : 0;
+			gs_xml_newline(&w, depth);
+			g_string_append_len(out, t.start, t.end - t.start);
+			break;
+		case GS_XML_TOKEN_EMPTY:
+			gs_xml_newline(&w, depth);
+			gs_xml_write_tag(&w, &t);
+			break;
+		default: // Comment, CDATA, declaration: keep as-is
+			gs_xml_newline(&w, depth);
+			g_string_append_len(out, t.start, t.end - t.start);
+			break;
+		}
+	}
+
+	if (t.type == GS_XML_TOKEN_ERROR) {
+		if (err) {
+			err->offset  = t.start - text;
+			err->message = s.errmsg;
+		}
+		return FALSE;
+	}
+	return TRUE;
+}
+
+//######################################################################################################
+// XPath engine
+//
+// Evaluates a practical subset of XPath in one pass over the tokens of gs_xml_next(), without a tree:
+// child (/) and descendant (//) steps with a name or *, attribute predicates [@a], [@a='v'], [@a!='v'],
+// and a selection of the elements, their /text() or //text(), or an /@attribute. Every open element
+// keeps a bitmask of how many steps match down to it, so memory depends on the nesting depth only.
+// Element matches are held back until they are closed, which keeps the results in document order.
+// A run stops after a given number of bytes and continues where it stopped. It keeps offsets only, so
+// the text may move in memory between the calls (Scintilla's gap buffer) as long as it isn't modified.
+
+#define GS_XPATH_STEPS_MAX 63
+
+typedef struct {
+	gchar    *attr;
+	gchar    *value;   // NULL: attribute exists
+	gboolean  negate;  // [@a!='v']: attribute exists with another value
+} GsXpathPredicate;
+
+typedef struct {
+	gboolean  descendant;  // Step after //
+	gchar    *name;        // Element name, * for any
+	GArray   *predicates;  // GsXpathPredicate, all of them must hold
+} GsXpathStep;
+
+typedef struct {
+	guint64  states;          // Bit i: steps[0..i) match the elements down to this one
+	gboolean inside;          // This element or an ancestor matches all steps
+	gsize    name, name_len;  // Element name, to pair it with its end tag
+	guint64  match;           // Sequence number of its element match, G_MAXUINT64 if none
+} GsXpathFrame;
+
+void gs_xpath_free(GsXpath *xpath) {
+	for (guint i = 0; i < xpath->steps->len; i++) {
+		GsXpathStep *step = &g_array_index(xpath->steps, GsXpathStep, i);
+		for (guint j = 0; j < step->predicates->len; j++) {
+			g_free(g_array_index(step->predicates, GsXpathPredicate, j).attr);
+			g_free(g_array_index(step->predicates, GsXpathPredicate, j).value);
+		}
+		g_array_free(step->predicates, TRUE);
+		g_free(step->name);
+	}
+	g_array_free(xpath->steps, TRUE);
+	g_free(xpath->attr);
+	g_free(xpath);
+}
+
+// Element or attribute name at *p, NULL if there is none
+static gchar* gs_xpath_parse_name(const gchar **p) {
+	const gchar *start = *p;
+	while (gs_xml_is_name_char(**p)) {
+		(*p)++;
+	}
+	return *p > start ? g_strndup(start, *p - start) : NULL;
+}
+
+// Compile query like //item[@type='book']/title/text(). Returns NULL and sets *error if it isn't part of the subset
+GsXpath* gs_xpath_compile(const gchar *query, const gchar **error) {
+	GsXpath *xpath = g_new0(GsXpath, 1);
+	xpath->steps = g_array_new(FALSE, FALSE, sizeof(GsXpathStep));
+	const gchar *p = query;
+	*error = *p != '/' ? "Query must start with / or //" : NULL;
+
+	while (*error == NULL && *p == '/') {
+		gboolean descendant = p[1] == '/';
+		p += descendant ? 2 : 1;
+		if (strcmp(p, "text()") == 0) {
+			xpath->select = GS_XPATH_TEXT;
+			xpath->text_descendant = descendant;
+			p += 6;
+			break;
+		} else if (*p == '@') {
+			p++;
+			xpath->select = GS_XPATH_ATTR;
+			xpath->attr = gs_xpath_parse_name(&p);
+			*error = xpath->attr == NULL ? "Expected attribute name after @" : descendant ? "Use //*/@name for the attributes of all elements" : NULL;
+			break;
+		}
+
+		GsXpathStep step = { descendant, NULL, g_array_new(FALSE, FALSE, sizeof(GsXpathPredicate)) };
+		if (*p == '*') {
+			step.name = g_strdup("*");
+			p++;
+		} else {
+			step.name = gs_xpath_parse_name(&p);
+		}
+		g_array_append_val(xpath->steps, step);
+		if (step.name == NULL) {
+			*error = "Expected element name, *, text() or @name";
+		}
+		while (*error == NULL && *p == '[') {
+			GsXpathPredicate predicate = { NULL, NULL, FALSE };
+			if (*++p != '@' || (p++, predicate.attr = gs_xpath_parse_name(&p)) == NULL) {
+				*error = "Only attribute predicates are supported: [@name], [@name='value'] or [@name!='value']";
+				break;
+			}
+			predicate.negate = p[0] == '!' && p[1] == '=';
+			p += predicate.negate;
+			if (*p == '=') {
+				const gchar *value_end = (p[1] == '\'' || p[1] == '"') ? strchr(p + 2, p[1]) : NULL;
+				if (value_end != NULL) {
+					predicate.value = g_strndup(p + 2, value_end - p - 2);
+					p = value_end + 1;
+				} else {
+					*error = "Expected quoted value after =";
+				}
+			}
+			g_array_append_val(step.predicates, predicate);
+			if (*error == NULL && *p++ != ']') {
+				*error = "Expected ] after predicate";
+			}
+		}
+	}
+
+	if (*error == NULL && *p != '\0') {
+		*error = "Unexpected text, text() and @name must be the last step";
+	} else if (*error == NULL && xpath->steps->len == 0) {
+		*error = "Expected at least one element step, like //*/text()";
+	} else if (*error == NULL && xpath->steps->len > GS_XPATH_STEPS_MAX) {
+		*error = "Too many steps";
+	}
+	if (*error != NULL) {
+		gs_xpath_free(xpath);
+		return NULL;
+	}
+	return xpath;
+}
+
+// Whether name[0..len) is pattern. Case-insensitive for HTML, a pattern without prefix ignores the prefix (namespace) of name
+static gboolean gs_xpath_name_matches(const gchar *pattern, const gchar *name, gsize len, gboolean html) {
+	const gchar *colon;
+	if (strchr(pattern, ':') == NULL && (colon = memchr(name, ':', len)) != NULL) {
+		len -= colon + 1 - name;
+		name = colon + 1;
+	}
+	return strlen(pattern) == len && (html ? g_ascii_strncasecmp(pattern, name, len) == 0 : memcmp(pattern, name, len) == 0);
+}
+
+// Value of attribute name of tag t (quotes removed, entities as written), FALSE if it has none
+static gboolean gs_xpath_attr(const GsXmlToken *t, const gchar *name, gboolean html, const gchar **value, const gchar **value_end) {
+	const gchar *pos = t->attrs, *attr, *attr_end;
+	while (gs_xml_next_attr(&pos, t->attrs_end, &attr, &attr_end)) {
+		const gchar *p = attr;
+		while (p < attr_end && !g_ascii_isspace(*p) && *p != '=') {
+			p++;
+		}
+		if (!gs_xpath_name_matches(name, attr, p - attr, html)) {
+			continue;
+		}
+		while (p < attr_end && (g_ascii_isspace(*p) || *p == '=')) {
+			p++;
+		}
+		gboolean quoted = p < attr_end && (*p == '"' || *p == '\'');
+		*value = p + quoted;
+		*value_end = quoted && attr_end > *value && attr_end[-1] == *p ? attr_end - 1 : attr_end;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+static gboolean gs_xpath_step_matches(const GsXpathStep *step, const GsXmlToken *t, gboolean html) {
+	if (strcmp(step->name, "*") != 0 && !gs_xpath_name_matches(step->name, t->name, t->name_end - t->name, html)) {
+		return FALSE;
+	}
+	for (guint i = 0; i < step->predicates->len; i++) {
+		const GsXpathPredicate *predicate = &g_array_index(step->predicates, GsXpathPredicate, i);
+		const gchar *value, *value_end;
+		gboolean exists = gs_xpath_attr(t, predicate->attr, html, &value, &value_end);
+		gboolean equal = exists && (predicate->value == NULL
+			|| (strlen(predicate->value) == (gsize)(value_end - value) && memcmp(predicate->value, value, value_end - value) == 0));
+		if (predicate->negate ? !exists || equal : !equal) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+GsXpathRun* gs_xpath_run_new(const GsXpath *xpath, gboolean html) {
+	GsXpathRun *run = g_new0(GsXpathRun, 1);
+	run->xpath = xpath;
+	run->html = html;
+	run->stack = g_array_new(FALSE, FALSE, sizeof(GsXpathFrame));
+	run->pending = g_array_new(FALSE, FALSE, sizeof(GsXpathMatch));
+	return run;
+}
+
+void gs_xpath_run_free(GsXpathRun *run) {
+	g_array_free(run->stack, TRUE);
+	g_array_free(run->pending, TRUE);
+	g_free(run);
+}
+
+// Add a match, end is G_MAXSIZE for an element that is still open. Returns its sequence number
+static guint64 gs_xpath_add(GsXpathRun *run, GArray *matches, gsize start, gsize end) {
+	GsXpathMatch match = { start, end };
+	if (run->pending->len == 0 && end != G_MAXSIZE) {
+		g_array_append_val(matches, match);
+		return G_MAXUINT64;
+	}
+	g_array_append_val(run->pending, match);
+	return run->pending_base + run->pending->len - 1;
+}
+
+// Close the innermost open element, its match (if any) ends at end. Passes on the matches complete now
+static void gs_xpath_pop(GsXpathRun *run, GArray *matches, gsize end) {
+	guint64 seq = g_array_index(run->stack, GsXpathFrame, run->stack->len - 1).match;
+	g_array_set_size(run->stack, run->stack->len - 1);
+	if (seq == G_MAXUINT64) {
+		return;
+	}
+	g_array_index(run->pending, GsXpathMatch, seq - run->pending_base).end = end;
+	guint complete = 0;
+	while (complete < run->pending->len && g_array_index(run->pending, GsXpathMatch, complete).end != G_MAXSIZE) {
+		complete++;
+	}
+	g_array_append_vals(matches, run->pending->data, complete);
+	g_array_remove_range(run->pending, 0, complete);
+	run->pending_base += complete;
+}
+
+// Continue the run on text[0..len) for about budget bytes, matches are appended to matches in document
+// order. Returns FALSE once the end of the text is reached
+gboolean gs_xpath_run_step(GsXpathRun *run, const gchar *text, gsize len, gsize budget, GArray *matches) {
+	const GsXpath *xpath = run->xpath;
+	const guint64 full = G_GUINT64_CONSTANT(1) << xpath->steps->len;
+	gsize stop = budget < len - MIN(run->pos, len) ? run->pos + budget : len;
+	GsXmlScanner s;
+	GsXmlToken t;
+	gs_xml_scanner_init(&s, text, len, run->html);
+	s.p = text + MIN(run->pos, len);
+	if (run->raw_name_len > 0) {
+		s.raw_name = text + run->raw_name;
+		s.raw_name_len = run->raw_name_len;
+	}
+
+	while (!run->done && ((gsize)(s.p - text) < stop || stop == len)) {
+		if (!gs_xml_next(&s, &t)) {
+			if (t.type == GS_XML_TOKEN_EOF) {
+				run->done = TRUE;
+			} else if (run->errors++ == 0) { // Go on behind the < of the malformed tag, like it was text
+				run->error_pos = t.start - text;
+			}
+			s.p = t.type == GS_XML_TOKEN_EOF ? s.p : t.start + 1;
+			continue;
+		}
+		const GsXpathFrame *parent = run->stack->len > 0 ? &g_array_index(run->stack, GsXpathFrame, run->stack->len - 1) : NULL;
+
+		if (t.type == GS_XML_TOKEN_START || t.type == GS_XML_TOKEN_EMPTY) {
+			guint64 parent_states = parent != NULL ? parent->states : 1, states = 0;
+			for (guint i = 0; i < xpath->steps->len; i++) {
+				const GsXpathStep *step = &g_array_index(xpath->steps, GsXpathStep, i);
+				if ((parent_states & (G_GUINT64_CONSTANT(1) << i)) != 0) {
+					states |= step->descendant ? G_GUINT64_CONSTANT(1) << i : 0; // The step may match further down
+					states |= gs_xpath_step_matches(step, &t, run->html) ? G_GUINT64_CONSTANT(1) << (i + 1) : 0;
+				}
+			}
+			GsXpathFrame frame = { states, (parent != NULL && parent->inside) || (states & full) != 0, t.name - text, t.name_end - t.name, G_MAXUINT64 };
+			const gchar *value, *value_end;
+			if ((states & full) != 0 && xpath->select == GS_XPATH_ELEMENT) {
+				frame.match = gs_xpath_add(run, matches, t.start - text, t.type == GS_XML_TOKEN_EMPTY ? (gsize)(t.end - text) : G_MAXSIZE);
+			} else if ((states & full) != 0 && xpath->select == GS_XPATH_ATTR && gs_xpath_attr(&t, xpath->attr, run->html, &value, &value_end)) {
+				gs_xpath_add(run, matches, value - text, value_end - text);
+			}
+			if (t.type == GS_XML_TOKEN_START) {
+				g_array_append_val(run->stack, frame);
+			}
+		} else if (t.type == GS_XML_TOKEN_END) {
+			// Close the element of that name and the unclosed ones inside of it (HTML). Stray end tags are ignored
+			gsize name_len = t.name_end - t.name;
+			guint i = run->stack->len;
+			for (; i > 0; i--) {
+				const GsXpathFrame *frame = &g_array_index(run->stack, GsXpathFrame, i - 1);
+				if (frame->name_len == name_len && (run->html ? g_ascii_strncasecmp(text + frame->name, t.name, name_len) : memcmp(text + frame->name, t.name, name_len)) == 0) {
+					break;
+				}
+			}
+			while (i > 0 && run->stack->len >= i) {
+				gs_xpath_pop(run, matches, run->stack->len == i ? (gsize)(t.end - text) : (gsize)(t.start - text));
+			}
+		} else if ((t.type == GS_XML_TOKEN_TEXT || t.type == GS_XML_TOKEN_CDATA) && xpath->select == GS_XPATH_TEXT && parent != NULL
+				&& (xpath->text_descendant ? parent->inside : (parent->states & full) != 0)) {
+			const gchar *start = t.start + (t.type == GS_XML_TOKEN_CDATA ? 9 : 0), *end = t.end - (t.type == GS_XML_TOKEN_CDATA ? 3 : 0);
+			while (start < end && g_ascii_isspace(*start)) {
+				start++;
+			}
+			while (end > start && g_ascii_isspace(end[-1])) {
+				end--;
+			}
+			if (start < end) {
+				gs_xpath_add(run, matches, start - text, end - text);
+			}
+		}
+	}
+
+	run->pos = s.p - text;
+	run->raw_name = s.raw_name != NULL ? (gsize)(s.raw_name - text) : 0;
+	run->raw_name_len = s.raw_name != NULL ? s.raw_name_len : 0;
+	while (run->done && run->stack->len > 0) { // Unclosed elements end with the text
+		gs_xpath_pop(run, matches, len);
+	}
+	return !run->done;
+}
+
+//######################################################################################################
+// Blocks
+//
+// The JSON or XML block around the caret, which the block variants of the tools work on.
+
+// Whether an opener at or before pos is still open. The stack is ordered, its bottom is the first one
+static inline gboolean gs_block_open_before(const GArray *open, gsize pos) {
+	return open->len > 0 && g_array_index(open, gsize, 0) <= pos;
+}
+
+// Innermost JSON/XML block containing pos. One pass from the start of text with a stack of the open
+// brackets or start tags, the first one closed behind pos is the innermost block. Unclosed openers
+// are never scanned again, so the cost is linear in the end offset of the block, also for "[[[[".
+// Brackets and tags are matched by depth only, strings are skipped, malformed tags are taken as text
+gboolean gs_find_block(const gchar *text, gsize len, gsize pos, GsBlockKind kind, gboolean html, gsize *start, gsize *end) {
+	GArray *open = g_array_new(FALSE, FALSE, sizeof(gsize));
+	gsize block_start = 0, block_end = 0;
+
+	if (kind == GS_BLOCK_JSON) {
+		const gchar *text_end = text + len;
+		for (const gchar *p = text; p < text_end && block_end == 0 && ((gsize)(p - text) <= pos || gs_block_open_before(open, pos)); p++) {
+			if (*p == '"') { // An unterminated string ends the scan
+				for (p++; (p = gs_json_scan_string_special(p, text_end)) < text_end && *p != '"'; p += (*p == '\\') ? 2 : 1);
+			} else if (*p == '{' || *p == '[') {
+				gsize offset = p - text;
+				g_array_append_val(open, offset);
+			} else if ((*p == '}' || *p == ']') && open->len > 0) {
+				block_start = g_array_index(open, gsize, open->len - 1);
+				g_array_set_size(open, open->len - 1);
+				block_end = block_start <= pos && (gsize)(p - text) >= pos ? (gsize)(p + 1 - text) : 0;
+			}
+		}
+	} else if (kind == GS_BLOCK_XML) {
+		GsXmlScanner s;
+		GsXmlToken t;
+		gs_xml_scanner_init(&s, text, len, html);
+		while (block_end == 0 && ((gsize)(s.p - text) <= pos || gs_block_open_before(open, pos))) {
+			if (!gs_xml_next(&s, &t)) {
+				if (t.type == GS_XML_TOKEN_EOF) {
+					break;
+				}
+				s.p = t.start + 1; // Go on behind the < of the malformed tag, like it was text
+				continue;
+			}
+			if (t.type == GS_XML_TOKEN_START) {
+				gsize offset = t.start - text;
+				g_array_append_val(open, offset);
+				continue;
+			} else if (t.type == GS_XML_TOKEN_END && open->len > 0) {
+				block_start = g_array_index(open, gsize, open->len - 1);
+				g_array_set_size(open, open->len - 1);
+			} else if (t.type == GS_XML_TOKEN_EMPTY) {
+				block_start = t.start - text;
+			} else {
+				continue;
+			}
+			block_end = block_start <= pos && (gsize)(t.end - text) > pos ? (gsize)(t.end - text) : 0;
+		}
+	}
+
+	g_array_free(open, TRUE);
+	if (block_end == 0) {
+		return FALSE;
+	}
+	*start = block_start;
+	*end = block_end;
+	return TRUE;
+}
+
+//######################################################################################################
+// Pipe engine
+//
+// Runs `/bin/sh -c CMD` with stdin/stdout/stderr connected to pipes. Input is written and output
+// read in chunks from main loop watches, so the UI stays responsive while the command runs.
+// The child gets its own process group, cancelling terminates the whole shell pipeline.
+//
+// SIGPIPE keeps its disposition for the process: it is blocked only on the writing thread while
+// writing to a child, so a command which stops reading (head) gives EPIPE instead of killing Geany.
+// Children reset it to the default, so `yes | head` inside of them ends quietly as in a terminal.
+
+#define GS_PIPE_CHUNK_SIZE (64 * 1024)
+
+// Block SIGPIPE on this thread, returns whether one was pending already
+static gboolean gs_sigpipe_block(sigset_t *old_mask) {
+	sigset_t set, pending;
+	sigemptyset(&set);
+	sigaddset(&set, SIGPIPE);
+	sigpending(&pending);
+	pthread_sigmask(SIG_BLOCK, &set, old_mask);
+	return sigismember(&pending, SIGPIPE) == 1;
+}
+
+// Discard a SIGPIPE raised by the writes since gs_sigpipe_block and restore the signal mask
+static void gs_sigpipe_unblock(const sigset_t *old_mask, gboolean was_pending) {
+	if (!was_pending) {
+		sigset_t set;
+		struct timespec zero = { 0, 0 };
+		sigemptyset(&set);
+		sigaddset(&set, SIGPIPE);
+		while (sigtimedwait(&set, NULL, &zero) < 0 && errno == EINTR) {
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, old_mask, NULL);
+}
+
+static void gs_pipe_child_setup(gpointer user_data) {
+	setpgid(0, 0);
+	signal(SIGPIPE, SIG_DFL);
+}
+
+static void gs_pipe_close_channel(GIOChannel **ch, guint *watch) {
+	if (*watch != 0) {
+		g_source_remove(*watch);
+		*watch = 0;
+	}
+	if (*ch != NULL) {
+		g_io_channel_shutdown(*ch, FALSE, NULL);
+		g_io_channel_unref(*ch);
+		*ch = NULL;
+	}
+}
+
+static void gs_pipe_job_free(GsPipeJob *job) {
+	if (job->watch_child != 0) {
+		g_source_remove(job->watch_child);
+	}
+	gs_pipe_close_channel(&job->ch_in, &job->watch_in);
+	gs_pipe_close_channel(&job->ch_out, &job->watch_out);
+	gs_pipe_close_channel(&job->ch_err, &job->watch_err);
+	g_string_free(job->output, TRUE);
+	g_string_free(job->errors, TRUE);
+	g_free(job->command);
+	g_free(job);
+}
+
+// Finish when the child exited and all output has been read
+static void gs_pipe_check_done(GsPipeJob *job) {
+	if (job->exited && job->ch_out == NULL && job->ch_err == NULL) {
+		gs_pipe_close_channel(&job->ch_in, &job->watch_in);
+		job->on_done(job, job->user_data);
+		gs_pipe_job_free(job);
+	}
+}
+
+static gboolean gs_pipe_on_stdin(GIOChannel *ch, GIOCondition cond, gpointer data) {
+	GsPipeJob *job = data;
+	gsize written = 0;
+	GIOStatus status = G_IO_STATUS_ERROR;
+	gsize len = MIN(GS_PIPE_CHUNK_SIZE, job->input_len - job->input_pos);
+	const gchar *chunk = (cond & G_IO_OUT) ? job->read_input(job->input_pos, len, job->user_data) : NULL;
+	if (chunk != NULL) {
+		sigset_t old_mask;
+		gboolean was_pending = gs_sigpipe_block(&old_mask);
+		status = g_io_channel_write_chars(ch, chunk, len, &written, NULL);
+		gs_sigpipe_unblock(&old_mask, was_pending);
+		job->input_pos += written;
+	}
+	if ((status != G_IO_STATUS_NORMAL && status != G_IO_STATUS_AGAIN) || job->input_pos >= job->input_len) {
+		job->watch_in = 0; // Removed by returning FALSE
+		gs_pipe_close_channel(&job->ch_in, &job->watch_in);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static gboolean gs_pipe_on_output(GIOChannel *ch, GIOCondition cond, gpointer data) {
+	GsPipeJob *job = data;
+	gboolean is_stdout = (ch == job->ch_out);
+	GString *target = is_stdout ? job->output : job->errors;
+	GIOStatus status = G_IO_STATUS_EOF;
+	if (cond & (G_IO_IN | G_IO_PRI)) {
+		gsize nread = 0;
+		gsize len = target->len;
+		g_string_set_size(target, len + GS_PIPE_CHUNK_SIZE);
+		status = g_io_channel_read_chars(ch, target->str + len, GS_PIPE_CHUNK_SIZE, &nread, NULL);
+		g_string_set_size(target, len + nread);
+	}
+	if (status == G_IO_STATUS_NORMAL || status == G_IO_STATUS_AGAIN) {
+		return TRUE;
+	}
+
+	// EOF or error
+	if (is_stdout) {
+		job->watch_out = 0;
+		gs_pipe_close_channel(&job->ch_out, &job->watch_out);
+	} else {
+		job->watch_err = 0;
+		gs_pipe_close_channel(&job->ch_err, &job->watch_err);
+	}
+	gs_pipe_check_done(job);
+	return FALSE;
+}
+
+static void gs_pipe_on_child_exit(GPid pid, gint wait_status, gpointer data) {
+	GsPipeJob *job = data;
+	job->wait_status = wait_status;
+	job->exited = TRUE;
+	job->watch_child = 0;
+	g_spawn_close_pid(pid);
+	gs_pipe_check_done(job);
+}
+
+static GIOChannel* gs_pipe_channel_new(gint fd) {
+	GIOChannel *ch = g_io_channel_unix_new(fd);
+	g_io_channel_set_encoding(ch, NULL, NULL);
+	g_io_channel_set_buffered(ch, FALSE);
+	g_io_channel_set_flags(ch, G_IO_FLAG_NONBLOCK, NULL);
+	g_io_channel_set_close_on_unref(ch, TRUE);
+	return ch;
+}
+
+// Start command asynchronously, input_len bytes are requested from read_input. Returns NULL and sets error on failure
+GsPipeJob* gs_pipe_job_start(const gchar *command, gsize input_len, GsPipeReadFunc read_input, GsPipeDoneFunc on_done, gpointer user_data, GError **error) {
+	gchar *argv[] = { "/bin/sh", "-c", (gchar*) command, NULL };
+	gint fd_in, fd_out, fd_err;
+	GPid pid;
+
+	if (!g_spawn_async_with_pipes(NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD, gs_pipe_child_setup, NULL, &pid, &fd_in, &fd_out, &fd_err, error)) {
+		return NULL;
+	}
+
+	GsPipeJob *job  = g_new0(GsPipeJob, 1);
+	job->command    = g_strdup(command);
+	job->pid        = pid;
+	job->read_input = read_input;
+	job->input_len  = input_len;
+	job->output     = g_string_sized_new(MAX(GS_PIPE_CHUNK_SIZE, input_len) + 1);
+	job->errors     = g_string_new(NULL);
+	job->time_start = g_get_monotonic_time();
+	job->on_done    = on_done;
+	job->user_data  = user_data;
+	job->ch_in      = gs_pipe_channel_new(fd_in);
+	job->ch_out     = gs_pipe_channel_new(fd_out);
+	job->ch_err     = gs_pipe_channel_new(fd_err);
+
+	if (input_len > 0) {
+		job->watch_in = g_io_add_watch(job->ch_in, G_IO_OUT | G_IO_ERR | G_IO_HUP | G_IO_NVAL, gs_pipe_on_stdin, job);
+	} else {
+		gs_pipe_close_channel(&job->ch_in, &job->watch_in);
+	}
+	job->watch_out = g_io_add_watch(job->ch_out, G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP | G_IO_NVAL, gs_pipe_on_output, job);
+	job->watch_err = g_io_add_watch(job->ch_err, G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP | G_IO_NVAL, gs_pipe_on_output, job);
+	job->watch_child = g_child_watch_add(pid, gs_pipe_on_child_exit, job);
+	return job;
+}
+
+// Terminate the command, on_done is still called once the child is gone
+void gs_pipe_job_cancel(GsPipeJob *job) {
+	if (job != NULL && !job->exited) {
+		job->cancelled = TRUE;
+		gs_pipe_close_channel(&job->ch_in, &job->watch_in);
+		kill(-job->pid, SIGTERM);
+	}
+}
+
+// Terminate the command and free the job right away without calling on_done (plugin unload)
+void gs_pipe_job_abort(GsPipeJob *job) {
+	if (!job->exited) {
+		kill(-job->pid, SIGTERM);
+		waitpid(job->pid, NULL, WNOHANG);
+		g_spawn_close_pid(job->pid);
+	}
+	gs_pipe_job_free(job);
+}
+
+// Exit code like a shell would report it (128+N for signal N)
+gint gs_pipe_exit_code(gint wait_status) {
+	return WIFEXITED(wait_status) ? WEXITSTATUS(wait_status) : (WIFSIGNALED(wait_status) ? 128 + WTERMSIG(wait_status) : -1);
+}
+
+//######################################################################################################
+// Co-process engine
+//
+// Long-lived formatter processes in stdin-loop mode. A request is the input followed by a NUL byte,
+// the process answers with the result followed by a NUL byte and waits for the next request. This
+// saves the process startup (interpreters) on every format. Formatters don't speak this framing
+// themselves, ggu-format-server wraps them. Requests are served by main loop watches like the pipe
+// engine, so a slow formatter never blocks the UI. A co-process which failed, timed out or exited
+// is killed and marked dead, gs_coprocess_get() starts it again on next use.
+
+#define GS_COPROCESS_MAX_ERRORS (64 * 1024) // Stderr kept between requests
+
+// End the current request
+static void gs_coprocess_finish(GsCoprocess *co, gboolean ok, const gchar *reason) {
+	if (!ok) {
+		g_string_append(co->errors, reason);
+		co->dead = TRUE;
+		if (!co->exited) {
+			kill(-co->pid, SIGKILL); // Reaped by the child watch
+		}
+	}
+	if (co->watch_in != 0) {
+		g_source_remove(co->watch_in);
+		co->watch_in = 0;
+	}
+	if (co->timeout != 0) {
+		g_source_remove(co->timeout);
+		co->timeout = 0;
+	}
+	GsCoprocessDoneFunc on_done = co->on_done;
+	gpointer user_data = co->user_data;
+	GString *out = co->out, *errors = co->errors;
+	g_bytes_unref(co->input);
+	co->input = NULL;
+	co->out = NULL;
+	co->errors = g_string_new(NULL);
+	co->on_done = NULL;
+	co->busy = FALSE;
+	on_done(co, ok, out, errors, user_data);
+	g_string_free(out, TRUE);
+	g_string_free(errors, TRUE);
+}
+
+static gboolean gs_coprocess_on_stdin(GIOChannel *ch, GIOCondition cond, gpointer data) {
+	static const gchar terminator = '\0';
+	GsCoprocess *co = data;
+	gsize len, written = 0;
+	const gchar *input = g_bytes_get_data(co->input, &len);
+	GIOStatus status = G_IO_STATUS_ERROR;
+	if (cond & G_IO_OUT) {
+		sigset_t old_mask;
+		gboolean was_pending = gs_sigpipe_block(&old_mask);
+		status = co->input_pos < len ? g_io_channel_write_chars(ch, input + co->input_pos, MIN(len - co->input_pos, GS_PIPE_CHUNK_SIZE), &written, NULL)
+			: g_io_channel_write_chars(ch, &terminator, 1, &written, NULL);
+		gs_sigpipe_unblock(&old_mask, was_pending);
+		co->input_pos += written;
+	}
+	if ((status != G_IO_STATUS_NORMAL && status != G_IO_STATUS_AGAIN) || co->input_pos > len) {
+		co->watch_in = 0; // Sent, or stopped reading: the answer, the child watch or the timeout ends the request
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// Read what is available. The answer of a request is complete at the NUL, output besides requests is dropped
+static GIOStatus gs_coprocess_read(GsCoprocess *co, GIOChannel *ch) {
+	gchar buf[GS_PIPE_CHUNK_SIZE];
+	gsize nread = 0;
+	GIOStatus status = g_io_channel_read_chars(ch, buf, sizeof(buf), &nread, NULL);
+	if (ch == co->ch_err) {
+		g_string_append_len(co->errors, buf, MIN(nread, GS_COPROCESS_MAX_ERRORS - MIN(co->errors->len, GS_COPROCESS_MAX_ERRORS)));
+	} else if (co->busy && nread > 0) {
+		const gchar *nul = memchr(buf, '\0', nread);
+		g_string_append_len(co->out, buf, nul != NULL ? (gsize) (nul - buf) : nread);
+		if (nul != NULL) {
+			while (gs_coprocess_read(co, co->ch_err) == G_IO_STATUS_NORMAL) { // Written before the answer, so it's there already
+			}
+			gs_coprocess_finish(co, TRUE, NULL);
+		}
+	}
+	return status;
+}
+
+static gboolean gs_coprocess_on_output(GIOChannel *ch, GIOCondition cond, gpointer data) {
+	GsCoprocess *co = data;
+	GIOStatus status = (cond & (G_IO_IN | G_IO_PRI)) ? gs_coprocess_read(co, ch) : G_IO_STATUS_EOF;
+	if (status == G_IO_STATUS_NORMAL || status == G_IO_STATUS_AGAIN) {
+		return TRUE;
+	}
+
+	// EOF or error: The process exited or closed its output, the child watch ends a pending request
+	if (ch == co->ch_out) {
+		co->watch_out = 0;
+	} else {
+		co->watch_err = 0;
+	}
+	return FALSE;
+}
+
+static void gs_coprocess_on_exit(GPid pid, gint wait_status, gpointer data) {
+	GsCoprocess *co = data;
+	co->watch_child = 0;
+	co->exited = TRUE;
+	co->dead = TRUE;
+	g_spawn_close_pid(pid);
+
+	// An answer written right before exiting is still in the pipe, so are the last errors
+	while (co->busy && gs_coprocess_read(co, co->ch_out) == G_IO_STATUS_NORMAL) {
+	}
+	if (co->busy) {
+		while (gs_coprocess_read(co, co->ch_err) == G_IO_STATUS_NORMAL) {
+		}
+		gchar *reason = g_strdup_printf("Formatter exited with code %d", gs_pipe_exit_code(wait_status));
+		gs_coprocess_finish(co, FALSE, reason);
+		g_free(reason);
+	}
+}
+
+static gboolean gs_coprocess_on_timeout(gpointer data) {
+	GsCoprocess *co = data;
+	co->timeout = 0;
+	gs_coprocess_finish(co, FALSE, "Formatter timed out");
+	return FALSE;
+}
+
+GsCoprocess* gs_coprocess_start(const gchar *command, GError **error) {
+	gchar *argv[] = { "/bin/sh", "-c", (gchar*) command, NULL };
+	gint fd_in, fd_out, fd_err;
+	GPid pid;
+	if (!g_spawn_async_with_pipes(NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD, gs_pipe_child_setup, NULL, &pid, &fd_in, &fd_out, &fd_err, error)) {
+		return NULL;
+	}
+	GsCoprocess *co = g_new0(GsCoprocess, 1);
+	co->command     = g_strdup(command);
+	co->pid         = pid;
+	co->ch_in       = gs_pipe_channel_new(fd_in);
+	co->ch_out      = gs_pipe_channel_new(fd_out);
+	co->ch_err      = gs_pipe_channel_new(fd_err);
+	co->errors      = g_string_new(NULL);
+	co->watch_out   = g_io_add_watch(co->ch_out, G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP | G_IO_NVAL, gs_coprocess_on_output, co);
+	co->watch_err   = g_io_add_watch(co->ch_err, G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP | G_IO_NVAL, gs_coprocess_on_output, co);
+	co->watch_child = g_child_watch_add(pid, gs_coprocess_on_exit, co);
+	return co;
+}
+
+// Kill the process group and reap it. SIGKILL, so waiting can't block. A pending request fails, closing
+// is set when its on_done runs
+void gs_coprocess_free(GsCoprocess *co) {
+	co->closing = TRUE;
+	if (co->busy) {
+		gs_coprocess_finish(co, FALSE, "Formatter closed");
+	}
+	if (co->watch_child != 0) {
+		g_source_remove(co->watch_child);
+		kill(-co->pid, SIGKILL);
+		waitpid(co->pid, NULL, 0);
+		g_spawn_close_pid(co->pid);
+	}
+	gs_pipe_close_channel(&co->ch_in, &co->watch_in);
+	gs_pipe_close_channel(&co->ch_out, &co->watch_out);
+	gs_pipe_close_channel(&co->ch_err, &co->watch_err);
+	g_string_free(co->errors, TRUE);
+	g_free(co->command);
+	g_free(co);
+}
+
+// Running co-process of command in running (command -> GsCoprocess, freeing values), started if there is
+// none or it is dead. NULL and error if it can't be started
+GsCoprocess* gs_coprocess_get(GHashTable *running, const gchar *command, GError **error) {
+	GsCoprocess *co = g_hash_table_lookup(running, command);
+	if (co != NULL && co->dead && !co->busy) {
+		g_hash_table_remove(running, command);
+		co = NULL;
+	}
+	if (co == NULL && (co = gs_coprocess_start(command, error)) != NULL) {
+		g_hash_table_insert(running, co->command, co);
+	}
+	return co;
+}
+
+// Send input, on_done gets the answer up to the terminating NUL, or ok FALSE and the reason in errors
+// if the process exits or doesn't answer within timeout_ms. on_done must not free co. FALSE if busy or dead
+gboolean gs_coprocess_request(GsCoprocess *co, GBytes *input, guint timeout_ms, GsCoprocessDoneFunc on_done, gpointer user_data) {
+	if (co->busy || co->dead) {
+		return FALSE;
+	}
+	gsize len = g_bytes_get_size(input);
+	co->busy       = TRUE;
+	co->input      = g_bytes_ref(input);
+	co->input_pos  = 0;
+	co->out        = g_string_sized_new(len + len / 4 + 1);
+	co->on_done    = on_done;
+	co->user_data  = user_data;
+	co->watch_in   = g_io_add_watch(co->ch_in, G_IO_OUT | G_IO_ERR | G_IO_HUP | G_IO_NVAL, gs_coprocess_on_stdin, co);
+	co->timeout    = g_timeout_add(timeout_ms, gs_coprocess_on_timeout, co);
+	return TRUE;
+}
+
+//######################################################################################################
+// Background format engine
+//
+// Formats a snapshot of a document on a worker thread, so saving never waits for a formatter. The
+// builtin JSON/XML formatters run in-process, other commands get the snapshot on stdin. Finished jobs
+// are queued for the UI thread, which applies a result only if the document is unchanged since the
+// snapshot and drops it otherwise.
+
+void gs_format_job_free(GsFormatJob *job) {
+	g_bytes_unref(job->snapshot);
+	g_string_free(job->out, TRUE);
+	g_free(job->command);
+	g_free(job->errors);
+	g_free(job);
+}
+
+// Formatter command of a job, waited for in a main context of the worker thread
+typedef struct {
+	GsFormatJob  *job;
+	GCancellable *cancellable;
+	GPid          pid;
+	GBytes       *out, *errors;
+	GError       *error;
+	gboolean      done, timed_out;
+} GsFormatCommand;
+
+static void gs_format_on_communicated(GObject *proc, GAsyncResult *result, gpointer data) {
+	GsFormatCommand *command = data;
+	g_subprocess_communicate_finish(G_SUBPROCESS(proc), result, &command->out, &command->errors, &command->error);
+	command->done = TRUE;
+}
+
+// Timeout or queue freed: Kill the process group, cancelling ends the communication even if a process
+// in background keeps the pipes open
+static void gs_format_command_stop(GsFormatCommand *command) {
+	kill(-command->pid, SIGKILL);
+	g_cancellable_cancel(command->cancellable);
+}
+
+static gboolean gs_format_on_timeout(gpointer data) {
+	GsFormatCommand *command = data;
+	command->timed_out = TRUE;
+	gs_format_command_stop(command);
+	return FALSE;
+}
+
+static gboolean gs_format_on_queue_closed(GCancellable *cancellable, gpointer data) {
+	gs_format_command_stop(data);
+	return FALSE;
+}
+
+// Whole snapshot on stdin, GSubprocess serves stdin/stdout/stderr together so pipes can't dead-lock
+static void gs_format_job_run_command(GsFormatJob *job, GsFormatQueue *queue) {
+	const gchar *argv[] = { "/bin/sh", "-c", job->command, NULL };
+	GsFormatCommand command = { job, g_cancellable_new(), 0, NULL, NULL, NULL, FALSE, FALSE };
+	GSubprocessLauncher *launcher = g_subprocess_launcher_new(G_SUBPROCESS_FLAGS_STDIN_PIPE | G_SUBPROCESS_FLAGS_STDOUT_PIPE | G_SUBPROCESS_FLAGS_STDERR_PIPE);
+	g_subprocess_launcher_set_child_setup(launcher, gs_pipe_child_setup, NULL, NULL);
+	GSubprocess *proc = g_subprocess_launcher_spawnv(launcher, argv, &command.error);
+	g_object_unref(launcher);
+
+	if (proc != NULL) {
+		GMainContext *context = g_main_context_new();
+		g_main_context_push_thread_default(context);
+		command.pid = (GPid) g_ascii_strtoll(g_subprocess_get_identifier(proc), NULL, 10);
+		GSource *timeout = g_timeout_source_new(queue->timeout_ms), *closed = g_cancellable_source_new(queue->cancellable);
+		g_source_set_callback(timeout, gs_format_on_timeout, &command, NULL);
+		g_source_set_callback(closed, (GSourceFunc) (void (*)(void)) gs_format_on_queue_closed, &command, NULL); // GCancellableSourceFunc
+		g_source_attach(timeout, context);
+		g_source_attach(closed, context);
+
+		sigset_t old_mask;
+		gboolean was_pending = gs_sigpipe_block(&old_mask);
+		g_subprocess_communicate_async(proc, job->snapshot, command.cancellable, gs_format_on_communicated, &command);
+		while (!command.done) {
+			g_main_context_iteration(context, TRUE);
+		}
+		gs_sigpipe_unblock(&old_mask, was_pending);
+
+		g_source_destroy(timeout);
+		g_source_destroy(closed);
+		g_source_unref(timeout);
+		g_source_unref(closed);
+		g_main_context_pop_thread_default(context);
+		g_main_context_unref(context);
+	}
+
+	if (command.timed_out) {
+		job->errors = g_strdup_printf("Formatter timed out after %u ms", queue->timeout_ms);
+	} else if (command.error != NULL) {
+		job->errors = g_strdup(command.error->message);
+	} else {
+		gsize out_len, errors_len;
+		const gchar *out_data = g_bytes_get_data(command.out, &out_len), *errors_data = g_bytes_get_data(command.errors, &errors_len);
+		job->ok = g_subprocess_get_successful(proc) && (out_len > 0 || g_bytes_get_size(job->snapshot) == 0);
+		g_string_append_len(job->out, out_data, out_len);
+		job->errors = errors_len > 0 ? g_strndup(errors_data, errors_len) : NULL;
+	}
+	if (command.out != NULL) {
+		g_bytes_unref(command.out);
+	}
+	if (command.errors != NULL) {
+		g_bytes_unref(command.errors);
+	}
+	g_clear_error(&command.error);
+	g_object_unref(command.cancellable);
+	g_clear_object(&proc);
+}
+
+static void gs_format_job_run(gpointer data, gpointer user_data) {
+	GsFormatJob *job = data;
+	GsFormatQueue *queue = user_data;
+	gsize len;
+	const gchar *text = g_bytes_get_data(job->snapshot, &len);
+	job->out = g_string_sized_new(len + len / 2 + 1);
+
+	if (g_cancellable_is_cancelled(queue->cancellable)) {
+		job->errors = g_strdup("Cancelled"); // Queue freed before the job started
+	} else if (g_str_equal(job->command, "builtin:json")) {
+		if ((job->ok = gs_json_format(text, len, 2, job->out, &job->err))) {
+			g_string_append_c(job->out, '\n');
+		}
+	} else if (g_str_equal(job->command, "builtin:xml")) {
+		if ((job->ok = gs_xml_format(text, len, job->html || gs_xml_looks_like_html(text, len), 2, 105, job->out, &job->err))) {
+			g_string_append_c(job->out, '\n');
+		}
+	} else {
+		gs_format_job_run_command(job, queue);
+	}
+	g_async_queue_push(queue->done, job);
+}
+
+// Formatter commands are killed after timeout_ms
+GsFormatQueue* gs_format_queue_new(guint timeout_ms) {
+	GsFormatQueue *queue = g_new0(GsFormatQueue, 1);
+	queue->done = g_async_queue_new_full((GDestroyNotify) gs_format_job_free);
+	queue->timeout_ms = timeout_ms;
+	queue->cancellable = g_cancellable_new();
+	queue->pool = g_thread_pool_new(gs_format_job_run, queue, MAX(1, g_get_num_processors() / 2), FALSE, NULL);
+	return queue;
+}
+
+// Format snapshot with command in background. Takes a reference of snapshot
+void gs_format_queue_push(GsFormatQueue *queue, guint doc_id, guint version, const gchar *command, gboolean html, GBytes *snapshot) {
+	GsFormatJob *job = g_new0(GsFormatJob, 1);
+	job->doc_id = doc_id;
+	job->version = version;
+	job->command = g_strdup(command);
+	job->html = html;
+	job->snapshot = g_bytes_ref(snapshot);
+	job->time_start = g_get_monotonic_time();
+	queue->pending++;
+	g_thread_pool_push(queue->pool, job, NULL);
+}
+
+// Whether the result of job still fits document doc_id, which is at version now. Jobs finish in any
+// order, an older snapshot may come back after a newer one
+gboolean gs_format_job_is_current(const GsFormatJob *job, guint doc_id, guint version) {
+	return job->doc_id == doc_id && job->version == version;
+}
+
+// Next finished job, NULL if there is none yet. The caller frees it with gs_format_job_free
+GsFormatJob* gs_format_queue_next(GsFormatQueue *queue) {
+	GsFormatJob *job = g_async_queue_try_pop(queue->done);
+	queue->pending -= job != NULL ? 1 : 0;
+	return job;
+}
+
+// Kill running formatter commands, skip queued jobs and free all results. Only builtin formatters
+// already running are waited for
+void gs_format_queue_free(GsFormatQueue *queue) {
+	g_cancellable_cancel(queue->cancellable);
+	g_thread_pool_free(queue->pool, FALSE, TRUE);
+	g_async_queue_unref(queue->done);
+	g_object_unref(queue->cancellable);
+	g_free(queue);
+}
+
+//######################################################################################################
+// Diff engine
+//
+// Line based Myers diff used to write tool results back as a few targeted replacements instead of
+// replacing the whole document. The common prefix/suffix is skipped byte-wise first, so for
+// typical edits only a small middle part is diffed. If the middle part needs too many edits, or
+// applying the hunks would cost more than replacing it at once, a single hunk is returned.
+//
+// For showing differences between whole documents, gs_diff_lines() uses a patience/histogram diff
+// instead: lines are numbered by content, lines unique on both sides split the files into small
+// ranges in one pass, then within each range the rarest common line anchors an equal region and both
+// sides of it are diffed the same way. That stays close to linear on large files where Myers would
+// need too many edits, and anchors on rare lines, which gives more readable hunks.
+
+#define GS_DIFF_MAX_EDITS  1000  // Give up on Myers beyond this distance (trace memory grows quadratic)
+#define GS_DIFF_HUNK_COST  256   // Estimated overhead of one replacement in bytes (undo record, line index)
+
+// Length of the common prefix of a[0..len) and b[0..len). Compares 16 bytes per step with SSE2 where available
+static gsize gs_mem_common_prefix(const gchar *a, const gchar *b, gsize len) {
+	gsize i = 0;
+#ifdef __SSE2__
+	for (; i + 16 <= len; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i*) (a + i)), vb = _mm_loadu_si128((const __m128i*) (b + i));
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xFFFF;
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+#endif
+	while (i < len && a[i] == b[i]) {
+		i++;
+	}
+	return i;
+}
+
+// Length of the common suffix of the len bytes before a_end and b_end
+static gsize gs_mem_common_suffix(const gchar *a_end, const gchar *b_end, gsize len) {
+	gsize i = 0;
+#ifdef __SSE2__
+	for (; i + 16 <= len; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i*) (a_end - i - 16)), vb = _mm_loadu_si128((const __m128i*) (b_end - i - 16));
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xFFFF;
+		if (mask != 0) {
+			return i + __builtin_clz(mask) - 16;
+		}
+	}
+#endif
+	while (i < len && a_end[-(gssize) i - 1] == b_end[-(gssize) i - 1]) {
+		i++;
+	}
+	return i;
+}
+
+// Number of line breaks in p[0..len)
+static gsize gs_mem_count_lines(const gchar *p, gsize len) {
+	gsize count = 0, i = 0;
+#ifdef __SSE2__
+	const __m128i nl = _mm_set1_epi8('\n');
+	for (; i + 16 <= len; i += 16) {
+		count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + i)), nl)));
+	}
+#endif
+	for (; i < len; i++) {
+		count += p[i] == '\n';
+	}
+	return count;
+}
+
+// 64bit FNV-1a
+static inline guint64 gs_hash_fnv1a(const gchar *p, gsize len) {
+	guint64 h = 14695981039346656037ULL;
+	for (const gchar *end = p + len; p < end; p++) {
+		h = (h ^ (guint8) *p) * 1099511628211ULL;
+	}
+	return h;
+}
+
+// Split text into lines (including the line break), returns start offsets with n+1 entries in *offsets
+static gsize gs_diff_split_lines(const gchar *text, gsize len, gsize base, GArray *offsets, GArray *hashes) {
+	const gchar *p = text, *end = text + len, *nl;
+	while (p < end) {
+		nl = memchr(p, '\n', end - p);
+		nl = nl != NULL ? nl + 1 : end;
+		gsize start = base + (p - text);
+		guint64 h = gs_hash_fnv1a(p, nl - p);
+		g_array_append_val(offsets, start);
+		g_array_append_val(hashes, h);
+		p = nl;
+	}
+	gsize total = base + len;
+	g_array_append_val(offsets, total);
+	return hashes->len;
+}
+
+// Lines of a text by their start offsets, for comparing lines whose hashes are equal
+typedef struct {
+	const gchar *text;
+	const gsize *offsets;  // n+1 entries
+} GsDiffSide;
+
+// Whether line x of a equals line y of b, whose hashes are equal. Without sides the hashes are exact
+static inline gboolean gs_diff_same_line(const GsDiffSide *a, gint x, const GsDiffSide *b, gint y) {
+	if (a == NULL) {
+		return TRUE;
+	}
+	gsize len = a->offsets[x + 1] - a->offsets[x];
+	return len == b->offsets[y + 1] - b->offsets[y] && memcmp(a->text + a->offsets[x], b->text + b->offsets[y], len) == 0;
+}
+
+// Myers diff of line hashes a[0..n) and b[0..m), appends equal runs as triples (x, y, len) to snakes.
+// Lines with equal hashes are compared through a_side and b_side, unless they are NULL.
+// Returns FALSE if more than max_d edits would be needed
+static gboolean gs_diff_myers(const guint64 *a, gint n, const guint64 *b, gint m, const GsDiffSide *a_side, const GsDiffSide *b_side, gint max_d, GArray *snakes) {
+	gint offset = max_d + 1;
+	gint *v = g_new0(gint, 2 * offset + 1);
+	GArray *trace = g_array_new(FALSE, FALSE, sizeof(gint)); // v[-d..d] for every d
+	gint d, found = -1;
+
+	for (d = 0; d <= max_d && found < 0; d++) {
+		for (gint k = -d; k <= d; k += 2) {
+			gint x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) ? v[offset + k + 1] : v[offset + k - 1] + 1;
+			gint y = x - k;
+			while (x < n && y < m && a[x] == b[y] && gs_diff_same_line(a_side, x, b_side, y)) {
+				x++; y++;
+			}
+			v[offset + k] = x;
+			if (x >= n && y >= m) {
+				found = d;
+			}
+		}
+		g_array_append_vals(trace, v + offset - d, 2 * d + 1);
+	}
+
+	if (found >= 0) {
+		// Backtrack from (n, m), collecting equal runs in reverse order
+		gint x = n, y = m;
+		GArray *reverse = g_array_new(FALSE, FALSE, sizeof(gint));
+		for (d = found; d > 0; d--) {
+			const gint *prev = &g_array_index(trace, gint, (gsize)(d - 1) * (d - 1)) + (d - 1); // v[0] of round d-1
+			gint k = x - y;
+			gboolean down = (k == -d || (k != d && prev[k - 1] < prev[k + 1]));
+			gint prev_k = down ? k + 1 : k - 1;
+			gint prev_x = prev[prev_k], prev_y = prev_x - prev_k;
+			gint mid_x = down ? prev_x : prev_x + 1;
+			if (x > mid_x) {
+				gint snake[3] = { mid_x, mid_x - k, x - mid_x };
+				g_array_append_vals(reverse, snake, 3);
+			}
+			x = prev_x; y = prev_y;
+		}
+		if (x > 0) {
+			gint snake[3] = { 0, 0, x };
+			g_array_append_vals(reverse, snake, 3);
+		}
+		for (gint i = (gint) reverse->len - 3; i >= 0; i -= 3) {
+			g_array_append_vals(snakes, &g_array_index(reverse, gint, i), 3);
+		}
+		g_array_free(reverse, TRUE);
+	}
+
+	g_array_free(trace, TRUE);
+	g_free(v);
+	return found >= 0;
+}
+
+// Compute hunks turning old text into new text, appended to hunks (GsDiffHunk)
+void gs_diff_text(const gchar *old_text, gsize old_len, const gchar *new_text, gsize new_len, GArray *hunks) {
+	// Common prefix and suffix, aligned to line starts
+	gsize max_prefix = MIN(old_len, new_len);
+	gsize prefix = gs_mem_common_prefix(old_text, new_text, max_prefix);
+	while (prefix > 0 && old_text[prefix - 1] != '\n') {
+		prefix--;
+	}
+	// The suffix must start a line on both sides
+	gsize suffix = gs_mem_common_suffix(old_text + old_len, new_text + new_len, max_prefix - prefix);
+	while (suffix > 0 && ((old_len - suffix > prefix && old_text[old_len - suffix - 1] != '\n')
+		|| (new_len - suffix > prefix && new_text[new_len - suffix - 1] != '\n'))) {
+		suffix--;
+	}
+	if (prefix == old_len && prefix == new_len) {
+		return; // Equal
+	}
+
+	GsDiffHunk whole = { prefix, old_len - suffix, prefix, new_len - suffix };
+	gsize whole_cost = (whole.old_end - whole.old_start) + (whole.new_end - whole.new_start) + GS_DIFF_HUNK_COST;
+
+	// Diff lines of the middle part
+	GArray *old_offsets = g_array_new(FALSE, FALSE, sizeof(gsize)), *new_offsets = g_array_new(FALSE, FALSE, sizeof(gsize));
+	GArray *old_hashes  = g_array_new(FALSE, FALSE, sizeof(guint64)), *new_hashes = g_array_new(FALSE, FALSE, sizeof(guint64));
+	GArray *snakes = g_array_new(FALSE, FALSE, sizeof(gint));
+	gsize n = gs_diff_split_lines(old_text + whole.old_start, whole.old_end - whole.old_start, whole.old_start, old_offsets, old_hashes);
+	gsize m = gs_diff_split_lines(new_text + whole.new_start, whole.new_end - whole.new_start, whole.new_start, new_offsets, new_hashes);
+	GsDiffSide old_side = { old_text, (gsize*) old_offsets->data }, new_side = { new_text, (gsize*) new_offsets->data };
+	gboolean diffed = n < G_MAXINT && m < G_MAXINT && (n > m ? n - m : m - n) <= GS_DIFF_MAX_EDITS
+		&& gs_diff_myers((guint64*) old_hashes->data, n, (guint64*) new_hashes->data, m, &old_side, &new_side, GS_DIFF_MAX_EDITS, snakes);
+
+	// Hunks are the gaps between equal runs
+	guint first_hunk = hunks->len;
+	gsize cost = 0;
+	if (diffed) {
+		gint x = 0, y = 0;
+		gint end_snake[3] = { n, m, 0 };
+		g_array_append_vals(snakes, end_snake, 3);
+		for (guint i = 0; i < snakes->len; i += 3) {
+			gint *snake = &g_array_index(snakes, gint, i);
+			if (snake[0] > x || snake[1] > y) {
+				GsDiffHunk hunk = {
+					g_array_index(old_offsets, gsize, x), g_array_index(old_offsets, gsize, snake[0]),
+					g_array_index(new_offsets, gsize, y), g_array_index(new_offsets, gsize, snake[1]),
+				};
+				cost += (hunk.old_end - hunk.old_start) + (hunk.new_end - hunk.new_start) + GS_DIFF_HUNK_COST;
+				g_array_append_val(hunks, hunk);
+			}
+			x = snake[0] + snake[2];
+			y = snake[1] + snake[2];
+		}
+	}
+	if (!diffed || cost >= whole_cost) {
+		g_array_set_size(hunks, first_hunk);
+		g_array_append_val(hunks, whole);
+	}
+
+	g_array_free(old_offsets, TRUE); g_array_free(new_offsets, TRUE);
+	g_array_free(old_hashes, TRUE);  g_array_free(new_hashes, TRUE);
+	g_array_free(snakes, TRUE);
+}
+
+#define GS_DIFF_HISTOGRAM_CHAIN 64  // Lines occurring more often in a range don't anchor regions
+
+typedef struct {
+	guint a_lo, a_hi, b_lo, b_hi;
+} GsDiffRange;
+
+static void gs_diff_lines_add(GArray *hunks, guint a_lo, guint a_hi, guint b_lo, guint b_hi) {
+	if (a_lo == a_hi && b_lo == b_hi) {
+		return;
+	}
+	GsDiffLines *last = hunks->len > 0 ? &g_array_index(hunks, GsDiffLines, hunks->len - 1) : NULL;
+	if (last != NULL && last->old_end == a_lo && last->new_end == b_lo) {
+		last->old_end = a_hi;
+		last->new_end = b_hi;
+	} else {
+		GsDiffLines hunk = { a_lo, a_hi, b_lo, b_hi };
+		g_array_append_val(hunks, hunk);
+	}
+}
+
+// Number line hashes of both sides by content, equal lines get equal ids. Returns the number of ids
+static guint gs_diff_intern(const guint64 *a, guint n, const guint64 *b, guint m, guint *a_ids, guint *b_ids) {
+	gsize size = 64;
+	while (size < 2 * ((gsize) n + m)) {
+		size *= 2;
+	}
+	guint64 *keys = g_new0(guint64, size);
+	guint *values = g_new(guint, size);
+	guint ids = 0;
+	for (guint side = 0; side < 2; side++) {
+		const guint64 *hashes = side == 0 ? a : b;
+		guint *out = side == 0 ? a_ids : b_ids;
+		for (guint i = 0, count = side == 0 ? n : m; i < count; i++) {
+			guint64 key = hashes[i] != 0 ? hashes[i] : 1; // 0 marks free slots
+			gsize slot = (key ^ (key >> 29)) & (size - 1);
+			while (keys[slot] != 0 && keys[slot] != key) {
+				slot = (slot + 1) & (size - 1);
+			}
+			if (keys[slot] == 0) {
+				keys[slot] = key;
+				values[slot] = ids++;
+			}
+			out[i] = values[slot];
+		}
+	}
+	g_free(keys);
+	g_free(values);
+	return ids;
+}
+
+// Patience step: lines occurring exactly once on both sides, in the longest order both sides agree on,
+// split a[0..n) and b[0..m) into the ranges between them. Appends the ranges to stack, last range first.
+// For typical edits of large files this leaves many small ranges for the histogram pass
+static void gs_diff_unique_ranges(const guint *a, guint n, const guint *b, guint m, guint ids, GArray *stack) {
+	const guint none = G_MAXUINT;
+	guint *count_a = g_new0(guint, ids), *count_b = g_new0(guint, ids), *pos_a = g_new(guint, ids);
+	for (guint i = 0; i < n; i++) {
+		count_a[a[i]]++;
+		pos_a[a[i]] = i;
+	}
+	for (guint j = 0; j < m; j++) {
+		count_b[b[j]]++;
+	}
+
+	// Longest increasing subsequence of the a positions of unique lines in b order (patience sorting)
+	GArray *tails = g_array_new(FALSE, FALSE, sizeof(guint)); // Candidate index ending the best chain of each length
+	GArray *cand_a = g_array_new(FALSE, FALSE, sizeof(guint)), *cand_b = g_array_new(FALSE, FALSE, sizeof(guint));
+	GArray *prev = g_array_new(FALSE, FALSE, sizeof(guint));
+	for (guint j = 0; j < m; j++) {
+		guint id = b[j];
+		if (count_a[id] != 1 || count_b[id] != 1) {
+			continue;
+		}
+		guint i = pos_a[id], c = cand_a->len, lo = 0, hi = tails->len;
+		while (lo < hi) {
+			guint mid = (lo + hi) / 2;
+			if (g_array_index(cand_a, guint, g_array_index(tails, guint, mid)) < i) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		guint before = lo > 0 ? g_array_index(tails, guint, lo - 1) : none;
+		g_array_append_val(cand_a, i);
+		g_array_append_val(cand_b, j);
+		g_array_append_val(prev, before);
+		if (lo == tails->len) {
+			g_array_append_val(tails, c);
+		} else {
+			g_array_index(tails, guint, lo) = c;
+		}
+	}
+
+	// Walk the chain back to front, the ranges come out last first
+	guint a_hi = n, b_hi = m;
+	for (guint c = tails->len > 0 ? g_array_index(tails, guint, tails->len - 1) : none; c != none; c = g_array_index(prev, guint, c)) {
+		guint i = g_array_index(cand_a, guint, c), j = g_array_index(cand_b, guint, c);
+		if (i + 1 < a_hi || j + 1 < b_hi) {
+			GsDiffRange range = { i + 1, a_hi, j + 1, b_hi };
+			g_array_append_val(stack, range);
+		}
+		a_hi = i;
+		b_hi = j;
+	}
+	if (a_hi > 0 || b_hi > 0) {
+		GsDiffRange range = { 0, a_hi, 0, b_hi };
+		g_array_append_val(stack, range);
+	}
+
+	g_array_free(tails, TRUE);
+	g_array_free(cand_a, TRUE); g_array_free(cand_b, TRUE);
+	g_array_free(prev, TRUE);
+	g_free(count_a); g_free(count_b); g_free(pos_a);
+}
+
+// Histogram diff of line ids a[0..n) and b[0..m), appends GsDiffLines to hunks.
+// Ranges without an anchor fall back to Myers, or to a single hunk. Stops early if *cancelled gets set
+static void gs_diff_histogram(const guint *a, guint n, const guint *b, guint m, guint ids, GArray *hunks, gint *cancelled) {
+	const guint none = G_MAXUINT;
+	guint *count = g_new0(guint, ids), *head = g_new(guint, ids), *next = g_new(guint, MAX(n, 1));
+	GArray *stack = g_array_new(FALSE, FALSE, sizeof(GsDiffRange));
+	GArray *hashes = g_array_new(FALSE, FALSE, sizeof(guint64)), *snakes = g_array_new(FALSE, FALSE, sizeof(gint));
+	gs_diff_unique_ranges(a, n, b, m, ids, stack);
+
+	while (stack->len > 0 && (cancelled == NULL || !g_atomic_int_get(cancelled))) {
+		GsDiffRange r = g_array_index(stack, GsDiffRange, stack->len - 1);
+		g_array_set_size(stack, stack->len - 1);
+
+		// Common lines at both ends need no anchor
+		while (r.a_lo < r.a_hi && r.b_lo < r.b_hi && a[r.a_lo] == b[r.b_lo]) {
+			r.a_lo++; r.b_lo++;
+		}
+		while (r.a_lo < r.a_hi && r.b_lo < r.b_hi && a[r.a_hi - 1] == b[r.b_hi - 1]) {
+			r.a_hi--; r.b_hi--;
+		}
+		if (r.a_lo == r.a_hi || r.b_lo == r.b_hi) {
+			gs_diff_lines_add(hunks, r.a_lo, r.a_hi, r.b_lo, r.b_hi);
+			continue;
+		}
+
+		// Histogram of a, chained from the first occurrence
+		for (guint i = r.a_hi; i-- > r.a_lo; ) {
+			guint id = a[i];
+			next[i] = count[id] > 0 ? head[id] : none;
+			head[id] = i;
+			count[id]++;
+		}
+
+		// Longest equal region around the rarest lines of b that occur in a
+		guint best_a = 0, best_b = 0, best_len = 0, best_count = GS_DIFF_HISTOGRAM_CHAIN + 1;
+		for (guint j = r.b_lo; j < r.b_hi; ) {
+			guint id = b[j], j_next = j + 1;
+			if (count[id] == 0 || count[id] > best_count) {
+				j = j_next;
+				continue;
+			}
+			for (guint i = head[id]; i != none; ) {
+				guint as = i, bs = j, ae = i + 1, be = j + 1, rarity = count[id];
+				while (as > r.a_lo && bs > r.b_lo && a[as - 1] == b[bs - 1]) {
+					as--; bs--;
+					rarity = MIN(rarity, count[a[as]]);
+				}
+				while (ae < r.a_hi && be < r.b_hi && a[ae] == b[be]) {
+					rarity = MIN(rarity, count[a[ae]]);
+					ae++; be++;
+				}
+				if (ae - as > best_len || rarity < best_count) {
+					best_a = as; best_b = bs; best_len = ae - as; best_count = rarity;
+				}
+				j_next = MAX(j_next, be);
+				// Later occurrences inside this region would only find it again
+				for (i = next[i]; i != none && i < ae; i = next[i]);
+			}
+			j = j_next;
+		}
+		for (guint i = r.a_lo; i < r.a_hi; i++) {
+			count[a[i]] = 0;
+		}
+
+		if (best_len > 0) {
+			// Right part goes below the left one, so hunks come out in order
+			GsDiffRange right = { best_a + best_len, r.a_hi, best_b + best_len, r.b_hi };
+			GsDiffRange left  = { r.a_lo, best_a, r.b_lo, best_b };
+			g_array_append_val(stack, right);
+			g_array_append_val(stack, left);
+			continue;
+		}
+
+		// No line is rare enough: Myers on ids if the range is small enough, else one hunk
+		guint rn = r.a_hi - r.a_lo, rm = r.b_hi - r.b_lo;
+		g_array_set_size(hashes, 0);
+		g_array_set_size(snakes, 0);
+		for (guint i = r.a_lo; i < r.a_hi; i++) {
+			guint64 h = a[i];
+			g_array_append_val(hashes, h);
+		}
+		for (guint j = r.b_lo; j < r.b_hi; j++) {
+			guint64 h = b[j];
+			g_array_append_val(hashes, h);
+		}
+		if ((rn > rm ? rn - rm : rm - rn) <= GS_DIFF_MAX_EDITS && (gsize) rn + rm < G_MAXINT
+			&& gs_diff_myers((guint64*) hashes->data, rn, (guint64*) hashes->data + rn, rm, NULL, NULL, GS_DIFF_MAX_EDITS, snakes)) {
+			guint x = 0, y = 0;
+			gint end_snake[3] = { rn, rm, 0 };
+			g_array_append_vals(snakes, end_snake, 3);
+			for (guint i = 0; i < snakes->len; i += 3) {
+				gint *snake = &g_array_index(snakes, gint, i);
+				gs_diff_lines_add(hunks, r.a_lo + x, r.a_lo + snake[0], r.b_lo + y, r.b_lo + snake[1]);
+				x = snake[0] + snake[2];
+				y = snake[1] + snake[2];
+			}
+		} else {
+			gs_diff_lines_add(hunks, r.a_lo, r.a_hi, r.b_lo, r.b_hi);
+		}
+	}
+
+	g_array_free(stack, TRUE);
+	g_array_free(hashes, TRUE);
+	g_array_free(snakes, TRUE);
+	g_free(count); g_free(head); g_free(next);
+}
+
+// Diff old and new text by lines, appends GsDiffLines with 0-based line numbers to hunks.
+// Line breaks are part of the line, so a missing final line break counts as a change of the last line
+void gs_diff_lines(const gchar *old_text, gsize old_len, const gchar *new_text, gsize new_len, GArray *hunks, gint *cancelled) {
+	gsize max_prefix = MIN(old_len, new_len);
+	gsize prefix = gs_mem_common_prefix(old_text, new_text, max_prefix);
+	while (prefix > 0 && old_text[prefix - 1] != '\n') {
+		prefix--;
+	}
+	// Line numbers below need the middle part to start a line on both sides
+	gsize suffix = gs_mem_common_suffix(old_text + old_len, new_text + new_len, max_prefix - prefix);
+	while (suffix > 0 && ((old_len - suffix > prefix && old_text[old_len - suffix - 1] != '\n')
+		|| (new_len - suffix > prefix && new_text[new_len - suffix - 1] != '\n'))) {
+		suffix--;
+	}
+	if (prefix == old_len && prefix == new_len) {
+		return; // Equal
+	}
+
+	GArray *old_offsets = g_array_new(FALSE, FALSE, sizeof(gsize)), *new_offsets = g_array_new(FALSE, FALSE, sizeof(gsize));
+	GArray *old_hashes  = g_array_new(FALSE, FALSE, sizeof(guint64)), *new_hashes = g_array_new(FALSE, FALSE, sizeof(guint64));
+	gsize n = gs_diff_split_lines(old_text + prefix, old_len - suffix - prefix, 0, old_offsets, old_hashes);
+	gsize m = gs_diff_split_lines(new_text + prefix, new_len - suffix - prefix, 0, new_offsets, new_hashes);
+	guint base = gs_mem_count_lines(old_text, prefix);
+	g_array_free(old_offsets, TRUE);
+	g_array_free(new_offsets, TRUE);
+
+	if (n + m < G_MAXUINT / 2) {
+		guint *a = g_new(guint, MAX(n, 1)), *b = g_new(guint, MAX(m, 1));
+		guint ids = gs_diff_intern((guint64*) old_hashes->data, n, (guint64*) new_hashes->data, m, a, b);
+		guint first = hunks->len;
+		gs_diff_histogram(a, n, b, m, ids, hunks, cancelled);
+		for (guint i = first; i < hunks->len; i++) {
+			GsDiffLines *hunk = &g_array_index(hunks, GsDiffLines, i);
+			hunk->old_start += base; hunk->old_end += base;
+			hunk->new_start += base; hunk->new_end += base;
+		}
+		g_free(a);
+		g_free(b);
+	}
+	g_array_free(old_hashes, TRUE);
+	g_array_free(new_hashes, TRUE);
+}
+
+// Contents of filepath as UTF-8 without BOM, like an editor shows it. NULL and *error set on failure
+static GBytes* gs_diff_read_file(const gchar *filepath, const gchar *encoding, gchar **error) {
+	gchar *contents;
+	gsize len;
+	GError *err = NULL;
+	if (!g_file_get_contents(filepath, &contents, &len, &err)) {
+		*error = g_strdup(err->message);
+		g_error_free(err);
+		return NULL;
+	}
+	if (encoding != NULL && g_ascii_strcasecmp(encoding, "UTF-8") != 0) {
+		gchar *converted = g_convert(contents, len, "UTF-8", encoding, NULL, &len, &err);
+		g_free(contents);
+		if (converted == NULL) {
+			*error = g_strdup(err->message);
+			g_error_free(err);
+			return NULL;
+		}
+		contents = converted;
+	}
+	GBytes *bytes = g_bytes_new_take(contents, len);
+	if (len >= 3 && memcmp(contents, "\xEF\xBB\xBF", 3) == 0) {
+		GBytes *without_bom = g_bytes_new_from_bytes(bytes, 3, len - 3);
+		g_bytes_unref(bytes);
+		bytes = without_bom;
+	}
+	return bytes;
+}
+
+static gpointer gs_diff_job_thread(gpointer data) {
+	GsDiffJob *job = data;
+	if (job->old_text == NULL) {
+		job->old_text = gs_diff_read_file(job->old_path, job->old_encoding, &job->error);
+	}
+	if (job->old_text != NULL) {
+		gsize old_len, new_len;
+		const gchar *old_text = g_bytes_get_data(job->old_text, &old_len), *new_text = g_bytes_get_data(job->new_text, &new_len);
+		gs_diff_lines(old_text, old_len, new_text, new_len, job->hunks, &job->cancelled);
+	}
+	g_atomic_int_set(&job->done, 1);
+	return NULL;
+}
+
+// Diff two snapshots in background, takes ownership of them. If old_text is NULL, the old side is read
+// from old_path in the thread
+GsDiffJob* gs_diff_job_start(GBytes *old_text, const gchar *old_path, const gchar *old_encoding, GBytes *new_text) {
+	GsDiffJob *job = g_new0(GsDiffJob, 1);
+	job->old_text = old_text;
+	job->old_path = g_strdup(old_path);
+	job->old_encoding = g_strdup(old_encoding);
+	job->new_text = new_text;
+	job->hunks = g_array_new(FALSE, FALSE, sizeof(GsDiffLines));
+	job->thread = g_thread_new("ggu-diff", gs_diff_job_thread, job);
+	return job;
+}
+
+gboolean gs_diff_job_done(GsDiffJob *job) {
+	return g_atomic_int_get(&job->done);
+}
+
+// Wait for the job and free it. Returns the hunks, NULL if cancel is set or reading the old side
+// failed (*error set then, if error isn't NULL). The old side is passed to *old_text if that isn't NULL
+GArray* gs_diff_job_finish(GsDiffJob *job, gboolean cancel, GBytes **old_text, gchar **error) {
+	g_atomic_int_set(&job->cancelled, cancel);
+	g_thread_join(job->thread);
+	GArray *hunks = job->hunks;
+	if (cancel || job->error != NULL) {
+		g_array_free(hunks, TRUE);
+		hunks = NULL;
+	}
+	if (error != NULL) {
+		*error = job->error;
+		job->error = NULL;
+	}
+	if (old_text != NULL) {
+		*old_text = hunks != NULL ? job->old_text : NULL;
+		job->old_text = hunks != NULL ? NULL : job->old_text;
+	}
+	if (job->old_text != NULL) {
+		g_bytes_unref(job->old_text);
+	}
+	g_bytes_unref(job->new_text);
+	g_free(job->old_path);
+	g_free(job->old_encoding);
+	g_free(job->error);
+	g_free(job);
+	return hunks;
+}
+
+//######################################################################################################
+// Pipe result cache
+//
+// Bounded LRU cache of command outputs keyed by a hash of the input plus the command, so repeating a
+// command on unchanged text doesn't run it again. The input is hashed with XXH64, which reads 8 bytes
+// per step and runs at memory speed, so hashing a large document costs a few milliseconds.
+
+#define GS_XXH_P1 0x9E3779B185EBCA87ULL
+#define GS_XXH_P2 0xC2B2AE3D27D4EB4FULL
+#define GS_XXH_P3 0x165667B19E3779F9ULL
+#define GS_XXH_P4 0x85EBCA77C2B2AE63ULL
+#define GS_XXH_P5 0x27D4EB2F165667C5ULL
+
+static inline guint64 gs_rotl64(guint64 x, gint r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline guint64 gs_read64(const guchar *p) {
+	guint64 v;
+	memcpy(&v, p, sizeof(v));
+	return GUINT64_FROM_LE(v);
+}
+
+static inline guint64 gs_xxh64_round(guint64 acc, guint64 input) {
+	return gs_rotl64(acc + input * GS_XXH_P2, 31) * GS_XXH_P1;
+}
+
+static inline guint64 gs_xxh64_merge(guint64 h, guint64 v) {
+	return (h ^ gs_xxh64_round(0, v)) * GS_XXH_P1 + GS_XXH_P4;
+}
+
+// XXH64 of p[0..len)
+guint64 gs_hash_xxh64(const gchar *p, gsize len, guint64 seed) {
+	const guchar *b = (const guchar*) p, *end = b + len;
+	guint64 h;
+
+	if (len >= 32) {
+		guint64 v1 = seed + GS_XXH_P1 + GS_XXH_P2, v2 = seed + GS_XXH_P2, v3 = seed, v4 = seed - GS_XXH_P1;
+		for (; b + 32 <= end; b += 32) {
+			v1 = gs_xxh64_round(v1, gs_read64(b));
+			v2 = gs_xxh64_round(v2, gs_read64(b + 8));
+			v3 = gs_xxh64_round(v3, gs_read64(b + 16));
+			v4 = gs_xxh64_round(v4, gs_read64(b + 24));
+		}
+		h = gs_rotl64(v1, 1) + gs_rotl64(v2, 7) + gs_rotl64(v3, 12) + gs_rotl64(v4, 18);
+		h = gs_xxh64_merge(gs_xxh64_merge(gs_xxh64_merge(gs_xxh64_merge(h, v1), v2), v3), v4);
+	} else {
+		h = seed + GS_XXH_P5;
+	}
+
+	h += len;
+	for (; b + 8 <= end; b += 8) {
+		h = gs_rotl64(h ^ gs_xxh64_round(0, gs_read64(b)), 27) * GS_XXH_P1 + GS_XXH_P4;
+	}
+	if (b + 4 <= end) {
+		guint32 v;
+		memcpy(&v, b, sizeof(v));
+		h = gs_rotl64(h ^ (GUINT32_FROM_LE(v) * GS_XXH_P1), 23) * GS_XXH_P2 + GS_XXH_P3;
+		b += 4;
+	}
+	for (; b < end; b++) {
+		h = gs_rotl64(h ^ (*b * GS_XXH_P5), 11) * GS_XXH_P1;
+	}
+
+	h ^= h >> 33; h *= GS_XXH_P2;
+	h ^= h >> 29; h *= GS_XXH_P3;
+	h ^= h >> 32;
+	return h;
+}
+
+typedef struct {
+	guint64  input_hash;
+	gsize    input_len;
+	gchar   *command;
+	GString *output;
+} GsPipeCacheEntry;
+
+static void gs_pipe_cache_entry_free(GsPipeCacheEntry *entry) {
+	g_string_free(entry->output, TRUE);
+	g_free(entry->command);
+	g_free(entry);
+}
+
+// Output of command for the input, NULL if not cached. A hit becomes the most recently used entry
+GString* gs_pipe_cache_lookup(GsPipeCache *cache, guint64 input_hash, gsize input_len, const gchar *command) {
+	for (GList *link = cache->entries.head; link != NULL; link = link->next) {
+		GsPipeCacheEntry *entry = link->data;
+		if (entry->input_hash == input_hash && entry->input_len == input_len && g_str_equal(entry->command, command)) {
+			g_queue_unlink(&cache->entries, link);
+			g_queue_push_head_link(&cache->entries, link);
+			return entry->output;
+		}
+	}
+	return NULL;
+}
+
+// Drop least recently used entries until max_size is kept, all of them for 0
+void gs_pipe_cache_trim(GsPipeCache *cache, gsize max_size) {
+	while (!g_queue_is_empty(&cache->entries) && (cache->size > max_size || max_size == 0)) {
+		GsPipeCacheEntry *entry = g_queue_pop_tail(&cache->entries);
+		cache->size -= entry->output->len;
+		gs_pipe_cache_entry_free(entry);
+	}
+}
+
+// Add output of command for the input, takes ownership of output. It replaces an earlier output for the
+// same input and command, which differs for commands like date. Outputs bigger than the cache are dropped
+void gs_pipe_cache_insert(GsPipeCache *cache, guint64 input_hash, gsize input_len, const gchar *command, GString *output) {
+	if (gs_pipe_cache_lookup(cache, input_hash, input_len, command) != NULL) { // Now the first entry
+		GsPipeCacheEntry *entry = g_queue_pop_head(&cache->entries);
+		cache->size -= entry->output->len;
+		gs_pipe_cache_entry_free(entry);
+	}
+	if (cache->max_size == 0 || output->len > cache->max_size) {
+		g_string_free(output, TRUE);
+		return;
+	}
+	gs_pipe_cache_trim(cache, cache->max_size - output->len);
+	GsPipeCacheEntry *entry = g_new0(GsPipeCacheEntry, 1);
+	entry->input_hash = input_hash;
+	entry->input_len  = input_len;
+	entry->command    = g_strdup(command);
+	entry->output     = output;
+	g_queue_push_head(&cache->entries, entry);
+	cache->size += output->len;
+}
+
+//######################################################################################################
+// Transform engine
+//
+// Codecs for payloads found in logs: base64 (standard and URL alphabet), hex, URL percent-coding, JWT
+// and zlib/gzip inflate. Each one is a single pass reading the input in place and writing straight into
+// the output buffer, sized up front where the output length is known. SSE2 decodes 16 base64 or hex
+// characters per step and finds runs of characters URL encoding keeps as they are; anything the fast
+// path doesn't handle (line breaks, padding, invalid input) goes through the scalar loop. Base64
+// encoding stays scalar, spreading 3 bytes to 4 characters needs byte shuffles SSE2 doesn't have.
+// Inflate streams through GIO's zlib decompressor in fixed size output steps.
+
+#define GS_TRANSFORM_INFLATE_STEP (256 * 1024)
+
+static const gchar gs_base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Lookup: value of a base64 character of either alphabet, -1 if none
+static const gint8 gs_base64_values[256] = {
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,62,-1,62,-1,63,
+	52,53,54,55,56,57,58,59,  60,61,-1,-1,-1,-1,-1,-1,
+	-1, 0, 1, 2, 3, 4, 5, 6,   7, 8, 9,10,11,12,13,14,
+	15,16,17,18,19,20,21,22,  23,24,25,-1,-1,-1,-1,63,
+	-1,26,27,28,29,30,31,32,  33,34,35,36,37,38,39,40,
+	41,42,43,44,45,46,47,48,  49,50,51,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+};
+
+static inline gint gs_base64_value(guchar c) {
+	return gs_base64_values[c];
+}
+
+// Base64 of in[0..len), a line break after every wrap characters if wrap isn't 0 (and at the end)
+static void gs_base64_encode(const guchar *in, gsize len, guint wrap, GString *out) {
+	gsize chars = (len + 2) / 3 * 4, start = out->len, i = 0;
+	g_string_set_size(out, start + chars);
+	gchar *w = out->str + start;
+	for (; i + 3 <= len; i += 3, w += 4) {
+		guint32 group = (guint32) in[i] << 16 | (guint32) in[i + 1] << 8 | in[i + 2];
+		w[0] = gs_base64_alphabet[group >> 18];
+		w[1] = gs_base64_alphabet[(group >> 12) & 63];
+		w[2] = gs_base64_alphabet[(group >> 6) & 63];
+		w[3] = gs_base64_alphabet[group & 63];
+	}
+	if (i < len) {
+		guint32 group = (guint32) in[i] << 16 | (i + 1 < len ? (guint32) in[i + 1] << 8 : 0);
+		w[0] = gs_base64_alphabet[group >> 18];
+		w[1] = gs_base64_alphabet[(group >> 12) & 63];
+		w[2] = i + 1 < len ? gs_base64_alphabet[(group >> 6) & 63] : '=';
+		w[3] = '=';
+	}
+
+	// Spread the lines from the back, each one moves by the number of line breaks before it
+	if (wrap > 0 && chars > 0) {
+		gsize lines = (chars + wrap - 1) / wrap;
+		g_string_set_size(out, start + chars + lines);
+		for (gsize line = lines; line-- > 0; ) {
+			gsize from = start + line * wrap, n = MIN(wrap, chars - line * wrap);
+			memmove(out->str + from + line, out->str + from, n);
+			out->str[from + line + n] = '\n';
+		}
+	}
+}
+
+#ifdef __SSE2__
+// Decode 16 base64 characters at p into 12 bytes at w. Returns FALSE without writing if any isn't one
+static inline gboolean gs_base64_decode16(const gchar *p, guchar *w) {
+	// Signed compares: bytes >= 0x80 are negative and fall in no range
+	__m128i c = _mm_loadu_si128((const __m128i*) p);
+	__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('Z' + 1)));
+	__m128i lower = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('z' + 1)));
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+	__m128i v62 = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('+')), _mm_cmpeq_epi8(c, _mm_set1_epi8('-')));
+	__m128i v63 = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('/')), _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+	if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(v62, v63)))) != 0xFFFF) {
+		return FALSE;
+	}
+	__m128i v = _mm_or_si128(_mm_or_si128(_mm_and_si128(upper, _mm_sub_epi8(c, _mm_set1_epi8('A'))),
+	                                      _mm_and_si128(lower, _mm_sub_epi8(c, _mm_set1_epi8('a' - 26)))),
+	                         _mm_or_si128(_mm_and_si128(digit, _mm_add_epi8(c, _mm_set1_epi8(52 - '0'))),
+	                                      _mm_or_si128(_mm_and_si128(v62, _mm_set1_epi8(62)), _mm_and_si128(v63, _mm_set1_epi8(63)))));
+	// Join 6 bit values: pairs to 12 bits, then pairs of those to 24 bits per 32 bit lane
+	__m128i pairs = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00FF)), 6), _mm_srli_epi16(v, 8));
+	__m128i quads = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(pairs, _mm_set1_epi32(0xFFFF)), 12), _mm_srli_epi32(pairs, 16));
+	guint32 lanes[4];
+	_mm_storeu_si128((__m128i*) lanes, quads);
+	for (guint i = 0; i < 4; i++, w += 3) {
+		w[0] = lanes[i] >> 16;
+		w[1] = lanes[i] >> 8;
+		w[2] = lanes[i];
+	}
+	return TRUE;
+}
+#endif
+
+// Decode base64 of either alphabet, whitespace is skipped and padding is optional. Other characters
+// are an error unless ignore_garbage is set. Returns FALSE and sets *error on invalid input
+static gboolean gs_base64_decode(const gchar *in, gsize len, gboolean ignore_garbage, GString *out, gchar **error) {
+	gsize start = out->len;
+	g_string_set_size(out, start + len / 4 * 3 + 3);
+	guchar *w = (guchar*) out->str + start;
+	guint32 group = 0;
+	guint n = 0, padding = 0;
+	for (const gchar *p = in, *end = in + len; p < end; ) {
+#ifdef __SSE2__
+		if (n == 0 && padding == 0) {
+			for (; end - p >= 16 && gs_base64_decode16(p, w); p += 16, w += 12);
+			if (p == end) {
+				break;
+			}
+		}
+#endif
+		guchar c = *p++;
+		gint value = gs_base64_value(c);
+		if (value >= 0 && padding == 0) {
+			group = group << 6 | value;
+			if (++n == 4) {
+				w[0] = group >> 16;
+				w[1] = group >> 8;
+				w[2] = group;
+				w += 3;
+				n = 0;
+			}
+		} else if (c == '=' && n >= 2 && n + padding < 4) {
+			padding++;
+		} else if (!g_ascii_isspace(c) && !ignore_garbage) {
+			*error = g_strdup_printf("Invalid base64 character at offset %zu", (gsize) (p - 1 - in));
+			g_string_truncate(out, start);
+			return FALSE;
+		}
+	}
+	if (n == 1) {
+		*error = g_strdup("Truncated base64 input");
+		g_string_truncate(out, start);
+		return FALSE;
+	} else if (n == 2) {
+		*w++ = group >> 4;
+	} else if (n == 3) {
+		*w++ = group >> 10;
+		*w++ = group >> 2;
+	}
+	g_string_truncate(out, w - (guchar*) out->str);
+	return TRUE;
+}
+
+#ifdef __SSE2__
+// Lowercase hex digits of the 16 nibbles in n
+static inline __m128i gs_hex_digits16(__m128i n) {
+	__m128i letter = _mm_and_si128(_mm_cmpgt_epi8(n, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+	return _mm_add_epi8(n, _mm_add_epi8(_mm_set1_epi8('0'), letter));
+}
+#endif
+
+// Lowercase hex of in[0..len), a line break after every wrap characters if wrap isn't 0 (and at the end)
+static void gs_hex_encode(const guchar *in, gsize len, guint wrap, GString *out) {
+	static const gchar digits[] = "0123456789abcdef";
+	gsize line_bytes = wrap >= 2 ? wrap / 2 : len, start = out->len;
+	g_string_set_size(out, start + 2 * len + (wrap >= 2 ? len / line_bytes + 1 : 0));
+	gchar *w = out->str + start;
+	for (gsize line = 0; line < len; line += line_bytes) {
+		const guchar *p = in + line, *end = in + MIN(len, line + line_bytes);
+#ifdef __SSE2__
+		for (; end - p >= 16; p += 16, w += 32) {
+			__m128i bytes = _mm_loadu_si128((const __m128i*) p);
+			__m128i high = gs_hex_digits16(_mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x0F)));
+			__m128i low = gs_hex_digits16(_mm_and_si128(bytes, _mm_set1_epi8(0x0F)));
+			_mm_storeu_si128((__m128i*) w, _mm_unpacklo_epi8(high, low));
+			_mm_storeu_si128((__m128i*) (w + 16), _mm_unpackhi_epi8(high, low));
+		}
+#endif
+		for (; p < end; p++) {
+			*w++ = digits[*p >> 4];
+			*w++ = digits[*p & 0x0F];
+		}
+		if (wrap >= 2) {
+			*w++ = '\n';
+		}
+	}
+	g_string_truncate(out, w - out->str);
+}
+
+// Lookup: value of a hex digit of either case, -1 if none
+static const gint8 gs_hex_values[256] = {
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	 0, 1, 2, 3, 4, 5, 6, 7,   8, 9,-1,-1,-1,-1,-1,-1,
+	-1,10,11,12,13,14,15,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,10,11,12,13,14,15,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,  -1,-1,-1,-1,-1,-1,-1,-1,
+};
+
+static inline gint gs_hex_value(guchar c) {
+	return gs_hex_values[c];
+}
+
+#ifdef __SSE2__
+// Values of the 16 hex digits at p in the 16 bit lanes as (high << 4 | low) pairs, FALSE if any isn't one
+static inline gboolean gs_hex_decode16(const gchar *p, __m128i *pairs) {
+	__m128i c = _mm_loadu_si128((const __m128i*) p), folded = _mm_or_si128(c, _mm_set1_epi8(0x20));
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+	__m128i letter = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(folded, _mm_set1_epi8('f' + 1)));
+	if (_mm_movemask_epi8(_mm_or_si128(digit, letter)) != 0xFFFF) {
+		return FALSE;
+	}
+	__m128i v = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))), _mm_and_si128(letter, _mm_sub_epi8(folded, _mm_set1_epi8('a' - 10))));
+	*pairs = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00FF)), 4), _mm_srli_epi16(v, 8));
+	return TRUE;
+}
+#endif
+
+// Decode hex digits of either case, whitespace is skipped. Returns FALSE and sets *error on invalid input
+static gboolean gs_hex_decode(const gchar *in, gsize len, GString *out, gchar **error) {
+	gsize start = out->len;
+	g_string_set_size(out, start + len / 2 + 1);
+	guchar *w = (guchar*) out->str + start;
+	gint high = -1;
+	for (const gchar *p = in, *end = in + len; p < end; ) {
+#ifdef __SSE2__
+		__m128i pairs;
+		for (; high < 0 && end - p >= 16 && gs_hex_decode16(p, &pairs); p += 16, w += 8) {
+			_mm_storel_epi64((__m128i*) w, _mm_packus_epi16(pairs, pairs));
+		}
+		if (p == end) {
+			break;
+		}
+#endif
+		guchar c = *p++;
+		gint value = gs_hex_value(c);
+		if (value >= 0) {
+			if (high < 0) {
+				high = value;
+			} else {
+				*w++ = high << 4 | value;
+				high = -1;
+			}
+		} else if (!g_ascii_isspace(c)) {
+			*error = g_strdup_printf("Invalid hex digit at offset %zu", (gsize) (p - 1 - in));
+			g_string_truncate(out, start);
+			return FALSE;
+		}
+	}
+	if (high >= 0) {
+		*error = g_strdup("Odd number of hex digits");
+		g_string_truncate(out, start);
+		return FALSE;
+	}
+	g_string_truncate(out, w - (guchar*) out->str);
+	return TRUE;
+}
+
+// Characters URL encoding keeps: A-Z a-z 0-9 - . _ ~ (RFC 3986 unreserved)
+static inline gboolean gs_url_unreserved(guchar c) {
+	return g_ascii_isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+// End of the run of unreserved characters starting at p
+static inline const gchar* gs_url_unreserved_run(const gchar *p, const gchar *end) {
+#ifdef __SSE2__
+	for (; end - p >= 16; p += 16) {
+		__m128i c = _mm_loadu_si128((const __m128i*) p), folded = _mm_or_si128(c, _mm_set1_epi8(0x20));
+		__m128i letter = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(folded, _mm_set1_epi8('z' + 1)));
+		__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+		__m128i mark = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('-')), _mm_cmpeq_epi8(c, _mm_set1_epi8('.'))),
+		                            _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('_')), _mm_cmpeq_epi8(c, _mm_set1_epi8('~'))));
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), mark)) ^ 0xFFFF;
+		if (mask != 0) {
+			return p + __builtin_ctz(mask);
+		}
+	}
+#endif
+	while (p < end && gs_url_unreserved(*p)) {
+		p++;
+	}
+	return p;
+}
+
+// Percent-encode every byte except the unreserved characters
+static void gs_url_encode(const gchar *in, gsize len, GString *out) {
+	static const gchar digits[] = "0123456789ABCDEF";
+	for (const gchar *p = in, *end = in + len; p < end; ) {
+		const gchar *run = gs_url_unreserved_run(p, end);
+		g_string_append_len(out, p, run - p);
+		for (p = run; p < end && !gs_url_unreserved(*p); p++) {
+			gchar escape[3] = { '%', digits[(guchar) *p >> 4], digits[*p & 0x0F] };
+			g_string_append_len(out, escape, 3);
+		}
+	}
+}
+
+// Decode %XX escapes and + as space (form encoding). Malformed escapes are kept as they are
+static void gs_url_decode(const gchar *in, gsize len, GString *out) {
+	const gchar *p = in, *end = in + len;
+	while (p < end) {
+		const gchar *percent = memchr(p, '%', end - p);
+		const gchar *run_end = percent != NULL ? percent : end;
+		gsize start = out->len;
+		g_string_append_len(out, p, run_end - p);
+		for (gchar *plus = out->str + start; (plus = memchr(plus, '+', out->str + out->len - plus)) != NULL; ) {
+			*plus++ = ' ';
+		}
+		p = run_end;
+		if (percent != NULL) {
+			gint high = end - p > 2 ? gs_hex_value(p[1]) : -1, low = high >= 0 ? gs_hex_value(p[2]) : -1;
+			if (low >= 0) {
+				g_string_append_c(out, high << 4 | low);
+				p += 3;
+			} else {
+				g_string_append_c(out, '%');
+				p++;
+			}
+		}
+	}
+}
+
+// Inflate gzip, zlib or raw deflate data, the format is taken from the header. Concatenated gzip
+// members are inflated one after another like gunzip does. Returns FALSE and sets *error on invalid input
+static gboolean gs_inflate(const guchar *in, gsize len, GString *out, gchar **error) {
+	gboolean gzip = len >= 2 && in[0] == 0x1F && in[1] == 0x8B;
+	gboolean zlib = !gzip && len >= 2 && (in[0] & 0x0F) == 8 && ((in[0] << 8) | in[1]) % 31 == 0;
+	GConverter *inflater = G_CONVERTER(g_zlib_decompressor_new(gzip ? G_ZLIB_COMPRESSOR_FORMAT_GZIP : zlib ? G_ZLIB_COMPRESSOR_FORMAT_ZLIB : G_ZLIB_COMPRESSOR_FORMAT_RAW));
+	gsize pos = 0, start = out->len;
+	GConverterResult result;
+	GError *err = NULL;
+	gsize read, written;
+	do {
+		gsize out_len = out->len;
+		read = written = 0;
+		g_string_set_size(out, out_len + GS_TRANSFORM_INFLATE_STEP);
+		result = g_converter_convert(inflater, in + pos, len - pos, out->str + out_len, GS_TRANSFORM_INFLATE_STEP, G_CONVERTER_INPUT_AT_END, &read, &written, &err);
+		g_string_truncate(out, out_len + written);
+		pos += read;
+		if (result == G_CONVERTER_FINISHED && gzip && len - pos >= 2 && in[pos] == 0x1F && in[pos + 1] == 0x8B) {
+			g_converter_reset(inflater);
+			result = G_CONVERTER_CONVERTED;
+		}
+	} while (result == G_CONVERTER_CONVERTED && (read > 0 || written > 0));
+	g_object_unref(inflater);
+	if (result != G_CONVERTER_FINISHED) {
+		*error = g_strdup_printf("Inflate failed at offset %zu: %s", pos, err != NULL ? err->message : "Truncated input");
+		if (err != NULL) {
+			g_error_free(err);
+		}
+		g_string_truncate(out, start);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// Decode a JWT (header.payload.signature, also behind "Bearer ") into the JSON object
+// {"header": .., "payload": .., "signature": ".."}, formatted with indent.
+// Returns FALSE and sets *error if it isn't a signed JWT or header or payload aren't JSON
+static gboolean gs_jwt_decode(const gchar *in, gsize len, gint indent, GString *out, gchar **error) {
+	const gchar *p = in, *end = in + len;
+	for (; p < end && g_ascii_isspace(*p); p++);
+	for (; end > p && g_ascii_isspace(end[-1]); end--);
+	if (end - p > 7 && g_ascii_strncasecmp(p, "Bearer ", 7) == 0) {
+		for (p += 7; p < end && *p == ' '; p++);
+	}
+	const gchar *dot1 = memchr(p, '.', end - p);
+	const gchar *dot2 = dot1 != NULL ? memchr(dot1 + 1, '.', end - dot1 - 1) : NULL;
+	if (dot2 == NULL || memchr(dot2 + 1, '.', end - dot2 - 1) != NULL) {
+		*error = g_strdup("Not a signed JWT (header.payload.signature)");
+		return FALSE;
+	}
+	for (const gchar *s = dot2 + 1; s < end; s++) {
+		if (gs_base64_value(*s) < 0) {
+			*error = g_strdup_printf("Invalid base64 character at offset %zu", (gsize) (s - in));
+			return FALSE;
+		}
+	}
+
+	GString *json = g_string_new("{\"header\":");
+	gboolean ok = gs_base64_decode(p, dot1 - p, FALSE, json, error);
+	g_string_append(json, ",\"payload\":");
+	ok = ok && gs_base64_decode(dot1 + 1, dot2 - dot1 - 1, FALSE, json, error);
+	g_string_append(json, ",\"signature\":\"");
+	g_string_append_len(json, dot2 + 1, end - dot2 - 1);
+	g_string_append(json, "\"}");
+
+	GsParseError err = { 0, NULL };
+	gsize start = out->len;
+	if (ok && !gs_json_format(json->str, json->len, indent, out, &err)) {
+		*error = g_strdup_printf("Header or payload is not JSON: %s", err.message);
+		g_string_truncate(out, start);
+		ok = FALSE;
+	}
+	g_string_free(json, TRUE);
+	return ok;
+}
+
+// Run transform on in[0..len), appending to out. wrap applies to encoders, 0 for no line breaks.
+// Returns FALSE and sets *error on invalid input, out is unchanged then
+gboolean gs_transform(GsTransformType type, const gchar *in, gsize len, guint wrap, GString *out, gchar **error) {
+	switch (type) {
+		case GS_TRANSFORM_BASE64_ENCODE: gs_base64_encode((const guchar*) in, len, wrap, out); return TRUE;
+		case GS_TRANSFORM_BASE64_DECODE: return gs_base64_decode(in, len, FALSE, out, error);
+		case GS_TRANSFORM_HEX_ENCODE:    gs_hex_encode((const guchar*) in, len, wrap, out); return TRUE;
+		case GS_TRANSFORM_HEX_DECODE:    return gs_hex_decode(in, len, out, error);
+		case GS_TRANSFORM_URL_ENCODE:    gs_url_encode(in, len, out); return TRUE;
+		case GS_TRANSFORM_URL_DECODE:    gs_url_decode(in, len, out); return TRUE;
+		case GS_TRANSFORM_INFLATE:       return gs_inflate((const guchar*) in, len, out, error);
+		case GS_TRANSFORM_JWT_DECODE:    return gs_jwt_decode(in, len, 2, out, error);
+		case GS_TRANSFORM_BASE64_INFLATE: {
+			GString *compressed = g_string_sized_new(len / 4 * 3 + 3);
+			gboolean ok = gs_base64_decode(in, len, FALSE, compressed, error) && gs_inflate((const guchar*) compressed->str, compressed->len, out, error);
+			g_string_free(compressed, TRUE);
+			return ok;
+		}
+	}
+	return FALSE;
+}
+
+//######################################################################################################
+// Text operators
+//
+// In-process grep, sort, uniq, cut, tr and the codecs base64, xxd -p and gunzip for the pipe tool. A
+// command built only from these, chained
+// with |, runs on the text directly without starting any process. Commands the parser doesn't fully
+// understand (other programs, redirections, globs, unknown options) are left to the shell.
+// Like the coreutils every output line ends with \n. Comparisons are bytewise as in the C locale.
+
+#define GS_TEXTOP_SORT_CHUNK 65536  // Lines per parallel sort task
+
+typedef enum { GS_TEXTOP_GREP, GS_TEXTOP_SORT, GS_TEXTOP_UNIQ, GS_TEXTOP_CUT, GS_TEXTOP_TR, GS_TEXTOP_TRANSFORM } GsTextOpType;
+
+typedef struct {
+	GsTextOpType type;
+	gboolean     ignore_case;                // grep -i, sort -f, uniq -i
+	gboolean     count;                      // grep -c, uniq -c
+	gboolean     invert, extended, fixed;    // grep -v -E -F
+	gchar       *pattern;
+	GRegex      *regex;                      // grep pattern, NULL for a literal search
+	gboolean     reverse, numeric, unique;   // sort -r -n -u
+	guint        key, key_end;               // sort -k: 1-based fields, 0 for the whole line / up to its end
+	gchar        separator;                  // sort -t, cut -d. 0: fields start at runs of blanks (sort)
+	gboolean     repeated, single;           // uniq -d -u
+	GArray      *ranges;                     // cut -f/-c/-b list: pairs of 1-based inclusive from, to
+	gboolean     fields;                     // cut -f, else bytes
+	gboolean     delete, squeeze;            // tr -d -s
+	guchar       map[256];                   // tr translation
+	guchar       delete_set[256], squeeze_set[256];
+	GsTransformType transform;               // base64, xxd -p, gunzip
+	guint        wrap;                       // base64 -w, xxd -c (as characters)
+	gboolean     ignore_garbage;             // base64 -i
+} GsTextOp;
+
+static void gs_textop_free(GsTextOp *op) {
+	if (op->regex != NULL) {
+		g_regex_unref(op->regex);
+	}
+	if (op->ranges != NULL) {
+		g_array_free(op->ranges, TRUE);
+	}
+	g_free(op->pattern);
+	g_free(op);
+}
+
+// Split command at unquoted |. Returns NULL if it uses any other shell syntax
+static gchar** gs_textop_split(const gchar *command) {
+	GPtrArray *stages = g_ptr_array_new_with_free_func(g_free);
+	const gchar *stage = command;
+	gchar quote = 0;
+	for (const gchar *p = command; ; p++) {
+		if ((*p == '\0' && quote == 0) || (*p == '|' && quote == 0)) {
+			g_ptr_array_add(stages, g_strndup(stage, p - stage));
+			if (*p == '\0') {
+				break;
+			}
+			stage = p + 1;
+		} else if (*p == '\0' || (quote == '"' && (*p == '$' || *p == '`')) || (quote == 0 && strchr(";&<>$`(){}*?[~#!\n", *p) != NULL)) {
+			g_ptr_array_free(stages, TRUE);
+			return NULL;
+		} else if (quote == '\'') {
+			quote = *p == '\'' ? 0 : quote;
+		} else if (*p == '\\' && p[1] != '\0') {
+			p++;
+		} else if (quote == 0 && (*p == '"' || *p == '\'')) {
+			quote = *p;
+		} else if (quote == '"' && *p == '"') {
+			quote = 0;
+		}
+	}
+	g_ptr_array_add(stages, NULL);
+	return (gchar**) g_ptr_array_free(stages, FALSE);
+}
+
+// Minimal getopt over argv: returns the next option letter, '\0' at the first operand (*arg points to it).
+// Letters in with_value take the rest of the argument or the next argument as *value, '?' if it's missing
+static gchar gs_textop_next_option(gchar ***arg, const gchar **flag, const gchar *with_value, const gchar **value) {
+	if (*flag == NULL || **flag == '\0') {
+		const gchar *a = **arg;
+		if (a == NULL || a[0] != '-' || a[1] == '\0') {
+			return '\0';
+		}
+		(*arg)++;
+		if (g_str_equal(a, "--")) {
+			return '\0';
+		}
+		*flag = a + 1;
+	}
+	gchar c = *(*flag)++;
+	if (strchr(with_value, c) != NULL) {
+		if (**flag != '\0') {
+			*value = *flag;
+		} else if (**arg != NULL) {
+			*value = *(*arg)++;
+		} else {
+			return '?';
+		}
+		*flag = NULL;
+	}
+	return c;
+}
+
+// Parse an unsigned decimal number made of all of s[0..len)
+static gboolean gs_textop_parse_uint(const gchar *s, gsize len, guint *value) {
+	guint64 v = 0;
+	for (gsize i = 0; i < len; i++) {
+		if (!g_ascii_isdigit(s[i]) || (v = v * 10 + (s[i] - '0')) > G_MAXUINT) {
+			return FALSE;
+		}
+	}
+	*value = v;
+	return len > 0;
+}
+
+// POSIX basic regular expression (grep without -E) in the syntax of GRegex
+static gchar* gs_regex_from_bre(const gchar *bre) {
+	GString *re = g_string_new(NULL);
+	for (const gchar *p = bre; *p != '\0'; p++) {
+		if (*p == '\\' && (p[1] == '<' || p[1] == '>')) {
+			g_string_append(re, "\\b");
+			p++;
+		} else if (*p == '\\' && p[1] != '\0' && strchr("(){}|+?", p[1]) != NULL) {
+			g_string_append_c(re, *++p);
+		} else if (*p == '\\' && p[1] != '\0') {
+			g_string_append_len(re, p++, 2);
+		} else {
+			if (strchr("(){}|+?", *p) != NULL) {
+				g_string_append_c(re, '\\');
+			}
+			g_string_append_c(re, *p);
+		}
+	}
+	return g_string_free(re, FALSE);
+}
+
+// grep / egrep / fgrep [-ivcEF] [-e] PATTERN
+static gboolean gs_textop_parse_grep(GsTextOp *op, gchar **argv) {
+	gchar **arg = argv + 1;
+	const gchar *flag = NULL, *value = NULL;
+	gchar c;
+	op->extended = g_str_equal(argv[0], "egrep");
+	op->fixed = g_str_equal(argv[0], "fgrep");
+	while ((c = gs_textop_next_option(&arg, &flag, "e", &value)) != '\0') {
+		switch (c) {
+			case 'i': op->ignore_case = TRUE; break;
+			case 'v': op->invert = TRUE; break;
+			case 'c': op->count = TRUE; break;
+			case 'E': op->extended = TRUE; break;
+			case 'F': op->fixed = TRUE; break;
+			case 'e':
+				if (op->pattern != NULL) {
+					return FALSE;
+				}
+				op->pattern = g_strdup(value);
+				break;
+			default: return FALSE;
+		}
+	}
+	if (op->pattern == NULL && *arg != NULL) {
+		op->pattern = g_strdup(*arg++);
+	}
+	if (op->pattern == NULL || *arg != NULL || strchr(op->pattern, '\n') != NULL) { // File operands, multiple patterns
+		return FALSE;
+	}
+
+	// Patterns without special characters are searched literally. Case folding of the literal search is ASCII only
+	gboolean ascii = TRUE;
+	for (const gchar *p = op->pattern; *p != '\0'; p++) {
+		ascii &= (guchar) *p < 0x80;
+	}
+	op->fixed |= strpbrk(op->pattern, op->extended ? "\\.[]*^$+?(){}|" : "\\.[]*^$") == NULL;
+	if (!op->fixed || (op->ignore_case && !ascii)) {
+		gchar *re = op->fixed ? g_regex_escape_string(op->pattern, -1) : op->extended ? g_strdup(op->pattern) : gs_regex_from_bre(op->pattern);
+		op->regex = g_regex_new(re, G_REGEX_OPTIMIZE | (op->ignore_case ? G_REGEX_CASELESS : 0), 0, NULL);
+		g_free(re);
+	}
+	return op->fixed || op->regex != NULL; // Let grep report invalid patterns
+}
+
+// sort [-rnuf] [-t SEP] [-k FIELD[,FIELD]]
+static gboolean gs_textop_parse_sort(GsTextOp *op, gchar **argv) {
+	gchar **arg = argv + 1;
+	const gchar *flag = NULL, *value = NULL, *comma;
+	gchar c;
+	while ((c = gs_textop_next_option(&arg, &flag, "kt", &value)) != '\0') {
+		switch (c) {
+			case 'r': op->reverse = TRUE; break;
+			case 'n': op->numeric = TRUE; break;
+			case 'u': op->unique = TRUE; break;
+			case 'f': op->ignore_case = TRUE; break;
+			case 't':
+				if (strlen(value) != 1) {
+					return FALSE;
+				}
+				op->separator = value[0];
+				break;
+			case 'k':
+				comma = strchr(value, ',');
+				if (!gs_textop_parse_uint(value, comma != NULL ? (gsize)(comma - value) : strlen(value), &op->key) || op->key == 0
+						|| (comma != NULL && (!gs_textop_parse_uint(comma + 1, strlen(comma + 1), &op->key_end) || op->key_end < op->key))) {
+					return FALSE;
+				}
+				break;
+			default: return FALSE;
+		}
+	}
+	return *arg == NULL;
+}
+
+// uniq [-cdui]
+static gboolean gs_textop_parse_uniq(GsTextOp *op, gchar **argv) {
+	gchar **arg = argv + 1;
+	const gchar *flag = NULL, *value = NULL;
+	gchar c;
+	while ((c = gs_textop_next_option(&arg, &flag, "", &value)) != '\0') {
+		switch (c) {
+			case 'c': op->count = TRUE; break;
+			case 'd': op->repeated = TRUE; break;
+			case 'u': op->single = TRUE; break;
+			case 'i': op->ignore_case = TRUE; break;
+			default: return FALSE;
+		}
+	}
+	return *arg == NULL;
+}
+
+// cut -f LIST [-d SEP] or cut -c/-b LIST. LIST like 1,3-5,-2,7-
+static gboolean gs_textop_parse_cut(GsTextOp *op, gchar **argv) {
+	gchar **arg = argv + 1;
+	const gchar *flag = NULL, *value = NULL, *list = NULL;
+	gchar c;
+	op->separator = '\t';
+	while ((c = gs_textop_next_option(&arg, &flag, "fcbd", &value)) != '\0') {
+		switch (c) {
+			case 'f': case 'c': case 'b':
+				if (list != NULL) {
+					return FALSE;
+				}
+				list = value;
+				op->fields = c == 'f';
+				break;
+			case 'd':
+				if (strlen(value) != 1) {
+					return FALSE;
+				}
+				op->separator = value[0];
+				break;
+			default: return FALSE;
+		}
+	}
+	if (list == NULL || *arg != NULL) {
+		return FALSE;
+	}
+
+	op->ranges = g_array_new(FALSE, FALSE, sizeof(guint));
+	gchar **items = g_strsplit(list, ",", -1);
+	gboolean ok = TRUE;
+	for (gchar **item = items; *item != NULL && ok; item++) {
+		const gchar *dash = strchr(*item, '-');
+		guint from = 1, to = G_MAXUINT;
+		if (dash == NULL) {
+			ok = gs_textop_parse_uint(*item, strlen(*item), &from);
+			to = from;
+		} else {
+			ok = dash != *item || dash[1] != '\0';
+			ok = ok && (dash == *item || gs_textop_parse_uint(*item, dash - *item, &from));
+			ok = ok && (dash[1] == '\0' || gs_textop_parse_uint(dash + 1, strlen(dash + 1), &to));
+		}
+		ok = ok && from > 0 && to >= from;
+		g_array_append_val(op->ranges, from);
+		g_array_append_val(op->ranges, to);
+	}
+	g_strfreev(items);
+	return ok;
+}
+
+// Whether c is in the tr class [:name:], -1 for an unknown class
+static gint gs_textop_tr_class(const gchar *name, gchar c) {
+	if (g_str_equal(name, "alnum"))  return g_ascii_isalnum(c);
+	if (g_str_equal(name, "alpha"))  return g_ascii_isalpha(c);
+	if (g_str_equal(name, "blank"))  return c == ' ' || c == '\t';
+	if (g_str_equal(name, "cntrl"))  return g_ascii_iscntrl(c);
+	if (g_str_equal(name, "digit"))  return g_ascii_isdigit(c);
+	if (g_str_equal(name, "graph"))  return g_ascii_isgraph(c);
+	if (g_str_equal(name, "lower"))  return g_ascii_islower(c);
+	if (g_str_equal(name, "print"))  return g_ascii_isprint(c);
+	if (g_str_equal(name, "punct"))  return g_ascii_ispunct(c);
+	if (g_str_equal(name, "space"))  return g_ascii_isspace(c);
+	if (g_str_equal(name, "upper"))  return g_ascii_isupper(c);
+	if (g_str_equal(name, "xdigit")) return g_ascii_isxdigit(c);
+	return -1;
+}
+
+// Next character of a tr set at *s, resolving \n, \t, \\, \NNN and the like
+static guchar gs_textop_tr_char(const gchar **s) {
+	const gchar *p = *s;
+	guchar c = *p++;
+	if (c == '\\' && *p >= '0' && *p <= '7') {
+		c = 0;
+		for (gint i = 0; i < 3 && *p >= '0' && *p <= '7'; i++) {
+			c = c * 8 + (*p++ - '0');
+		}
+	} else if (c == '\\' && *p != '\0') {
+		switch (*p++) {
+			case 'n': c = '\n'; break;
+			case 't': c = '\t'; break;
+			case 'r': c = '\r'; break;
+			case 'f': c = '\f'; break;
+			case 'v': c = '\v'; break;
+			case 'a': c = '\a'; break;
+			case 'b': c = '\b'; break;
+			default:  c = p[-1]; break;
+		}
+	}
+	*s = p;
+	return c;
+}
+
+// Expand a tr set into its bytes: characters, ranges like a-z and classes like [:upper:]
+static gboolean gs_textop_tr_set(const gchar *s, GByteArray *set) {
+	while (*s != '\0') {
+		if (s[0] == '[' && s[1] == ':') {
+			const gchar *close = strstr(s + 2, ":]");
+			gchar *name = close != NULL ? g_strndup(s + 2, close - s - 2) : NULL;
+			gboolean known = name != NULL && gs_textop_tr_class(name, 'a') >= 0;
+			for (guint c = 0; c < 256 && known; c++) {
+				if (gs_textop_tr_class(name, c)) {
+					g_byte_array_append(set, (guchar[]) { c }, 1);
+				}
+			}
+			g_free(name);
+			if (!known) {
+				return FALSE;
+			}
+			s = close + 2;
+		} else if (s[0] == '[') { // [=c=] and [c*n] are left to tr
+			return FALSE;
+		} else {
+			guint first = gs_textop_tr_char(&s), last = first;
+			if (s[0] == '-' && s[1] != '\0') {
+				s++;
+				last = gs_textop_tr_char(&s);
+			}
+			if (last < first) {
+				return FALSE;
+			}
+			for (guint c = first; c <= last; c++) {
+				g_byte_array_append(set, (guchar[]) { c }, 1);
+			}
+		}
+	}
+	return TRUE;
+}
+
+// tr SET1 SET2, tr -d SET1, tr -s SET1, tr -s SET1 SET2, tr -ds SET1 SET2
+static gboolean gs_textop_parse_tr(GsTextOp *op, gchar **argv) {
+	gchar **arg = argv + 1;
+	const gchar *flag = NULL, *value = NULL;
+	gchar c;
+	while ((c = gs_textop_next_option(&arg, &flag, "", &value)) != '\0') {
+		switch (c) {
+			case 'd': op->delete = TRUE; break;
+			case 's': op->squeeze = TRUE; break;
+			default: return FALSE;
+		}
+	}
+
+	GByteArray *set1 = g_byte_array_new(), *set2 = g_byte_array_new();
+	guint operands = g_strv_length(arg);
+	gboolean ok = op->delete ? operands == 1u + op->squeeze : (operands == 2 || (op->squeeze && operands == 1));
+	ok = ok && gs_textop_tr_set(arg[0], set1) && (operands == 1 || gs_textop_tr_set(arg[1], set2));
+	for (guint i = 0; i < 256; i++) {
+		op->map[i] = i;
+	}
+	for (guint i = 0; ok && i < set1->len; i++) {
+		if (op->delete) {
+			op->delete_set[set1->data[i]] = TRUE;
+		} else if (operands == 2) { // SET2 is extended with its last character
+			ok = set2->len > 0;
+			op->map[set1->data[i]] = ok ? set2->data[MIN(i, set2->len - 1)] : 0;
+		}
+	}
+	GByteArray *squeeze = operands == 2 ? set2 : set1;
+	for (guint i = 0; ok && op->squeeze && i < squeeze->len; i++) {
+		op->squeeze_set[squeeze->data[i]] = TRUE;
+	}
+	g_byte_array_free(set1, TRUE);
+	g_byte_array_free(set2, TRUE);
+	return ok;
+}
+
+// base64 [-d] [-i] [-w COLS], xxd -p [-r] [-c COLS], gunzip / zcat / gzip -d [-c -f -q], all on stdin
+static gboolean gs_textop_parse_transform(GsTextOp *op, gchar **argv) {
+	gchar **arg = argv + 1;
+	const gchar *flag = NULL, *value = NULL;
+	gboolean decode = FALSE, plain = FALSE, base64 = g_str_equal(argv[0], "base64"), xxd = g_str_equal(argv[0], "xxd");
+	guint columns = base64 ? 76 : 30;
+	const gchar *options = base64 ? "diw" : xxd ? "prc" : "dcfq";
+	gchar c;
+	while ((c = gs_textop_next_option(&arg, &flag, base64 ? "w" : xxd ? "c" : "", &value)) != '\0') {
+		if (strchr(options, c) == NULL) {
+			return FALSE;
+		} else if (c == 'd' || c == 'r') {
+			decode = TRUE;
+		} else if (c == 'i') {
+			op->ignore_garbage = TRUE;
+		} else if (c == 'p') {
+			plain = TRUE;
+		} else if ((c == 'w' || (c == 'c' && xxd)) && (!gs_textop_parse_uint(value, strlen(value), &columns) || (xxd && columns == 0))) {
+			return FALSE;
+		}
+	}
+	if (base64) {
+		op->transform = decode ? GS_TRANSFORM_BASE64_DECODE : GS_TRANSFORM_BASE64_ENCODE;
+		op->wrap = columns;
+	} else if (xxd) {
+		op->transform = decode ? GS_TRANSFORM_HEX_DECODE : GS_TRANSFORM_HEX_ENCODE;
+		op->wrap = 2 * columns;
+	} else {
+		op->transform = GS_TRANSFORM_INFLATE;
+		decode = decode || !g_str_equal(argv[0], "gzip");
+	}
+	return *arg == NULL && (base64 || xxd || decode) && (!xxd || plain) && (!op->ignore_garbage || decode);
+}
+
+// Parse command into text operators. Returns NULL unless every stage of the pipeline is one of them
+GPtrArray* gs_textops_parse(const gchar *command) {
+	gchar **stages = gs_textop_split(command);
+	if (stages == NULL) {
+		return NULL;
+	}
+
+	GPtrArray *ops = g_ptr_array_new_with_free_func((GDestroyNotify) gs_textop_free);
+	for (gchar **stage = stages; *stage != NULL && ops != NULL; stage++) {
+		gchar **argv = NULL;
+		GsTextOp *op = g_new0(GsTextOp, 1);
+		g_ptr_array_add(ops, op);
+		gboolean ok = g_shell_parse_argv(*stage, NULL, &argv, NULL);
+		if (!ok) {
+			// Empty stage or unbalanced quotes
+		} else if (g_str_equal(argv[0], "grep") || g_str_equal(argv[0], "egrep") || g_str_equal(argv[0], "fgrep")) {
+			op->type = GS_TEXTOP_GREP;
+			ok = gs_textop_parse_grep(op, argv);
+		} else if (g_str_equal(argv[0], "sort")) {
+			op->type = GS_TEXTOP_SORT;
+			ok = gs_textop_parse_sort(op, argv);
+		} else if (g_str_equal(argv[0], "uniq")) {
+			op->type = GS_TEXTOP_UNIQ;
+			ok = gs_textop_parse_uniq(op, argv);
+		} else if (g_str_equal(argv[0], "cut")) {
+			op->type = GS_TEXTOP_CUT;
+			ok = gs_textop_parse_cut(op, argv);
+		} else if (g_str_equal(argv[0], "tr")) {
+			op->type = GS_TEXTOP_TR;
+			ok = gs_textop_parse_tr(op, argv);
+		} else if (g_str_equal(argv[0], "base64") || g_str_equal(argv[0], "xxd") || g_str_equal(argv[0], "gunzip")
+			|| g_str_equal(argv[0], "zcat") || g_str_equal(argv[0], "gzip")) {
+			op->type = GS_TEXTOP_TRANSFORM;
+			ok = gs_textop_parse_transform(op, argv);
+		} else {
+			ok = FALSE;
+		}
+		g_strfreev(argv);
+		if (!ok) {
+			g_ptr_array_free(ops, TRUE);
+			ops = NULL;
+		}
+	}
+	g_strfreev(stages);
+	return ops;
+}
+
+// Append line and a line break
+static inline void gs_textop_append_line(GString *out, const gchar *line, gsize len) {
+	g_string_append_len(out, line, len);
+	g_string_append_c(out, '\n');
+}
+
+// Compare a[0..n) and b[0..n) ignoring ASCII case
+static gint gs_mem_casecmp(const gchar *a, const gchar *b, gsize n) {
+	for (gsize i = 0; i < n; i++) {
+		gint d = (guchar) g_ascii_tolower(a[i]) - (guchar) g_ascii_tolower(b[i]);
+		if (d != 0) {
+			return d;
+		}
+	}
+	return 0;
+}
+
+// First a or b in p[0..end), end if none. Uses SSE2 to test 16 bytes per step where available
+static inline const gchar* gs_mem_chr2(const gchar *p, const gchar *end, gchar a, gchar b) {
+#ifdef __SSE2__
+	const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+	for (; end - p >= 16; p += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*) p);
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)));
+		if (mask != 0) {
+			return p + __builtin_ctz(mask);
+		}
+	}
+#endif
+	while (p < end && *p != a && *p != b) {
+		p++;
+	}
+	return p;
+}
+
+// memmem ignoring ASCII case. Candidates are found by testing for both cases of the first byte at once,
+// so the cost doesn't depend on how rare either case is
+static const gchar* gs_mem_casemem(const gchar *text, gsize len, const gchar *needle, gsize needle_len) {
+	if (needle_len > len) {
+		return NULL;
+	}
+	const gchar *end = text + len, *last = end - needle_len;
+	gchar lower = g_ascii_tolower(needle[0]), upper = g_ascii_toupper(needle[0]);
+	for (const gchar *p = text; (p = gs_mem_chr2(p, last + 1, lower, upper)) <= last; p++) {
+		if (gs_mem_casecmp(p, needle, needle_len) == 0) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+// Copy the whole lines text[0..len) with a line break after each, unless only counting. Returns their number
+static guint gs_textop_grep_lines(const GsTextOp *op, const gchar *text, gsize len, GString *out) {
+	guint lines = 0;
+	if (len == 0) {
+		return 0;
+	}
+	for (const gchar *p = text; (p = memchr(p, '\n', text + len - p)) != NULL; p++) {
+		lines++;
+	}
+	if (!op->count) {
+		g_string_append_len(out, text, len);
+	}
+	if (text[len - 1] != '\n') {
+		lines++;
+		if (!op->count) {
+			g_string_append_c(out, '\n');
+		}
+	}
+	return lines;
+}
+
+// Literal patterns jump from hit to hit with memmem instead of looking at every line, lines in between
+// are skipped or, with -v, copied as one block
+static void gs_textop_grep(const GsTextOp *op, const gchar *text, gsize len, GString *out) {
+	const gchar *p = text, *end = text + len;
+	gsize pattern_len = strlen(op->pattern);
+	guint count = 0;
+	while (p < end) {
+		const gchar *line = p;
+		gboolean match = TRUE;
+		if (op->regex == NULL) {
+			const gchar *hit = pattern_len == 0 ? p : op->ignore_case ? gs_mem_casemem(p, end - p, op->pattern, pattern_len) : memmem(p, end - p, op->pattern, pattern_len);
+			const gchar *nl = hit != NULL ? memrchr(p, '\n', hit - p) : NULL;
+			line = hit == NULL ? end : nl != NULL ? nl + 1 : p;
+			if (op->invert) {
+				count += gs_textop_grep_lines(op, p, line - p, out);
+			}
+			if (hit == NULL) {
+				break;
+			}
+		}
+		const gchar *nl = memchr(line, '\n', end - line);
+		const gchar *line_end = nl != NULL ? nl : end;
+		if (op->regex != NULL) {
+			match = g_regex_match_full(op->regex, line, line_end - line, 0, 0, NULL, NULL);
+		}
+		if (match != op->invert) {
+			count++;
+			if (!op->count) {
+				gs_textop_append_line(out, line, line_end - line);
+			}
+		}
+		p = nl != NULL ? nl + 1 : end;
+	}
+	if (op->count) {
+		g_string_append_printf(out, "%u\n", count);
+	}
+}
+
+typedef struct {
+	const gchar *line, *key;   // Without line break
+	gsize        len, key_len;
+	guint64      prefix;       // First 8 key bytes big-endian (lowercase for sort -f), decides most comparisons
+	gdouble      number;       // sort -n
+} GsSortLine;
+
+// Start of field (1-based) in p[0..end). Without separator a field is a run of blanks and the non-blanks behind it
+static const gchar* gs_sort_field(const gchar *p, const gchar *end, guint field, gchar separator) {
+	for (guint i = 1; i < field && p < end; i++) {
+		if (separator != 0) {
+			const gchar *sep = memchr(p, separator, end - p);
+			p = sep != NULL ? sep + 1 : end;
+		} else {
+			for (; p < end && (*p == ' ' || *p == '\t'); p++);
+			for (; p < end && *p != ' ' && *p != '\t'; p++);
+		}
+	}
+	return p;
+}
+
+// End of the field starting at p
+static const gchar* gs_sort_field_end(const gchar *p, const gchar *end, gchar separator) {
+	if (separator != 0) {
+		const gchar *sep = memchr(p, separator, end - p);
+		return sep != NULL ? sep : end;
+	}
+	for (; p < end && (*p == ' ' || *p == '\t'); p++);
+	for (; p < end && *p != ' ' && *p != '\t'; p++);
+	return p;
+}
+
+// Leading number of p[0..len) like sort -n reads it: blanks, optional minus, digits, fraction. 0 if none
+static gdouble gs_sort_number(const gchar *p, gsize len) {
+	const gchar *end = p + len;
+	gdouble value = 0, scale = 1;
+	for (; p < end && (*p == ' ' || *p == '\t'); p++);
+	gboolean negative = p < end && *p == '-';
+	for (p += negative; p < end && g_ascii_isdigit(*p); p++) {
+		value = value * 10 + (*p - '0');
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && g_ascii_isdigit(*p); p++) {
+			value += (*p - '0') * (scale /= 10);
+		}
+	}
+	return negative ? -value : value;
+}
+
+static gint gs_sort_compare_text(const gchar *a, gsize a_len, const gchar *b, gsize b_len, gboolean ignore_case) {
+	gsize n = MIN(a_len, b_len);
+	gint r = ignore_case ? gs_mem_casecmp(a, b, n) : memcmp(a, b, n);
+	return r != 0 ? r : (a_len > b_len) - (a_len < b_len);
+}
+
+// Compare keys, lines with equal keys by their whole text like sort does (except with -u)
+static gint gs_sort_compare(const GsSortLine *a, const GsSortLine *b, const GsTextOp *op) {
+	gint r;
+	if (op->numeric) {
+		r = (a->number > b->number) - (a->number < b->number);
+	} else if (a->prefix != b->prefix) {
+		r = a->prefix > b->prefix ? 1 : -1;
+	} else {
+		r = gs_sort_compare_text(a->key, a->key_len, b->key, b->key_len, op->ignore_case);
+	}
+	if (r == 0 && !op->unique) {
+		r = gs_sort_compare_text(a->line, a->len, b->line, b->len, FALSE);
+	}
+	return op->reverse ? -r : r;
+}
+
+// Merge sorted src[lo..mid) and src[mid..hi) into dst[lo..hi), stable
+static void gs_sort_merge(const GsSortLine *src, GsSortLine *dst, gsize lo, gsize mid, gsize hi, const GsTextOp *op) {
+	gsize i = lo, j = mid, k = lo;
+	while (i < mid && j < hi) {
+		dst[k++] = gs_sort_compare(&src[j], &src[i], op) < 0 ? src[j++] : src[i++];
+	}
+	memcpy(dst + k, src + i, (mid - i) * sizeof(GsSortLine));
+	memcpy(dst + k + (mid - i), src + j, (hi - j) * sizeof(GsSortLine));
+}
+
+typedef struct {
+	GsSortLine     *lines, *tmp;   // Sort task: lines[lo..hi) with tmp as scratch space. Merge task: source, destination
+	gsize           lo, mid, hi;
+	const GsTextOp *op;
+} GsSortTask;
+
+// Merge sort of lines[lo..hi): insertion sort of runs of 16, then merge passes between lines and tmp
+static void gs_sort_task_sort(gpointer data, gpointer user_data) {
+	GsSortTask *task = data;
+	GsSortLine *src = task->lines, *dst = task->tmp, *swap;
+	for (gsize run = task->lo; run < task->hi; run += 16) {
+		for (gsize i = run + 1; i < MIN(run + 16, task->hi); i++) {
+			GsSortLine line = src[i];
+			gsize j = i;
+			for (; j > run && gs_sort_compare(&line, &src[j - 1], task->op) < 0; j--) {
+				src[j] = src[j - 1];
+			}
+			src[j] = line;
+		}
+	}
+	for (gsize width = 16; width < task->hi - task->lo; width *= 2) {
+		for (gsize lo = task->lo; lo < task->hi; lo += 2 * width) {
+			gs_sort_merge(src, dst, lo, MIN(lo + width, task->hi), MIN(lo + 2 * width, task->hi), task->op);
+		}
+		swap = src, src = dst, dst = swap;
+	}
+	if (src != task->lines) {
+		memcpy(task->lines + task->lo, src + task->lo, (task->hi - task->lo) * sizeof(GsSortLine));
+	}
+}
+
+static void gs_sort_task_merge(gpointer data, gpointer user_data) {
+	GsSortTask *task = data;
+	gs_sort_merge(task->lines, task->tmp, task->lo, task->mid, task->hi, task->op);
+}
+
+// Stable sort on all cores: chunks of GS_TEXTOP_SORT_CHUNK lines are sorted in parallel, then merged
+// pairwise, every merge pass in parallel as well
+static void gs_sort_lines(GsSortLine *lines, gsize n, const GsTextOp *op) {
+	GsSortLine *tmp = g_new(GsSortLine, MAX(n, 1)), *src = lines, *dst = tmp, *swap;
+	GsSortTask *tasks = g_new(GsSortTask, n / GS_TEXTOP_SORT_CHUNK + 1);
+	guint ntasks = 0;
+	GThreadPool *pool = g_thread_pool_new(gs_sort_task_sort, NULL, g_get_num_processors(), FALSE, NULL);
+	for (gsize lo = 0; lo < n; lo += GS_TEXTOP_SORT_CHUNK, ntasks++) {
+		tasks[ntasks] = (GsSortTask) { lines, tmp, lo, 0, MIN(lo + GS_TEXTOP_SORT_CHUNK, n), op };
+		g_thread_pool_push(pool, &tasks[ntasks], NULL);
+	}
+	g_thread_pool_free(pool, FALSE, TRUE);
+
+	for (gsize width = GS_TEXTOP_SORT_CHUNK; width < n; width *= 2) {
+		pool = g_thread_pool_new(gs_sort_task_merge, NULL, g_get_num_processors(), FALSE, NULL);
+		ntasks = 0;
+		for (gsize lo = 0; lo < n; lo += 2 * width, ntasks++) {
+			tasks[ntasks] = (GsSortTask) { src, dst, lo, MIN(lo + width, n), MIN(lo + 2 * width, n), op };
+			g_thread_pool_push(pool, &tasks[ntasks], NULL);
+		}
+		g_thread_pool_free(pool, FALSE, TRUE);
+		swap = src, src = dst, dst = swap;
+	}
+	if (src != lines) {
+		memcpy(lines, src, n * sizeof(GsSortLine));
+	}
+	g_free(tasks);
+	g_free(tmp);
+}
+
+static void gs_textop_sort(const GsTextOp *op, const gchar *text, gsize len, GString *out) {
+	GArray *lines = g_array_new(FALSE, FALSE, sizeof(GsSortLine));
+	for (const gchar *p = text, *end = text + len, *nl; p < end; p = nl != NULL ? nl + 1 : end) {
+		nl = memchr(p, '\n', end - p);
+		GsSortLine line = { p, p, nl != NULL ? (gsize)(nl - p) : (gsize)(end - p), 0, 0, 0 };
+		const gchar *line_end = line.line + line.len;
+		if (op->key > 0) {
+			line.key = gs_sort_field(line.line, line_end, op->key, op->separator);
+			const gchar *key_end = op->key_end > 0 ? gs_sort_field_end(gs_sort_field(line.key, line_end, op->key_end - op->key + 1, op->separator), line_end, op->separator) : line_end;
+			line.key_len = key_end - line.key;
+		} else {
+			line.key_len = line.len;
+		}
+		for (gsize i = 0; i < 8; i++) {
+			guchar c = i < line.key_len ? line.key[i] : 0;
+			line.prefix = line.prefix << 8 | (op->ignore_case ? (guchar) g_ascii_tolower(c) : c);
+		}
+		line.number = op->numeric ? gs_sort_number(line.key, line.key_len) : 0;
+		g_array_append_val(lines, line);
+	}
+
+	GsSortLine *sorted = (GsSortLine*) lines->data;
+	gs_sort_lines(sorted, lines->len, op);
+	for (guint i = 0; i < lines->len; i++) {
+		if (!op->unique || i == 0 || gs_sort_compare(&sorted[i - 1], &sorted[i], op) != 0) {
+			gs_textop_append_line(out, sorted[i].line, sorted[i].len);
+		}
+	}
+	g_array_free(lines, TRUE);
+}
+
+static void gs_textop_uniq_group(const GsTextOp *op, const gchar *line, gsize len, guint count, GString *out) {
+	if (line == NULL || (op->repeated && count < 2) || (op->single && count > 1)) {
+		return;
+	}
+	if (op->count) {
+		g_string_append_printf(out, "%7u ", count);
+	}
+	gs_textop_append_line(out, line, len);
+}
+
+static void gs_textop_uniq(const GsTextOp *op, const gchar *text, gsize len, GString *out) {
+	const gchar *group = NULL;
+	gsize group_len = 0;
+	guint count = 0;
+	for (const gchar *p = text, *end = text + len, *nl; p < end; p = nl != NULL ? nl + 1 : end) {
+		nl = memchr(p, '\n', end - p);
+		gsize line_len = nl != NULL ? (gsize)(nl - p) : (gsize)(end - p);
+		if (group != NULL && gs_sort_compare_text(group, group_len, p, line_len, op->ignore_case) == 0) {
+			count++;
+			continue;
+		}
+		gs_textop_uniq_group(op, group, group_len, count, out);
+		group = p;
+		group_len = line_len;
+		count = 1;
+	}
+	gs_textop_uniq_group(op, group, group_len, count, out);
+}
+
+static gboolean gs_textop_cut_selected(const GsTextOp *op, guint index) {
+	const guint *ranges = (const guint*) op->ranges->data;
+	for (guint i = 0; i < op->ranges->len; i += 2) {
+		if (index >= ranges[i] && index <= ranges[i + 1]) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+// Selected fields are joined by the separator, lines without it are kept whole like cut does without -s
+static void gs_textop_cut(const GsTextOp *op, const gchar *text, gsize len, GString *out) {
+	for (const gchar *p = text, *end = text + len, *nl; p < end; p = nl != NULL ? nl + 1 : end) {
+		nl = memchr(p, '\n', end - p);
+		const gchar *line_end = nl != NULL ? nl : end;
+		if (!op->fields) {
+			for (guint i = 1; p < line_end; p++, i++) {
+				if (gs_textop_cut_selected(op, i)) {
+					g_string_append_c(out, *p);
+				}
+			}
+		} else if (memchr(p, op->separator, line_end - p) == NULL) {
+			g_string_append_len(out, p, line_end - p);
+		} else {
+			gboolean first = TRUE;
+			for (guint i = 1; p <= line_end; i++) {
+				const gchar *sep = memchr(p, op->separator, line_end - p);
+				const gchar *field_end = sep != NULL ? sep : line_end;
+				if (gs_textop_cut_selected(op, i)) {
+					if (!first) {
+						g_string_append_c(out, op->separator);
+					}
+					g_string_append_len(out, p, field_end - p);
+					first = FALSE;
+				}
+				p = field_end + 1;
+			}
+		}
+		g_string_append_c(out, '\n');
+	}
+}
+
+// Bytewise like tr: delete, translate, then squeeze repeats
+static void gs_textop_tr(const GsTextOp *op, const gchar *text, gsize len, GString *out) {
+	gsize start = out->len;
+	g_string_set_size(out, start + len);
+	guchar *w = (guchar*) out->str + start;
+	gint last = -1;
+	for (const guchar *p = (const guchar*) text, *end = p + len; p < end; p++) {
+		if (op->delete_set[*p]) {
+			continue;
+		}
+		guchar c = op->map[*p];
+		if (op->squeeze_set[c] && c == last) {
+			continue;
+		}
+		*w++ = c;
+		last = c;
+	}
+	g_string_truncate(out, w - (guchar*) out->str);
+}
+
+// Run the operators one after another on text[0..len), returns the output of the last one.
+// Returns NULL and sets *error (prefixed with the command name) if a decoder gets invalid input
+GString* gs_textops_run(const GPtrArray *ops, const gchar *text, gsize len, gchar **error) {
+	GString *out = NULL;
+	gboolean ok = TRUE;
+	for (guint i = 0; i < ops->len && ok; i++) {
+		const GsTextOp *op = ops->pdata[i];
+		GString *in = out;
+		out = g_string_sized_new(len + 1);
+		switch (op->type) {
+			case GS_TEXTOP_GREP: gs_textop_grep(op, text, len, out); break;
+			case GS_TEXTOP_SORT: gs_textop_sort(op, text, len, out); break;
+			case GS_TEXTOP_UNIQ: gs_textop_uniq(op, text, len, out); break;
+			case GS_TEXTOP_CUT:  gs_textop_cut(op, text, len, out); break;
+			case GS_TEXTOP_TR:   gs_textop_tr(op, text, len, out); break;
+			case GS_TEXTOP_TRANSFORM:
+				ok = op->ignore_garbage ? gs_base64_decode(text, len, TRUE, out, error) : gs_transform(op->transform, text, len, op->wrap, out, error);
+				if (!ok) {
+					const gchar *name = op->transform <= GS_TRANSFORM_BASE64_DECODE ? "base64" : op->transform == GS_TRANSFORM_INFLATE ? "gunzip" : "xxd";
+					gchar *message = g_strdup_printf("%s: %s", name, *error);
+					g_free(*error);
+					*error = message;
+				}
+				break;
+		}
+		if (in != NULL) {
+			g_string_free(in, TRUE);
+		}
+		text = out->str;
+		len = out->len;
+	}
+	if (!ok) {
+		g_string_free(out, TRUE);
+		out = NULL;
+	}
+	return out;
+}
+
+//######################################################################################################
+// Search engine
+//
+// Searches snapshots of many texts at once. Every text is cut into chunks of whole lines, which are
+// searched on a GThreadPool. A literal prefilter (memmem, or the literal every regex match must
+// contain) jumps to candidate lines, the regex only confirms those. Matches are pushed to a
+// GAsyncQueue as they are found, so results can be shown while the search is still running.
+
+#define GS_SEARCH_CHUNK_SIZE (4 * 1024 * 1024)
+#define GS_SEARCH_LINE_MAX   300   // Bytes of a matching line kept for display
+
+typedef struct {
+	struct GsSearch *search;
+	guint            text;
+	gsize            start, end;
+} GsSearchChunk;
+
+// Skip a bracket expression starting at p ([), a ] right after [ or [^ belongs to it
+static const gchar* gs_regex_skip_class(const gchar *p) {
+	p += 1 + (p[1] == '^');
+	p += *p == ']';
+	for (; *p != '\0' && *p != ']'; p++) {
+		p += *p == '\\' && p[1] != '\0';
+	}
+	return p + (*p == ']');
+}
+
+// Skip an escape starting at p (\) whose next character is alphanumeric, including its argument:
+// \xHH, \x{..}, \o{..}, octal and back reference digits, \cX, \k<..>, \g{..}, \gN, \p{..}, \pL
+static const gchar* gs_regex_skip_escape(const gchar *p) {
+	gchar kind = p[1];
+	p += 2;
+	if (g_ascii_isdigit(kind)) {
+		while (g_ascii_isdigit(*p)) {
+			p++;
+		}
+	} else if (kind == 'x' && *p != '{') {
+		for (gint i = 0; i < 2 && g_ascii_isxdigit(*p); i++) {
+			p++;
+		}
+	} else if (kind == 'c') {
+		p += *p != '\0';
+	} else if (kind == 'g' && (*p == '-' || *p == '+' || g_ascii_isdigit(*p))) {
+		for (p++; g_ascii_isdigit(*p); p++);
+	} else if (strchr("xopPkg", kind) != NULL && *p != '\0' && strchr("{<'", *p) != NULL) {
+		const gchar *close = strchr(p, *p == '{' ? '}' : *p == '<' ? '>' : '\'');
+		p = close != NULL ? close + 1 : p + strlen(p);
+	} else if (kind == 'p' || kind == 'P') {
+		p += *p != '\0';
+	}
+	return p;
+}
+
+// Longest literal every match of the regex contains, used as prefilter. Empty if there is none for sure.
+// Conservative: alternations and inline options disable it, anything optional or repeated ends a literal
+static gchar* gs_regex_required_literal(const gchar *pattern) {
+	GString *run = g_string_new(NULL), *best = g_string_new(NULL);
+	if (strchr(pattern, '|') != NULL || strstr(pattern, "(?") != NULL) {
+		g_string_free(run, TRUE);
+		return g_string_free(best, FALSE);
+	}
+	for (const gchar *p = pattern; *p != '\0'; ) {
+		gboolean literal = FALSE;
+		gchar c = *p;
+		if (c == '\\' && p[1] != '\0' && !g_ascii_isalnum(p[1])) { // Escaped punctuation
+			c = p[1];
+			literal = TRUE;
+			p += 2;
+		} else if (c == '\\') { // Class, anchor, back reference or character code, never part of the literal
+			p = p[1] != '\0' ? gs_regex_skip_escape(p) : p + 1;
+		} else if (c == '[') {
+			p = gs_regex_skip_class(p);
+		} else if (c == '(') { // Skip group
+			gint depth = 0;
+			do {
+				if (*p == '[') {
+					p = gs_regex_skip_class(p);
+					continue;
+				}
+				depth += (*p == '(') - (*p == ')');
+				p += *p == '\\' && p[1] != '\0';
+				p++;
+			} while (*p != '\0' && depth > 0);
+		} else if (c == '{') { // Skip counted repetition
+			const gchar *close = strchr(p, '}');
+			p = close != NULL ? close + 1 : p + strlen(p);
+		} else {
+			literal = strchr(".^$?*+)", c) == NULL;
+			p++;
+		}
+
+		// A quantifier makes the atom optional (?, *, {0,..}) or ends the literal after it (+)
+		gboolean optional = *p == '?' || *p == '*' || *p == '{';
+		if (literal && !optional) {
+			g_string_append_c(run, c);
+		}
+		if (!literal || optional || *p == '+') {
+			if (run->len > best->len) {
+				g_string_assign(best, run->str);
+			}
+			g_string_truncate(run, 0);
+		}
+	}
+	if (run->len > best->len) {
+		g_string_assign(best, run->str);
+	}
+	g_string_free(run, TRUE);
+	return g_string_free(best, FALSE);
+}
+
+static void gs_search_chunk(gpointer data, gpointer user_data) {
+	GsSearchChunk *chunk = data;
+	GsSearch *search = chunk->search;
+	gsize text_len;
+	const gchar *text = g_bytes_get_data(g_ptr_array_index(search->texts, chunk->text), &text_len);
+	const gchar *p = text + chunk->start, *end = text + chunk->end;
+	gsize literal_len = strlen(search->literal);
+
+	while (p < end && !g_atomic_int_get(&search->cancelled)) {
+		// Jump to the next line containing the literal
+		const gchar *hit = literal_len == 0 ? p : search->ignore_case ? gs_mem_casemem(p, end - p, search->literal, literal_len) : memmem(p, end - p, search->literal, literal_len);
+		if (hit == NULL) {
+			break;
+		}
+		const gchar *nl = memrchr(p, '\n', hit - p);
+		const gchar *line = nl != NULL ? nl + 1 : p;
+		nl = memchr(hit, '\n', end - hit);
+		const gchar *line_end = nl != NULL ? nl : end;
+
+		if (search->regex == NULL || g_regex_match_full(search->regex, line, line_end - line, 0, 0, NULL, NULL)) {
+			gsize len = MIN((gsize)(line_end - line), GS_SEARCH_LINE_MAX);
+			while (len < (gsize)(line_end - line) && len > 0 && ((guchar) line[len] & 0xC0) == 0x80) { // Don't cut UTF-8 sequences
+				len--;
+			}
+			GsSearchMatch *match = g_new(GsSearchMatch, 1);
+			match->text = chunk->text;
+			match->pos = line - text;
+			match->line = g_strndup(line, len);
+			g_atomic_int_inc(&search->count);
+			g_async_queue_push(search->matches, match);
+		}
+		p = nl != NULL ? nl + 1 : end;
+	}
+
+	GsSearchMatch *done = g_new0(GsSearchMatch, 1);
+	g_async_queue_push(search->matches, done);
+}
+
+// Prepare a search for pattern, a literal or (regex) a GRegex pattern. Returns NULL and sets error for an invalid regex
+GsSearch* gs_search_new(const gchar *pattern, gboolean regex, gboolean ignore_case, GError **error) {
+	gboolean ascii = TRUE;
+	for (const gchar *p = pattern; *p != '\0'; p++) {
+		ascii &= (guchar) *p < 0x80;
+	}
+
+	GsSearch *search = g_new0(GsSearch, 1);
+	search->ignore_case = ignore_case;
+	search->literal = regex ? gs_regex_required_literal(pattern) : g_strdup(pattern);
+	if (regex || (ignore_case && !ascii)) { // Literal case folding is ASCII only
+		gchar *escaped = regex ? NULL : g_regex_escape_string(pattern, -1);
+		search->regex = g_regex_new(regex ? pattern : escaped, G_REGEX_OPTIMIZE | (ignore_case ? G_REGEX_CASELESS : 0), 0, error);
+		g_free(escaped);
+		if (search->regex == NULL) {
+			g_free(search->literal);
+			g_free(search);
+			return NULL;
+		}
+	}
+	for (const gchar *p = search->literal; ignore_case && *p != '\0'; p++) {
+		if ((guchar) *p >= 0x80) {
+			search->literal[0] = '\0';
+		}
+	}
+	search->texts = g_ptr_array_new_with_free_func((GDestroyNotify) g_bytes_unref);
+	search->chunks = g_array_new(FALSE, FALSE, sizeof(GsSearchChunk));
+	search->matches = g_async_queue_new();
+	return search;
+}
+
+// Add a text to search, takes ownership. Returns its index for GsSearchMatch.text
+guint gs_search_add_text(GsSearch *search, GBytes *text) {
+	g_ptr_array_add(search->texts, text);
+	return search->texts->len - 1;
+}
+
+// Cut the texts into chunks of whole lines and search them in background
+void gs_search_start(GsSearch *search) {
+	for (guint i = 0; i < search->texts->len; i++) {
+		gsize len;
+		const gchar *text = g_bytes_get_data(g_ptr_array_index(search->texts, i), &len);
+		for (gsize start = 0; start < len; ) {
+			const gchar *nl = start + GS_SEARCH_CHUNK_SIZE < len ? memchr(text + start + GS_SEARCH_CHUNK_SIZE, '\n', len - start - GS_SEARCH_CHUNK_SIZE) : NULL;
+			GsSearchChunk chunk = { search, i, start, nl != NULL ? (gsize)(nl - text) + 1 : len };
+			g_array_append_val(search->chunks, chunk);
+			start = chunk.end;
+		}
+	}
+
+	search->time_start = g_get_monotonic_time();
+	search->pool = g_thread_pool_new(gs_search_chunk, NULL, g_get_num_processors(), FALSE, NULL);
+	for (guint i = 0; i < search->chunks->len; i++) {
+		g_thread_pool_push(search->pool, &g_array_index(search->chunks, GsSearchChunk, i), NULL);
+	}
+}
+
+// Next match found, NULL if there is none yet. Check gs_search_done() after NULL
+GsSearchMatch* gs_search_next(GsSearch *search) {
+	GsSearchMatch *match;
+	while ((match = g_async_queue_try_pop(search->matches)) != NULL) {
+		if (match->line != NULL) {
+			return match;
+		}
+		search->chunks_done++;
+		g_free(match);
+	}
+	return NULL;
+}
+
+gboolean gs_search_done(GsSearch *search) {
+	return search->chunks_done == search->chunks->len;
+}
+
+void gs_search_match_free(GsSearchMatch *match) {
+	g_free(match->line);
+	g_free(match);
+}
+
+// Stop searching, chunks in progress finish early
+void gs_search_cancel(GsSearch *search) {
+	g_atomic_int_set(&search->cancelled, TRUE);
+}
+
+void gs_search_free(GsSearch *search) {
+	GsSearchMatch *match;
+	gs_search_cancel(search);
+	if (search->pool != NULL) {
+		g_thread_pool_free(search->pool, TRUE, TRUE);
+	}
+	while ((match = g_async_queue_try_pop(search->matches)) != NULL) {
+		gs_search_match_free(match);
+	}
+	g_async_queue_unref(search->matches);
+	g_array_free(search->chunks, TRUE);
+	g_ptr_array_free(search->texts, TRUE);
+	if (search->regex != NULL) {
+		g_regex_unref(search->regex);
+	}
+	g_free(search->literal);
+	g_free(search);
+}
+
+//######################################################################################################
+// Path index
+//
+// In-memory index of file paths for quick open. Paths live in a GStringChunk and every entry keeps a
+// 64 bit mask of the characters in its path, so a query rejects most entries with a single AND before
+// the fuzzy matcher looks at the text. Directories are kept in their own table: a query matches every
+// directory once, the files continue from there. Removed entries stay as tombstones until the index is
+// rebuilt. A trigram index doesn't help here: fuzzy queries are subsequences, not substrings of the path.
+
+#define GS_PATH_NO_MATCH G_MININT
+
+static inline guint64 gs_path_char_bit(guchar c) {
+	c = g_ascii_tolower(c);
+	if (c >= 'a' && c <= 'z') {
+		return 1ULL << (c - 'a');
+	} else if (c >= '0' && c <= '9') {
+		return 1ULL << (26 + c - '0');
+	}
+	return 1ULL << (36 + c % 28);
+}
+
+GsPathIndex* gs_path_index_new() {
+	GsPathIndex *index = g_new0(GsPathIndex, 1);
+	index->strings = g_string_chunk_new(1024 * 1024);
+	index->entries = g_array_new(FALSE, FALSE, sizeof(GsPathEntry));
+	index->lookup = g_hash_table_new(g_str_hash, g_str_equal);
+	index->dirs = g_ptr_array_new();
+	index->dir_lookup = g_hash_table_new(g_str_hash, g_str_equal);
+	return index;
+}
+
+void gs_path_index_free(GsPathIndex *index) {
+	g_hash_table_destroy(index->dir_lookup);
+	g_ptr_array_free(index->dirs, TRUE);
+	g_hash_table_destroy(index->lookup);
+	g_array_free(index->entries, TRUE);
+	g_string_chunk_free(index->strings);
+	g_free(index);
+}
+
+// Add path, a known path gets the flags added
+void gs_path_index_add(GsPathIndex *index, const gchar *path, guint flags) {
+	guint pos = GPOINTER_TO_UINT(g_hash_table_lookup(index->lookup, path));
+	if (pos != 0) {
+		g_array_index(index->entries, GsPathEntry, pos - 1).flags |= flags;
+		return;
+	}
+	const gchar *slash = strrchr(path, G_DIR_SEPARATOR);
+	GsPathEntry entry = { g_string_chunk_insert(index->strings, path), 0, 0, strlen(path), slash != NULL ? (guint32)(slash - path) + 1 : 0, 0, flags };
+	for (const gchar *p = path; *p != '\0'; p++) {
+		entry.mask |= gs_path_char_bit(*p);
+		entry.base_mask |= p - path >= entry.base ? gs_path_char_bit(*p) : 0;
+	}
+
+	gchar *dirpath = g_strndup(path, entry.base);
+	entry.dir = GPOINTER_TO_UINT(g_hash_table_lookup(index->dir_lookup, dirpath));
+	if (entry.dir == 0) {
+		g_ptr_array_add(index->dirs, g_string_chunk_insert(index->strings, dirpath));
+		entry.dir = index->dirs->len;
+		g_hash_table_insert(index->dir_lookup, g_ptr_array_index(index->dirs, entry.dir - 1), GUINT_TO_POINTER(entry.dir));
+	}
+	entry.dir--;
+	g_free(dirpath);
+
+	g_array_append_val(index->entries, entry);
+	g_hash_table_insert(index->lookup, (gpointer) entry.path, GUINT_TO_POINTER(index->entries->len));
+}
+
+void gs_path_index_remove(GsPathIndex *index, const gchar *path) {
+	guint pos = GPOINTER_TO_UINT(g_hash_table_lookup(index->lookup, path));
+	if (pos != 0) {
+		GsPathEntry *entry = &g_array_index(index->entries, GsPathEntry, pos - 1);
+		g_hash_table_remove(index->lookup, path);
+		entry->path = NULL;
+		entry->mask = 0;
+		entry->base_mask = 0;
+		entry->flags = 0;
+	}
+}
+
+// Continue matching query (lowercase) as subsequence of text from text[*i] and query[*q] on, with the
+// score so far. Every matched character scores, more if it continues a run or starts a word (after
+// / _ - . or space, or a camelCase hump): 14 at most, the first one 9. Stops at the end of the text
+// with *q < query_len, or returns -1 once the score can't beat min anymore
+static gint gs_path_match_next(const gchar *text, gsize len, gsize *i, const gchar *query, gsize query_len, gsize *q, gint score, gint min) {
+	for (; *q < query_len; (*q)++, (*i)++) {
+		if (score + 14 * (gint)(query_len - *q) <= min) {
+			return -1;
+		}
+		for (; *i < len && g_ascii_tolower(text[*i]) != query[*q]; (*i)++);
+		if (*i == len) {
+			return score;
+		}
+		score += 1;
+		score += *q > 0 && *i > 0 && g_ascii_tolower(text[*i - 1]) == query[*q - 1] ? 5 : 0;
+		score += *i == 0 || strchr("/_-. ", text[*i - 1]) != NULL || (g_ascii_isupper(text[*i]) && g_ascii_islower(text[*i - 1])) ? 8 : 0;
+	}
+	return score;
+}
+
+// Score of query as subsequence of text[i..len), -1 if it isn't one or the score can't beat min
+static inline gint gs_path_match(const gchar *text, gsize len, gsize i, const gchar *query, gsize query_len, gsize q, gint score, gint min) {
+	score = gs_path_match_next(text, len, &i, query, query_len, &q, score, min);
+	return q == query_len ? score : -1;
+}
+
+// Progress of a query through a directory, files go on from there. Matched on first use
+typedef struct {
+	gboolean done;
+	gint     score;
+	guint    q;          // Query characters matched
+	guint64  rest_mask;  // gs_path_char_bit() of the query characters left for the basename
+} GsPathDirMatch;
+
+// Score of a path for query (may be negative), GS_PATH_NO_MATCH for no match or if it can't beat min. Matches inside the basename beat
+// matches spread over the directories, favourites and recent files get a bonus, long paths a small penalty.
+// The best possible score rules out most paths before reading them
+static gint gs_path_score(const GsPathEntry *entry, GsPathDirMatch *dir, const gchar *query, gsize query_len, guint64 mask, gint min) {
+	gint bonus = ((entry->flags & GS_PATH_FAVOURITE) ? 30 : 0) + ((entry->flags & GS_PATH_RECENT) ? 20 : 0) - (gint)(entry->len / 16);
+	gint max = query_len > 0 ? 14 * (gint) query_len - 5 + bonus : bonus;
+	gint score = -1;
+	if ((entry->base_mask & mask) == mask && max + 100 > min) {
+		score = gs_path_match(entry->path + entry->base, entry->len - entry->base, 0, query, query_len, 0, 0, min - bonus - 100);
+		score = score >= 0 ? score + 100 : -1;
+	}
+	if (score < 0 && max > min && !dir->done) {
+		gsize pos = 0, q = 0;
+		dir->score = gs_path_match_next(entry->path, entry->base, &pos, query, query_len, &q, 0, G_MININT / 2);
+		dir->q = q;
+		dir->done = TRUE;
+		for (; q < query_len; q++) {
+			dir->rest_mask |= gs_path_char_bit(query[q]);
+		}
+	}
+	if (score < 0 && max > min && dir->score >= 0 && (entry->base_mask & dir->rest_mask) == dir->rest_mask) {
+		score = gs_path_match(entry->path, entry->len, entry->base, query, query_len, dir->q, dir->score, min - bonus);
+	}
+	return score >= 0 && score + bonus > min ? score + bonus : GS_PATH_NO_MATCH;
+}
+
+// Best matches for query (spaces are ignored) into results, best first. An empty query matches the
+// favourites and recent files. Returns their number, GS_PATH_RESULTS_MAX at most
+guint gs_path_index_query(const GsPathIndex *index, const gchar *query, const GsPathEntry **results) {
+	gint scores[GS_PATH_RESULTS_MAX];
+	guint count = 0;
+	gchar *needle = g_ascii_strdown(query, -1);
+	gsize needle_len = 0;
+	guint64 mask = 0;
+	for (const gchar *p = needle; *p != '\0'; p++) {
+		if (*p != ' ') {
+			needle[needle_len++] = *p;
+			mask |= gs_path_char_bit(*p);
+		}
+	}
+
+	GsPathDirMatch *dirs = g_new0(GsPathDirMatch, index->dirs->len);
+	const GsPathEntry *entries = (const GsPathEntry*) index->entries->data;
+	for (guint i = 0; i < index->entries->len; i++) {
+		if ((entries[i].mask & mask) != mask || (needle_len == 0 && entries[i].flags == 0)) { // Removed entries have no mask and no flags
+			continue;
+		}
+		gint min = count == GS_PATH_RESULTS_MAX ? scores[count - 1] : G_MININT / 2; // Halved: bounds subtract from it
+		gint score = gs_path_score(&entries[i], &dirs[entries[i].dir], needle, needle_len, mask, min);
+		if (score == GS_PATH_NO_MATCH) {
+			continue;
+		}
+		guint pos = MIN(count, GS_PATH_RESULTS_MAX - 1);
+		for (; pos > 0 && scores[pos - 1] < score; pos--) { // Insert sorted, equal scores keep index order
+			scores[pos] = scores[pos - 1];
+			results[pos] = results[pos - 1];
+		}
+		scores[pos] = score;
+		results[pos] = &entries[i];
+		count = MIN(count + 1, GS_PATH_RESULTS_MAX);
+	}
+	g_free(dirs);
+	g_free(needle);
+	return count;
+}
+
+// Walk root recursively and add every regular file, hidden files and directories are skipped, symlinks
+// are not followed. Directories visited are appended to dirs. Stops at max_files entries or when cancelled
+static void gs_path_index_scan(GsPathIndex *index, const gchar *root, GPtrArray *dirs, guint max_files, const gint *cancelled) {
+	GPtrArray *stack = g_ptr_array_new();
+	g_ptr_array_add(stack, g_strdup(root));
+	while (stack->len > 0) {
+		gchar *dir = g_ptr_array_remove_index(stack, stack->len - 1);
+		DIR *handle = index->entries->len < max_files && !g_atomic_int_get(cancelled) ? opendir(dir) : NULL;
+		struct dirent *item;
+		while (handle != NULL && (item = readdir(handle)) != NULL && index->entries->len < max_files) {
+			if (item->d_name[0] == '.') {
+				continue;
+			}
+			gchar *path = g_build_filename(dir, item->d_name, NULL);
+			struct stat st;
+			gboolean is_dir = item->d_type == DT_DIR, is_file = item->d_type == DT_REG;
+			if (item->d_type == DT_UNKNOWN && lstat(path, &st) == 0) { // File systems without d_type
+				is_dir = S_ISDIR(st.st_mode);
+				is_file = S_ISREG(st.st_mode);
+			}
+			if (is_file) {
+				gs_path_index_add(index, path, 0);
+			}
+			if (is_dir) {
+				g_ptr_array_add(stack, path);
+			} else {
+				g_free(path);
+			}
+		}
+		if (handle != NULL) {
+			closedir(handle);
+			g_ptr_array_add(dirs, dir);
+		} else {
+			g_free(dir);
+		}
+	}
+	g_ptr_array_free(stack, TRUE);
+}
+
+// Save as text, one path per line. Flags aren't saved, favourites and recent files come from geany.conf
+static gboolean gs_path_index_save(const GsPathIndex *index, const gchar *filepath) {
+	GString *contents = g_string_sized_new(index->entries->len * 64 + 1);
+	for (guint i = 0; i < index->entries->len; i++) {
+		const GsPathEntry *entry = &g_array_index(index->entries, GsPathEntry, i);
+		if (entry->path != NULL) {
+			g_string_append_len(contents, entry->path, entry->len);
+			g_string_append_c(contents, '\n');
+		}
+	}
+	gchar *dirpath = g_path_get_dirname(filepath);
+	g_mkdir_with_parents(dirpath, 0755);
+	gboolean ok = g_file_set_contents(filepath, contents->str, contents->len, NULL);
+	g_free(dirpath);
+	g_string_free(contents, TRUE);
+	return ok;
+}
+
+// Add the paths saved by gs_path_index_save(). Returns FALSE if there is no such file
+static gboolean gs_path_index_load(GsPathIndex *index, const gchar *filepath) {
+	gchar *contents = NULL;
+	gsize len = 0;
+	if (!g_file_get_contents(filepath, &contents, &len, NULL)) {
+		return FALSE;
+	}
+	for (gchar *p = contents, *end = contents + len, *nl; p < end && (nl = memchr(p, '\n', end - p)) != NULL; p = nl + 1) {
+		*nl = '\0';
+		if (nl > p) {
+			gs_path_index_add(index, p, 0);
+		}
+	}
+	g_free(contents);
+	return TRUE;
+}
+
+static void gs_path_scan_result_free(GsPathScanResult *result) {
+	gs_path_index_free(result->index);
+	if (result->dirs != NULL) {
+		g_ptr_array_free(result->dirs, TRUE);
+	}
+	g_free(result);
+}
+
+static gpointer gs_path_scan_thread(gpointer data) {
+	GsPathScan *scan = data;
+	GsPathScanResult *result;
+	if (scan->load_cache) {
+		result = g_new0(GsPathScanResult, 1);
+		result->index = gs_path_index_new();
+		if (gs_path_index_load(result->index, scan->cache_path)) {
+			g_async_queue_push(scan->results, result);
+		} else {
+			gs_path_scan_result_free(result);
+		}
+	}
+
+	result = g_new0(GsPathScanResult, 1);
+	result->index = gs_path_index_new();
+	result->dirs = g_ptr_array_new_with_free_func(g_free);
+	for (gchar **root = scan->roots; *root != NULL; root++) {
+		gs_path_index_scan(result->index, *root, result->dirs, scan->max_files, &scan->cancelled);
+	}
+	if (g_atomic_int_get(&scan->cancelled)) {
+		gs_path_scan_result_free(result);
+		return NULL;
+	}
+	gs_path_index_save(result->index, scan->cache_path);
+	g_async_queue_push(scan->results, result);
+	return NULL;
+}
+
+// Scan roots (NULL terminated) in background, with the index saved at cache_path first if load_cache
+GsPathScan* gs_path_scan_start(gchar **roots, guint max_files, const gchar *cache_path, gboolean load_cache) {
+	GsPathScan *scan = g_new0(GsPathScan, 1);
+	scan->roots = g_strdupv(roots);
+	scan->max_files = max_files;
+	scan->cache_path = g_strdup(cache_path);
+	scan->load_cache = load_cache;
+	scan->results = g_async_queue_new_full((GDestroyNotify) gs_path_scan_result_free);
+	scan->thread = g_thread_new("ggu-path-scan", gs_path_scan_thread, scan);
+	return scan;
+}
+
+// Next index of the scan, NULL if there is none yet. The caller owns it, the one with dirs is the last
+GsPathScanResult* gs_path_scan_next(GsPathScan *scan) {
+	return g_async_queue_try_pop(scan->results);
+}
+
+// Stop scanning and wait for the thread, results not taken yet are dropped
+void gs_path_scan_free(GsPathScan *scan) {
+	g_atomic_int_set(&scan->cancelled, 1);
+	if (scan->thread != NULL) {
+		g_thread_join(scan->thread);
+	}
+	g_async_queue_unref(scan->results);
+	g_strfreev(scan->roots);
+	g_free(scan->cache_path);
+	g_free(scan);
+}
+
+//######################################################################################################
+// Telemetry
+//
+// Latency samples in one fixed-size ring buffer per event, a full ring overwrites its oldest sample.
+// Adding a sample doesn't allocate: events are static strings, filetypes and files interned ones.
+// Percentiles are only computed on export, per event and per filetype and size class of the document
+
+#define GS_TELEMETRY_RING_SIZE 4096
+#define GS_TELEMETRY_SLOWEST   20   // Samples listed in the report
+
+static const gchar *GS_TELEMETRY_SIZE_CLASSES[] = { "<100KB", "<1MB", "<10MB", "<100MB", ">=100MB" };
+
+typedef struct {
+	const gchar       *event;
+	GsTelemetrySample *samples;  // GS_TELEMETRY_RING_SIZE
+	guint              next;     // Slot of the next sample
+	guint              count;
+} GsTelemetryRing;
+
+GsTelemetry* gs_telemetry_new() {
+	GsTelemetry *telemetry = g_new0(GsTelemetry, 1);
+	telemetry->rings = g_ptr_array_new();
+	return telemetry;
+}
+
+void gs_telemetry_free(GsTelemetry *telemetry) {
+	for (guint i = 0; i < telemetry->rings->len; i++) {
+		GsTelemetryRing *ring = g_ptr_array_index(telemetry->rings, i);
+		g_free(ring->samples);
+		g_free(ring);
+	}
+	g_ptr_array_free(telemetry->rings, TRUE);
+	g_free(telemetry);
+}
+
+static guint gs_telemetry_size_class(gsize size) {
+	guint size_class = 0;
+	for (gsize limit = 100 * 1000; size_class < G_N_ELEMENTS(GS_TELEMETRY_SIZE_CLASSES) - 1 && size >= limit; limit *= 10) {
+		size_class++;
+	}
+	return size_class;
+}
+
+// Add a sample of event (a static string). Only the first sample of an event allocates its ring
+void gs_telemetry_add(GsTelemetry *telemetry, const gchar *event, const GsTelemetrySample *sample) {
+	GsTelemetryRing *ring = NULL;
+	for (guint i = 0; i < telemetry->rings->len && ring == NULL; i++) {
+		GsTelemetryRing *candidate = g_ptr_array_index(telemetry->rings, i);
+		ring = (candidate->event == event || g_str_equal(candidate->event, event)) ? candidate : NULL;
+	}
+	if (ring == NULL) {
+		ring = g_new0(GsTelemetryRing, 1);
+		ring->event = event;
+		ring->samples = g_new(GsTelemetrySample, GS_TELEMETRY_RING_SIZE);
+		g_ptr_array_add(telemetry->rings, ring);
+	}
+	ring->samples[ring->next] = *sample;
+	ring->next = (ring->next + 1) % GS_TELEMETRY_RING_SIZE;
+	ring->count = MIN(ring->count + 1, GS_TELEMETRY_RING_SIZE);
+}
+
+// i-th sample of the ring, oldest first
+static inline const GsTelemetrySample* gs_telemetry_ring_sample(const GsTelemetryRing *ring, guint i) {
+	return &ring->samples[(ring->next + GS_TELEMETRY_RING_SIZE - ring->count + i) % GS_TELEMETRY_RING_SIZE];
+}
+
+static gint gs_telemetry_compare_duration(gconstpointer a, gconstpointer b) {
+	gint64 x = *(const gint64*) a, y = *(const gint64*) b;
+	return (x > y) - (x < y);
+}
+
+// Group by filetype and size class, shortest duration first within a group
+typedef struct {
+	const gchar *filetype;
+	guint        size_class;
+	gint64       duration;
+} GsTelemetryKey;
+
+static gint gs_telemetry_compare_key(gconstpointer a, gconstpointer b) {
+	const GsTelemetryKey *x = a, *y = b;
+	gint cmp = x->filetype == y->filetype ? 0 : strcmp(x->filetype, y->filetype);
+	if (cmp == 0) {
+		cmp = (gint) x->size_class - (gint) y->size_class;
+	}
+	return cmp != 0 ? cmp : (x->duration > y->duration) - (x->duration < y->duration);
+}
+
+static gint gs_telemetry_compare_p90(gconstpointer a, gconstpointer b) {
+	const GsTelemetrySummary *x = a, *y = b;
+	return (x->p90 < y->p90) - (x->p90 > y->p90);
+}
+
+// Nearest-rank percentiles of count durations, sorted ascending. The durations are read with stride
+// bytes between them, so they may be fields of a struct array
+static void gs_telemetry_percentiles(const guint8 *durations, gsize stride, guint count, GsTelemetrySummary *summary) {
+	#define GS_TELEMETRY_PERCENTILE(p) (*(const gint64*) (durations + stride * (MAX(1, (count * (p) + 99) / 100) - 1)))
+	summary->count = count;
+	summary->p50 = GS_TELEMETRY_PERCENTILE(50);
+	summary->p90 = GS_TELEMETRY_PERCENTILE(90);
+	summary->p99 = GS_TELEMETRY_PERCENTILE(99);
+	summary->max = GS_TELEMETRY_PERCENTILE(100);
+	#undef GS_TELEMETRY_PERCENTILE
+}
+
+// Percentiles of every event: first over all its samples, then per filetype and size class, slowest p90 first
+GArray* gs_telemetry_summary(const GsTelemetry *telemetry) {
+	GArray *summary = g_array_new(FALSE, TRUE, sizeof(GsTelemetrySummary));
+	for (guint r = 0; r < telemetry->rings->len; r++) {
+		const GsTelemetryRing *ring = g_ptr_array_index(telemetry->rings, r);
+		gint64 *all = g_new(gint64, ring->count);
+		GsTelemetryKey *keys = g_new(GsTelemetryKey, ring->count);
+		for (guint i = 0; i < ring->count; i++) {
+			const GsTelemetrySample *sample = gs_telemetry_ring_sample(ring, i);
+			all[i] = sample->duration;
+			keys[i] = (GsTelemetryKey) { sample->filetype, gs_telemetry_size_class(sample->size), sample->duration };
+		}
+		qsort(all, ring->count, sizeof(gint64), gs_telemetry_compare_duration);
+		qsort(keys, ring->count, sizeof(GsTelemetryKey), gs_telemetry_compare_key);
+
+		GsTelemetrySummary row = { ring->event, "*", "*" };
+		gs_telemetry_percentiles((const guint8*) all, sizeof(gint64), ring->count, &row);
+		g_array_append_val(summary, row);
+
+		// Runs of equal filetype and size class are the groups
+		GArray *groups = g_array_new(FALSE, TRUE, sizeof(GsTelemetrySummary));
+		for (guint start = 0, end; start < ring->count; start = end) {
+			for (end = start + 1; end < ring->count && keys[end].filetype == keys[start].filetype && keys[end].size_class == keys[start].size_class; end++);
+			GsTelemetrySummary group = { ring->event, *keys[start].filetype ? keys[start].filetype : "none", GS_TELEMETRY_SIZE_CLASSES[keys[start].size_class] };
+			gs_telemetry_percentiles((const guint8*) &keys[start].duration, sizeof(GsTelemetryKey), end - start, &group);
+			g_array_append_val(groups, group);
+		}
+		g_array_sort(groups, gs_telemetry_compare_p90);
+		g_array_append_vals(summary, groups->data, groups->len);
+
+		g_array_free(groups, TRUE);
+		g_free(keys);
+		g_free(all);
+	}
+	return summary;
+}
+
+// Quote a CSV field, quotes inside are doubled
+static void gs_telemetry_append_csv(GString *out, const gchar *text) {
+	g_string_append_c(out, '"');
+	for (const gchar *p = text; *p; p++) {
+		if (*p == '"') {
+			g_string_append_c(out, '"');
+		}
+		g_string_append_c(out, *p);
+	}
+	g_string_append_c(out, '"');
+}
+
+// Quote a JSON string, control characters are \u-escaped
+static void gs_telemetry_append_json(GString *out, const gchar *text) {
+	g_string_append_c(out, '"');
+	for (const guchar *p = (const guchar*) text; *p; p++) {
+		if (*p == '"' || *p == '\\') {
+			g_string_append_c(out, '\\');
+			g_string_append_c(out, *p);
+		} else if (*p < 0x20) {
+			g_string_append_printf(out, "\\u%04x", *p);
+		} else {
+			g_string_append_c(out, *p);
+		}
+	}
+	g_string_append_c(out, '"');
+}
+
+// Every sample as CSV, oldest first per event
+void gs_telemetry_write_csv(const GsTelemetry *telemetry, GString *out) {
+	g_string_append(out, "event,time_us,filetype,size,duration_us,file\n");
+	for (guint r = 0; r < telemetry->rings->len; r++) {
+		const GsTelemetryRing *ring = g_ptr_array_index(telemetry->rings, r);
+		for (guint i = 0; i < ring->count; i++) {
+			const GsTelemetrySample *sample = gs_telemetry_ring_sample(ring, i);
+			g_string_append_printf(out, "%s,%" G_GINT64_FORMAT ",", ring->event, sample->time);
+			gs_telemetry_append_csv(out, sample->filetype);
+			g_string_append_printf(out, ",%" G_GSIZE_FORMAT ",%" G_GINT64_FORMAT ",", sample->size, sample->duration);
+			gs_telemetry_append_csv(out, sample->file);
+			g_string_append_c(out, '\n');
+		}
+	}
+}
+
+// Summary and every sample as JSON object, one summary row or sample per line
+void gs_telemetry_write_json(const GsTelemetry *telemetry, const GArray *summary, GString *out) {
+	g_string_append(out, "{\n\"summary\": [");
+	for (guint i = 0; i < summary->len; i++) {
+		const GsTelemetrySummary *row = &g_array_index(summary, GsTelemetrySummary, i);
+		g_string_append(out, i > 0 ? ",\n  {\"event\": " : "\n  {\"event\": ");
+		gs_telemetry_append_json(out, row->event);
+		g_string_append(out, ", \"filetype\": ");
+		gs_telemetry_append_json(out, row->filetype);
+		g_string_append_printf(out, ", \"size_class\": \"%s\", \"count\": %u, \"p50_us\": %" G_GINT64_FORMAT ", \"p90_us\": %" G_GINT64_FORMAT
+			", \"p99_us\": %" G_GINT64_FORMAT ", \"max_us\": %" G_GINT64_FORMAT "}", row->size_class, row->count, row->p50, row->p90, row->p99, row->max);
+	}
+	g_string_append(out, "\n],\n\"samples\": [");
+	gboolean first = TRUE;
+	for (guint r = 0; r < telemetry->rings->len; r++) {
+		const GsTelemetryRing *ring = g_ptr_array_index(telemetry->rings, r);
+		for (guint i = 0; i < ring->count; i++, first = FALSE) {
+			const GsTelemetrySample *sample = gs_telemetry_ring_sample(ring, i);
+			g_string_append(out, first ? "\n  {\"event\": " : ",\n  {\"event\": ");
+			gs_telemetry_append_json(out, ring->event);
+			g_string_append_printf(out, ", \"time_us\": %" G_GINT64_FORMAT ", \"filetype\": ", sample->time);
+			gs_telemetry_append_json(out, sample->filetype);
+			g_string_append_printf(out, ", \"size\": %" G_GSIZE_FORMAT ", \"duration_us\": %" G_GINT64_FORMAT ", \"file\": ", sample->size, sample->duration);
+			gs_telemetry_append_json(out, sample->file);
+			g_string_append_c(out, '}');
+		}
+	}
+	g_string_append(out, "\n]\n}\n");
+}
+
+typedef struct {
+	const gchar             *event;
+	const GsTelemetrySample *sample;
+} GsTelemetryEventSample;
+
+static gint gs_telemetry_compare_slowest(gconstpointer a, gconstpointer b) {
+	const GsTelemetrySample *x = ((const GsTelemetryEventSample*) a)->sample, *y = ((const GsTelemetryEventSample*) b)->sample;
+	return (x->duration < y->duration) - (x->duration > y->duration);
+}
+
+// Readable report: the summary as table, then the slowest samples with their files
+void gs_telemetry_write_report(const GsTelemetry *telemetry, const GArray *summary, GString *out) {
+	g_string_append_printf(out, "%-20s %-16s %-8s %7s %10s %10s %10s %10s\n", "event", "filetype", "size", "count", "p50 ms", "p90 ms", "p99 ms", "max ms");
+	for (guint i = 0; i < summary->len; i++) {
+		const GsTelemetrySummary *row = &g_array_index(summary, GsTelemetrySummary, i);
+		g_string_append_printf(out, "%s%-20s %-16s %-8s %7u %10.1f %10.1f %10.1f %10.1f\n", i > 0 && g_str_equal(row->filetype, "*") ? "\n" : "",
+			row->event, row->filetype, row->size_class, row->count, row->p50 / 1000.0, row->p90 / 1000.0, row->p99 / 1000.0, row->max / 1000.0);
+	}
+
+	GArray *slowest = g_array_new(FALSE, FALSE, sizeof(GsTelemetryEventSample));
+	for (guint r = 0; r < telemetry->rings->len; r++) {
+		const GsTelemetryRing *ring = g_ptr_array_index(telemetry->rings, r);
+		for (guint i = 0; i < ring->count; i++) {
+			GsTelemetryEventSample entry = { ring->event, gs_telemetry_ring_sample(ring, i) };
+			g_array_append_val(slowest, entry);
+		}
+	}
+	g_array_sort(slowest, gs_telemetry_compare_slowest);
+	g_string_append_printf(out, "\nSlowest samples:\n%10s %-20s %-16s %12s  %s\n", "ms", "event", "filetype", "size", "file");
+	for (guint i = 0; i < MIN(slowest->len, GS_TELEMETRY_SLOWEST); i++) {
+		const GsTelemetryEventSample *entry = &g_array_index(slowest, GsTelemetryEventSample, i);
+		g_string_append_printf(out, "%10.1f %-20s %-16s %12" G_GSIZE_FORMAT "  %s\n", entry->sample->duration / 1000.0, entry->event,
+			*entry->sample->filetype ? entry->sample->filetype : "none", entry->sample->size, entry->sample->file);
+	}
+	g_array_free(slowest, TRUE);
+}
+
+//######################################################################################################
+// JSON structural index
+//
+// Side table for navigating huge JSON documents: every object/array with the offsets of its brackets,
+// its parent and its position in the parent array, and every key. One pass over the text finds the
+// structural characters with SSE2 and skips strings as a whole, it runs on a snapshot in background.
+// Containers and keys are kept in order of their start, so lookups by offset are binary searches.
+// Edits without structural characters keep the index valid, they are recorded as (pos, delta) and
+// offsets are translated on access. Other edits rescan the innermost container holding them and splice
+// the result into the index: a pass over the index, but none over the text outside of the container.
+// Edits outside of any closed container or in a big one need a new scan of the whole text.
+
+#define GS_JSON_INDEX_NONE      G_MAXUINT
+#define GS_JSON_INDEX_MAX_EDITS 64                 // Translation cost grows with every edit, offsets are rewritten beyond
+#define GS_JSON_INDEX_RESCAN_MAX (4 * 1024 * 1024) // Bytes of a container rescanned after a structural edit
+#define GS_JSON_INDEX_COUNT_MAX (16 * 1024 * 1024) // Bytes of array content counted for the path at the caret
+
+typedef struct {
+	gsize start, end;  // Offsets of the brackets in the scanned text, end is G_MAXSIZE if never closed
+	guint parent;      // Enclosing container, GS_JSON_INDEX_NONE at top level
+	guint element;     // Position in the parent array
+} GsJsonNode;
+
+typedef struct {
+	gsize start;       // Offset of the opening quote in the scanned text
+	guint node;        // Container the key belongs to
+	guint next;        // Next key of the same container, GS_JSON_INDEX_NONE if last
+} GsJsonKey;
+
+typedef struct {
+	guint node;
+	guint last_key;
+	guint elements;    // Commas seen so far in an array
+} GsJsonIndexOpen;
+
+// Lookup: structural characters outside of strings
+static const guint8 gs_json_structural[256] = { ['"'] = 1, [','] = 1, ['['] = 1, [']'] = 1, ['{'] = 1, ['}'] = 1 };
+
+// Find the next `"`, `,`, `[`, `]`, `{` or `}`, starting at p. Uses SSE2 to test 16 bytes per step where
+// available: brackets and braces only differ in bit 5, so both pairs are found with two compares
+static inline const gchar* gs_json_next_structural(const gchar *p, const gchar *end) {
+#ifdef __SSE2__
+	const __m128i quote = _mm_set1_epi8('"'), comma = _mm_set1_epi8(','), open = _mm_set1_epi8('{'), close = _mm_set1_epi8('}'), bit5 = _mm_set1_epi8(0x20);
+	for (; end - p >= 16; p += 16) {
+		__m128i chunk  = _mm_loadu_si128((const __m128i*) p);
+		__m128i folded = _mm_or_si128(chunk, bit5);
+		__m128i hits   = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, comma)),
+		                              _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)));
+		int mask = _mm_movemask_epi8(hits);
+		if (mask != 0) {
+			return p + __builtin_ctz(mask);
+		}
+	}
+#endif
+	while (p < end && !gs_json_structural[(guint8) *p]) {
+		p++;
+	}
+	return p;
+}
+
+// Pointer to the closing quote of the string whose opening quote is at p, end if unterminated
+static inline const gchar* gs_json_string_end(const gchar *p, const gchar *end) {
+	for (p++; (p = gs_json_scan_string_special(p, end)) < end && *p != '"'; p += (*p == '\\') ? 2 : 1);
+	return MIN(p, end);
+}
+
+static GsJsonIndex* gs_json_index_new() {
+	GsJsonIndex *index = g_new0(GsJsonIndex, 1);
+	index->nodes  = g_array_new(FALSE, FALSE, sizeof(GsJsonNode));
+	index->by_end = g_array_new(FALSE, FALSE, sizeof(guint));
+	index->keys   = g_array_new(FALSE, FALSE, sizeof(GsJsonKey));
+	index->edits  = g_array_new(FALSE, FALSE, sizeof(GsJsonEdit));
+	return index;
+}
+
+void gs_json_index_free(GsJsonIndex *index) {
+	g_array_free(index->nodes, TRUE);
+	g_array_free(index->by_end, TRUE);
+	g_array_free(index->keys, TRUE);
+	g_array_free(index->edits, TRUE);
+	g_free(index);
+}
+
+// Index text[0..len), which is found at document offset offset. Nodes and keys are numbered from
+// node_base and key_base on. Inside of root, GS_JSON_INDEX_NONE for a whole document, returns FALSE if
+// the brackets and strings of text don't balance. Otherwise invalid JSON is indexed as far as its
+// brackets go. Stops early if *cancelled is set
+static gboolean gs_json_index_scan_range(GsJsonIndex *index, const gchar *text, gsize len, gsize offset, guint root, guint node_base, guint key_base, const gint *cancelled) {
+	const gchar *p = text, *end = text + len;
+	GArray *stack = g_array_new(FALSE, FALSE, sizeof(GsJsonIndexOpen));
+	gboolean ok = TRUE;
+	gint64 time_start = g_get_monotonic_time();
+	if (root != GS_JSON_INDEX_NONE) {
+		GsJsonIndexOpen open = { root, GS_JSON_INDEX_NONE, 0 };
+		g_array_append_val(stack, open);
+	}
+
+	for (guint steps = 0; ok && (p = gs_json_next_structural(p, end)) < end; p++) {
+		GsJsonIndexOpen *top = stack->len > 0 ? &g_array_index(stack, GsJsonIndexOpen, stack->len - 1) : NULL;
+		if ((++steps & 0xFFFF) == 0 && g_atomic_int_get(cancelled)) {
+			break;
+		}
+		if (*p == '"') {
+			const gchar *q = gs_json_string_end(p, end), *next = gs_json_skip_ws(q + 1, end);
+			if (top != NULL && next < end && *next == ':') {
+				GsJsonKey key = { offset + (p - text), top->node, GS_JSON_INDEX_NONE };
+				if (top->last_key != GS_JSON_INDEX_NONE) {
+					g_array_index(index->keys, GsJsonKey, top->last_key - key_base).next = key_base + index->keys->len;
+				}
+				top->last_key = key_base + index->keys->len;
+				g_array_append_val(index->keys, key);
+			}
+			ok = q < end || root == GS_JSON_INDEX_NONE;
+			p = q;
+		} else if (*p == ',' && top != NULL) {
+			top->elements++;
+		} else if (*p == '{' || *p == '[') {
+			GsJsonNode node = { offset + (p - text), G_MAXSIZE, top != NULL ? top->node : GS_JSON_INDEX_NONE, top != NULL ? top->elements : 0 };
+			GsJsonIndexOpen open = { node_base + index->nodes->len, GS_JSON_INDEX_NONE, 0 };
+			g_array_append_val(index->nodes, node);
+			g_array_append_val(stack, open);
+		} else if (top != NULL && top->node != root) { // Closing bracket
+			g_array_index(index->nodes, GsJsonNode, top->node - node_base).end = offset + (p - text);
+			g_array_append_val(index->by_end, top->node);
+			g_array_set_size(stack, stack->len - 1);
+		} else {
+			ok = root == GS_JSON_INDEX_NONE;
+		}
+	}
+	ok &= root == GS_JSON_INDEX_NONE || stack->len == 1;
+	g_array_free(stack, TRUE);
+	index->seconds = MAX(1, g_get_monotonic_time() - time_start) / (gdouble) G_USEC_PER_SEC;
+	return ok;
+}
+
+// Offset in the scanned text -> offset in the current document. Structural offsets never lie in deleted text
+static gsize gs_json_index_to_doc(const GsJsonIndex *index, gsize offset) {
+	for (guint i = 0; i < index->edits->len; i++) {
+		const GsJsonEdit *edit = &g_array_index(index->edits, GsJsonEdit, i);
+		if (offset >= edit->pos && edit->delta > 0) {
+			offset += edit->delta;
+		} else if (offset >= edit->pos) {
+			offset = offset >= edit->pos - edit->delta ? offset + edit->delta : edit->pos;
+		}
+	}
+	return offset;
+}
+
+// Translate all offsets to the current document and drop the edits
+static void gs_json_index_apply_edits(GsJsonIndex *index) {
+	if (index->edits->len == 0) {
+		return;
+	}
+	for (guint i = 0; i < index->nodes->len; i++) {
+		GsJsonNode *node = &g_array_index(index->nodes, GsJsonNode, i);
+		node->start = gs_json_index_to_doc(index, node->start);
+		node->end = node->end == G_MAXSIZE ? G_MAXSIZE : gs_json_index_to_doc(index, node->end);
+	}
+	for (guint k = 0; k < index->keys->len; k++) {
+		GsJsonKey *key = &g_array_index(index->keys, GsJsonKey, k);
+		key->start = gs_json_index_to_doc(index, key->start);
+	}
+	g_array_set_size(index->edits, 0);
+}
+
+// Index text[0..len). Invalid JSON is indexed as far as its brackets go. Stops early if *cancelled is set
+static void gs_json_index_scan(GsJsonIndex *index, const gchar *text, gsize len, const gint *cancelled) {
+	gs_json_index_scan_range(index, text, len, 0, GS_JSON_INDEX_NONE, 0, 0, cancelled);
+}
+
+// Record an edit of the document without structural characters. The offsets are rewritten once there
+// are too many edits to translate on access
+void gs_json_index_add_edit(GsJsonIndex *index, gsize pos, gssize delta) {
+	if (index->edits->len >= GS_JSON_INDEX_MAX_EDITS) {
+		gs_json_index_apply_edits(index);
+	}
+	GsJsonEdit edit = { pos, delta };
+	g_array_append_val(index->edits, edit);
+}
+
+// Whether an edit of text[0..len) can change the structure: brackets, strings, keys or escapes
+gboolean gs_json_index_edit_is_structural(const gchar *text, gsize len) {
+	for (const gchar *p = text, *end = text + len; p < end; p++) {
+		if (gs_json_structural[(guint8) *p] || *p == ':' || *p == '\\') {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static inline const GsJsonNode* gs_json_index_node(const GsJsonIndex *index, guint n) {
+	return &g_array_index(index->nodes, GsJsonNode, n);
+}
+
+static inline gsize gs_json_index_node_start(const GsJsonIndex *index, guint n) {
+	return gs_json_index_to_doc(index, gs_json_index_node(index, n)->start);
+}
+
+// Document offset of the closing bracket of node n, G_MAXSIZE if it is never closed
+static inline gsize gs_json_index_node_end(const GsJsonIndex *index, guint n) {
+	gsize end = gs_json_index_node(index, n)->end;
+	return end == G_MAXSIZE ? end : gs_json_index_to_doc(index, end);
+}
+
+static inline gsize gs_json_index_key_start(const GsJsonIndex *index, guint k) {
+	return gs_json_index_to_doc(index, g_array_index(index->keys, GsJsonKey, k).start);
+}
+
+// Number of nodes starting before document offset pos
+static guint gs_json_index_nodes_before(const GsJsonIndex *index, gsize pos) {
+	guint lo = 0, hi = index->nodes->len;
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		if (gs_json_index_node_start(index, mid) < pos) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+// Number of keys starting before document offset pos
+static guint gs_json_index_keys_before(const GsJsonIndex *index, gsize pos) {
+	guint lo = 0, hi = index->keys->len;
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		if (gs_json_index_key_start(index, mid) < pos) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+// Node whose opening bracket is at document offset pos, GS_JSON_INDEX_NONE if none
+static guint gs_json_index_node_starting_at(const GsJsonIndex *index, gsize pos) {
+	guint n = gs_json_index_nodes_before(index, pos);
+	return n < index->nodes->len && gs_json_index_node_start(index, n) == pos ? n : GS_JSON_INDEX_NONE;
+}
+
+// Innermost node containing document offset pos (brackets included), GS_JSON_INDEX_NONE if none.
+// It is the last node starting at or before pos or one of its ancestors
+static guint gs_json_index_node_at(const GsJsonIndex *index, gsize pos) {
+	guint n = gs_json_index_nodes_before(index, pos + 1);
+	for (n = n > 0 ? n - 1 : GS_JSON_INDEX_NONE; n != GS_JSON_INDEX_NONE; n = gs_json_index_node(index, n)->parent) {
+		gsize end = gs_json_index_node_end(index, n);
+		if (end == G_MAXSIZE || end >= pos) {
+			return n;
+		}
+	}
+	return GS_JSON_INDEX_NONE;
+}
+
+// Ancestor of node n (or n itself) whose parent is ancestor, GS_JSON_INDEX_NONE if n is no descendant
+static guint gs_json_index_child_of(const GsJsonIndex *index, guint ancestor, guint n) {
+	while (n != GS_JSON_INDEX_NONE && gs_json_index_node(index, n)->parent != ancestor) {
+		n = gs_json_index_node(index, n)->parent;
+	}
+	return n;
+}
+
+// Document offset of the bracket matching the one at pos, FALSE if there is no indexed bracket at pos
+gboolean gs_json_index_match(const GsJsonIndex *index, gsize pos, gsize *match) {
+	guint n = gs_json_index_node_starting_at(index, pos);
+	if (n != GS_JSON_INDEX_NONE) {
+		*match = gs_json_index_node_end(index, n);
+		return *match != G_MAXSIZE;
+	}
+	guint lo = 0, hi = index->by_end->len;
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		if (gs_json_index_node_end(index, g_array_index(index->by_end, guint, mid)) < pos) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo < index->by_end->len && gs_json_index_node_end(index, (n = g_array_index(index->by_end, guint, lo))) == pos) {
+		*match = gs_json_index_node_start(index, n);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+// Structural edit of the document: Rescan the innermost closed container holding it between its
+// brackets and replace its nodes and keys. read returns the given range of the document as it is now.
+// Returns FALSE if there is no such container, it is too big or its content doesn't balance anymore,
+// the whole text must be scanned again then
+gboolean gs_json_index_update(GsJsonIndex *index, gsize pos, gssize delta, GsJsonReadFunc read, gpointer user_data) {
+	gsize removed = delta < 0 ? (gsize) -delta : 0, start = 0, end = 0;
+	guint n = gs_json_index_node_at(index, pos);
+	for (; n != GS_JSON_INDEX_NONE; n = gs_json_index_node(index, n)->parent) {
+		start = gs_json_index_node_start(index, n);
+		end = gs_json_index_node_end(index, n);
+		if (end == G_MAXSIZE) {
+			return FALSE; // Never closed, nor are its ancestors
+		} else if (start < pos && end >= pos + removed) {
+			break;
+		}
+	}
+	if (n == GS_JSON_INDEX_NONE || end - start > GS_JSON_INDEX_RESCAN_MAX) {
+		return FALSE;
+	}
+
+	// Content of n as it is now. Its nodes and keys are found behind n
+	gsize content_len = end + delta - start - 1;
+	const gchar *text = read(start + 1, content_len, user_data);
+	guint nodes_end = gs_json_index_nodes_before(index, end), keys_start = gs_json_index_keys_before(index, start), keys_end = gs_json_index_keys_before(index, end);
+	GsJsonIndex *part = gs_json_index_new();
+	gint cancelled = 0;
+	if (text == NULL || !gs_json_index_scan_range(part, text, content_len, start + 1, n, n + 1, keys_start, &cancelled)) {
+		gs_json_index_free(part);
+		return FALSE;
+	}
+
+	// Splice: Old offsets move to the current document, numbers behind the content shift
+	GsJsonEdit edit = { pos, delta };
+	g_array_append_val(index->edits, edit);
+	gs_json_index_apply_edits(index);
+	gint node_shift = (gint) part->nodes->len - (gint)(nodes_end - n - 1), key_shift = (gint) part->keys->len - (gint)(keys_end - keys_start);
+	g_array_remove_range(index->nodes, n + 1, nodes_end - n - 1);
+	g_array_insert_vals(index->nodes, n + 1, part->nodes->data, part->nodes->len);
+	g_array_remove_range(index->keys, keys_start, keys_end - keys_start);
+	g_array_insert_vals(index->keys, keys_start, part->keys->data, part->keys->len);
+	for (guint i = n + 1 + part->nodes->len; i < index->nodes->len && node_shift != 0; i++) {
+		GsJsonNode *node = &g_array_index(index->nodes, GsJsonNode, i);
+		node->parent += node->parent != GS_JSON_INDEX_NONE && node->parent >= nodes_end ? node_shift : 0;
+	}
+	for (guint k = 0; k < index->keys->len && (node_shift != 0 || key_shift != 0); k++) {
+		GsJsonKey *key = &g_array_index(index->keys, GsJsonKey, k);
+		if (k >= keys_start && k < keys_start + part->keys->len) {
+			continue; // New
+		}
+		key->node += key->node >= nodes_end ? node_shift : 0;
+		key->next += key->next != GS_JSON_INDEX_NONE && key->next >= keys_end ? key_shift : 0;
+	}
+
+	// Containers close in the order of by_end, the ones inside n right before n
+	GArray *by_end = g_array_sized_new(FALSE, FALSE, sizeof(guint), index->by_end->len + part->by_end->len);
+	for (guint i = 0; i < index->by_end->len; i++) {
+		guint c = g_array_index(index->by_end, guint, i);
+		if (c > n && c < nodes_end) {
+			continue;
+		} else if (c == n) {
+			g_array_append_vals(by_end, part->by_end->data, part->by_end->len);
+		}
+		c += c >= nodes_end ? node_shift : 0;
+		g_array_append_val(by_end, c);
+	}
+	g_array_free(index->by_end, TRUE);
+	index->by_end = by_end;
+	gs_json_index_free(part);
+	return TRUE;
+}
+
+// Top-level commas in text[from..to), which holds array content without containers
+static guint gs_json_count_commas(const gchar *text, gsize from, gsize to) {
+	const gchar *p = text + from, *end = text + to;
+	guint commas = 0;
+	for (; (p = gs_json_next_structural(p, end)) < end; p++) {
+		if (*p == '"') {
+			p = gs_json_string_end(p, end);
+		} else if (*p == ',') {
+			commas++;
+		}
+	}
+	return commas;
+}
+
+// Document offset behind the count-th top-level comma from text[from], G_MAXSIZE if the array ends before
+static gsize gs_json_skip_commas(const gchar *text, gsize len, gsize from, guint count) {
+	const gchar *p = text + from, *end = text + len;
+	for (; count > 0 && (p = gs_json_next_structural(p, end)) < end; p++) {
+		if (*p == '"') {
+			p = gs_json_string_end(p, end);
+		} else if (*p == ',') {
+			count--;
+		} else {
+			return G_MAXSIZE;
+		}
+	}
+	return count == 0 ? (gsize)(p - text) : G_MAXSIZE;
+}
+
+// Position of the element at document offset pos in array n, G_MAXUINT if counting would take too long.
+// Commas are counted from the last child container before pos, which knows its own position
+static guint gs_json_index_element_at(const GsJsonIndex *index, const gchar *text, guint n, gsize pos) {
+	guint last = gs_json_index_nodes_before(index, pos);
+	gsize from = gs_json_index_node_start(index, n) + 1;
+	guint element = 0;
+	if (last > n + 1) {
+		guint child = gs_json_index_child_of(index, n, last - 1);
+		gsize child_end = gs_json_index_node_end(index, child);
+		element = gs_json_index_node(index, child)->element;
+		if (child_end == G_MAXSIZE || child_end >= pos) {
+			return element;
+		}
+		from = child_end + 1;
+	}
+	return pos - from > GS_JSON_INDEX_COUNT_MAX ? G_MAXUINT : element + gs_json_count_commas(text, from, pos);
+}
+
+// Key of the member of object n at or before document offset pos, GS_JSON_INDEX_NONE if none. Keys of
+// nested containers are skipped by continuing before the child of n holding them
+static guint gs_json_index_key_at(const GsJsonIndex *index, guint n, gsize pos) {
+	gsize start = gs_json_index_node_start(index, n);
+	for (guint k = gs_json_index_keys_before(index, pos + 1); k > 0; ) {
+		const GsJsonKey *key = &g_array_index(index->keys, GsJsonKey, k - 1);
+		guint child = key->node == n ? n : gs_json_index_child_of(index, n, key->node);
+		if (gs_json_index_key_start(index, k - 1) < start || child == GS_JSON_INDEX_NONE) {
+			return GS_JSON_INDEX_NONE;
+		} else if (child == n) {
+			return k - 1;
+		}
+		k = gs_json_index_keys_before(index, gs_json_index_node_start(index, child));
+	}
+	return GS_JSON_INDEX_NONE;
+}
+
+// Append the path step of the key starting at text[start]: .name, or ['name'] if it is no identifier.
+// A key running past text is completed from ahead, the text following it
+static void gs_json_path_append_key(GString *path, const gchar *text, gsize len, const gchar *ahead, gsize ahead_len, gsize start) {
+	GString *joined = NULL;
+	if (start > len || (start == len && ahead_len == 0)) {
+		return;
+	} else if (ahead_len > 0 && (start == len || gs_json_string_end(text + start, text + len) == text + len)) {
+		joined = g_string_new_len(text + start, len - start);
+		g_string_append_len(joined, ahead, ahead_len);
+		text = joined->str;
+		len = joined->len;
+		start = 0;
+	}
+	const gchar *name = text + start + 1, *name_end = gs_json_string_end(text + start, text + len);
+	gboolean identifier = name < name_end && !g_ascii_isdigit(*name);
+	for (const gchar *c = name; c < name_end && identifier; c++) {
+		identifier = g_ascii_isalnum(*c) || *c == '_' || *c == '$';
+	}
+	g_string_append(path, identifier ? "." : "['");
+	g_string_append_len(path, name, name_end - name);
+	g_string_append(path, identifier ? "" : "']");
+	if (joined != NULL) {
+		g_string_free(joined, TRUE);
+	}
+}
+
+// JSONPath of the value at document offset pos, like $.items[12].id. text is the current document,
+// at least up to pos, and ahead (may be NULL) is the text following it, read only for the key at pos.
+// NULL if pos is outside of any object or array
+gchar* gs_json_index_path(const GsJsonIndex *index, const gchar *text, gsize len, const gchar *ahead, gsize ahead_len, gsize pos) {
+	guint n = gs_json_index_node_at(index, pos);
+	if (n == GS_JSON_INDEX_NONE) {
+		return NULL;
+	}
+
+	// Containers from the top-level one down to n, with the offset inside each of them to step to
+	GArray *chain = g_array_new(FALSE, FALSE, sizeof(guint));
+	for (guint c = n; c != GS_JSON_INDEX_NONE; c = gs_json_index_node(index, c)->parent) {
+		g_array_prepend_val(chain, c);
+	}
+	GString *path = g_string_new("$");
+	for (guint i = 0; i < chain->len; i++) {
+		guint c = g_array_index(chain, guint, i);
+		gsize target = i + 1 < chain->len ? gs_json_index_node_start(index, g_array_index(chain, guint, i + 1)) : pos;
+		gsize start = gs_json_index_node_start(index, c);
+		if (target == start || target == gs_json_index_node_end(index, c)) {
+			break; // On the brackets of c
+		} else if (text[start] == '[') {
+			guint element = gs_json_index_element_at(index, text, c, target);
+			if (element != G_MAXUINT) {
+				g_string_append_printf(path, "[%u]", element);
+			} else {
+				g_string_append(path, "[*]"); // Too far to count
+			}
+		} else {
+			guint k = gs_json_index_key_at(index, c, target);
+			if (k == GS_JSON_INDEX_NONE) {
+				break;
+			}
+			gs_json_path_append_key(path, text, len, ahead, ahead_len, gs_json_index_key_start(index, k));
+		}
+	}
+	g_array_free(chain, TRUE);
+	return g_string_free(path, FALSE);
+}
+
+// Document offset of the value at path, e.g. $.items[1234].id or $['a b'][0]. text is the current
+// document. Returns FALSE and sets *error if there is no such value. Key names are compared as written
+// in the document, escape sequences are not decoded
+gboolean gs_json_index_find(const GsJsonIndex *index, const gchar *text, gsize len, const gchar *path, gsize *pos, const gchar **error) {
+	const gchar *p = path;
+	*error = NULL;
+	if (*p++ != '$') {
+		*error = "Path must start with $";
+		return FALSE;
+	} else if (index->nodes->len == 0) {
+		*error = "No object or array in document";
+		return FALSE;
+	}
+	guint n = 0;
+	gsize value = gs_json_index_node_start(index, n);
+
+	while (*p != '\0' && *error == NULL) {
+		// Parse step: .name, ['name'], ["name"] or [number]
+		const gchar *name = NULL, *name_end = NULL;
+		guint64 element = 0;
+		if (*p == '.') {
+			for (name = name_end = ++p; *name_end != '\0' && *name_end != '.' && *name_end != '['; name_end++);
+			p = name_end;
+		} else if (*p == '[' && (p[1] == '\'' || p[1] == '"')) {
+			name = p + 2;
+			name_end = strchr(name, p[1]);
+			if (name_end == NULL || name_end[1] != ']') {
+				*error = "Unterminated ['name']";
+				break;
+			}
+			p = name_end + 2;
+		} else if (*p == '[' && g_ascii_isdigit(p[1])) {
+			gchar *number_end;
+			element = g_ascii_strtoull(p + 1, &number_end, 10);
+			if (*number_end != ']' || element >= G_MAXUINT) {
+				*error = "Invalid [index]";
+				break;
+			}
+			p = number_end + 1;
+		} else {
+			*error = "Expected .name, ['name'] or [index]";
+			break;
+		}
+
+		if (n == GS_JSON_INDEX_NONE) {
+			*error = "Path continues below a value which is no object or array";
+		} else if (name != NULL && text[value] != '{') {
+			*error = "Key of a value which is no object";
+		} else if (name == NULL && text[value] != '[') {
+			*error = "Index of a value which is no array";
+		} else if (name != NULL) {
+			// Walk the keys of n
+			guint k = gs_json_index_keys_before(index, value + 1);
+			if (k >= index->keys->len || g_array_index(index->keys, GsJsonKey, k).node != n) {
+				k = GS_JSON_INDEX_NONE;
+			}
+			for (; k != GS_JSON_INDEX_NONE; k = g_array_index(index->keys, GsJsonKey, k).next) {
+				gsize key = gs_json_index_key_start(index, k);
+				const gchar *key_end = gs_json_string_end(text + key, text + len);
+				if ((gsize)(key_end - text - key - 1) == (gsize)(name_end - name) && memcmp(text + key + 1, name, name_end - name) == 0) {
+					const gchar *colon = gs_json_skip_ws(key_end + 1, text + len);
+					value = gs_json_skip_ws(colon + 1, text + len) - text;
+					break;
+				}
+			}
+			*error = k == GS_JSON_INDEX_NONE ? "Key not found" : NULL;
+		} else {
+			// Binary search of the nodes inside n by the position of the child of n holding them, commas are
+			// counted only behind the last child container before the element
+			gsize n_end = gs_json_index_node_end(index, n);
+			guint inside_end = n_end != G_MAXSIZE ? gs_json_index_nodes_before(index, n_end) : index->nodes->len;
+			guint lo = n + 1, hi = inside_end;
+			while (lo < hi) {
+				guint mid = lo + (hi - lo) / 2;
+				if (gs_json_index_node(index, gs_json_index_child_of(index, n, mid))->element < element) {
+					lo = mid + 1;
+				} else {
+					hi = mid;
+				}
+			}
+			guint child = lo < inside_end ? gs_json_index_child_of(index, n, lo) : GS_JSON_INDEX_NONE;
+			guint prev = lo > n + 1 ? gs_json_index_child_of(index, n, lo - 1) : GS_JSON_INDEX_NONE;
+			if (child != GS_JSON_INDEX_NONE && gs_json_index_node(index, child)->element == element) {
+				value = gs_json_index_node_start(index, child);
+			} else {
+				gsize from = prev != GS_JSON_INDEX_NONE ? gs_json_index_node_end(index, prev) + 1 : value + 1;
+				guint skip = element - (prev != GS_JSON_INDEX_NONE ? gs_json_index_node(index, prev)->element : 0);
+				gsize found = prev == GS_JSON_INDEX_NONE || gs_json_index_node_end(index, prev) != G_MAXSIZE ? gs_json_skip_commas(text, len, from, skip) : G_MAXSIZE;
+				value = found != G_MAXSIZE ? (gsize)(gs_json_skip_ws(text + found, text + len) - text) : value;
+				*error = found == G_MAXSIZE || value >= len || text[value] == ']' ? "Index out of range" : NULL;
+			}
+		}
+		n = *error == NULL ? gs_json_index_node_starting_at(index, value) : n;
+	}
+	*pos = MIN(value, len);
+	return *error == NULL;
+}
+
+static gpointer gs_json_index_build_thread(gpointer data) {
+	GsJsonIndexBuild *build = data;
+	gsize len;
+	const gchar *text = g_bytes_get_data(build->snapshot, &len);
+	gs_json_index_scan(build->index, text, len, &build->cancelled);
+	g_atomic_int_set(&build->done, 1);
+	return NULL;
+}
+
+// Index snapshot in background, takes ownership of it
+GsJsonIndexBuild* gs_json_index_build_start(GBytes *snapshot) {
+	GsJsonIndexBuild *build = g_new0(GsJsonIndexBuild, 1);
+	build->snapshot = snapshot;
+	build->index = gs_json_index_new();
+	build->thread = g_thread_new("ggu-json-index", gs_json_index_build_thread, build);
+	return build;
+}
+
+gboolean gs_json_index_build_done(GsJsonIndexBuild *build) {
+	return g_atomic_int_get(&build->done);
+}
+
+// Wait for the build and free it. Returns the index, NULL if cancel is set
+GsJsonIndex* gs_json_index_build_finish(GsJsonIndexBuild *build, gboolean cancel) {
+	g_atomic_int_set(&build->cancelled, cancel);
+	g_thread_join(build->thread);
+	GsJsonIndex *index = build->index;
+	if (cancel) {
+		gs_json_index_free(index);
+		index = NULL;
+	}
+	g_bytes_unref(build->snapshot);
+	g_free(build);
+	return index;
+}
@@ -0,0 +1,449 @@
+//######################################################################################################
+//
+// > ggucore: Text processing core of geanygsantnerutils (formatters, pipe, transforms, diff, search, ..)
+//
+// Authors:
+//   2019-2023 Gregor Santner, gsantner AT mailbox DOT org
+//
+// License: Public domain / Creative Commons Zero 1.0
+//
+//######################################################################################################
+//
+// Depends on GLib/GIO only, no Geany or Scintilla. Built as static library libggucore.a which is
+// linked into the plugin and into ggubench (make test / make bench).
+//
+//######################################################################################################
+// vim: sw=4 ts=4 ft=c noexpandtab:
+
+#ifndef GGUCORE_H
+#define GGUCORE_H
+
+#include <glib.h>
+#include <gio/gio.h>
+
+//######################################################################################################
+// JSON engine
+
+typedef struct {
+	gsize        offset;   // Byte offset of the first error, relative to the input start
+	const gchar *message;  // Static description of the error
+} GsParseError;
+
+const gchar* gs_json_scan_string_special(const gchar *p, const gchar *end);
+void gs_string_indent_lines(GString *out, const gchar *indentation);
+
+extern const gchar gs_json_err_extra_data[];
+
+gboolean gs_json_format(const gchar *text, gsize len, gint indent, GString *out, GsParseError *err);
+guint gs_json_format_fragments(const gchar *text, gsize len, gint indent, GString *out);
+gsize gs_mem_first_of(const gchar *text, gsize len, gchar a, gchar b);
+gsize gs_mem_end_of_last(const gchar *text, gsize len, gchar a, gchar b);
+
+//######################################################################################################
+// NDJSON / JSON Lines engine
+
+typedef struct {
+	guint        line;      // Input line, 0-based
+	guint        out_line;  // Line of the record in the output, 0-based
+	gsize        column;    // Byte offset in the line
+	const gchar *message;
+} GsNdjsonError;
+
+guint gs_ndjson_format(const gchar *text, gsize len, gint indent, GString *out, GArray *errors);
+
+//######################################################################################################
+// XML / HTML engine
+
+typedef enum {
+	GS_XML_TOKEN_EOF,
+	GS_XML_TOKEN_TEXT,     // Character data between tags
+	GS_XML_TOKEN_START,    // <name ...>
+	GS_XML_TOKEN_EMPTY,    // <name .../>
+	GS_XML_TOKEN_END,      // </name>
+	GS_XML_TOKEN_COMMENT,  // <!-- ... -->
+	GS_XML_TOKEN_CDATA,    // <![CDATA[ ... ]]>
+	GS_XML_TOKEN_DECL,     // <?...?>, <!DOCTYPE ...>
+	GS_XML_TOKEN_ERROR,
+} GsXmlTokenType;
+
+typedef struct {
+	GsXmlTokenType  type;
+	const gchar    *start, *end;          // Whole token
+	const gchar    *name, *name_end;      // Element name of START/EMPTY/END
+	const gchar    *attrs, *attrs_end;    // Attribute area of START/EMPTY
+} GsXmlToken;
+
+typedef struct {
+	const gchar    *p, *end;
+	gboolean        html;                 // Void elements and raw text elements (script/style)
+	const gchar    *raw_name;             // Set while inside a raw text element
+	gsize           raw_name_len;
+	const gchar    *errmsg;
+} GsXmlScanner;
+
+void gs_xml_scanner_init(GsXmlScanner *s, const gchar *text, gsize len, gboolean html);
+gboolean gs_xml_next(GsXmlScanner *s, GsXmlToken *t);
+gboolean gs_xml_looks_like_html(const gchar *text, gsize len);
+gboolean gs_xml_format(const gchar *text, gsize len, gboolean html, gint indent, gint width, GString *out, GsParseError *err);
+
+//######################################################################################################
+// XPath engine
+
+typedef enum {
+	GS_XPATH_ELEMENT,  // Whole element from start tag to end tag
+	GS_XPATH_TEXT,     // Text content, trimmed
+	GS_XPATH_ATTR,     // Attribute value without quotes
+} GsXpathSelect;
+
+typedef struct GsXpath {
+	GArray        *steps;            // GsXpathStep
+	GsXpathSelect  select;
+	gboolean       text_descendant;  // //text(): text anywhere inside of a match
+	gchar         *attr;             // Attribute for GS_XPATH_ATTR
+} GsXpath;
+
+typedef struct {
+	gsize start, end;
+} GsXpathMatch;
+
+typedef struct GsXpathRun {
+	const GsXpath *xpath;
+	gboolean       html;
+	gsize          pos;                     // Offset to continue at
+	gsize          raw_name, raw_name_len;  // Inside a raw text element (HTML script/style), raw_name_len is 0 if not
+	GArray        *stack;                   // GsXpathFrame of the open elements
+	GArray        *pending;                 // GsXpathMatch held back until the element matches before them are closed
+	guint64        pending_base;            // Sequence number of pending[0]
+	guint          errors;                  // Malformed tags, skipped as text
+	gsize          error_pos;               // Offset of the first one
+	gboolean       done;
+} GsXpathRun;
+
+void gs_xpath_free(GsXpath *xpath);
+GsXpath* gs_xpath_compile(const gchar *query, const gchar **error);
+GsXpathRun* gs_xpath_run_new(const GsXpath *xpath, gboolean html);
+void gs_xpath_run_free(GsXpathRun *run);
+gboolean gs_xpath_run_step(GsXpathRun *run, const gchar *text, gsize len, gsize budget, GArray *matches);
+
+//######################################################################################################
+// Blocks
+
+typedef enum {
+	GS_BLOCK_NONE,   // Selection or whole document
+	GS_BLOCK_JSON,   // Innermost {...} / [...] around the caret
+	GS_BLOCK_XML,    // Innermost element around the caret
+} GsBlockKind;
+
+gboolean gs_find_block(const gchar *text, gsize len, gsize pos, GsBlockKind kind, gboolean html, gsize *start, gsize *end);
+
+//######################################################################################################
+// Pipe engine
+
+typedef struct GsPipeJob GsPipeJob;
+
+typedef void (*GsPipeDoneFunc)(GsPipeJob *job, gpointer user_data);
+
+typedef const gchar* (*GsPipeReadFunc)(gsize pos, gsize len, gpointer user_data); // NULL aborts input
+
+struct GsPipeJob {
+	gchar          *command;
+	GPid            pid;
+	GIOChannel     *ch_in, *ch_out, *ch_err;
+	guint           watch_in, watch_out, watch_err, watch_child;
+	GsPipeReadFunc  read_input;      // Provides stdin chunk by chunk, no copy of the whole input
+	gsize           input_len, input_pos;
+	GString        *output, *errors; // Collected stdout/stderr
+	gint            wait_status;
+	gboolean        exited, cancelled;
+	gint64          time_start;
+	GsPipeDoneFunc  on_done;         // Called exactly once, afterwards the job is freed
+	gpointer        user_data;
+};
+
+GsPipeJob* gs_pipe_job_start(const gchar *command, gsize input_len, GsPipeReadFunc read_input, GsPipeDoneFunc on_done, gpointer user_data, GError **error);
+void gs_pipe_job_cancel(GsPipeJob *job);
+void gs_pipe_job_abort(GsPipeJob *job);
+gint gs_pipe_exit_code(gint wait_status);
+
+//######################################################################################################
+// Co-process engine
+
+typedef struct GsCoprocess GsCoprocess;
+
+typedef void (*GsCoprocessDoneFunc)(GsCoprocess *co, gboolean ok, GString *out, GString *errors, gpointer user_data);
+
+struct GsCoprocess {
+	gchar               *command;
+	GPid                 pid;
+	GIOChannel          *ch_in, *ch_out, *ch_err;
+	guint                watch_in, watch_out, watch_err, watch_child, timeout;
+	gboolean             busy;      // Request pending
+	gboolean             dead;      // Exited or killed after a failed request, started again on next use
+	gboolean             exited, closing;
+	GBytes              *input;     // Of the pending request
+	gsize                input_pos;
+	GString             *out, *errors;
+	GsCoprocessDoneFunc  on_done;   // Called once per request
+	gpointer             user_data;
+};
+
+GsCoprocess* gs_coprocess_start(const gchar *command, GError **error);
+void gs_coprocess_free(GsCoprocess *co);
+GsCoprocess* gs_coprocess_get(GHashTable *running, const gchar *command, GError **error);
+gboolean gs_coprocess_request(GsCoprocess *co, GBytes *input, guint timeout_ms, GsCoprocessDoneFunc on_done, gpointer user_data);
+
+//######################################################################################################
+// Background format engine
+
+typedef struct {
+	guint     doc_id;
+	guint     version;      // Document version the snapshot was taken at
+	gchar    *command;      // "builtin:json", "builtin:xml" or shell command
+	gboolean  html;
+	GBytes   *snapshot;
+	GString  *out;
+	gboolean  ok;
+	GsParseError err;       // Builtin formatters, offset in the snapshot
+	gchar    *errors;       // Stderr or error of a formatter command
+	gint64    time_start;
+} GsFormatJob;
+
+typedef struct GsFormatQueue {
+	GThreadPool  *pool;
+	GAsyncQueue  *done;        // Finished GsFormatJob*
+	guint         pending;     // Jobs pushed but not taken from done yet, UI thread only
+	guint         timeout_ms;  // Formatter commands are killed after this
+	GCancellable *cancellable; // Cancelled when the queue is freed
+} GsFormatQueue;
+
+void gs_format_job_free(GsFormatJob *job);
+gboolean gs_format_job_is_current(const GsFormatJob *job, guint doc_id, guint version);
+GsFormatQueue* gs_format_queue_new(guint timeout_ms);
+void gs_format_queue_push(GsFormatQueue *queue, guint doc_id, guint version, const gchar *command, gboolean html, GBytes *snapshot);
+GsFormatJob* gs_format_queue_next(GsFormatQueue *queue);
+void gs_format_queue_free(GsFormatQueue *queue);
+
+//######################################################################################################
+// Diff engine
+
+typedef struct {
+	gsize old_start, old_end;    // Byte range in old text
+	gsize new_start, new_end;    // Byte range in new text
+} GsDiffHunk;
+
+void gs_diff_text(const gchar *old_text, gsize old_len, const gchar *new_text, gsize new_len, GArray *hunks);
+
+typedef struct {
+	guint old_start, old_end;   // Line range in old text
+	guint new_start, new_end;   // Line range in new text
+} GsDiffLines;
+
+void gs_diff_lines(const gchar *old_text, gsize old_len, const gchar *new_text, gsize new_len, GArray *hunks, gint *cancelled);
+
+typedef struct GsDiffJob {
+	GBytes  *old_text, *new_text;
+	gchar   *old_path;          // Read in the thread if old_text is NULL
+	gchar   *old_encoding;      // Encoding of old_path, NULL for UTF-8
+	GArray  *hunks;             // GsDiffLines
+	gchar   *error;             // Reading old_path failed
+	GThread *thread;
+	gint     done, cancelled;
+} GsDiffJob;
+
+GsDiffJob* gs_diff_job_start(GBytes *old_text, const gchar *old_path, const gchar *old_encoding, GBytes *new_text);
+gboolean gs_diff_job_done(GsDiffJob *job);
+GArray* gs_diff_job_finish(GsDiffJob *job, gboolean cancel, GBytes **old_text, gchar **error);
+
+//######################################################################################################
+// Pipe result cache
+
+guint64 gs_hash_xxh64(const gchar *p, gsize len, guint64 seed);
+
+typedef struct GsPipeCache {
+	GQueue   entries;   // GsPipeCacheEntry, most recently used first
+	gsize    size;      // Bytes of all outputs
+	gsize    max_size;
+} GsPipeCache;
+
+GString* gs_pipe_cache_lookup(GsPipeCache *cache, guint64 input_hash, gsize input_len, const gchar *command);
+void gs_pipe_cache_trim(GsPipeCache *cache, gsize max_size);
+void gs_pipe_cache_insert(GsPipeCache *cache, guint64 input_hash, gsize input_len, const gchar *command, GString *output);
+
+//######################################################################################################
+// Transform engine
+
+typedef enum {
+	GS_TRANSFORM_BASE64_ENCODE,
+	GS_TRANSFORM_BASE64_DECODE,
+	GS_TRANSFORM_HEX_ENCODE,
+	GS_TRANSFORM_HEX_DECODE,
+	GS_TRANSFORM_URL_ENCODE,
+	GS_TRANSFORM_URL_DECODE,
+	GS_TRANSFORM_INFLATE,
+	GS_TRANSFORM_BASE64_INFLATE,   // Base64 decode, then inflate (compressed payloads in logs)
+	GS_TRANSFORM_JWT_DECODE,
+} GsTransformType;
+
+gboolean gs_transform(GsTransformType type, const gchar *in, gsize len, guint wrap, GString *out, gchar **error);
+
+//######################################################################################################
+// Text operators
+
+GPtrArray* gs_textops_parse(const gchar *command);
+GString* gs_textops_run(const GPtrArray *ops, const gchar *text, gsize len, gchar **error);
+
+//######################################################################################################
+// Search engine
+
+typedef struct {
+	guint        text;   // Index of the searched text
+	gsize        pos;    // Offset of the matching line
+	gchar       *line;   // Matching line, shortened to GS_SEARCH_LINE_MAX. NULL marks a finished chunk
+} GsSearchMatch;
+
+typedef struct GsSearch {
+	GPtrArray   *texts;          // Snapshots (GBytes)
+	gchar       *literal;        // Prefilter, empty: every line is a candidate
+	GRegex      *regex;          // Confirms candidates, NULL for a literal search
+	gboolean     ignore_case;
+	GArray      *chunks;         // GsSearchChunk
+	GThreadPool *pool;
+	GAsyncQueue *matches;        // GsSearchMatch
+	gint         cancelled;      // Atomic
+	gint         count;          // Atomic, matches found so far
+	guint        chunks_done;    // Finished chunks popped from matches
+	gint64       time_start;
+} GsSearch;
+
+GsSearch* gs_search_new(const gchar *pattern, gboolean regex, gboolean ignore_case, GError **error);
+guint gs_search_add_text(GsSearch *search, GBytes *text);
+void gs_search_start(GsSearch *search);
+GsSearchMatch* gs_search_next(GsSearch *search);
+gboolean gs_search_done(GsSearch *search);
+void gs_search_match_free(GsSearchMatch *match);
+void gs_search_cancel(GsSearch *search);
+void gs_search_free(GsSearch *search);
+
+//######################################################################################################
+// Path index
+
+#define GS_PATH_RESULTS_MAX 50
+
+enum {
+	GS_PATH_FAVOURITE = 1 << 0,
+	GS_PATH_RECENT    = 1 << 1,
+};
+
+typedef struct {
+	const gchar *path;       // NULL if removed
+	guint64      mask;       // gs_path_char_bit() of every character, 0 if removed
+	guint64      base_mask;  // Same for the basename
+	guint32      len;
+	guint32      base;       // Offset of the basename, the directory part has the same length
+	guint32      dir;        // Index in GsPathIndex.dirs
+	guint32      flags;      // GS_PATH_*
+} GsPathEntry;
+
+typedef struct GsPathIndex {
+	GStringChunk *strings;
+	GArray       *entries;  // GsPathEntry
+	GHashTable   *lookup;   // Path -> entry index + 1
+	GPtrArray    *dirs;     // Directory part of paths, including the trailing separator
+	GHashTable   *dir_lookup; // Directory -> dirs index + 1
+} GsPathIndex;
+
+GsPathIndex* gs_path_index_new();
+void gs_path_index_free(GsPathIndex *index);
+void gs_path_index_add(GsPathIndex *index, const gchar *path, guint flags);
+void gs_path_index_remove(GsPathIndex *index, const gchar *path);
+guint gs_path_index_query(const GsPathIndex *index, const gchar *query, const GsPathEntry **results);
+
+// Background scan: Loads the saved index first, so quick open works right away, then walks the roots
+// and saves the result. Both indexes are passed through a queue, the owner polls gs_path_scan_next()
+typedef struct {
+	GsPathIndex *index;
+	GPtrArray   *dirs;    // Directories walked (gchar*), NULL for the saved index
+} GsPathScanResult;
+
+typedef struct GsPathScan {
+	gchar      **roots;
+	guint        max_files;
+	gchar       *cache_path;
+	gboolean     load_cache;
+	GThread     *thread;
+	GAsyncQueue *results;  // GsPathScanResult*
+	gint         cancelled;
+} GsPathScan;
+
+GsPathScan* gs_path_scan_start(gchar **roots, guint max_files, const gchar *cache_path, gboolean load_cache);
+GsPathScanResult* gs_path_scan_next(GsPathScan *scan);
+void gs_path_scan_free(GsPathScan *scan);
+
+//######################################################################################################
+// Telemetry
+
+typedef struct {
+	gint64       time;      // Wall clock at the start, µs since the epoch
+	gint64       duration;  // µs
+	gsize        size;      // Document size in bytes
+	const gchar *filetype;  // Interned, "" if none
+	const gchar *file;      // Interned, "" if none
+} GsTelemetrySample;
+
+typedef struct GsTelemetry {
+	GPtrArray *rings;  // GsTelemetryRing, in order of their first sample
+} GsTelemetry;
+
+// Percentiles of an event, filetype and size_class are "*" for all samples of the event
+typedef struct {
+	const gchar *event, *filetype, *size_class;
+	guint        count;
+	gint64       p50, p90, p99, max;
+} GsTelemetrySummary;
+
+GsTelemetry* gs_telemetry_new();
+void gs_telemetry_free(GsTelemetry *telemetry);
+void gs_telemetry_add(GsTelemetry *telemetry, const gchar *event, const GsTelemetrySample *sample);
+GArray* gs_telemetry_summary(const GsTelemetry *telemetry);
+void gs_telemetry_write_csv(const GsTelemetry *telemetry, GString *out);
+void gs_telemetry_write_json(const GsTelemetry *telemetry, const GArray *summary, GString *out);
+void gs_telemetry_write_report(const GsTelemetry *telemetry, const GArray *summary, GString *out);
+
+//######################################################################################################
+// JSON structural index
+
+typedef struct {
+	gsize  pos;        // Document offset at the time of the edit
+	gssize delta;      // Inserted (> 0) or deleted (< 0) bytes
+} GsJsonEdit;
+
+typedef struct GsJsonIndex {
+	GArray  *nodes;    // GsJsonNode by start
+	GArray  *by_end;   // Node indices (guint) by end, closed containers only
+	GArray  *keys;     // GsJsonKey by start
+	GArray  *edits;    // GsJsonEdit since the scan, oldest first
+	gdouble  seconds;  // Duration of the scan
+} GsJsonIndex;
+
+typedef const gchar* (*GsJsonReadFunc)(gsize pos, gsize len, gpointer user_data);
+
+void gs_json_index_free(GsJsonIndex *index);
+void gs_json_index_add_edit(GsJsonIndex *index, gsize pos, gssize delta);
+gboolean gs_json_index_edit_is_structural(const gchar *text, gsize len);
+gboolean gs_json_index_update(GsJsonIndex *index, gsize pos, gssize delta, GsJsonReadFunc read, gpointer user_data);
+gboolean gs_json_index_match(const GsJsonIndex *index, gsize pos, gsize *match);
+gchar* gs_json_index_path(const GsJsonIndex *index, const gchar *text, gsize len, const gchar *ahead, gsize ahead_len, gsize pos);
+gboolean gs_json_index_find(const GsJsonIndex *index, const gchar *text, gsize len, const gchar *path, gsize *pos, const gchar **error);
+
+typedef struct GsJsonIndexBuild {
+	GBytes      *snapshot;
+	GsJsonIndex *index;
+	GThread     *thread;
+	gint         done, cancelled;
+} GsJsonIndexBuild;
+
+GsJsonIndexBuild* gs_json_index_build_start(GBytes *snapshot);
+gboolean gs_json_index_build_done(GsJsonIndexBuild *build);
+GsJsonIndex* gs_json_index_build_finish(GsJsonIndexBuild *build, gboolean cancel);
+
+#endif // GGUCORE_H